@@ -0,0 +1,1161 @@
+/*
+    bench.c
+
+    Micro-benchmarks for the software pipeline.  Needs no window or GL,
+    run it as
+        bench [name]
+    to time one benchmark, or with no arguments to time all of them.
+*/
+
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include "framebuffer.h"
+#include "glm.h"
+#include "mesh.h"
+#include "lod.h"
+#include "pipeline.h"
+
+#define FRAME_SIZE 512
+#define FRAMES 200
+#define SPANS 20000
+#define SPAN_LENGTH 32
+#define DATA_DIR "data/"
+#define LOADS 5
+#define LIGHTS_MODEL DATA_DIR "al.obj"
+#define LIGHT_FRAMES 10
+#define SHADOW_FRAMES 20
+#define SHADOW_BUDGET 30.0
+
+int failed = 0;     //a check found a mismatch, bench exits with 1
+
+//milliseconds on a monotonic clock
+double now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000.0 + t.tv_nsec / 1000000.0;
+}
+
+/*=======================================================================
+FRAMEBUFFER =============================================================
+=======================================================================*/
+
+//the pipeline's frame before the framebuffer module: one 32 byte
+//structure per pixel, cleared pixel by pixel every frame
+struct legacyPoint
+{
+    int populated;
+    double z;
+    float r, g, b;
+};
+struct legacyPoint legacyFrame[FRAME_SIZE * FRAME_SIZE];
+
+//the same spans every frame so both layouts do the same work
+struct benchSpan
+{
+    int index;
+    float z, zdx;
+};
+struct benchSpan spans[SPANS];
+
+void legacyFrameLoop(void)
+{
+    int i, j;
+    for(i = 0; i < FRAME_SIZE * FRAME_SIZE; i++)
+    {
+        legacyFrame[i].populated = 0;
+        legacyFrame[i].z = 0.0;
+        legacyFrame[i].r = legacyFrame[i].g = legacyFrame[i].b = 0.0f;
+    }
+    for(i = 0; i < SPANS; i++)
+    {
+        struct legacyPoint* p = &legacyFrame[spans[i].index];
+        for(j = 0; j < SPAN_LENGTH; j++)
+        {
+            double z = spans[i].z + spans[i].zdx * j;
+            if(!p[j].populated || p[j].z >= z)
+            {
+                p[j].populated = 1;
+                p[j].z = z;
+                p[j].r = p[j].g = p[j].b = 0.5f;
+            }
+        }
+    }
+}
+
+void planeFrameLoop(void)
+{
+    int i, j;
+    fbClear();
+    for(i = 0; i < SPANS; i++)
+    {
+        unsigned int* depth = &fbDepth[spans[i].index];
+        unsigned int* color = &fbColor[spans[i].index];
+        for(j = 0; j < SPAN_LENGTH; j++)
+        {
+            unsigned int key = fbFrame | FB_DEPTH(spans[i].z + spans[i].zdx * j);
+            if(depth[j] >= key)
+            {
+                depth[j] = key;
+                color[j] = FB_COLOR(128, 128, 128);
+            }
+        }
+    }
+}
+
+//times FRAMES frames of a clear plus SPANS depth tested spans
+double timeFrames(void (*frameLoop)(void))
+{
+    int f;
+    double start = now();
+    for(f = 0; f < FRAMES; f++)
+        frameLoop();
+    return (now() - start) / FRAMES;
+}
+
+void benchFramebuffer(void)
+{
+    int i;
+    double legacy, planes;
+
+    fbResize(FRAME_SIZE, FRAME_SIZE);
+    srand(1);
+    for(i = 0; i < SPANS; i++)
+    {
+        spans[i].index = (rand() % FRAME_SIZE) * FRAME_SIZE + rand() % (FRAME_SIZE - SPAN_LENGTH);
+        spans[i].z = 0.25f + 0.5f * rand() / (float)RAND_MAX;
+        spans[i].zdx = 0.001f * (rand() / (float)RAND_MAX - 0.5f);
+    }
+
+    legacy = timeFrames(legacyFrameLoop);
+    planes = timeFrames(planeFrameLoop);
+    printf("framebuffer: %d spans of %d pixels per frame\n", SPANS, SPAN_LENGTH);
+    printf("  32 byte pixels, per-pixel clear: %8.3f ms/frame\n", legacy);
+    printf("  depth + color planes, tag clear: %8.3f ms/frame (%.1fx)\n", planes, legacy / planes);
+    printf("  bytes read per depth test: %d -> %d\n", (int)sizeof(struct legacyPoint), (int)sizeof(fbDepth[0]));
+}
+
+/*=======================================================================
+OBJ LOADING =============================================================
+=======================================================================*/
+
+//nonzero if glmReadOBJ built the same model and materials as the two
+//pass reader; the two pass reader leaves index 0 of the vertex arrays,
+//findex and the indices a face doesn't give unset, and gives a usemtl
+//before the first group to the last group instead of the default one,
+//so those and the material of empty groups aren't looked at
+int sameModel(GLMmodel* a, GLMmodel* b)
+{
+    GLMgroup* ga;
+    GLMgroup* gb;
+    GLuint i, j;
+
+    if(a->numvertices != b->numvertices || a->numnormals != b->numnormals ||
+       a->numtexcoords != b->numtexcoords || a->numtriangles != b->numtriangles ||
+       a->nummaterials != b->nummaterials || a->numgroups != b->numgroups)
+        return 0;
+    if(memcmp(a->vertices + 3, b->vertices + 3, sizeof(GLfloat) * 3 * a->numvertices) ||
+       (a->numnormals && memcmp(a->normals + 3, b->normals + 3, sizeof(GLfloat) * 3 * a->numnormals)) ||
+       (a->numtexcoords && memcmp(a->texcoords + 2, b->texcoords + 2, sizeof(GLfloat) * 2 * a->numtexcoords)))
+        return 0;
+    for(i = 0; i < a->numtriangles; i++)
+    {
+        for(j = 0; j < 3; j++)
+        {
+            if(a->triangles[i].vindices[j] != b->triangles[i].vindices[j] ||
+               (b->triangles[i].nindices[j] && a->triangles[i].nindices[j] != b->triangles[i].nindices[j]) ||
+               (b->triangles[i].tindices[j] && a->triangles[i].tindices[j] != b->triangles[i].tindices[j]))
+                return 0;
+        }
+    }
+    for(i = 0; i < a->nummaterials; i++)
+    {
+        if(strcmp(a->materials[i].name, b->materials[i].name) != 0 ||
+           a->materials[i].shininess != b->materials[i].shininess ||
+           memcmp(a->materials[i].diffuse, b->materials[i].diffuse, sizeof(GLfloat) * 3) ||
+           memcmp(a->materials[i].ambient, b->materials[i].ambient, sizeof(GLfloat) * 3) ||
+           memcmp(a->materials[i].specular, b->materials[i].specular, sizeof(GLfloat) * 3))
+            return 0;
+    }
+    for(ga = a->groups, gb = b->groups; ga && gb; ga = ga->next, gb = gb->next)
+    {
+        if(strcmp(ga->name, gb->name) != 0 || (ga->numtriangles && ga->material != gb->material) ||
+           ga->numtriangles != gb->numtriangles ||
+           memcmp(ga->triangles, gb->triangles, sizeof(GLuint) * ga->numtriangles))
+            return 0;
+    }
+    return 1;
+}
+
+//milliseconds per load of a model, the best of LOADS loads; readOBJ
+//is NULL to load with glmReadOBJParallel on threads threads
+double timeLoad(GLMmodel* (*readOBJ)(char*), char* filename, int threads)
+{
+    int i;
+    double start, best = 0.0;
+    for(i = 0; i < LOADS; i++)
+    {
+        start = now();
+        glmDelete(readOBJ ? readOBJ(filename) : glmReadOBJParallel(filename, threads));
+        if(i == 0 || now() - start < best)
+            best = now() - start;
+    }
+    return best;
+}
+
+void benchOBJ(void)
+{
+    DIR* dirp;
+    struct dirent* direntp;
+    char name[1024];
+    GLMmodel* legacy;
+    GLMmodel* mapped;
+    double legacyTime, mappedTime, legacyTotal = 0.0, mappedTotal = 0.0;
+    int same;
+
+    dirp = opendir(DATA_DIR);
+    if(!dirp)
+    {
+        fprintf(stderr, "obj: can't open %s\n", DATA_DIR);
+        return;
+    }
+    printf("obj: glmReadOBJ against the two pass fscanf reader, best of %d loads\n", LOADS);
+    while((direntp = readdir(dirp)) != NULL)
+    {
+        if(!strstr(direntp->d_name, ".obj"))
+            continue;
+        sprintf(name, "%s%s", DATA_DIR, direntp->d_name);
+
+        legacy = glmReadOBJLegacy(name);
+        mapped = glmReadOBJ(name);
+        same = sameModel(legacy, mapped);
+        glmDelete(legacy);
+        glmDelete(mapped);
+
+        legacyTime = timeLoad(glmReadOBJLegacy, name, 1);
+        mappedTime = timeLoad(glmReadOBJ, name, 1);
+        legacyTotal += legacyTime;
+        mappedTotal += mappedTime;
+        printf("  %-20s %9.3f ms -> %8.3f ms (%5.1fx)%s\n", direntp->d_name,
+               legacyTime, mappedTime, legacyTime / mappedTime, same ? "" : "  DIFFERENT MODEL");
+    }
+    closedir(dirp);
+    printf("  %-20s %9.3f ms -> %8.3f ms (%5.1fx)\n", "all", legacyTotal, mappedTotal, legacyTotal / mappedTotal);
+}
+
+//the largest model in data on more and more threads
+void benchParallelOBJ(void)
+{
+    char* name = DATA_DIR "head.obj";
+    GLMmodel* serial;
+    GLMmodel* parallel;
+    double serialTime, time;
+    int threads, same;
+
+    serial = glmReadOBJ(name);
+    serialTime = timeLoad(glmReadOBJ, name, 1);
+    printf("parallelobj: glmReadOBJParallel on %s, best of %d loads\n", name, LOADS);
+    for(threads = 1; threads <= 8; threads *= 2)
+    {
+        parallel = glmReadOBJParallel(name, threads);
+        same = sameModel(serial, parallel);
+        glmDelete(parallel);
+        time = timeLoad(NULL, name, threads);
+        printf("  %d threads: %8.3f ms (%4.1fx)%s\n", threads, time, serialTime / time,
+               same ? "" : "  DIFFERENT MODEL");
+    }
+    glmDelete(serial);
+}
+
+//the largest model in data, read and prepared the way smooth does,
+//against mapping its cache file
+void benchCache(void)
+{
+    char* name = DATA_DIR "head.obj";
+    GLMmodel* fresh;
+    GLMmodel* cached;
+    GLfloat scale;
+    double start, freshTime = 0.0, cachedTime = 0.0;
+    int i, same;
+
+    for(i = 0; i < LOADS; i++)
+    {
+        start = now();
+        fresh = glmReadOBJ(name);
+        glmUnitize(fresh);
+        glmFacetNormals(fresh);
+        glmVertexNormals(fresh, 90.0);
+        glmOptimizeOrder(fresh, GLM_SMOOTH | GLM_TEXTURE, GL_FALSE);
+        if(i == 0 || now() - start < freshTime)
+            freshTime = now() - start;
+        if(i < LOADS - 1)
+            glmDelete(fresh);
+    }
+
+    //the first read writes the cache
+    glmDelete(glmReadOBJCached(name, 90.0, &scale, 1));
+    for(i = 0; i < LOADS; i++)
+    {
+        start = now();
+        cached = glmReadOBJCached(name, 90.0, &scale, 1);
+        if(i == 0 || now() - start < cachedTime)
+            cachedTime = now() - start;
+        if(i < LOADS - 1)
+            glmDelete(cached);
+    }
+    same = sameModel(fresh, cached) && cached->cache &&
+        !memcmp(fresh->facetnorms + 3, cached->facetnorms + 3, sizeof(GLfloat) * 3 * fresh->numfacetnorms);
+    printf("cache: %s read and prepared, best of %d loads\n", name, LOADS);
+    printf("  glmReadOBJ + unitize + normals + order: %8.3f ms\n", freshTime);
+    printf("  glmReadOBJCached from cache:            %8.3f ms (%.1fx)%s\n", cachedTime, freshTime / cachedTime,
+           same ? "" : "  DIFFERENT MODEL");
+    glmDelete(fresh);
+    glmDelete(cached);
+}
+
+/*=======================================================================
+WELDING =================================================================
+=======================================================================*/
+
+#define WELD_THREADS 4
+
+//milliseconds to weld a copy of a model's vertices, the best of LOADS
+//welds; legacy to weld with the original loop; the welded copy is left
+//in result (remapped vertices first, then the copies) for comparing
+double timeWeld(GLMmodel* model, GLfloat epsilon, int legacy, int threads, GLfloat** result)
+{
+    GLuint n = model->numvertices, kept;
+    GLfloat* vectors = (GLfloat*)malloc(sizeof(GLfloat) * 3 * (n + 1));
+    GLfloat* copies;
+    double start, best = 0.0;
+    int i;
+
+    for(i = 0; i < LOADS; i++)
+    {
+        memcpy(vectors, model->vertices, sizeof(GLfloat) * 3 * (n + 1));
+        kept = n;
+        start = now();
+        copies = legacy ? glmWeldVectorsLegacy(vectors, &kept, epsilon)
+                        : glmWeldVectors(vectors, &kept, epsilon, threads);
+        if(i == 0 || now() - start < best)
+            best = now() - start;
+        if(i < LOADS - 1)
+            free(copies);
+    }
+    *result = (GLfloat*)malloc(sizeof(GLfloat) * (3 * (n + 1) + 3 * kept + 1));
+    memcpy(*result, vectors, sizeof(GLfloat) * 3 * (n + 1));
+    (*result)[3 * (n + 1)] = (GLfloat)kept;
+    memcpy(*result + 3 * (n + 1) + 1, copies + 3, sizeof(GLfloat) * 3 * kept);
+    free(copies);
+    free(vectors);
+    return best;
+}
+
+//welds the two largest models in data at the viewer's first weld
+//distances, with the original loop and with the hash grid
+void benchWeld(void)
+{
+    char* names[] = { DATA_DIR "head.obj", DATA_DIR "world_curved.obj" };
+    GLfloat epsilons[] = { 0.00001f, 0.01f, 0.05f };
+    GLMmodel* model;
+    GLfloat* legacy;
+    GLfloat* grid;
+    GLfloat* parallel;
+    double legacyTime, gridTime, parallelTime;
+    size_t size;
+    GLuint kept;        //where the number of vertices kept is
+    int m, e, same;
+
+    printf("weld: glmWeldVectors against the original loop, best of %d welds\n", LOADS);
+    for(m = 0; m < 2; m++)
+    {
+        model = glmReadOBJ(names[m]);
+        glmUnitize(model);
+        for(e = 0; e < 3; e++)
+        {
+            legacyTime = timeWeld(model, epsilons[e], 1, 1, &legacy);
+            gridTime = timeWeld(model, epsilons[e], 0, 1, &grid);
+            parallelTime = timeWeld(model, epsilons[e], 0, WELD_THREADS, &parallel);
+            kept = 3 * (model->numvertices + 1);
+            size = sizeof(GLfloat) * (kept + 3 * (GLuint)legacy[kept] + 1);
+            same = legacy[kept] == grid[kept] && legacy[kept] == parallel[kept] &&
+                !memcmp(legacy, grid, size) && !memcmp(legacy, parallel, size);
+            printf("  %-24s %8.5f: %5d -> %5d vertices %9.3f ms -> %7.3f ms (%5.1fx), %d threads %7.3f ms%s\n",
+                   names[m], epsilons[e], model->numvertices, (int)legacy[kept],
+                   legacyTime, gridTime, legacyTime / gridTime, WELD_THREADS, parallelTime,
+                   same ? "" : "  DIFFERENT WELD");
+            free(legacy);
+            free(grid);
+            free(parallel);
+        }
+        glmDelete(model);
+    }
+}
+
+/*=======================================================================
+NORMALS =================================================================
+=======================================================================*/
+
+#define NORMALS_THREADS 4
+
+//milliseconds to generate the vertex normals of a model, the best of
+//LOADS runs; legacy to use the original lists
+double timeNormals(GLMmodel* model, GLfloat angle, int legacy, int threads)
+{
+    double start, best = 0.0;
+    int i;
+    for(i = 0; i < LOADS; i++)
+    {
+        start = now();
+        if(legacy)
+            glmVertexNormalsLegacy(model, angle);
+        else
+            glmVertexNormalsParallel(model, angle, threads);
+        if(i == 0 || now() - start < best)
+            best = now() - start;
+    }
+    return best;
+}
+
+//nonzero if two models have the same normals and normal indices
+int sameNormals(GLMmodel* a, GLMmodel* b)
+{
+    GLuint i;
+    if(a->numnormals != b->numnormals ||
+       memcmp(a->normals + 3, b->normals + 3, sizeof(GLfloat) * 3 * a->numnormals))
+        return 0;
+    for(i = 0; i < a->numtriangles; i++)
+    {
+        if(memcmp(a->triangles[i].nindices, b->triangles[i].nindices, sizeof(a->triangles[i].nindices)))
+            return 0;
+    }
+    return 1;
+}
+
+//the smoothing the viewer redoes on every '+' and '-', with the
+//original lists of nodes and with the table of triangles by vertex
+void benchNormals(void)
+{
+    char* names[] = { DATA_DIR "head.obj", DATA_DIR "world_curved.obj" };
+    GLfloat angles[] = { 90.0f, 30.0f };
+    GLMmodel* legacy;
+    GLMmodel* table;
+    double legacyTime, tableTime, parallelTime;
+    long legacyBytes, tableBytes;
+    int m, a, same;
+
+    printf("normals: glmVertexNormals against the original lists, best of %d runs\n", LOADS);
+    for(m = 0; m < 2; m++)
+    {
+        legacy = glmReadOBJ(names[m]);
+        table = glmReadOBJ(names[m]);
+        glmFacetNormals(legacy);
+        glmFacetNormals(table);
+        for(a = 0; a < 2; a++)
+        {
+            legacyTime = timeNormals(legacy, angles[a], 1, 1);
+            tableTime = timeNormals(table, angles[a], 0, 1);
+            same = sameNormals(legacy, table);
+            parallelTime = timeNormals(table, angles[a], 0, NORMALS_THREADS);
+            same = same && sameNormals(legacy, table);
+
+            //working memory besides the normals: a node per corner and
+            //room for a normal per corner, against the table
+            legacyBytes = 3L * legacy->numtriangles * (sizeof(GLfloat) * 3 + 2 * sizeof(void*)) +
+                legacy->numvertices * sizeof(void*);
+            tableBytes = 3L * table->numtriangles * sizeof(GLuint) + 2L * table->numvertices * sizeof(GLuint);
+            printf("  %-24s %5.1f degrees: %8.3f ms -> %7.3f ms (%5.1fx), %d threads %7.3f ms, %ld KB -> %ld KB%s\n",
+                   names[m], angles[a], legacyTime, tableTime, legacyTime / tableTime,
+                   NORMALS_THREADS, parallelTime, legacyBytes / 1024, tableBytes / 1024,
+                   same ? "" : "  DIFFERENT NORMALS");
+        }
+        glmDelete(legacy);
+        glmDelete(table);
+    }
+}
+
+/*=======================================================================
+ANGLE ===================================================================
+=======================================================================*/
+
+#define ANGLE_STEPS 60
+
+//holding '-' and then '+' in the viewer: the angle goes from 90 down
+//to 60 and back up to 120 a degree at a time, with every vertex
+//smoothed again each step and with only the ones the step changes
+void benchAngle(void)
+{
+    char* names[] = { DATA_DIR "head.obj", DATA_DIR "world_curved.obj" };
+    GLMmodel* scratch;
+    GLMmodel* angle;
+    double start, scratchTime, angleTime, firstTime;
+    long redone;
+    GLfloat degrees;
+    int m, s, same;
+
+    printf("angle: %d one degree steps, glmVertexNormalsParallel against glmVertexNormalsAngle\n",
+           2 * ANGLE_STEPS);
+    for(m = 0; m < 2; m++)
+    {
+        scratch = glmReadOBJ(names[m]);
+        angle = glmReadOBJ(names[m]);
+        glmFacetNormals(scratch);
+        glmFacetNormals(angle);
+
+        //the first call builds the tables
+        start = now();
+        glmVertexNormalsAngle(angle, 90.0f, NORMALS_THREADS);
+        firstTime = now() - start;
+
+        scratchTime = angleTime = 0.0;
+        redone = 0;
+        same = 1;
+        degrees = 90.0f;
+        for(s = 0; s < 2 * ANGLE_STEPS; s++)
+        {
+            degrees += s < ANGLE_STEPS / 2 || s >= 3 * ANGLE_STEPS / 2 ? -1.0f : 1.0f;
+            start = now();
+            glmVertexNormalsParallel(scratch, degrees, NORMALS_THREADS);
+            scratchTime += now() - start;
+            start = now();
+            redone += glmVertexNormalsAngle(angle, degrees, NORMALS_THREADS);
+            angleTime += now() - start;
+            same = same && sameNormals(scratch, angle);
+        }
+        printf("  %-24s %8.3f ms -> %7.3f ms a step (%5.1fx), first %7.3f ms, %ld of %d vertices a step%s\n",
+               names[m], scratchTime / (2 * ANGLE_STEPS), angleTime / (2 * ANGLE_STEPS),
+               scratchTime / angleTime, firstTime, redone / (2 * ANGLE_STEPS), angle->numvertices,
+               same ? "" : "  DIFFERENT NORMALS");
+        glmDelete(scratch);
+        glmDelete(angle);
+    }
+}
+
+/*=======================================================================
+MESH ====================================================================
+=======================================================================*/
+
+//nonzero if every corner of a mesh has the position and normal of the
+//model triangle corner it came from (the first corner of its vertex, in
+//a degenerate triangle)
+int sameMesh(GLMmodel* model, struct mesh* mesh)
+{
+    GLMgroup* group;
+    GLMtriangle* triangle;
+    struct meshVertex* vertex;
+    GLuint g, i, j, k, n;
+    for(group = model->groups, g = 0; group; group = group->next, g++)
+    {
+        for(i = 0; i < group->numtriangles; i++)
+        {
+            triangle = &model->triangles[group->triangles[i]];
+            for(j = 0; j < 3; j++)
+            {
+                for(k = 0; triangle->vindices[k] != triangle->vindices[j]; k++)
+                    ;
+                n = triangle->nindices[k];
+                vertex = &mesh->vertices[meshIndex(&mesh->groups[g], 3 * i + j)];
+                if(memcmp(vertex->position, &model->vertices[3 * triangle->vindices[j]], sizeof(vertex->position)) ||
+                   memcmp(vertex->normal, &model->normals[3 * n], sizeof(vertex->normal)))
+                    return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+//compiles every model in data into the indexed mesh the pipeline draws
+//and tells how many corners share a vertex and the memory it saves
+void benchMesh(void)
+{
+    DIR* dirp;
+    struct dirent* direntp;
+    char name[1024];
+    GLMmodel* model;
+    struct mesh* mesh;
+    double start, best;
+    GLuint g, short16;
+    int i;
+
+    dirp = opendir(DATA_DIR);
+    if(!dirp)
+    {
+        fprintf(stderr, "mesh: can't open %s\n", DATA_DIR);
+        return;
+    }
+    printf("mesh: meshCompile with vertex normals, best of %d runs\n", LOADS);
+    while((direntp = readdir(dirp)) != NULL)
+    {
+        if(!strstr(direntp->d_name, ".obj"))
+            continue;
+        sprintf(name, "%s%s", DATA_DIR, direntp->d_name);
+        model = glmReadOBJ(name);
+        glmFacetNormals(model);
+        glmVertexNormals(model, 90.0);
+
+        mesh = NULL;
+        best = 0.0;
+        for(i = 0; i < LOADS; i++)
+        {
+            meshDelete(mesh);
+            start = now();
+            mesh = meshCompile(model, GLM_SMOOTH);
+            if(i == 0 || now() - start < best)
+                best = now() - start;
+        }
+        short16 = 0;
+        for(g = 0; g < mesh->numgroups; g++)
+            short16 += mesh->groups[g].indexsize == 2;
+        printf("  %-20s %7d corners -> %6d vertices (%4.2f each), %5ld KB -> %5ld KB, "
+               "16 bit indices in %d of %d groups, %7.3f ms%s\n",
+               direntp->d_name, mesh->numcorners, mesh->numvertices,
+               (double)mesh->numcorners / mesh->numvertices,
+               meshModelBytes(mesh) / 1024, meshBytes(mesh) / 1024, short16, mesh->numgroups,
+               best, sameMesh(model, mesh) ? "" : "  DIFFERENT MESH");
+        meshDelete(mesh);
+        glmDelete(model);
+    }
+    closedir(dirp);
+}
+
+/*=======================================================================
+ORDER ===================================================================
+=======================================================================*/
+
+//reads and prepares a model the way smooth does, then times
+//glmOptimizeOrder on it; the model is left in *model
+double timeOrder(char* name, GLboolean overdraw, GLMmodel** model)
+{
+    double start;
+    *model = glmReadOBJ(name);
+    glmFacetNormals(*model);
+    glmVertexNormals(*model, 90.0);
+    start = now();
+    glmOptimizeOrder(*model, GLM_SMOOTH, overdraw);
+    return now() - start;
+}
+
+//reorders every model in data for the vertex cache, and for the vertex
+//cache and overdraw, and tells the average cache miss ratio (vertices
+//transformed per triangle) of each order
+void benchOrder(void)
+{
+    DIR* dirp;
+    struct dirent* direntp;
+    char name[1024];
+    GLMmodel* model;
+    GLMmodel* cache;
+    GLMmodel* overdraw;
+    struct mesh* mesh;
+    double cacheTime, overdrawTime;
+    GLuint numvertices;
+    int same;
+
+    dirp = opendir(DATA_DIR);
+    if(!dirp)
+    {
+        fprintf(stderr, "order: can't open %s\n", DATA_DIR);
+        return;
+    }
+    printf("order: ACMR of a 32 vertex FIFO cache as read / after glmOptimizeOrder / with overdraw\n");
+    while((direntp = readdir(dirp)) != NULL)
+    {
+        if(!strstr(direntp->d_name, ".obj"))
+            continue;
+        sprintf(name, "%s%s", DATA_DIR, direntp->d_name);
+        model = glmReadOBJ(name);
+        glmFacetNormals(model);
+        glmVertexNormals(model, 90.0);
+        cacheTime = timeOrder(name, GL_FALSE, &cache);
+        overdrawTime = timeOrder(name, GL_TRUE, &overdraw);
+
+        //the same corners, only in another order
+        mesh = meshCompile(model, GLM_SMOOTH);
+        numvertices = mesh->numvertices;
+        meshDelete(mesh);
+        mesh = meshCompile(cache, GLM_SMOOTH);
+        same = mesh->numvertices == numvertices && cache->numtriangles == model->numtriangles;
+        meshDelete(mesh);
+
+        printf("  %-20s %7d triangles  %5.3f / %5.3f %7.3f ms / %5.3f %7.3f ms%s\n",
+               direntp->d_name, model->numtriangles, glmCacheMissRatio(model, GLM_SMOOTH),
+               glmCacheMissRatio(cache, GLM_SMOOTH), cacheTime,
+               glmCacheMissRatio(overdraw, GLM_SMOOTH), overdrawTime,
+               same ? "" : "  DIFFERENT MESH");
+        glmDelete(model);
+        glmDelete(cache);
+        glmDelete(overdraw);
+    }
+    closedir(dirp);
+}
+
+/*=======================================================================
+PACKED ==================================================================
+=======================================================================*/
+
+//sum of what timeDecode read, so the reads are not optimized away
+double decodeSum = 0.0;
+
+//milliseconds to read every position and normal of a mesh, decoding
+//them if it is packed, the best of LOADS passes
+double timeDecode(struct mesh* mesh)
+{
+    GLfloat decoded[3];
+    GLfloat* v;
+    double start, best = 0.0;
+    GLuint i;
+    int pass;
+    for(pass = 0; pass < LOADS; pass++)
+    {
+        start = now();
+        for(i = 0; i < mesh->numvertices; i++)
+        {
+            v = meshPosition(mesh, i, decoded);
+            decodeSum += v[0] + v[1] + v[2];
+            v = meshNormal(mesh, i, decoded);
+            decodeSum += v[0] + v[1] + v[2];
+        }
+        if(pass == 0 || now() - start < best)
+            best = now() - start;
+    }
+    return best;
+}
+
+//compiles every model in data with float and with quantized vertices
+//(MESH_PACKED) and tells the memory, the largest error and the time to
+//read the vertices back
+void benchPacked(void)
+{
+    DIR* dirp;
+    struct dirent* direntp;
+    char name[1024];
+    GLMmodel* model;
+    struct mesh* floats;
+    struct mesh* packed;
+
+    dirp = opendir(DATA_DIR);
+    if(!dirp)
+    {
+        fprintf(stderr, "packed: can't open %s\n", DATA_DIR);
+        return;
+    }
+    printf("packed: unitized meshes with float / packed vertices, best of %d reads\n", LOADS);
+    while((direntp = readdir(dirp)) != NULL)
+    {
+        if(!strstr(direntp->d_name, ".obj"))
+            continue;
+        sprintf(name, "%s%s", DATA_DIR, direntp->d_name);
+        model = glmReadOBJ(name);
+        glmUnitize(model);
+        glmFacetNormals(model);
+        glmVertexNormals(model, 90.0);
+        floats = meshCompile(model, GLM_SMOOTH);
+        packed = meshCompile(model, GLM_SMOOTH | MESH_PACKED);
+
+        printf("  %-20s %6d vertices  %5ld KB / %5ld KB  error %.6f, %.3f degrees  read %6.3f / %6.3f ms\n",
+               direntp->d_name, floats->numvertices, meshBytes(floats) / 1024, meshBytes(packed) / 1024,
+               packed->positionerror, packed->normalerror, timeDecode(floats), timeDecode(packed));
+        meshDelete(floats);
+        meshDelete(packed);
+        glmDelete(model);
+    }
+    closedir(dirp);
+}
+
+/*=======================================================================
+LEVELS OF DETAIL ========================================================
+=======================================================================*/
+
+//triangles of the level lodPick() picks with the model's center a
+//distance in front of smooth's 512 x 512, 60 degree camera
+GLuint pickedTriangles(struct lod* lod, double distance)
+{
+    double f = 1.0 / tan(30.0 * 3.14159265358979323846 / 180.0);
+    double modelview[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, -distance, 1 };
+    double projection[16] = { f, 0, 0, 0, 0, f, 0, 0, 0, 0, -129.0 / 127.0, -1, 0, 0, -256.0 / 127.0, 0 };
+    int viewport[4] = { 0, 0, FRAME_SIZE, FRAME_SIZE };
+
+    return lod->models[lodPick(lod, modelview, projection, viewport, LOD_PIXEL_ERROR)]->numtriangles;
+}
+
+//simplifies every model into levels of detail, and prints the triangles
+//and error of each level and the triangles drawn further and further off
+void benchLOD(void)
+{
+    DIR* dirp;
+    struct dirent* direntp;
+    char name[1024];
+    GLMmodel* model;
+    struct lod* lod;
+    double start, build;
+    GLuint i;
+
+    dirp = opendir(DATA_DIR);
+    if(!dirp)
+    {
+        fprintf(stderr, "lod: can't open %s\n", DATA_DIR);
+        return;
+    }
+    printf("lod: unitized models, triangles drawn at distance 3 / 6 / 12 / 24, triangles/error of each level\n");
+    while((direntp = readdir(dirp)) != NULL)
+    {
+        if(!strstr(direntp->d_name, ".obj"))
+            continue;
+        sprintf(name, "%s%s", DATA_DIR, direntp->d_name);
+        model = glmReadOBJ(name);
+        glmUnitize(model);
+        glmFacetNormals(model);
+        glmVertexNormals(model, 90.0);
+        start = now();
+        lod = lodBuild(model, 90.0, GLM_SMOOTH);
+        build = now() - start;
+
+        printf("  %-20s build %8.3f ms  drawn %6u / %6u / %6u / %6u  levels",
+               direntp->d_name, build, pickedTriangles(lod, 3.0), pickedTriangles(lod, 6.0),
+               pickedTriangles(lod, 12.0), pickedTriangles(lod, 24.0));
+        for(i = 0; i < lod->numlevels; i++)
+            printf(" %u/%.4f", lod->models[i]->numtriangles, lod->errors[i]);
+        printf("\n");
+        lodDelete(lod);
+        glmDelete(model);
+    }
+    closedir(dirp);
+}
+
+/*=======================================================================
+KERNELS =================================================================
+=======================================================================*/
+
+#define KERNEL_CONFIGS 4
+
+char* configNames[KERNEL_CONFIGS] = { "plain", "hiz", "texture", "shadows" };
+char* modeNames[] = { "flat", "smooth", "deferred" };
+unsigned int reference[FRAME_SIZE * FRAME_SIZE];
+
+//renders a mesh turned 30 degrees and tilted 20 into pixels, with
+//smooth's 512 x 512, 60 degree camera
+void renderTurned(struct mesh* mesh, int mode)
+{
+    double f = 1.0 / tan(30.0 * 3.14159265358979323846 / 180.0);
+    double a = 30.0 * 3.14159265358979323846 / 180.0, e = 20.0 * 3.14159265358979323846 / 180.0;
+    double modelview[16] = {
+        cos(a), sin(e) * sin(a), -cos(e) * sin(a), 0,
+        0, cos(e), sin(e), 0,
+        sin(a), -sin(e) * cos(a), cos(e) * cos(a), 0,
+        0, 0, -3.0, 1,
+    };
+    double projection[16] = { f, 0, 0, 0, 0, f, 0, 0, 0, 0, -129.0 / 127.0, -1, 0, 0, -256.0 / 127.0, 0 };
+    int viewport[4] = { 0, 0, FRAME_SIZE, FRAME_SIZE };
+
+    pipelineRender(mesh, mode, 1, modelview, projection, viewport);
+}
+
+//renders every model in data in flat, Gouraud and deferred mode with
+//the scalar kernel and then with each SIMD kernel the processor runs,
+//plain and with the hierarchical z, texture and shadow map kernels,
+//and prints the pixels that differ
+void benchKernels(void)
+{
+    DIR* dirp;
+    struct dirent* direntp;
+    char name[1024];
+    GLMmodel* model;
+    struct mesh* plain;
+    struct mesh* textured;
+    struct texture* texture;
+    GLubyte* image;
+    int width, height, config, mode, kernel, i, differing, failures = 0;
+
+    image = textureReadImage(DATA_DIR "paisley.rgb", &width, &height);
+    if(!image)
+        return;
+    texture = textureCreate(image, width, height);
+    free(image);
+    dirp = opendir(DATA_DIR);
+    if(!dirp)
+    {
+        fprintf(stderr, "kernels: can't open %s\n", DATA_DIR);
+        return;
+    }
+    numThreads = 1;
+    bestKernel = detectKernel();
+    pipelineResize(FRAME_SIZE, FRAME_SIZE);
+    printf("kernels: every model in flat / smooth / deferred mode, pixels differing from the scalar kernel, %s and below\n",
+           kernelNames[bestKernel]);
+    printf("  shadow lookup rows:");
+    for(kernel = KERNEL_SCALAR; kernel <= bestKernel; kernel++)
+        printf(" %s kernel %s%s", kernelNames[kernel], visibilityNames[kernel], kernel < bestKernel ? "," : "\n");
+    while((direntp = readdir(dirp)) != NULL)
+    {
+        if(!strstr(direntp->d_name, ".obj"))
+            continue;
+        sprintf(name, "%s%s", DATA_DIR, direntp->d_name);
+        model = glmReadOBJ(name);
+        glmUnitize(model);
+        glmFacetNormals(model);
+        glmVertexNormals(model, 90.0);
+        plain = meshCompile(model, GLM_SMOOTH);
+        if(!model->numtexcoords)
+            glmSpheremapTexture(model);
+        textured = meshCompile(model, GLM_SMOOTH | GLM_TEXTURE);
+
+        for(config = 0; config < KERNEL_CONFIGS; config++)
+        {
+            hizEnabled = config == 1;
+            pipelineTexture = config == 2 ? texture : NULL;
+            shadowsEnabled = config == 3;
+            printf("  %-20s %-8s", direntp->d_name, configNames[config]);
+            for(mode = PIPELINE_FLAT; mode <= PIPELINE_DEFERRED; mode++)
+            {
+                rasterKernel = KERNEL_SCALAR;
+                renderTurned(config == 2 ? textured : plain, mode);
+                memcpy(reference, pixels, sizeof(reference));
+                printf("  %s", modeNames[mode]);
+                for(kernel = KERNEL_SCALAR + 1; kernel <= bestKernel; kernel++)
+                {
+                    rasterKernel = kernel;
+                    renderTurned(config == 2 ? textured : plain, mode);
+                    differing = 0;
+                    for(i = 0; i < FRAME_SIZE * FRAME_SIZE; i++)
+                    {
+                        if(reference[i] != pixels[i])
+                            differing++;
+                    }
+                    printf(" %d", differing);
+                    if(differing)
+                        failures++;
+                }
+            }
+            printf("\n");
+        }
+        meshDelete(plain);
+        meshDelete(textured);
+        glmDelete(model);
+    }
+    closedir(dirp);
+    hizEnabled = shadowsEnabled = 0;
+    pipelineTexture = NULL;
+    textureDelete(texture);
+    printf("kernels: %s\n", failures ? "FAILED" : "all kernels match");
+    if(failures)
+        failed = 1;
+}
+
+/*=======================================================================
+SHADOWS =================================================================
+=======================================================================*/
+
+//fastest of SHADOW_FRAMES Gouraud frames of a mesh turned like
+//renderTurned(): without shadows, keeping the shadow map and drawing it
+//every frame, in turns so all three see the machine alike
+void timeShadows(struct mesh* mesh, double* best)
+{
+    double start;
+    int i, k;
+
+    best[0] = best[1] = best[2] = 1e30;
+    for(i = 0; i < SHADOW_FRAMES; i++)
+    {
+        for(k = 0; k < 3; k++)
+        {
+            shadowsEnabled = k > 0;
+            keepShadowMap = k < 2;
+            start = now();
+            renderTurned(mesh, PIPELINE_SMOOTH);
+            start = now() - start;
+            best[k] = start < best[k] ? start : best[k];
+        }
+    }
+    shadowsEnabled = 0;
+    keepShadowMap = 1;
+}
+
+//the share of a shadowed frame's time the shadows take, in percent
+double shadowShare(double plain, double shadowed)
+{
+    return shadowed > 0.0 ? 100.0 * (shadowed - plain) / shadowed : 0.0;
+}
+
+//times every model in data without shadows, with the shadow map kept
+//from the frame before and with it drawn every frame, and prints the
+//share of the frame time the shadows take against SHADOW_BUDGET
+void benchShadows(void)
+{
+    DIR* dirp;
+    struct dirent* direntp;
+    char name[1024];
+    GLMmodel* model;
+    struct mesh* mesh;
+    double ms[3];
+    int models = 0, over = 0, overDrawn = 0;
+
+    dirp = opendir(DATA_DIR);
+    if(!dirp)
+    {
+        fprintf(stderr, "shadows: can't open %s\n", DATA_DIR);
+        return;
+    }
+    numThreads = 1;
+    rasterKernel = bestKernel = detectKernel();
+    pipelineResize(FRAME_SIZE, FRAME_SIZE);
+    printf("shadows: every model in data, smooth, %d x %d, 1 thread, %s kernel, fastest of %d frames,\n"
+           "  share of the shadowed frame the shadows take, * over %.0f%%\n",
+           FRAME_SIZE, FRAME_SIZE, kernelNames[rasterKernel], SHADOW_FRAMES, SHADOW_BUDGET);
+    printf("  %-20s %8s %18s %25s\n", "", "plain", "map kept", "map drawn every frame");
+    while((direntp = readdir(dirp)) != NULL)
+    {
+        if(!strstr(direntp->d_name, ".obj"))
+            continue;
+        sprintf(name, "%s%s", DATA_DIR, direntp->d_name);
+        model = glmReadOBJ(name);
+        glmUnitize(model);
+        glmFacetNormals(model);
+        glmVertexNormals(model, 90.0);
+        mesh = meshCompile(model, GLM_SMOOTH);
+
+        timeShadows(mesh, ms);
+        printf("  %-20s %8.3f ms %8.3f ms %5.1f%%%c %8.3f ms %5.1f%%%c\n", direntp->d_name, ms[0],
+               ms[1], shadowShare(ms[0], ms[1]), shadowShare(ms[0], ms[1]) > SHADOW_BUDGET ? '*' : ' ',
+               ms[2], shadowShare(ms[0], ms[2]), shadowShare(ms[0], ms[2]) > SHADOW_BUDGET ? '*' : ' ');
+        models++;
+        over += shadowShare(ms[0], ms[1]) > SHADOW_BUDGET;
+        overDrawn += shadowShare(ms[0], ms[2]) > SHADOW_BUDGET;
+        meshDelete(mesh);
+        glmDelete(model);
+    }
+    closedir(dirp);
+    printf("shadows: %d of %d models over %.0f%% with the map kept, %d drawing it every frame\n",
+           over, models, SHADOW_BUDGET, overDrawn);
+}
+
+/*=======================================================================
+POINT LIGHTS ============================================================
+=======================================================================*/
+
+//fastest of LIGHT_FRAMES deferred frames of a mesh with count point
+//lights of a radius, in smooth's 512 x 512, 60 degree camera
+double timeLights(struct mesh* mesh, int count, double radius)
+{
+    double f = 1.0 / tan(30.0 * 3.14159265358979323846 / 180.0);
+    double modelview[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, -3.0, 1 };
+    double projection[16] = { f, 0, 0, 0, 0, f, 0, 0, 0, 0, -129.0 / 127.0, -1, 0, 0, -256.0 / 127.0, 0 };
+    int viewport[4] = { 0, 0, FRAME_SIZE, FRAME_SIZE };
+    double start, best = 1e30;
+    int i;
+
+    pipelineLights = (struct pipelineLight*)malloc(sizeof(struct pipelineLight) * (count ? count : 1));
+    scatterLights(pipelineLights, count, radius, 1);
+    numLights = count;
+    for(i = 0; i < LIGHT_FRAMES; i++)
+    {
+        start = now();
+        pipelineRender(mesh, PIPELINE_DEFERRED, 1, modelview, projection, viewport);
+        start = now() - start;
+        best = start < best ? start : best;
+    }
+    free(pipelineLights);
+    pipelineLights = NULL;
+    numLights = 0;
+    return best;
+}
+
+//one row of benchLights()
+void printLights(struct mesh* mesh, int count, double radius)
+{
+    double ms = timeLights(mesh, count, radius);
+    printf("  %6d lights  radius %6.3f  %5d in view  %6.2f a tile  %5.2f a pixel  %8.3f ms\n", count, radius,
+           frameStats.lights, frameStats.lightTiles ? (double)frameStats.tileLights / frameStats.lightTiles : 0.0,
+           frameStats.lightPixels ? (double)frameStats.pixelLights / frameStats.lightPixels : 0.0, ms);
+}
+
+//deferred frames of a model lit by 1, 256 and 4096 point lights. With
+//the lights shrinking so about as many reach every point, the lights a
+//tile keeps grow far slower than the lights, and the frame time with
+//them; with every light as large as 256 lights, both grow with the
+//lights. A tile still keeps more lights than reach any of its pixels
+//once the lights are smaller than it, which the last columns show
+void benchLights(void)
+{
+    GLMmodel* model;
+    struct mesh* mesh;
+    int counts[] = { 1, 256, 4096 };
+    int i;
+
+    model = glmReadOBJ(LIGHTS_MODEL);
+    if(!model)
+        return;
+    glmUnitize(model);
+    glmFacetNormals(model);
+    glmVertexNormals(model, 90.0);
+    mesh = meshCompile(model, GLM_SMOOTH);
+    numThreads = 1;
+    rasterKernel = bestKernel = detectKernel();
+    pipelineResize(FRAME_SIZE, FRAME_SIZE);
+
+    printf("lights: %s, deferred, %d x %d, 1 thread, %dx%d pixel tiles, fastest of %d frames\n",
+           LIGHTS_MODEL, FRAME_SIZE, FRAME_SIZE, LIGHT_TILE, LIGHT_TILE, LIGHT_FRAMES);
+    printf("  %6d lights %66.3f ms\n", 0, timeLights(mesh, 0, 0.0));
+    printf(" about %d reaching every point:\n", LIGHTS_REACHING);
+    for(i = 0; i < 3; i++)
+        printLights(mesh, counts[i], reachingRadius(counts[i]));
+    printf(" (a tile lists every light whose sphere meets its pixels' two depth ranges,\n"
+           "  so small lights it lists miss most of its pixels and the list grows as they shrink)\n");
+    printf(" all as large as 256 lights:\n");
+    for(i = 0; i < 3; i++)
+        printLights(mesh, counts[i], reachingRadius(256));
+    meshDelete(mesh);
+    glmDelete(model);
+}
+
+/*=======================================================================
+MAIN ====================================================================
+=======================================================================*/
+
+struct benchmark
+{
+    char* name;
+    void (*run)(void);
+};
+struct benchmark benchmarks[] = {
+    { "framebuffer", benchFramebuffer },
+    { "obj", benchOBJ },
+    { "parallelobj", benchParallelOBJ },
+    { "cache", benchCache },
+    { "weld", benchWeld },
+    { "normals", benchNormals },
+    { "angle", benchAngle },
+    { "mesh", benchMesh },
+    { "order", benchOrder },
+    { "packed", benchPacked },
+    { "lod", benchLOD },
+    { "kernels", benchKernels },
+    { "shadows", benchShadows },
+    { "lights", benchLights },
+};
+#define NUM_BENCHMARKS (int)(sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+int main(int argc, char** argv)
+{
+    int i, ran = 0;
+    for(i = 0; i < NUM_BENCHMARKS; i++)
+    {
+        if(argc > 1 && strcmp(argv[1], benchmarks[i].name) != 0)
+            continue;
+        benchmarks[i].run();
+        ran++;
+    }
+    if(!ran)
+    {
+        fprintf(stderr, "usage: %s [", argv[0]);
+        for(i = 0; i < NUM_BENCHMARKS; i++)
+            fprintf(stderr, "%s%s", i ? " | " : "", benchmarks[i].name);
+        fprintf(stderr, "]\n");
+        return 1;
+    }
+    return failed;
+}
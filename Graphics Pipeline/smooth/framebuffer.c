@@ -0,0 +1,84 @@
+/*
+ *  framebuffer.c
+ *
+ *  Depth and color planes for the software pipeline.  See
+ *  framebuffer.h for the layout of a pixel.
+ */
+
+
+#include <stdlib.h>
+#include "framebuffer.h"
+
+
+int fbWidth = 0;
+int fbHeight = 0;
+unsigned int* fbDepth = NULL;
+unsigned int* fbColor = NULL;
+unsigned int fbFrame;
+
+/* tag of the current frame, counting down; 0 means the depth plane
+   has to be cleared for real before the next frame */
+static unsigned int fb_tag = 0;
+
+
+/* fbResize: sets the size of the frame, the contents of the planes
+ * are lost.
+ *
+ * width  - pixels per row
+ * height - rows
+ */
+void
+fbResize(int width, int height)
+{
+    if (width == fbWidth && height == fbHeight)
+        return;
+
+    fbWidth = width;
+    fbHeight = height;
+    fbDepth = (unsigned int*)realloc(fbDepth, sizeof(unsigned int) * width * height);
+    fbColor = (unsigned int*)realloc(fbColor, sizeof(unsigned int) * width * height);
+
+    /* the next fbClear() has to clear the new depth plane */
+    fb_tag = 0;
+}
+
+/* fbClear: starts a new frame, clearing the depth of every pixel
+ * to the far plane and its color to the background.
+ */
+void
+fbClear(void)
+{
+    int i;
+
+    if (fb_tag == 0) {
+        for (i = 0; i < fbWidth * fbHeight; i++)
+            fbDepth[i] = FB_CLEARED;
+        fb_tag = FB_CLEARED >> 24;
+    }
+
+    fb_tag--;
+    fbFrame = fb_tag << 24;
+}
+
+/* fbResolve: copies the pixels inside x0..x1, y0..y1 (inclusive)
+ * into an image of fbWidth x fbHeight packed colors, using the
+ * background color for pixels nothing was drawn on this frame.
+ *
+ * image      - packed colors, laid out like the planes
+ * x0, y0     - lower left corner of the rectangle
+ * x1, y1     - upper right corner of the rectangle
+ * background - packed color of empty pixels
+ */
+void
+fbResolve(unsigned int* image, int x0, int y0, int x1, int y1,
+          unsigned int background)
+{
+    int x, y, i;
+
+    for (y = y0; y <= y1; y++) {
+        for (x = x0; x <= x1; x++) {
+            i = y * fbWidth + x;
+            image[i] = (fbDepth[i] & FB_TAG_MASK) == fbFrame ? fbColor[i] : background;
+        }
+    }
+}
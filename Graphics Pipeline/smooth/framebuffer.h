@@ -0,0 +1,93 @@
+/*
+ *  framebuffer.h
+ *
+ *  Depth and color planes for the software pipeline.
+ *
+ *  Every pixel is two 32 bit words in two separate planes, so a depth
+ *  test only reads the depth plane:
+ *
+ *  o  fbDepth[] holds a depth key, the frame tag in the top 8 bits and
+ *     the window z scaled to 24 bits below it.  Smaller keys are closer.
+ *  o  fbColor[] holds the color packed as RGBA bytes (R in the low byte
+ *     on a little endian machine, so it can go to glDrawPixels as
+ *     GL_RGBA / GL_UNSIGNED_BYTE).  A deferred renderer can keep other
+ *     bytes there instead, such as a normal and a material index, and
+ *     resolve them itself (fbFrame tells which pixels were drawn).
+ *
+ *  Clearing does not touch the planes.  fbClear() lowers the frame tag
+ *  instead, which makes every key written in an earlier frame farther
+ *  than anything drawn in this one; pixels whose tag is not the current
+ *  one read back as the background in fbResolve().  The tag is 7 bits
+ *  wide (keys stay positive for signed SIMD compares), so once every
+ *  127 frames fbClear() really clears the depth plane.
+ *
+ *  Usage:
+ *
+ *  o  call fbResize() to set the size of the frame before drawing
+ *  o  call fbClear() once at the start of each frame
+ *  o  compare and store fbFrame | FB_DEPTH(z) in fbDepth[] (z already
+ *     clamped to [0, 1]) and FB_COLOR(r, g, b) in fbColor[] (bytes)
+ *  o  call fbResolve() to copy a rectangle of the frame into an image
+ */
+
+
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#define FB_DEPTH_SCALE  16777215.0f    /* largest 24 bit depth */
+#define FB_TAG_MASK     0xff000000u    /* frame tag bits of a depth key */
+#define FB_CLEARED      0x7fffffffu    /* key farther than any frame */
+#define FB_ALPHA        0xff000000u    /* opaque alpha of a packed color */
+
+/* FB_DEPTH: 24 bit depth of a window z already clamped to [0, 1] */
+#define FB_DEPTH(z)     ((unsigned int)(int)((z) * FB_DEPTH_SCALE))
+
+/* FB_RGB: low three bytes of a packed color from byte valued channels */
+#define FB_RGB(r, g, b) \
+    ((unsigned int)(r) | ((unsigned int)(g) << 8) | ((unsigned int)(b) << 16))
+
+/* FB_COLOR: opaque packed color */
+#define FB_COLOR(r, g, b) (FB_ALPHA | FB_RGB(r, g, b))
+
+
+/* size of the frame and its planes, row by row from the bottom */
+extern int fbWidth;
+extern int fbHeight;
+extern unsigned int* fbDepth;
+extern unsigned int* fbColor;
+
+/* tag of the current frame, already shifted into the top of a key */
+extern unsigned int fbFrame;
+
+
+/* functions */
+
+/* fbResize: sets the size of the frame, the contents of the planes
+ * are lost.
+ *
+ * width  - pixels per row
+ * height - rows
+ */
+void
+fbResize(int width, int height);
+
+/* fbClear: starts a new frame, clearing the depth of every pixel
+ * to the far plane and its color to the background.
+ */
+void
+fbClear(void);
+
+/* fbResolve: copies the pixels inside x0..x1, y0..y1 (inclusive)
+ * into an image of fbWidth x fbHeight packed colors, using the
+ * background color for pixels nothing was drawn on this frame.
+ *
+ * image      - packed colors, laid out like the planes
+ * x0, y0     - lower left corner of the rectangle
+ * x1, y1     - upper right corner of the rectangle
+ * background - packed color of empty pixels
+ */
+void
+fbResolve(unsigned int* image, int x0, int y0, int x1, int y1,
+          unsigned int background);
+
+#endif /* FRAMEBUFFER_H */
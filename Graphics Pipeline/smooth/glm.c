@@ -17,11 +17,37 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <pthread.h>
+#endif
 #include "glm.h"
 
 
 #define T(x) (model->triangles[(x)])
 
+#define GLM_MAX_THREADS 64          /* most threads glmRunThreads() runs */
+#define GLM_MAX_CHUNKS 64           /* most pieces a file is parsed in */
+#define GLM_MIN_CHUNK  (1 << 16)    /* fewest bytes in a piece */
+#define GLM_MAP_MIN    (1 << 16)    /* smallest file glmMapFile() maps */
+
+#define GLM_WELD_PART  4096        /* fewest vectors a weld thread looks up */
+#define GLM_WELD_SCAN  16          /* most earlier vectors looked at in pass 1 */
+#define GLM_WELD_CELL  4           /* weld grid cell size, in epsilons */
+#define GLM_WELD_CELLS (1 << 30)   /* cells a weld grid coordinate is clamped to */
+
+#define GLM_SMOOTH_PART 4096        /* fewest vertices a smoothing thread does */
+
+#define GLM_VERTEX_CACHE 32         /* vertices in the post-transform cache */
+
+#define GLM_CACHE_MAGIC     0x434d4c47      /* "GLMC" */
+#define GLM_CACHE_VERSION   2
+#define GLM_CACHE_EXTENSION ".glmc"
+
 
 /* _GLMnode: general purpose node */
 typedef struct _GLMnode {
@@ -31,6 +57,133 @@ typedef struct _GLMnode {
 } GLMnode;
 
 
+/* _GLMweld: the hash grid glmWeldVectors() looks vectors up in, and
+   the part of the vectors one of its threads works on */
+typedef struct _GLMweld {
+    GLfloat* vectors;           /* vectors being welded, from index 1 */
+    GLfloat  epsilon;
+    double   scale;             /* grid cells per unit */
+    double   reach;             /* a little more than epsilon */
+    GLuint   mask;              /* buckets in the grid - 1 */
+    GLuint*  buckets;           /* bucket of each vector's cell */
+    GLuint*  first;             /* where each bucket starts in sorted */
+    GLuint*  sorted;            /* vectors by bucket, in order in each */
+    GLubyte* lonely;            /* no earlier vector within epsilon */
+    GLuint   start, end;        /* vectors of the part */
+    GLuint   pass;              /* 0: find buckets, 1: find lonely vectors */
+} GLMweld;
+
+
+/* _GLMsmooth: the triangles of every vertex, which
+   glmVertexNormalsParallel() averages the facet normals of, and the
+   vertices one of its threads works on */
+typedef struct _GLMsmooth {
+    struct _GLMmodel* model;
+    GLfloat  cos_angle;
+    GLuint*  first;             /* where each vertex's triangles start */
+    GLuint*  triangles;         /* triangles of the vertices, in order */
+    GLuint*  normalbase;        /* normals before each vertex's */
+    GLuint   start, end;        /* vertices of the part */
+    GLuint   pass;              /* 0: count normals, 1: write them */
+} GLMsmooth;
+
+
+/* _GLMcrease: the dot product of the facet normal of a corner with
+   the one its vertex compares it with in glmSmoothVertex() */
+typedef struct _GLMcrease {
+    GLfloat dot;
+    GLuint  vertex;
+} GLMcrease;
+
+/* _GLMsmoothing: what glmVertexNormalsAngle() keeps with a model to
+   redo its normals for another angle */
+typedef struct _GLMsmoothing {
+    GLMsmooth  smooth;          /* triangles by vertex, the angle now and
+                                   where each vertex's normals start */
+    GLMcrease* creases;         /* every corner, smallest dot first */
+    GLuint     numcreases;
+    GLuint*    changed;         /* vertices being redone, in order */
+    GLuint*    counts;          /* their new numbers of normals */
+    GLint*     shifts;          /* how far the normals before each move */
+    GLubyte*   marked;          /* vertices in changed */
+} GLMsmoothing;
+
+
+/* _GLMevent: a line in a piece of an OBJ file that changes the group
+   or material, played back in order by glmStitch() */
+typedef struct _GLMevent {
+    char   type;            /* 'm' (mtllib), 'u' (usemtl) or 'g' (group) */
+    char*  text;            /* rest of the line after the keyword */
+    GLuint triangle;        /* triangles in the piece before the line */
+} GLMevent;
+
+/* _GLMchunk: what was read from a piece of an OBJ file, numbered from
+   the start of the piece until glmStitch() puts it in the model */
+typedef struct _GLMchunk {
+    char*   start;              /* first line of the piece */
+    char*   end;                /* end of the piece */
+    char*   error;              /* unknown token, if any */
+    GLuint  numvertices, maxvertices;
+    GLfloat* vertices;          /* from index 1, like the model's */
+    GLuint  numnormals, maxnormals;
+    GLfloat* normals;
+    GLuint  numtexcoords, maxtexcoords;
+    GLfloat* texcoords;
+    GLuint  numtriangles, maxtriangles;
+    GLMtriangle* triangles;
+    GLuint  numevents, maxevents;
+    GLMevent* events;
+    GLuint  numrelative, maxrelative;
+    GLuint* relative;           /* 9 * triangle + 3 * v/t/n + corner of
+                                   each index that was negative */
+    struct _GLMmodel* model;    /* model being stitched */
+    GLuint  vertexbase;         /* items before the piece in the model */
+    GLuint  normalbase;
+    GLuint  texcoordbase;
+    GLuint  trianglebase;
+} GLMchunk;
+
+
+/* _GLMcacheheader: start of a cache file (see glmReadOBJCached()).
+   The file is in the byte order and layout of the machine that wrote
+   it; offsets are from the start of the file, 0 for none. */
+typedef struct _GLMcacheheader {
+    GLuint  magic;              /* GLM_CACHE_MAGIC */
+    GLuint  version;            /* GLM_CACHE_VERSION */
+    GLuint  headersize;         /* sizeof(GLMcacheheader) */
+    GLuint  size;               /* length of the cache file */
+    GLuint  objsize;            /* length of the OBJ file it was made from */
+    GLuint  objsum;             /* glmChecksum() of the OBJ file */
+    GLfloat angle;              /* smoothing angle of the vertex normals */
+    GLfloat scale;              /* what glmUnitize() returned */
+    GLuint  numvertices, numnormals, numtexcoords, numfacetnorms;
+    GLuint  numtriangles, nummaterials, numgroups;
+    GLuint  vertices, normals, texcoords, facetnorms;   /* GLfloat arrays */
+    GLuint  triangles;          /* GLMtriangle array */
+    GLuint  materials;          /* GLMcachematerial array */
+    GLuint  groups;             /* GLMcachegroup array, in list order */
+    GLuint  mtllibname;         /* string */
+} GLMcacheheader;
+
+/* _GLMcachematerial: a GLMmaterial in a cache file */
+typedef struct _GLMcachematerial {
+    GLuint  name;               /* offset of the name */
+    GLfloat diffuse[4];
+    GLfloat ambient[4];
+    GLfloat specular[4];
+    GLfloat emmissive[4];
+    GLfloat shininess;
+} GLMcachematerial;
+
+/* _GLMcachegroup: a GLMgroup in a cache file */
+typedef struct _GLMcachegroup {
+    GLuint  name;               /* offset of the name */
+    GLuint  numtriangles;
+    GLuint  triangles;          /* offset of the triangle indices */
+    GLuint  material;
+} GLMcachegroup;
+
+
 /* glmMax: returns the maximum of two floats */
 static GLfloat
 glmMax(GLfloat a, GLfloat b) 
@@ -114,8 +267,9 @@ glmEqual(GLfloat* u, GLfloat* v, GLfloat epsilon)
     return GL_FALSE;
 }
 
-/* glmWeldVectors: eliminate (weld) vectors that are within an
- * epsilon of each other.
+/* glmWeldVectorsLegacy: eliminate (weld) vectors that are within an
+ * epsilon of each other, comparing every vector with every vector
+ * already kept.  Kept to check and time glmWeldVectors() against.
  *
  * vectors     - array of GLfloat[3]'s to be welded
  * numvectors - number of GLfloat[3]'s in vectors
@@ -123,7 +277,7 @@ glmEqual(GLfloat* u, GLfloat* v, GLfloat epsilon)
  *
  */
 GLfloat*
-glmWeldVectors(GLfloat* vectors, GLuint* numvectors, GLfloat epsilon)
+glmWeldVectorsLegacy(GLfloat* vectors, GLuint* numvectors, GLfloat epsilon)
 {
     GLfloat* copies;
     GLuint   copied;
@@ -243,19 +397,55 @@ glmDirName(char* path)
 }
 
 
-/* glmReadMTL: read a wavefront material library file
+/* glmNewMaterials: give a model nummaterials materials, all set to the
+ * default one, the first named "default"
+ *
+ * model        - properly initialized GLMmodel structure
+ * nummaterials - number of materials
+ */
+static GLvoid
+glmNewMaterials(GLMmodel* model, GLuint nummaterials)
+{
+    GLuint i;
+    
+    model->materials = (GLMmaterial*)malloc(sizeof(GLMmaterial) * nummaterials);
+    model->nummaterials = nummaterials;
+    
+    /* set the default material */
+    for (i = 0; i < nummaterials; i++) {
+        model->materials[i].name = NULL;
+        model->materials[i].shininess = 65.0;
+        model->materials[i].diffuse[0] = 0.8;
+        model->materials[i].diffuse[1] = 0.8;
+        model->materials[i].diffuse[2] = 0.8;
+        model->materials[i].diffuse[3] = 1.0;
+        model->materials[i].ambient[0] = 0.2;
+        model->materials[i].ambient[1] = 0.2;
+        model->materials[i].ambient[2] = 0.2;
+        model->materials[i].ambient[3] = 1.0;
+        model->materials[i].specular[0] = 0.0;
+        model->materials[i].specular[1] = 0.0;
+        model->materials[i].specular[2] = 0.0;
+        model->materials[i].specular[3] = 1.0;
+    }
+    model->materials[0].name = strdup("default");
+}
+
+/* glmReadMTLLegacy: read a wavefront material library file with the
+ * original reader, which reads it twice with fscanf().  Kept for
+ * glmReadOBJLegacy(); glmReadOBJ() reads it with glmReadMTL().
  *
  * model - properly initialized GLMmodel structure
  * name  - name of the material library
  */
 static GLvoid
-glmReadMTL(GLMmodel* model, char* name)
+glmReadMTLLegacy(GLMmodel* model, char* name)
 {
     FILE* file;
     char* dir;
     char* filename;
     char    buf[128];
-    GLuint nummaterials, i;
+    GLuint nummaterials;
     
     dir = glmDirName(model->pathname);
     filename = (char*)malloc(sizeof(char) * (strlen(dir) + strlen(name) + 1));
@@ -265,7 +455,7 @@ glmReadMTL(GLMmodel* model, char* name)
     
     file = fopen(filename, "r");
     if (!file) {
-        fprintf(stderr, "glmReadMTL() failed: can't open material file \"%s\".\n",
+        fprintf(stderr, "glmReadMTLLegacy() failed: can't open material file \"%s\".\n",
             filename);
         exit(1);
     }
@@ -293,27 +483,7 @@ glmReadMTL(GLMmodel* model, char* name)
     
     rewind(file);
     
-    model->materials = (GLMmaterial*)malloc(sizeof(GLMmaterial) * nummaterials);
-    model->nummaterials = nummaterials;
-    
-    /* set the default material */
-    for (i = 0; i < nummaterials; i++) {
-        model->materials[i].name = NULL;
-        model->materials[i].shininess = 65.0;
-        model->materials[i].diffuse[0] = 0.8;
-        model->materials[i].diffuse[1] = 0.8;
-        model->materials[i].diffuse[2] = 0.8;
-        model->materials[i].diffuse[3] = 1.0;
-        model->materials[i].ambient[0] = 0.2;
-        model->materials[i].ambient[1] = 0.2;
-        model->materials[i].ambient[2] = 0.2;
-        model->materials[i].ambient[3] = 1.0;
-        model->materials[i].specular[0] = 0.0;
-        model->materials[i].specular[1] = 0.0;
-        model->materials[i].specular[2] = 0.0;
-        model->materials[i].specular[3] = 1.0;
-    }
-    model->materials[0].name = strdup("default");
+    glmNewMaterials(model, nummaterials);
     
     /* now, read in the data */
     nummaterials = 0;
@@ -480,7 +650,7 @@ glmFirstPass(GLMmodel* model, FILE* file)
                 fgets(buf, sizeof(buf), file);
                 sscanf(buf, "%s %s", buf, buf);
                 model->mtllibname = strdup(buf);
-                glmReadMTL(model, buf);
+                glmReadMTLLegacy(model, buf);
                 break;
             case 'u':
                 /* eat up rest of line */
@@ -759,172 +929,1008 @@ glmSecondPass(GLMmodel* model, FILE* file)
 }
 
 
-/* public functions */
-
-
-/* glmUnitize: "unitize" a model by translating it to the origin and
- * scaling it to fit in a unit cube around the origin.   Returns the
- * scalefactor used.
+/* glmMapFile: map a whole file into memory (files smaller than
+ * GLM_MAP_MIN are read instead).  Returns the contents of the file, or
+ * NULL if it can't be opened.  The mapping is private, writing to it
+ * doesn't change the file.
  *
- * model - properly initialized GLMmodel structure 
+ * filename - name of the file
+ * size     - (return) length of the file in bytes
+ *
+ * NOTE: the return value should be released with glmUnmapFile().
  */
-GLfloat
-glmUnitize(GLMmodel* model)
+static char*
+glmMapFile(char* filename, size_t* size)
 {
-    GLuint  i;
-    GLfloat maxx, minx, maxy, miny, maxz, minz;
-    GLfloat cx, cy, cz, w, h, d;
-    GLfloat scale;
+#if defined(_WIN32)
+    FILE* file;
+    char* data;
     
-    assert(model);
-    assert(model->vertices);
+    file = fopen(filename, "rb");
+    if (!file)
+        return NULL;
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    data = (char*)malloc(*size + 1);
+    *size = fread(data, 1, *size, file);
+    fclose(file);
+    return data;
+#else
+    static char empty[1];
+    struct stat info;
+    char* data;
+    int fd;
     
-    /* get the max/mins */
-    maxx = minx = model->vertices[3 + 0];
-    maxy = miny = model->vertices[3 + 1];
-    maxz = minz = model->vertices[3 + 2];
-    for (i = 1; i <= model->numvertices; i++) {
-        if (maxx < model->vertices[3 * i + 0])
-            maxx = model->vertices[3 * i + 0];
-        if (minx > model->vertices[3 * i + 0])
-            minx = model->vertices[3 * i + 0];
-        
-        if (maxy < model->vertices[3 * i + 1])
-            maxy = model->vertices[3 * i + 1];
-        if (miny > model->vertices[3 * i + 1])
-            miny = model->vertices[3 * i + 1];
-        
-        if (maxz < model->vertices[3 * i + 2])
-            maxz = model->vertices[3 * i + 2];
-        if (minz > model->vertices[3 * i + 2])
-            minz = model->vertices[3 * i + 2];
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &info) < 0) {
+        close(fd);
+        return NULL;
     }
     
-    /* calculate model width, height, and depth */
-    w = glmAbs(maxx) + glmAbs(minx);
-    h = glmAbs(maxy) + glmAbs(miny);
-    d = glmAbs(maxz) + glmAbs(minz);
-    
-    /* calculate center of the model */
-    cx = (maxx + minx) / 2.0;
-    cy = (maxy + miny) / 2.0;
-    cz = (maxz + minz) / 2.0;
-    
-    /* calculate unitizing scale factor */
-    scale = 2.0 / glmMax(glmMax(w, h), d);
+    /* mmap() refuses to map nothing */
+    *size = info.st_size;
+    if (*size == 0) {
+        close(fd);
+        return empty;
+    }
     
-    /* translate around center then scale */
-    for (i = 1; i <= model->numvertices; i++) {
-        model->vertices[3 * i + 0] -= cx;
-        model->vertices[3 * i + 1] -= cy;
-        model->vertices[3 * i + 2] -= cz;
-        model->vertices[3 * i + 0] *= scale;
-        model->vertices[3 * i + 1] *= scale;
-        model->vertices[3 * i + 2] *= scale;
+    /* a small file is read faster than mapping, faulting in and
+       unmapping its pages */
+    if (*size < GLM_MAP_MIN) {
+        data = (char*)malloc(*size);
+        if (read(fd, data, *size) != (ssize_t)*size) {
+            free(data);
+            data = NULL;
+        }
+        close(fd);
+        return data;
     }
     
-    return scale;
+    data = (char*)mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == (char*)MAP_FAILED)
+        return NULL;
+#ifdef MADV_SEQUENTIAL
+    madvise(data, *size, MADV_SEQUENTIAL);
+#endif
+    return data;
+#endif
 }
 
-/* glmDimensions: Calculates the dimensions (width, height, depth) of
- * a model.
+/* glmUnmapFile: release a file mapped with glmMapFile()
  *
- * model   - initialized GLMmodel structure
- * dimensions - array of 3 GLfloats (GLfloat dimensions[3])
+ * data - contents of the file
+ * size - length of the file in bytes
  */
-GLvoid
-glmDimensions(GLMmodel* model, GLfloat* dimensions)
+static GLvoid
+glmUnmapFile(char* data, size_t size)
 {
-    GLuint i;
-    GLfloat maxx, minx, maxy, miny, maxz, minz;
+#if defined(_WIN32)
+    free(data);
+#else
+    if (size >= GLM_MAP_MIN)
+        munmap(data, size);
+    else if (size)
+        free(data);
+#endif
+}
+
+/* glmFree: free an array of a model, unless it is in the model's
+ * cache file mapping (see glmReadOBJCached()).
+ *
+ * model - initialized GLMmodel structure
+ * array - array to free
+ */
+static GLvoid
+glmFree(GLMmodel* model, GLvoid* array)
+{
+    if (model->cache && (char*)array >= model->cache &&
+        (char*)array < model->cache + model->cachesize)
+        return;
+    free(array);
+}
+
+/* glmGrow: make room for at least count elements in an array, doubling
+ * its capacity as needed.  Returns the (possibly moved) array.
+ *
+ * array    - array to grow (or NULL)
+ * capacity - (in/out) number of elements the array has room for
+ * count    - number of elements needed
+ * size     - size of an element in bytes
+ */
+static GLvoid*
+glmGrow(GLvoid* array, GLuint* capacity, GLuint count, size_t size)
+{
+    if (count <= *capacity)
+        return array;
     
-    assert(model);
-    assert(model->vertices);
-    assert(dimensions);
+    if (*capacity < 256)
+        *capacity = 256;
+    while (*capacity < count)
+        *capacity *= 2;
+    return realloc(array, size * *capacity);
+}
+
+#define glmIsBlank(c) ((c) == ' ' || (c) == '\t' || (c) == '\r' || \
+                       (c) == '\v' || (c) == '\f')
+#define glmIsDigit(c) ((c) >= '0' && (c) <= '9')
+
+/* glmSkipBlanks: return the first character at or after s that isn't
+ * a blank (the newline isn't one) */
+static char*
+glmSkipBlanks(char* s, char* end)
+{
+    while (s < end && glmIsBlank(*s))
+        s++;
+    return s;
+}
+
+/* glmSkipLine: return the start of the line after the one s is on */
+static char*
+glmSkipLine(char* s, char* end)
+{
+    s = (char*)memchr(s, '\n', end - s);
+    return s ? s + 1 : end;
+}
+
+/* glmScanName: copy the next word on the line into buf (at most size-1
+ * characters, the rest of the word is skipped) */
+static char*
+glmScanName(char* s, char* end, char* buf, int size)
+{
+    int i;
     
-    /* get the max/mins */
-    maxx = minx = model->vertices[3 + 0];
-    maxy = miny = model->vertices[3 + 1];
-    maxz = minz = model->vertices[3 + 2];
-    for (i = 1; i <= model->numvertices; i++) {
-        if (maxx < model->vertices[3 * i + 0])
-            maxx = model->vertices[3 * i + 0];
-        if (minx > model->vertices[3 * i + 0])
-            minx = model->vertices[3 * i + 0];
-        
-        if (maxy < model->vertices[3 * i + 1])
-            maxy = model->vertices[3 * i + 1];
-        if (miny > model->vertices[3 * i + 1])
-            miny = model->vertices[3 * i + 1];
-        
-        if (maxz < model->vertices[3 * i + 2])
-            maxz = model->vertices[3 * i + 2];
-        if (minz > model->vertices[3 * i + 2])
-            minz = model->vertices[3 * i + 2];
+    s = glmSkipBlanks(s, end);
+    for (i = 0; s < end && *s != '\n' && !glmIsBlank(*s); s++) {
+        if (i < size - 1)
+            buf[i++] = *s;
     }
-    
-    /* calculate model width, height, and depth */
-    dimensions[0] = glmAbs(maxx) + glmAbs(minx);
-    dimensions[1] = glmAbs(maxy) + glmAbs(miny);
-    dimensions[2] = glmAbs(maxz) + glmAbs(minz);
+    buf[i] = '\0';
+    return s;
 }
 
-/* glmScale: Scales a model by a given amount.
- * 
- * model - properly initialized GLMmodel structure
- * scale - scalefactor (0.5 = half as large, 2.0 = twice as large)
- */
-GLvoid
-glmScale(GLMmodel* model, GLfloat scale)
+/* glmScanInt: scan a decimal integer at *s like "%d" (without skipping
+ * blanks).  Returns GL_FALSE, leaving *s alone, if there isn't one. */
+static GLboolean
+glmScanInt(char** s, char* end, int* value)
 {
-    GLuint i;
+    char* p = *s;
+    int negative = 0;
+    int i = 0;
     
-    for (i = 1; i <= model->numvertices; i++) {
-        model->vertices[3 * i + 0] *= scale;
-        model->vertices[3 * i + 1] *= scale;
-        model->vertices[3 * i + 2] *= scale;
-    }
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+    if (p == end || !glmIsDigit(*p))
+        return GL_FALSE;
+    while (p < end && glmIsDigit(*p))
+        i = i * 10 + (*p++ - '0');
+    
+    *value = negative ? -i : i;
+    *s = p;
+    return GL_TRUE;
 }
 
-/* glmReverseWinding: Reverse the polygon winding for all polygons in
- * this model.   Default winding is counter-clockwise.  Also changes
- * the direction of the normals.
- * 
- * model - properly initialized GLMmodel structure 
+/* powers of ten a double holds exactly */
+static double glm_pow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* glmScanFloat: scan a float at *s (after blanks) giving the same value
+ * as "%f" would.  Returns GL_FALSE, leaving *s alone, if there isn't
+ * one.
+ *
+ * Numbers of up to 9 significant digits within 10^+-22 (nearly all of
+ * the ones in OBJ files) are exact in a double, so one multiply or
+ * divide by an exact power of ten rounds them correctly; that only
+ * rounds to the same float as strtof() when it doesn't land exactly
+ * halfway between two floats.  Anything else goes to strtof().
  */
-GLvoid
-glmReverseWinding(GLMmodel* model)
+static GLboolean
+glmScanFloat(char** s, char* end, GLfloat* value)
 {
-    GLuint i, swap;
-    
-    assert(model);
+    char*  start;
+    char*  p;
+    char   buf[64];
+    char*  e;
+    unsigned int mantissa = 0;
+    double d, error;
+    float  f;
+    int    digits = 0, exponent = 0, x, i;
+    int    negative = 0, seen = 0;
     
-    for (i = 0; i < model->numtriangles; i++) {
-        swap = T(i).vindices[0];
-        T(i).vindices[0] = T(i).vindices[2];
-        T(i).vindices[2] = swap;
-        
-        if (model->numnormals) {
-            swap = T(i).nindices[0];
-            T(i).nindices[0] = T(i).nindices[2];
-            T(i).nindices[2] = swap;
+    start = p = glmSkipBlanks(*s, end);
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+    for (; p < end && glmIsDigit(*p); p++, seen = 1) {
+        mantissa = mantissa * 10 + (*p - '0');
+        digits += mantissa != 0;
+    }
+    if (p < end && *p == '.') {
+        for (p++; p < end && glmIsDigit(*p); p++, seen = 1) {
+            mantissa = mantissa * 10 + (*p - '0');
+            digits += mantissa != 0;
+            exponent--;
         }
-        
-        if (model->numtexcoords) {
-            swap = T(i).tindices[0];
-            T(i).tindices[0] = T(i).tindices[2];
-            T(i).tindices[2] = swap;
+    }
+    if (!seen)
+        goto slow;                      /* inf, nan or not a number */
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        e = p + 1;
+        if (glmScanInt(&e, end, &x)) {
+            exponent += x;
+            p = e;
         }
     }
-    
-    /* reverse facet normals */
-    for (i = 1; i <= model->numfacetnorms; i++) {
-        model->facetnorms[3 * i + 0] = -model->facetnorms[3 * i + 0];
-        model->facetnorms[3 * i + 1] = -model->facetnorms[3 * i + 1];
-        model->facetnorms[3 * i + 2] = -model->facetnorms[3 * i + 2];
+    if (digits > 9 || exponent < -22 || exponent > 22)
+        goto slow;
+    if (mantissa == 0) {
+        f = 0.0f;
+        goto done;
     }
     
-    /* reverse vertex normals */
+    d = exponent < 0 ? mantissa / glm_pow10[-exponent] : mantissa * glm_pow10[exponent];
+    f = (float)d;
+    
+    /* halfway between two floats: f + 2 * error is the other one */
+    error = d - f;
+    if (error != 0.0 && (double)(float)(f + 2.0 * error) == f + 2.0 * error)
+        goto slow;
+    goto done;
+    
+slow:
+    for (i = 0; start + i < end && i < (int)sizeof(buf) - 1 &&
+         start[i] != '\n' && !glmIsBlank(start[i]); i++)
+        buf[i] = start[i];
+    buf[i] = '\0';
+    f = strtof(buf, &e);
+    if (e == buf)
+        return GL_FALSE;
+    *value = f;
+    *s = start + (e - buf);
+    return GL_TRUE;
+    
+done:
+    *value = negative ? -f : f;
+    *s = p;
+    return GL_TRUE;
+}
+
+/* glmReadMTL: read a wavefront material library file, mapped and
+ * scanned like glmParse() reads the model.  Reads the same materials as
+ * glmReadMTLLegacy().
+ *
+ * model - properly initialized GLMmodel structure
+ * name  - name of the material library
+ */
+static GLvoid
+glmReadMTL(GLMmodel* model, char* name)
+{
+    GLMmaterial* material;
+    char*   dir;
+    char*   filename;
+    char*   data;
+    char*   s;
+    char*   end;
+    char*   token;
+    char    buf[128];
+    size_t  size;
+    GLuint  nummaterials, i;
+    
+    dir = glmDirName(model->pathname);
+    filename = (char*)malloc(sizeof(char) * (strlen(dir) + strlen(name) + 1));
+    strcpy(filename, dir);
+    strcat(filename, name);
+    free(dir);
+    
+    data = glmMapFile(filename, &size);
+    if (!data) {
+        fprintf(stderr, "glmReadMTL() failed: can't open material file \"%s\".\n",
+            filename);
+        exit(1);
+    }
+    free(filename);
+    end = data + size;
+    
+    /* count the number of materials in the file */
+    nummaterials = 1;
+    for (s = data; s < end; s = glmSkipLine(s, end)) {
+        s = glmSkipBlanks(s, end);
+        if (s < end && *s == 'n')
+            nummaterials++;
+    }
+    glmNewMaterials(model, nummaterials);
+    
+    /* now, read in the data */
+    material = &model->materials[0];
+    for (s = data; s < end; s = glmSkipLine(s, end)) {
+        s = glmSkipBlanks(s, end);
+        token = s;
+        while (s < end && *s != '\n' && !glmIsBlank(*s))
+            s++;
+        if (s == token)
+            continue;
+        
+        switch (token[0]) {
+        case 'n':               /* newmtl */
+            glmScanName(s, end, buf, sizeof(buf));
+            material++;
+            material->name = strdup(buf);
+            break;
+        case 'N':
+            glmScanFloat(&s, end, &material->shininess);
+            /* wavefront shininess is from [0, 1000], so scale for OpenGL */
+            material->shininess /= 1000.0;
+            material->shininess *= 128.0;
+            break;
+        case 'K':
+            switch (s - token > 1 ? token[1] : '\0') {
+            case 'd':
+                for (i = 0; i < 3; i++)
+                    glmScanFloat(&s, end, &material->diffuse[i]);
+                break;
+            case 's':
+                for (i = 0; i < 3; i++)
+                    glmScanFloat(&s, end, &material->specular[i]);
+                break;
+            case 'a':
+                for (i = 0; i < 3; i++)
+                    glmScanFloat(&s, end, &material->ambient[i]);
+                break;
+            }
+            break;
+        }
+    }
+    
+    glmUnmapFile(data, size);
+}
+
+/* glmParseChunk: read the lines of a piece of a Wavefront OBJ file in
+ * one pass, growing the chunk's arrays as it goes.  Vertices, normals
+ * and texcoords are numbered from 1 at the start of the piece; lines
+ * that change the group or material are only noted, glmStitch() works
+ * them out in file order.  Stops at the first unknown 'v' token.
+ *
+ * chunk - start and end of the piece, everything else 0
+ */
+static GLvoid
+glmParseChunk(GLMchunk* chunk)
+{
+    GLuint  numvertices;        /* number of vertices in chunk */
+    GLuint  numnormals;         /* number of normals in chunk */
+    GLuint  numtexcoords;       /* number of texcoords in chunk */
+    GLuint  numtriangles;       /* number of triangles in chunk */
+    GLfloat*    vertices;           /* array of vertices  */
+    GLfloat*    normals;            /* array of normals */
+    GLfloat*    texcoords;          /* array of texture coordinates */
+    GLMtriangle* triangles;         /* array of triangles */
+    GLuint  corner[3][3];       /* first, previous and this corner of a face */
+    int     relative[3];        /* indices of a corner that were negative */
+    GLuint  i, j, count;
+    int     format;             /* indices given by the first corner of a face */
+    int     index[3];
+    char*   s;
+    char*   end;
+    char*   token;
+    
+    numvertices = numnormals = numtexcoords = numtriangles = 0;
+    vertices = normals = texcoords = NULL;
+    triangles = NULL;
+    
+    /* index 0 of vertices, normals and texcoords isn't used */
+    s = chunk->start;
+    end = chunk->end;
+    while (s < end) {
+        s = glmSkipBlanks(s, end);
+        token = s;
+        while (s < end && *s != '\n' && !glmIsBlank(*s))
+            s++;
+        if (s == token) {
+            s = glmSkipLine(s, end);
+            continue;
+        }
+        
+        switch (token[0]) {
+        case 'v':               /* v, vn, vt */
+            switch (s - token > 1 ? token[1] : '\0') {
+            case '\0':          /* vertex */
+                vertices = (GLfloat*)glmGrow(vertices, &chunk->maxvertices,
+                    numvertices + 2, 3 * sizeof(GLfloat));
+                numvertices++;
+                for (i = 0; i < 3; i++) {
+                    vertices[3 * numvertices + i] = 0.0f;
+                    glmScanFloat(&s, end, &vertices[3 * numvertices + i]);
+                }
+                break;
+            case 'n':           /* normal */
+                normals = (GLfloat*)glmGrow(normals, &chunk->maxnormals,
+                    numnormals + 2, 3 * sizeof(GLfloat));
+                numnormals++;
+                for (i = 0; i < 3; i++) {
+                    normals[3 * numnormals + i] = 0.0f;
+                    glmScanFloat(&s, end, &normals[3 * numnormals + i]);
+                }
+                break;
+            case 't':           /* texcoord */
+                texcoords = (GLfloat*)glmGrow(texcoords, &chunk->maxtexcoords,
+                    numtexcoords + 2, 2 * sizeof(GLfloat));
+                numtexcoords++;
+                for (i = 0; i < 2; i++) {
+                    texcoords[2 * numtexcoords + i] = 0.0f;
+                    glmScanFloat(&s, end, &texcoords[2 * numtexcoords + i]);
+                }
+                break;
+            default:
+                chunk->error = token;
+                s = end;
+                break;
+            }
+            break;
+        case 'm':               /* mtllib */
+        case 'u':               /* usemtl */
+        case 'g':               /* group */
+            chunk->events = (GLMevent*)glmGrow(chunk->events, &chunk->maxevents,
+                chunk->numevents + 1, sizeof(GLMevent));
+            chunk->events[chunk->numevents].type = token[0];
+            chunk->events[chunk->numevents].text = s;
+            chunk->events[chunk->numevents].triangle = numtriangles;
+            chunk->numevents++;
+            break;
+        case 'f':               /* face */
+            format = -1;
+            for (count = 0; ; count++) {
+                s = glmSkipBlanks(s, end);
+                index[0] = index[1] = index[2] = 0;
+                if (!glmScanInt(&s, end, &index[0]))
+                    break;
+                /* can be one of %d, %d//%d, %d/%d, %d/%d/%d */
+                i = 0;
+                if (s < end && *s == '/') {
+                    s++;
+                    if (glmScanInt(&s, end, &index[1]))
+                        i |= 1;
+                    if (s < end && *s == '/') {
+                        s++;
+                        if (glmScanInt(&s, end, &index[2]))
+                            i |= 2;
+                    }
+                }
+                if (format < 0)
+                    format = i;
+                if (!(format & 1))
+                    index[1] = 0;
+                if (!(format & 2))
+                    index[2] = 0;
+                
+                /* negative indices count back from the last one read;
+                   glmStitch() adds what came before the chunk */
+                i = count < 2 ? count : 2;
+                relative[i] = 0;
+                for (j = 0; j < 3; j++) {
+                    if (index[j] < 0) {
+                        index[j] += (j == 0 ? numvertices : j == 1 ?
+                            numtexcoords : numnormals) + 1;
+                        relative[i] |= 1 << j;
+                    }
+                    corner[i][j] = index[j];
+                }
+                if (count < 2)
+                    continue;
+                
+                /* fan out from the first corner */
+                triangles = (GLMtriangle*)glmGrow(triangles, &chunk->maxtriangles,
+                    numtriangles + 1, sizeof(GLMtriangle));
+                for (i = 0; i < 3; i++) {
+                    triangles[numtriangles].vindices[i] = corner[i][0];
+                    triangles[numtriangles].tindices[i] = corner[i][1];
+                    triangles[numtriangles].nindices[i] = corner[i][2];
+                    for (j = 0; j < 3; j++) {
+                        if (!(relative[i] & (1 << j)))
+                            continue;
+                        chunk->relative = (GLuint*)glmGrow(chunk->relative,
+                            &chunk->maxrelative, chunk->numrelative + 1,
+                            sizeof(GLuint));
+                        chunk->relative[chunk->numrelative++] = 9 * numtriangles + 3 * j + i;
+                    }
+                }
+                triangles[numtriangles].findex = 0;
+                numtriangles++;
+                memcpy(corner[1], corner[2], sizeof(corner[2]));
+                relative[1] = relative[2];
+            }
+            break;
+        }
+        
+        /* eat up rest of line */
+        s = glmSkipLine(s, end);
+    }
+    
+    chunk->numvertices  = numvertices;
+    chunk->numnormals   = numnormals;
+    chunk->numtexcoords = numtexcoords;
+    chunk->numtriangles = numtriangles;
+    chunk->vertices  = vertices;
+    chunk->normals   = normals;
+    chunk->texcoords = texcoords;
+    chunk->triangles = triangles;
+}
+
+/* glmParseWorker: thread entry for glmParseChunk() */
+static GLvoid*
+glmParseWorker(GLvoid* chunk)
+{
+    glmParseChunk((GLMchunk*)chunk);
+    return NULL;
+}
+
+/* glmCopyWorker: copy a chunk's arrays into the model's at its bases,
+ * turning its relative indices into the model's, and free them.
+ */
+static GLvoid*
+glmCopyWorker(GLvoid* data)
+{
+    GLMchunk* chunk = (GLMchunk*)data;
+    GLMmodel* model = chunk->model;
+    GLMtriangle* triangle;
+    GLuint  base[3];
+    GLuint  i, j, k;
+    
+    if (chunk->numvertices) {
+        memcpy(model->vertices + 3 * (chunk->vertexbase + 1), chunk->vertices + 3,
+            sizeof(GLfloat) * 3 * chunk->numvertices);
+    }
+    if (chunk->numnormals) {
+        memcpy(model->normals + 3 * (chunk->normalbase + 1), chunk->normals + 3,
+            sizeof(GLfloat) * 3 * chunk->numnormals);
+    }
+    if (chunk->numtexcoords) {
+        memcpy(model->texcoords + 2 * (chunk->texcoordbase + 1), chunk->texcoords + 2,
+            sizeof(GLfloat) * 2 * chunk->numtexcoords);
+    }
+    
+    triangle = model->triangles + chunk->trianglebase;
+    if (chunk->numtriangles)
+        memcpy(triangle, chunk->triangles, sizeof(GLMtriangle) * chunk->numtriangles);
+    base[0] = chunk->vertexbase;
+    base[1] = chunk->texcoordbase;
+    base[2] = chunk->normalbase;
+    for (i = 0; i < chunk->numrelative; i++) {
+        j = chunk->relative[i] % 9 / 3;
+        k = chunk->relative[i] % 3;
+        switch (j) {
+        case 0: triangle[chunk->relative[i] / 9].vindices[k] += base[0]; break;
+        case 1: triangle[chunk->relative[i] / 9].tindices[k] += base[1]; break;
+        case 2: triangle[chunk->relative[i] / 9].nindices[k] += base[2]; break;
+        }
+    }
+    
+    free(chunk->vertices);
+    free(chunk->normals);
+    free(chunk->texcoords);
+    free(chunk->triangles);
+    chunk->vertices = chunk->normals = chunk->texcoords = NULL;
+    chunk->triangles = NULL;
+    return NULL;
+}
+
+/* glmRunThreads: run work on every item of an array, each on its
+ * own thread
+ *
+ * items    - array of items (at most GLM_MAX_THREADS)
+ * size     - bytes per item
+ * numitems - number of items
+ * work     - function to run on an item
+ */
+static GLvoid
+glmRunThreads(GLvoid* items, size_t size, GLuint numitems, GLvoid* (*work)(GLvoid*))
+{
+#if defined(_WIN32)
+    GLuint i;
+    
+    for (i = 0; i < numitems; i++)
+        work((char*)items + i * size);
+#else
+    pthread_t threads[GLM_MAX_THREADS];
+    GLboolean started[GLM_MAX_THREADS];
+    GLuint i;
+    
+    for (i = 1; i < numitems; i++)
+        started[i] = pthread_create(&threads[i], NULL, work, (char*)items + i * size) == 0;
+    work(items);
+    for (i = 1; i < numitems; i++) {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+        else
+            work((char*)items + i * size);
+    }
+#endif
+}
+
+/* glmStitch: fill in a model from the chunks of its file, in order,
+ * freeing the chunks' arrays.
+ *
+ * model     - properly initialized GLMmodel structure
+ * chunks    - the parsed chunks of the file, in order
+ * numchunks - number of chunks
+ */
+static GLvoid
+glmStitch(GLMmodel* model, GLMchunk* chunks, GLuint numchunks)
+{
+    GLMchunk*   chunk;
+    GLMevent*   event;
+    GLMgroup*   group;              /* current group */
+    GLMgroup**  rungroups;          /* group of each run of triangles */
+    GLuint*     runs;               /* first triangle of each run */
+    GLuint  numruns;
+    GLuint  material;           /* current material */
+    GLuint  i, j, k, first;
+    char    buf[128];
+    
+    /* report an unknown token the way a serial read would stop at it */
+    for (i = 0; i < numchunks; i++) {
+        if (chunks[i].error) {
+            for (j = 0; chunks[i].error + j < chunks[i].end &&
+                 chunks[i].error[j] != '\n' && !glmIsBlank(chunks[i].error[j]); j++)
+                ;
+            printf("glmReadOBJ(): Unknown token \"%.*s\".\n", (int)j, chunks[i].error);
+            exit(1);
+        }
+    }
+    
+    /* where each chunk goes in the model */
+    for (i = 0; i < numchunks; i++) {
+        chunks[i].model = model;
+        chunks[i].vertexbase   = model->numvertices;
+        chunks[i].normalbase   = model->numnormals;
+        chunks[i].texcoordbase = model->numtexcoords;
+        chunks[i].trianglebase = model->numtriangles;
+        model->numvertices  += chunks[i].numvertices;
+        model->numnormals   += chunks[i].numnormals;
+        model->numtexcoords += chunks[i].numtexcoords;
+        model->numtriangles += chunks[i].numtriangles;
+    }
+    
+    if (numchunks == 1) {
+        /* a chunk from the start of the file is numbered like the
+           model, give the arrays back what they didn't use */
+        chunk = &chunks[0];
+        model->vertices = (GLfloat*)realloc(chunk->vertices,
+            sizeof(GLfloat) * 3 * (model->numvertices + 1));
+        if (model->numnormals) {
+            model->normals = (GLfloat*)realloc(chunk->normals,
+                sizeof(GLfloat) * 3 * (model->numnormals + 1));
+        }
+        if (model->numtexcoords) {
+            model->texcoords = (GLfloat*)realloc(chunk->texcoords,
+                sizeof(GLfloat) * 2 * (model->numtexcoords + 1));
+        }
+        if (model->numtriangles) {
+            model->triangles = (GLMtriangle*)realloc(chunk->triangles,
+                sizeof(GLMtriangle) * model->numtriangles);
+        }
+    } else {
+        model->vertices = (GLfloat*)malloc(sizeof(GLfloat) *
+            3 * (model->numvertices + 1));
+        if (model->numnormals) {
+            model->normals = (GLfloat*)malloc(sizeof(GLfloat) *
+                3 * (model->numnormals + 1));
+        }
+        if (model->numtexcoords) {
+            model->texcoords = (GLfloat*)malloc(sizeof(GLfloat) *
+                2 * (model->numtexcoords + 1));
+        }
+        if (model->numtriangles) {
+            model->triangles = (GLMtriangle*)malloc(sizeof(GLMtriangle) *
+                model->numtriangles);
+        }
+        glmRunThreads(chunks, sizeof(GLMchunk), numchunks, glmCopyWorker);
+    }
+    
+    /* play the group and material lines back in file order, splitting
+       the triangles into runs of one group */
+    numruns = numchunks;
+    for (i = 0; i < numchunks; i++)
+        numruns += chunks[i].numevents;
+    rungroups = (GLMgroup**)malloc(sizeof(GLMgroup*) * numruns);
+    runs = (GLuint*)malloc(sizeof(GLuint) * (numruns + 1));
+    
+    /* make a default group */
+    group = glmAddGroup(model, "default");
+    material = 0;
+    numruns = 0;
+    for (i = 0; i < numchunks; i++) {
+        chunk = &chunks[i];
+        for (j = 0; j <= chunk->numevents; j++) {
+            first = j ? chunk->events[j - 1].triangle : 0;
+            rungroups[numruns] = group;
+            runs[numruns++] = chunk->trianglebase + first;
+            if (j == chunk->numevents)
+                break;
+            
+            event = &chunk->events[j];
+            switch (event->type) {
+            case 'm':
+                glmScanName(event->text, chunk->end, buf, sizeof(buf));
+                model->mtllibname = strdup(buf);
+                glmReadMTL(model, buf);
+                break;
+            case 'u':
+                glmScanName(event->text, chunk->end, buf, sizeof(buf));
+                group->material = material = glmFindMaterial(model, buf);
+                break;
+            case 'g':
+                /* the rest of the line less its last character, like
+                   fgets() and nuking the '\n' */
+                for (k = 0; event->text + k < chunk->end && k < sizeof(buf) - 1; ) {
+                    if (event->text[k++] == '\n')
+                        break;
+                }
+                memcpy(buf, event->text, k);
+                buf[k ? k - 1 : 0] = '\0';
+                group = glmAddGroup(model, buf);
+                group->material = material;
+                break;
+            }
+        }
+        free(chunk->events);
+        free(chunk->relative);
+    }
+    runs[numruns] = model->numtriangles;
+    
+    /* hand the triangles out to their groups */
+    for (i = 0; i < numruns; i++)
+        rungroups[i]->numtriangles += runs[i + 1] - runs[i];
+    for (group = model->groups; group; group = group->next) {
+        group->triangles = (GLuint*)malloc(sizeof(GLuint) * group->numtriangles);
+        group->numtriangles = 0;
+    }
+    for (i = 0; i < numruns; i++) {
+        group = rungroups[i];
+        for (j = runs[i]; j < runs[i + 1]; j++)
+            group->triangles[group->numtriangles++] = j;
+    }
+    free(rungroups);
+    free(runs);
+}
+
+/* glmParse: read a whole Wavefront OBJ file, in pieces split at line
+ * ends and parsed on as many threads, stitched together in file order.
+ * Reads the same data as glmFirstPass() and glmSecondPass() together
+ * whatever the number of threads, except that faces and materials
+ * before the first group go to the default group, indices a face
+ * doesn't give are 0, and negative (relative) indices work.
+ *
+ * model   - properly initialized GLMmodel structure
+ * data    - contents of the file
+ * size    - length of the contents
+ * threads - most threads to parse with
+ */
+static GLvoid
+glmParse(GLMmodel* model, char* data, size_t size, GLuint threads)
+{
+    GLMchunk chunks[GLM_MAX_CHUNKS];
+    GLuint  numchunks, i;
+    char*   s;
+    
+    /* pieces too small aren't worth a thread */
+    numchunks = threads;
+    if (numchunks > size / GLM_MIN_CHUNK)
+        numchunks = size / GLM_MIN_CHUNK;
+    if (numchunks > GLM_MAX_CHUNKS)
+        numchunks = GLM_MAX_CHUNKS;
+    if (numchunks < 1)
+        numchunks = 1;
+    
+    memset(chunks, 0, sizeof(GLMchunk) * numchunks);
+    s = data;
+    for (i = 0; i < numchunks; i++) {
+        chunks[i].start = s;
+        if (i == numchunks - 1)
+            s = data + size;
+        else if (s < data + size * (i + 1) / numchunks)
+            s = glmSkipLine(data + size * (i + 1) / numchunks, data + size);
+        chunks[i].end = s;
+    }
+    
+    glmRunThreads(chunks, sizeof(GLMchunk), numchunks, glmParseWorker);
+    glmStitch(model, chunks, numchunks);
+}
+
+
+/* public functions */
+
+
+/* glmUnitize: "unitize" a model by translating it to the origin and
+ * scaling it to fit in a unit cube around the origin.   Returns the
+ * scalefactor used.
+ *
+ * model - properly initialized GLMmodel structure 
+ */
+GLfloat
+glmUnitize(GLMmodel* model)
+{
+    GLuint  i;
+    GLfloat maxx, minx, maxy, miny, maxz, minz;
+    GLfloat cx, cy, cz, w, h, d;
+    GLfloat scale;
+    
+    assert(model);
+    assert(model->vertices);
+    
+    /* get the max/mins */
+    maxx = minx = model->vertices[3 + 0];
+    maxy = miny = model->vertices[3 + 1];
+    maxz = minz = model->vertices[3 + 2];
+    for (i = 1; i <= model->numvertices; i++) {
+        if (maxx < model->vertices[3 * i + 0])
+            maxx = model->vertices[3 * i + 0];
+        if (minx > model->vertices[3 * i + 0])
+            minx = model->vertices[3 * i + 0];
+        
+        if (maxy < model->vertices[3 * i + 1])
+            maxy = model->vertices[3 * i + 1];
+        if (miny > model->vertices[3 * i + 1])
+            miny = model->vertices[3 * i + 1];
+        
+        if (maxz < model->vertices[3 * i + 2])
+            maxz = model->vertices[3 * i + 2];
+        if (minz > model->vertices[3 * i + 2])
+            minz = model->vertices[3 * i + 2];
+    }
+    
+    /* calculate model width, height, and depth */
+    w = glmAbs(maxx) + glmAbs(minx);
+    h = glmAbs(maxy) + glmAbs(miny);
+    d = glmAbs(maxz) + glmAbs(minz);
+    
+    /* calculate center of the model */
+    cx = (maxx + minx) / 2.0;
+    cy = (maxy + miny) / 2.0;
+    cz = (maxz + minz) / 2.0;
+    
+    /* calculate unitizing scale factor */
+    scale = 2.0 / glmMax(glmMax(w, h), d);
+    
+    /* translate around center then scale */
+    for (i = 1; i <= model->numvertices; i++) {
+        model->vertices[3 * i + 0] -= cx;
+        model->vertices[3 * i + 1] -= cy;
+        model->vertices[3 * i + 2] -= cz;
+        model->vertices[3 * i + 0] *= scale;
+        model->vertices[3 * i + 1] *= scale;
+        model->vertices[3 * i + 2] *= scale;
+    }
+    
+    return scale;
+}
+
+/* glmDimensions: Calculates the dimensions (width, height, depth) of
+ * a model.
+ *
+ * model   - initialized GLMmodel structure
+ * dimensions - array of 3 GLfloats (GLfloat dimensions[3])
+ */
+GLvoid
+glmDimensions(GLMmodel* model, GLfloat* dimensions)
+{
+    GLuint i;
+    GLfloat maxx, minx, maxy, miny, maxz, minz;
+    
+    assert(model);
+    assert(model->vertices);
+    assert(dimensions);
+    
+    /* get the max/mins */
+    maxx = minx = model->vertices[3 + 0];
+    maxy = miny = model->vertices[3 + 1];
+    maxz = minz = model->vertices[3 + 2];
+    for (i = 1; i <= model->numvertices; i++) {
+        if (maxx < model->vertices[3 * i + 0])
+            maxx = model->vertices[3 * i + 0];
+        if (minx > model->vertices[3 * i + 0])
+            minx = model->vertices[3 * i + 0];
+        
+        if (maxy < model->vertices[3 * i + 1])
+            maxy = model->vertices[3 * i + 1];
+        if (miny > model->vertices[3 * i + 1])
+            miny = model->vertices[3 * i + 1];
+        
+        if (maxz < model->vertices[3 * i + 2])
+            maxz = model->vertices[3 * i + 2];
+        if (minz > model->vertices[3 * i + 2])
+            minz = model->vertices[3 * i + 2];
+    }
+    
+    /* calculate model width, height, and depth */
+    dimensions[0] = glmAbs(maxx) + glmAbs(minx);
+    dimensions[1] = glmAbs(maxy) + glmAbs(miny);
+    dimensions[2] = glmAbs(maxz) + glmAbs(minz);
+}
+
+/* glmScale: Scales a model by a given amount.
+ * 
+ * model - properly initialized GLMmodel structure
+ * scale - scalefactor (0.5 = half as large, 2.0 = twice as large)
+ */
+GLvoid
+glmScale(GLMmodel* model, GLfloat scale)
+{
+    GLuint i;
+    
+    for (i = 1; i <= model->numvertices; i++) {
+        model->vertices[3 * i + 0] *= scale;
+        model->vertices[3 * i + 1] *= scale;
+        model->vertices[3 * i + 2] *= scale;
+    }
+}
+
+/* glmDropSmoothing: forget the tables of glmVertexNormalsAngle(), for
+ * when the triangles or facet normals of a model change
+ *
+ * model - initialized GLMmodel structure
+ */
+static GLvoid
+glmDropSmoothing(GLMmodel* model)
+{
+    GLMsmoothing* smoothing = model->smoothing;
+    
+    if (!smoothing)
+        return;
+    free(smoothing->smooth.first);
+    free(smoothing->smooth.triangles);
+    free(smoothing->smooth.normalbase);
+    free(smoothing->creases);
+    free(smoothing->changed);
+    free(smoothing->counts);
+    free(smoothing->shifts);
+    free(smoothing->marked);
+    free(smoothing);
+    model->smoothing = NULL;
+}
+
+/* glmReverseWinding: Reverse the polygon winding for all polygons in
+ * this model.   Default winding is counter-clockwise.  Also changes
+ * the direction of the normals.
+ * 
+ * model - properly initialized GLMmodel structure 
+ */
+GLvoid
+glmReverseWinding(GLMmodel* model)
+{
+    GLuint i, swap;
+    
+    assert(model);
+    glmDropSmoothing(model);
+    
+    for (i = 0; i < model->numtriangles; i++) {
+        swap = T(i).vindices[0];
+        T(i).vindices[0] = T(i).vindices[2];
+        T(i).vindices[2] = swap;
+        
+        if (model->numnormals) {
+            swap = T(i).nindices[0];
+            T(i).nindices[0] = T(i).nindices[2];
+            T(i).nindices[2] = swap;
+        }
+        
+        if (model->numtexcoords) {
+            swap = T(i).tindices[0];
+            T(i).tindices[0] = T(i).tindices[2];
+            T(i).tindices[2] = swap;
+        }
+    }
+    
+    /* reverse facet normals */
+    for (i = 1; i <= model->numfacetnorms; i++) {
+        model->facetnorms[3 * i + 0] = -model->facetnorms[3 * i + 0];
+        model->facetnorms[3 * i + 1] = -model->facetnorms[3 * i + 1];
+        model->facetnorms[3 * i + 2] = -model->facetnorms[3 * i + 2];
+    }
+    
+    /* reverse vertex normals */
     for (i = 1; i <= model->numnormals; i++) {
         model->normals[3 * i + 0] = -model->normals[3 * i + 0];
         model->normals[3 * i + 1] = -model->normals[3 * i + 1];
@@ -947,10 +1953,11 @@ glmFacetNormals(GLMmodel* model)
     
     assert(model);
     assert(model->vertices);
+    glmDropSmoothing(model);
     
     /* clobber any old facetnormals */
     if (model->facetnorms)
-        free(model->facetnorms);
+        glmFree(model, model->facetnorms);
     
     /* allocate memory for the new facet normals */
     model->numfacetnorms = model->numtriangles;
@@ -979,24 +1986,15 @@ glmFacetNormals(GLMmodel* model)
     }
 }
 
-/* glmVertexNormals: Generates smooth vertex normals for a model.
- * First builds a list of all the triangles each vertex is in.   Then
- * loops through each vertex in the the list averaging all the facet
- * normals of the triangles each vertex is in.   Finally, sets the
- * normal index in the triangle for the vertex to the generated smooth
- * normal.   If the dot product of a facet normal and the facet normal
- * associated with the first triangle in the list of triangles the
- * current vertex is in is greater than the cosine of the angle
- * parameter to the function, that facet normal is not added into the
- * average normal calculation and the corresponding vertex is given
- * the facet normal.  This tends to preserve hard edges.  The angle to
- * use depends on the model, but 90 degrees is usually a good start.
+/* glmVertexNormalsLegacy: Generates smooth vertex normals for a model
+ * like glmVertexNormals() with the original lists of nodes.  Kept to
+ * check and time glmVertexNormals() against.
  *
  * model - initialized GLMmodel structure
  * angle - maximum angle (in degrees) to smooth across
  */
 GLvoid
-glmVertexNormals(GLMmodel* model, GLfloat angle)
+glmVertexNormalsLegacy(GLMmodel* model, GLfloat angle)
 {
     GLMnode*    node;
     GLMnode*    tail;
@@ -1010,12 +2008,14 @@ glmVertexNormals(GLMmodel* model, GLfloat angle)
     assert(model);
     assert(model->facetnorms);
     
+    glmDropSmoothing(model);
+    
     /* calculate the cosine of the angle (in degrees) */
     cos_angle = cos(angle * M_PI / 180.0);
     
     /* nuke any previous normals */
     if (model->normals)
-        free(model->normals);
+        glmFree(model, model->normals);
     
     /* allocate space for new normals */
     model->numnormals = model->numtriangles * 3; /* 3 normals per triangle */
@@ -1073,75 +2073,542 @@ glmVertexNormals(GLMmodel* model, GLfloat angle)
             }
             node = node->next;
         }
-        
-        if (avg) {
-            /* normalize the averaged normal */
-            glmNormalize(average);
-            
-            /* add the normal to the vertex normals list */
-            model->normals[3 * numnormals + 0] = average[0];
-            model->normals[3 * numnormals + 1] = average[1];
-            model->normals[3 * numnormals + 2] = average[2];
-            avg = numnormals;
-            numnormals++;
+        
+        if (avg) {
+            /* normalize the averaged normal */
+            glmNormalize(average);
+            
+            /* add the normal to the vertex normals list */
+            model->normals[3 * numnormals + 0] = average[0];
+            model->normals[3 * numnormals + 1] = average[1];
+            model->normals[3 * numnormals + 2] = average[2];
+            avg = numnormals;
+            numnormals++;
+        }
+        
+        /* set the normal of this vertex in each triangle it is in */
+        node = members[i];
+        while (node) {
+            if (node->averaged) {
+                /* if this node was averaged, use the average normal */
+                if (T(node->index).vindices[0] == i)
+                    T(node->index).nindices[0] = avg;
+                else if (T(node->index).vindices[1] == i)
+                    T(node->index).nindices[1] = avg;
+                else if (T(node->index).vindices[2] == i)
+                    T(node->index).nindices[2] = avg;
+            } else {
+                /* if this node wasn't averaged, use the facet normal */
+                model->normals[3 * numnormals + 0] = 
+                    model->facetnorms[3 * T(node->index).findex + 0];
+                model->normals[3 * numnormals + 1] = 
+                    model->facetnorms[3 * T(node->index).findex + 1];
+                model->normals[3 * numnormals + 2] = 
+                    model->facetnorms[3 * T(node->index).findex + 2];
+                if (T(node->index).vindices[0] == i)
+                    T(node->index).nindices[0] = numnormals;
+                else if (T(node->index).vindices[1] == i)
+                    T(node->index).nindices[1] = numnormals;
+                else if (T(node->index).vindices[2] == i)
+                    T(node->index).nindices[2] = numnormals;
+                numnormals++;
+            }
+            node = node->next;
+        }
+    }
+    
+    model->numnormals = numnormals - 1;
+    
+    /* free the member information */
+    for (i = 1; i <= model->numvertices; i++) {
+        node = members[i];
+        while (node) {
+            tail = node;
+            node = node->next;
+            free(tail);
+        }
+    }
+    free(members);
+    
+    /* pack the normals array (we previously allocated the maximum
+    number of normals that could possibly be created (numtriangles *
+    3), so get rid of some of them (usually alot unless none of the
+    facet normals were averaged)) */
+    normals = model->normals;
+    model->normals = (GLfloat*)malloc(sizeof(GLfloat)* 3* (model->numnormals+1));
+    for (i = 1; i <= model->numnormals; i++) {
+        model->normals[3 * i + 0] = normals[3 * i + 0];
+        model->normals[3 * i + 1] = normals[3 * i + 1];
+        model->normals[3 * i + 2] = normals[3 * i + 2];
+    }
+    free(normals);
+}
+
+/* glmSmoothVertex: counts (pass 0) or writes (pass 1) the normals of
+ * a vertex and sets them in its triangles.  Its triangles are looked
+ * at last one first, the order the original lists had them in, so the
+ * normals come out the same.
+ *
+ * smooth - table of the model's triangles by vertex
+ * v      - the vertex
+ */
+static GLuint
+glmSmoothVertex(GLMsmooth* smooth, GLuint v)
+{
+    GLMmodel* model = smooth->model;
+    GLuint*  triangles = smooth->triangles;
+    GLfloat* reference;
+    GLfloat* facet;
+    GLfloat  average[3];
+    GLuint   first, k, n, avg, count, normal;
+    
+    first = smooth->first[v];
+    k = smooth->first[v + 1];
+    if (k == first)
+        return 0;
+    
+    reference = &model->facetnorms[3 * T(triangles[k - 1]).findex];
+    average[0] = 0.0; average[1] = 0.0; average[2] = 0.0;
+    avg = 0;
+    count = 0;
+    while (k-- > first) {
+        facet = &model->facetnorms[3 * T(triangles[k]).findex];
+        if (glmDot(facet, reference) > smooth->cos_angle) {
+            average[0] += facet[0];
+            average[1] += facet[1];
+            average[2] += facet[2];
+            avg = 1;
+        } else {
+            count++;
+        }
+    }
+    if (smooth->pass == 0)
+        return count + avg;
+    
+    n = smooth->normalbase[v];
+    if (avg) {
+        glmNormalize(average);
+        model->normals[3 * n + 0] = average[0];
+        model->normals[3 * n + 1] = average[1];
+        model->normals[3 * n + 2] = average[2];
+        avg = n;
+        n++;
+    }
+    for (k = smooth->first[v + 1]; k-- > first; ) {
+        facet = &model->facetnorms[3 * T(triangles[k]).findex];
+        normal = avg;
+        if (!(glmDot(facet, reference) > smooth->cos_angle)) {
+            /* not averaged, use the facet normal */
+            model->normals[3 * n + 0] = facet[0];
+            model->normals[3 * n + 1] = facet[1];
+            model->normals[3 * n + 2] = facet[2];
+            normal = n;
+            n++;
+        }
+        if (T(triangles[k]).vindices[0] == v)
+            T(triangles[k]).nindices[0] = normal;
+        else if (T(triangles[k]).vindices[1] == v)
+            T(triangles[k]).nindices[1] = normal;
+        else
+            T(triangles[k]).nindices[2] = normal;
+    }
+    return n - smooth->normalbase[v];
+}
+
+/* glmSmoothWorker: thread entry for a pass of glmSmoothVertex() over
+ * a part of the vertices; pass 0 leaves the number of normals of each
+ * vertex in normalbase.
+ */
+static GLvoid*
+glmSmoothWorker(GLvoid* data)
+{
+    GLMsmooth* smooth = (GLMsmooth*)data;
+    GLuint i;
+    
+    for (i = smooth->start; i < smooth->end; i++) {
+        if (smooth->pass == 0)
+            smooth->normalbase[i] = glmSmoothVertex(smooth, i);
+        else
+            glmSmoothVertex(smooth, i);
+    }
+    return NULL;
+}
+
+/* glmSmoothTable: sort the corners of a model's triangles by vertex,
+ * into a table of the triangles of each vertex in order.
+ *
+ * smooth - (return) the table, first, triangles and normalbase to be
+ *          free()'d by the caller
+ * model  - initialized GLMmodel structure
+ */
+static GLvoid
+glmSmoothTable(GLMsmooth* smooth, GLMmodel* model)
+{
+    GLuint* fill;
+    GLuint  i, j, v;
+    
+    smooth->model = model;
+    smooth->first = (GLuint*)calloc(model->numvertices + 2, sizeof(GLuint));
+    smooth->triangles = (GLuint*)malloc(sizeof(GLuint) * (3 * model->numtriangles + 1));
+    smooth->normalbase = (GLuint*)malloc(sizeof(GLuint) * (model->numvertices + 2));
+    for (i = 0; i < model->numtriangles; i++) {
+        for (j = 0; j < 3; j++) {
+            v = T(i).vindices[j];
+            if (v >= 1 && v <= model->numvertices)
+                smooth->first[v + 1]++;
+        }
+    }
+    for (v = 1; v <= model->numvertices; v++)
+        smooth->first[v + 1] += smooth->first[v];
+    fill = smooth->normalbase;
+    memcpy(fill, smooth->first, sizeof(GLuint) * (model->numvertices + 2));
+    for (i = 0; i < model->numtriangles; i++) {
+        for (j = 0; j < 3; j++) {
+            v = T(i).vindices[j];
+            if (v >= 1 && v <= model->numvertices)
+                smooth->triangles[fill[v]++] = i;
+        }
+    }
+}
+
+/* glmSmoothNormals: generate the vertex normals of the model of a
+ * table for an angle, leaving where the normals of each vertex start
+ * in normalbase (normalbase[numvertices + 1] is past the last one).
+ *
+ * smooth  - table from glmSmoothTable()
+ * angle   - maximum angle (in degrees) to smooth across
+ * threads - most threads to use
+ */
+static GLvoid
+glmSmoothNormals(GLMsmooth* smooth, GLfloat angle, GLuint threads)
+{
+    GLMsmooth parts[GLM_MAX_THREADS];
+    GLMmodel* model = smooth->model;
+    GLuint    numparts, count, i, v;
+    
+    /* calculate the cosine of the angle (in degrees) */
+    smooth->cos_angle = cos(angle * M_PI / 180.0);
+    
+    numparts = threads;
+    if (numparts > model->numvertices / GLM_SMOOTH_PART)
+        numparts = model->numvertices / GLM_SMOOTH_PART;
+    if (numparts > GLM_MAX_THREADS)
+        numparts = GLM_MAX_THREADS;
+    if (numparts < 1)
+        numparts = 1;
+    for (i = 0; i < numparts; i++) {
+        parts[i] = *smooth;
+        parts[i].start = 1 + (GLuint)((double)model->numvertices * i / numparts);
+        parts[i].end   = 1 + (GLuint)((double)model->numvertices * (i + 1) / numparts);
+        parts[i].pass  = 0;
+    }
+    glmRunThreads(parts, sizeof(GLMsmooth), numparts, glmSmoothWorker);
+    
+    /* each vertex's normals start after the ones before it */
+    count = 1;
+    for (v = 1; v <= model->numvertices; v++) {
+        if (smooth->first[v] == smooth->first[v + 1])
+            fprintf(stderr, "glmVertexNormals(): vertex w/o a triangle\n");
+        i = smooth->normalbase[v];
+        smooth->normalbase[v] = count;
+        count += i;
+    }
+    smooth->normalbase[model->numvertices + 1] = count;
+    
+    /* nuke any previous normals */
+    if (model->normals)
+        glmFree(model, model->normals);
+    model->numnormals = count - 1;
+    model->normals = (GLfloat*)malloc(sizeof(GLfloat) * 3 * (model->numnormals + 1));
+    
+    for (i = 0; i < numparts; i++)
+        parts[i].pass = 1;
+    glmRunThreads(parts, sizeof(GLMsmooth), numparts, glmSmoothWorker);
+}
+
+/* glmVertexNormals: Generates smooth vertex normals for a model.
+ * First builds a table of all the triangles each vertex is in.   Then
+ * loops through each vertex in the the list averaging all the facet
+ * normals of the triangles each vertex is in.   Finally, sets the
+ * normal index in the triangle for the vertex to the generated smooth
+ * normal.   If the dot product of a facet normal and the facet normal
+ * associated with the first triangle in the list of triangles the
+ * current vertex is in is greater than the cosine of the angle
+ * parameter to the function, that facet normal is not added into the
+ * average normal calculation and the corresponding vertex is given
+ * the facet normal.  This tends to preserve hard edges.  The angle to
+ * use depends on the model, but 90 degrees is usually a good start.
+ *
+ * model - initialized GLMmodel structure
+ * angle - maximum angle (in degrees) to smooth across
+ */
+GLvoid
+glmVertexNormals(GLMmodel* model, GLfloat angle)
+{
+    glmVertexNormalsParallel(model, angle, 1);
+}
+
+/* glmVertexNormalsParallel: Generates smooth vertex normals for a
+ * model like glmVertexNormals(), on several threads.  The lists of
+ * triangles are one table, sorted by vertex with a counting sort; the
+ * threads count the normals of their vertices, and once every vertex
+ * knows where its normals start, write them in place.
+ *
+ * model   - initialized GLMmodel structure
+ * angle   - maximum angle (in degrees) to smooth across
+ * threads - most threads to use
+ */
+GLvoid
+glmVertexNormalsParallel(GLMmodel* model, GLfloat angle, GLuint threads)
+{
+    GLMsmooth smooth;
+    
+    assert(model);
+    assert(model->facetnorms);
+    
+    glmDropSmoothing(model);
+    glmSmoothTable(&smooth, model);
+    glmSmoothNormals(&smooth, angle, threads);
+    
+    free(smooth.first);
+    free(smooth.triangles);
+    free(smooth.normalbase);
+}
+
+/* glmCreaseAbove: the first of a fan's sorted creases whose dot
+ * product is greater than a value
+ */
+static GLuint
+glmCreaseAbove(GLMcrease* creases, GLuint numcreases, GLfloat value)
+{
+    GLuint lo = 0, hi = numcreases, mid;
+    
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (creases[mid].dot > value)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return lo;
+}
+
+/* glmCreaseCompare: qsort() order of creases, smallest dot first */
+static int
+glmCreaseCompare(const void* a, const void* b)
+{
+    GLfloat x = ((GLMcrease*)a)->dot;
+    GLfloat y = ((GLMcrease*)b)->dot;
+    
+    return x < y ? -1 : x > y;
+}
+
+/* glmIndexCompare: qsort() order of indices */
+static int
+glmIndexCompare(const void* a, const void* b)
+{
+    GLuint x = *(GLuint*)a;
+    GLuint y = *(GLuint*)b;
+    
+    return x < y ? -1 : x > y;
+}
+
+/* glmNewSmoothing: generate a model's vertex normals for an angle and
+ * keep the tables glmVertexNormalsAngle() needs to redo them.
+ *
+ * model   - initialized GLMmodel structure with facet normals
+ * angle   - maximum angle (in degrees) to smooth across
+ * threads - most threads to generate the normals with
+ */
+static GLMsmoothing*
+glmNewSmoothing(GLMmodel* model, GLfloat angle, GLuint threads)
+{
+    GLMsmoothing* smoothing;
+    GLMsmooth* smooth;
+    GLMcrease* crease;
+    GLfloat*   reference;
+    GLuint     v, k;
+    
+    smoothing = (GLMsmoothing*)malloc(sizeof(GLMsmoothing));
+    smooth = &smoothing->smooth;
+    glmSmoothTable(smooth, model);
+    glmSmoothNormals(smooth, angle, threads);
+    
+    /* every corner's dot product with its fan's reference facet normal,
+       as glmSmoothVertex() works it out (a NaN one never crosses) */
+    smoothing->creases = (GLMcrease*)malloc(sizeof(GLMcrease) * (3 * model->numtriangles + 1));
+    crease = smoothing->creases;
+    for (v = 1; v <= model->numvertices; v++) {
+        if (smooth->first[v] == smooth->first[v + 1])
+            continue;
+        reference = &model->facetnorms[3 * T(smooth->triangles[smooth->first[v + 1] - 1]).findex];
+        for (k = smooth->first[v]; k < smooth->first[v + 1]; k++) {
+            crease->dot = glmDot(&model->facetnorms[3 * T(smooth->triangles[k]).findex], reference);
+            crease->vertex = v;
+            if (crease->dot == crease->dot)
+                crease++;
+        }
+    }
+    smoothing->numcreases = crease - smoothing->creases;
+    qsort(smoothing->creases, smoothing->numcreases, sizeof(GLMcrease), glmCreaseCompare);
+    
+    smoothing->changed = (GLuint*)malloc(sizeof(GLuint) * (model->numvertices + 1));
+    smoothing->counts = (GLuint*)malloc(sizeof(GLuint) * (model->numvertices + 1));
+    smoothing->shifts = (GLint*)malloc(sizeof(GLint) * (model->numvertices + 2));
+    smoothing->marked = (GLubyte*)calloc(model->numvertices + 1, sizeof(GLubyte));
+    return smoothing;
+}
+
+/* glmShiftNormals: move the normals of the vertices between the ones
+ * that changed to where they go now, and fix the normal indices of
+ * their triangles.  shifts[j] is how far the normals of the vertices
+ * before changed[j] (and after changed[j - 1]) move.
+ *
+ * smoothing - the model's tables
+ * numchanged - number of changed vertices
+ */
+static GLvoid
+glmShiftNormals(GLMsmoothing* smoothing, GLuint numchanged)
+{
+    GLMsmooth* smooth = &smoothing->smooth;
+    GLMmodel*  model = smooth->model;
+    GLuint*    base = smooth->normalbase;
+    GLuint     from, to, j, v, k, t;
+    GLint      shift;
+    
+    /* normals moving down first, from the bottom, then the ones moving
+       up from the top, so none lands on normals not moved yet */
+    for (j = 0; j <= 2 * numchanged + 1; j++) {
+        k = j <= numchanged ? j : 2 * numchanged + 1 - j;
+        shift = smoothing->shifts[k];
+        if ((j <= numchanged) != (shift < 0))
+            continue;
+        from = k ? smoothing->changed[k - 1] + 1 : 1;
+        to = k < numchanged ? smoothing->changed[k] : model->numvertices + 1;
+        if (base[to] > base[from]) {
+            memmove(&model->normals[3 * (base[from] + shift)], &model->normals[3 * base[from]],
+                sizeof(GLfloat) * 3 * (base[to] - base[from]));
         }
-        
-        /* set the normal of this vertex in each triangle it is in */
-        node = members[i];
-        while (node) {
-            if (node->averaged) {
-                /* if this node was averaged, use the average normal */
-                if (T(node->index).vindices[0] == i)
-                    T(node->index).nindices[0] = avg;
-                else if (T(node->index).vindices[1] == i)
-                    T(node->index).nindices[1] = avg;
-                else if (T(node->index).vindices[2] == i)
-                    T(node->index).nindices[2] = avg;
-            } else {
-                /* if this node wasn't averaged, use the facet normal */
-                model->normals[3 * numnormals + 0] = 
-                    model->facetnorms[3 * T(node->index).findex + 0];
-                model->normals[3 * numnormals + 1] = 
-                    model->facetnorms[3 * T(node->index).findex + 1];
-                model->normals[3 * numnormals + 2] = 
-                    model->facetnorms[3 * T(node->index).findex + 2];
-                if (T(node->index).vindices[0] == i)
-                    T(node->index).nindices[0] = numnormals;
-                else if (T(node->index).vindices[1] == i)
-                    T(node->index).nindices[1] = numnormals;
-                else if (T(node->index).vindices[2] == i)
-                    T(node->index).nindices[2] = numnormals;
-                numnormals++;
+    }
+    
+    for (j = 0; j <= numchanged; j++) {
+        shift = smoothing->shifts[j];
+        from = j ? smoothing->changed[j - 1] + 1 : 1;
+        to = j < numchanged ? smoothing->changed[j] : model->numvertices + 1;
+        if (j < numchanged)
+            base[to] += shift;
+        if (!shift)
+            continue;
+        for (v = from; v < to; v++) {
+            base[v] += shift;
+            for (k = smooth->first[v]; k < smooth->first[v + 1]; k++) {
+                t = smooth->triangles[k];
+                if (k + 1 < smooth->first[v + 1] && smooth->triangles[k + 1] == t)
+                    continue;       /* a degenerate triangle, fix it once */
+                if (T(t).vindices[0] == v)
+                    T(t).nindices[0] += shift;
+                else if (T(t).vindices[1] == v)
+                    T(t).nindices[1] += shift;
+                else
+                    T(t).nindices[2] += shift;
             }
-            node = node->next;
         }
     }
+    base[model->numvertices + 1] += smoothing->shifts[numchanged];
+}
+
+/* glmVertexNormalsAngle: Generates smooth vertex normals for a model
+ * like glmVertexNormals(), redoing only the vertices whose normals
+ * change since the last call.
+ *
+ * The first call generates all the normals and keeps a table of the
+ * triangles of every vertex with the model, along with the dot product
+ * of every corner's facet normal with the facet normal its vertex
+ * compares it with, sorted.  A new angle only changes the vertices
+ * with a dot product between the cosines of the old and new angles:
+ * their normals are redone in place, and the normals of the vertices
+ * in between move up or down if the number of normals changes.
+ *
+ * model   - initialized GLMmodel structure with facet normals
+ * angle   - maximum angle (in degrees) to smooth across
+ * threads - most threads to use the first time
+ *
+ * Returns the number of vertices whose normals were redone.
+ */
+GLuint
+glmVertexNormalsAngle(GLMmodel* model, GLfloat angle, GLuint threads)
+{
+    GLMsmoothing* smoothing;
+    GLMsmooth* smooth;
+    GLfloat    cos_angle, lo, hi;
+    GLuint*    base;
+    GLuint     numchanged, first, last, i, v, size;
+    GLint      shift, moved;
     
-    model->numnormals = numnormals - 1;
+    assert(model);
+    assert(model->facetnorms);
     
-    /* free the member information */
-    for (i = 1; i <= model->numvertices; i++) {
-        node = members[i];
-        while (node) {
-            tail = node;
-            node = node->next;
-            free(tail);
+    cos_angle = cos(angle * M_PI / 180.0);
+    smoothing = model->smoothing;
+    if (!smoothing || cos_angle != cos_angle || smoothing->smooth.cos_angle != smoothing->smooth.cos_angle) {
+        glmDropSmoothing(model);
+        model->smoothing = glmNewSmoothing(model, angle, threads);
+        return model->numvertices;
+    }
+    smooth = &smoothing->smooth;
+    base = smooth->normalbase;
+    
+    /* the vertices with a corner on the other side of the angle now */
+    lo = cos_angle < smooth->cos_angle ? cos_angle : smooth->cos_angle;
+    hi = cos_angle < smooth->cos_angle ? smooth->cos_angle : cos_angle;
+    first = glmCreaseAbove(smoothing->creases, smoothing->numcreases, lo);
+    last = glmCreaseAbove(smoothing->creases, smoothing->numcreases, hi);
+    numchanged = 0;
+    for (i = first; i < last; i++) {
+        v = smoothing->creases[i].vertex;
+        if (!smoothing->marked[v]) {
+            smoothing->marked[v] = GL_TRUE;
+            smoothing->changed[numchanged++] = v;
         }
     }
-    free(members);
+    smooth->cos_angle = cos_angle;
+    if (!numchanged)
+        return 0;
+    qsort(smoothing->changed, numchanged, sizeof(GLuint), glmIndexCompare);
     
-    /* pack the normals array (we previously allocated the maximum
-    number of normals that could possibly be created (numtriangles *
-    3), so get rid of some of them (usually alot unless none of the
-    facet normals were averaged)) */
-    normals = model->normals;
-    model->normals = (GLfloat*)malloc(sizeof(GLfloat)* 3* (model->numnormals+1));
-    for (i = 1; i <= model->numnormals; i++) {
-        model->normals[3 * i + 0] = normals[3 * i + 0];
-        model->normals[3 * i + 1] = normals[3 * i + 1];
-        model->normals[3 * i + 2] = normals[3 * i + 2];
+    /* how far the normals of the vertices before each of them move */
+    smooth->pass = 0;
+    shift = 0;
+    moved = 0;
+    for (i = 0; i < numchanged; i++) {
+        v = smoothing->changed[i];
+        smoothing->shifts[i] = shift;
+        smoothing->counts[i] = glmSmoothVertex(smooth, v);
+        shift += (GLint)smoothing->counts[i] - (GLint)(base[v + 1] - base[v]);
+        moved |= shift;
     }
-    free(normals);
+    smoothing->shifts[numchanged] = shift;
+    
+    if (moved) {
+        size = model->numnormals + 1;
+        if (shift > 0) {
+            size += shift;
+            model->normals = (GLfloat*)realloc(model->normals, sizeof(GLfloat) * 3 * size);
+        }
+        glmShiftNormals(smoothing, numchanged);
+        model->numnormals += shift;
+        if (shift < 0) {
+            size += shift;
+            model->normals = (GLfloat*)realloc(model->normals, sizeof(GLfloat) * 3 * size);
+        }
+    }
+    
+    smooth->pass = 1;
+    for (i = 0; i < numchanged; i++) {
+        glmSmoothVertex(smooth, smoothing->changed[i]);
+        smoothing->marked[smoothing->changed[i]] = GL_FALSE;
+    }
+    return numchanged;
 }
 
 
@@ -1162,7 +2629,7 @@ glmLinearTexture(GLMmodel* model)
     assert(model);
     
     if (model->texcoords)
-        free(model->texcoords);
+        glmFree(model, model->texcoords);
     model->numtexcoords = model->numvertices;
     model->texcoords=(GLfloat*)malloc(sizeof(GLfloat)*2*(model->numtexcoords+1));
     
@@ -1217,7 +2684,7 @@ glmSpheremapTexture(GLMmodel* model)
     assert(model->normals);
     
     if (model->texcoords)
-        free(model->texcoords);
+        glmFree(model, model->texcoords);
     model->numtexcoords = model->numnormals;
     model->texcoords=(GLfloat*)malloc(sizeof(GLfloat)*2*(model->numtexcoords+1));
     
@@ -1270,51 +2737,42 @@ glmDelete(GLMmodel* model)
     GLuint i;
     
     assert(model);
+    glmDropSmoothing(model);
     
     if (model->pathname)     free(model->pathname);
     if (model->mtllibname) free(model->mtllibname);
-    if (model->vertices)     free(model->vertices);
-    if (model->normals)  free(model->normals);
-    if (model->texcoords)  free(model->texcoords);
-    if (model->facetnorms) free(model->facetnorms);
-    if (model->triangles)  free(model->triangles);
+    if (model->vertices)     glmFree(model, model->vertices);
+    if (model->normals)  glmFree(model, model->normals);
+    if (model->texcoords)  glmFree(model, model->texcoords);
+    if (model->facetnorms) glmFree(model, model->facetnorms);
+    if (model->triangles)  glmFree(model, model->triangles);
     if (model->materials) {
         for (i = 0; i < model->nummaterials; i++)
-            free(model->materials[i].name);
+            glmFree(model, model->materials[i].name);
     }
     free(model->materials);
     while(model->groups) {
         group = model->groups;
         model->groups = model->groups->next;
-        free(group->name);
-        free(group->triangles);
+        glmFree(model, group->name);
+        glmFree(model, group->triangles);
         free(group);
     }
+    if (model->cache)
+        glmUnmapFile(model->cache, model->cachesize);
     
     free(model);
 }
 
-/* glmReadOBJ: Reads a model description from a Wavefront .OBJ file.
- * Returns a pointer to the created object which should be free'd with
- * glmDelete().
+/* glmNewModel: allocate an empty model read from a file
  *
- * filename - name of the file containing the Wavefront .OBJ format data.  
+ * filename - name of the file the model is read from
  */
-GLMmodel* 
-glmReadOBJ(char* filename)
+static GLMmodel*
+glmNewModel(char* filename)
 {
     GLMmodel* model;
-    FILE*   file;
     
-    /* open the file */
-    file = fopen(filename, "r");
-    if (!file) {
-        fprintf(stderr, "glmReadOBJ() failed: can't open data file \"%s\".\n",
-            filename);
-        exit(1);
-    }
-    
-    /* allocate a new model */
     model = (GLMmodel*)malloc(sizeof(GLMmodel));
     model->pathname    = strdup(filename);
     model->mtllibname    = NULL;
@@ -1335,6 +2793,78 @@ glmReadOBJ(char* filename)
     model->position[0]   = 0.0;
     model->position[1]   = 0.0;
     model->position[2]   = 0.0;
+    model->cache         = NULL;
+    model->cachesize     = 0;
+    model->smoothing     = NULL;
+    
+    return model;
+}
+
+/* glmReadOBJ: Reads a model description from a Wavefront .OBJ file.
+ * Returns a pointer to the created object which should be free'd with
+ * glmDelete().
+ *
+ * filename - name of the file containing the Wavefront .OBJ format data.  
+ */
+GLMmodel* 
+glmReadOBJ(char* filename)
+{
+    return glmReadOBJParallel(filename, 1);
+}
+
+/* glmReadOBJParallel: Reads a model like glmReadOBJ(), splitting the
+ * file into pieces that are parsed on up to threads threads.  The model
+ * is the same for any number of threads.
+ *
+ * filename - name of the file containing the Wavefront .OBJ format data.  
+ * threads  - most threads to read with
+ */
+GLMmodel* 
+glmReadOBJParallel(char* filename, GLuint threads)
+{
+    GLMmodel* model;
+    char*   data;
+    size_t  size;
+    
+    /* map the file */
+    data = glmMapFile(filename, &size);
+    if (!data) {
+        fprintf(stderr, "glmReadOBJ() failed: can't open data file \"%s\".\n",
+            filename);
+        exit(1);
+    }
+    
+    /* allocate a new model and read it */
+    model = glmNewModel(filename);
+    glmParse(model, data, size, threads);
+    
+    glmUnmapFile(data, size);
+    
+    return model;
+}
+
+/* glmReadOBJLegacy: Reads a model like glmReadOBJ() with the original
+ * reader, which reads the file twice with fscanf().  Kept to check and
+ * time glmReadOBJ() against (see bench.c).
+ *
+ * filename - name of the file containing the Wavefront .OBJ format data.  
+ */
+GLMmodel* 
+glmReadOBJLegacy(char* filename)
+{
+    GLMmodel* model;
+    FILE*   file;
+    
+    /* open the file */
+    file = fopen(filename, "r");
+    if (!file) {
+        fprintf(stderr, "glmReadOBJ() failed: can't open data file \"%s\".\n",
+            filename);
+        exit(1);
+    }
+    
+    /* allocate a new model */
+    model = glmNewModel(filename);
     
     /* make a first pass through the file to get a count of the number
     of vertices, normals, texcoords & triangles */
@@ -1349,18 +2879,405 @@ glmReadOBJ(char* filename)
         model->normals = (GLfloat*)malloc(sizeof(GLfloat) *
             3 * (model->numnormals + 1));
     }
-    if (model->numtexcoords) {
-        model->texcoords = (GLfloat*)malloc(sizeof(GLfloat) *
-            2 * (model->numtexcoords + 1));
+    if (model->numtexcoords) {
+        model->texcoords = (GLfloat*)malloc(sizeof(GLfloat) *
+            2 * (model->numtexcoords + 1));
+    }
+    
+    /* rewind to beginning of file and read in the data this pass */
+    rewind(file);
+    
+    glmSecondPass(model, file);
+    
+    /* close the file */
+    fclose(file);
+    
+    return model;
+}
+
+/* glmChecksum: checksum of the contents of a file, to tell whether a
+ * cache file was made from it (Fletcher's, over 32 bit words)
+ *
+ * data - contents of the file
+ * size - length of the contents
+ */
+static GLuint
+glmChecksum(char* data, size_t size)
+{
+    GLuint a = 0, b = 0, word;
+    size_t i;
+    
+    for (i = 0; i + 4 <= size; i += 4) {
+        memcpy(&word, data + i, 4);
+        a += word;
+        b += a;
+    }
+    for (; i < size; i++) {
+        a += (unsigned char)data[i];
+        b += a;
+    }
+    
+    return a ^ (b << 16 | b >> 16);
+}
+
+/* glmCacheName: name of the cache file of a model, the name of the
+ * model with .glmc in place of .obj
+ *
+ * filename - name of the model's OBJ file
+ *
+ * NOTE: the return value should be free'd.
+ */
+static char*
+glmCacheName(char* filename)
+{
+    char* name;
+    char* dot;
+    
+    name = (char*)malloc(strlen(filename) + strlen(GLM_CACHE_EXTENSION) + 1);
+    strcpy(name, filename);
+    dot = strrchr(name, '.');
+    if (dot && !strchr(dot, '/'))
+        *dot = '\0';
+    strcat(name, GLM_CACHE_EXTENSION);
+    
+    return name;
+}
+
+/* glmCacheString: the string at an offset of a cache file, or NULL if
+ * it doesn't end inside the file */
+static char*
+glmCacheString(char* cache, GLuint size, GLuint offset)
+{
+    if (offset >= size || !memchr(cache + offset, '\0', size - offset))
+        return NULL;
+    return cache + offset;
+}
+
+/* glmCacheArray: the array at an offset of a cache file, or NULL if it
+ * doesn't fit inside the file */
+static GLvoid*
+glmCacheArray(char* cache, GLuint size, GLuint offset, GLuint count,
+              size_t itemsize)
+{
+    if (offset == 0 || offset > size || count > (size - offset) / itemsize)
+        return NULL;
+    return cache + offset;
+}
+
+/* glmReadCache: make a model of a cache file mapped into memory, its
+ * arrays and names pointing into the mapping.  Returns NULL if the
+ * cache file isn't one of this version, or wasn't made from this OBJ
+ * file with this smoothing angle.
+ *
+ * filename - name of the model's OBJ file
+ * cache    - contents of the cache file
+ * size     - length of the cache file
+ * objsize  - length of the OBJ file
+ * objsum   - glmChecksum() of the OBJ file
+ * angle    - smoothing angle the vertex normals should have
+ * scale    - (return) what glmUnitize() returned for the model
+ */
+static GLMmodel*
+glmReadCache(char* filename, char* cache, size_t size, GLuint objsize,
+             GLuint objsum, GLfloat angle, GLfloat* scale)
+{
+    GLMcacheheader* header;
+    GLMcachematerial* materials;
+    GLMcachegroup* groups;
+    GLMmaterial* material;
+    GLMgroup* group;
+    GLMgroup** tail;
+    GLMmodel* model;
+    GLuint  i;
+    
+    header = (GLMcacheheader*)cache;
+    if (size < sizeof(GLMcacheheader) || size != header->size ||
+        header->magic != GLM_CACHE_MAGIC ||
+        header->version != GLM_CACHE_VERSION ||
+        header->headersize != sizeof(GLMcacheheader) ||
+        header->objsize != objsize || header->objsum != objsum ||
+        header->angle != angle)
+        return NULL;
+    
+    model = glmNewModel(filename);
+    model->cache = cache;
+    model->cachesize = header->size;
+    model->numvertices   = header->numvertices;
+    model->numnormals    = header->numnormals;
+    model->numtexcoords  = header->numtexcoords;
+    model->numfacetnorms = header->numfacetnorms;
+    model->numtriangles  = header->numtriangles;
+    model->vertices = (GLfloat*)glmCacheArray(cache, header->size,
+        header->vertices, 3 * (model->numvertices + 1), sizeof(GLfloat));
+    model->normals = (GLfloat*)glmCacheArray(cache, header->size,
+        header->normals, 3 * (model->numnormals + 1), sizeof(GLfloat));
+    model->texcoords = (GLfloat*)glmCacheArray(cache, header->size,
+        header->texcoords, 2 * (model->numtexcoords + 1), sizeof(GLfloat));
+    model->facetnorms = (GLfloat*)glmCacheArray(cache, header->size,
+        header->facetnorms, 3 * (model->numfacetnorms + 1), sizeof(GLfloat));
+    model->triangles = (GLMtriangle*)glmCacheArray(cache, header->size,
+        header->triangles, model->numtriangles, sizeof(GLMtriangle));
+    materials = (GLMcachematerial*)glmCacheArray(cache, header->size,
+        header->materials, header->nummaterials, sizeof(GLMcachematerial));
+    groups = (GLMcachegroup*)glmCacheArray(cache, header->size,
+        header->groups, header->numgroups, sizeof(GLMcachegroup));
+    if (!model->vertices || !model->normals || !model->facetnorms ||
+        (header->texcoords && !model->texcoords) ||
+        (header->triangles && !model->triangles) ||
+        (header->materials && !materials) || (header->groups && !groups))
+        goto broken;
+    if (header->mtllibname) {
+        if (!glmCacheString(cache, header->size, header->mtllibname))
+            goto broken;
+        model->mtllibname = strdup(cache + header->mtllibname);
+    }
+    
+    /* materials and groups are small, only their names and triangle
+       lists stay in the mapping */
+    model->materials = (GLMmaterial*)malloc(sizeof(GLMmaterial) *
+        (header->nummaterials ? header->nummaterials : 1));
+    for (i = 0; i < header->nummaterials; i++) {
+        material = &model->materials[i];
+        material->name = glmCacheString(cache, header->size, materials[i].name);
+        if (!material->name)
+            goto broken;
+        memcpy(material->diffuse, materials[i].diffuse, sizeof(GLfloat) * 4);
+        memcpy(material->ambient, materials[i].ambient, sizeof(GLfloat) * 4);
+        memcpy(material->specular, materials[i].specular, sizeof(GLfloat) * 4);
+        memcpy(material->emmissive, materials[i].emmissive, sizeof(GLfloat) * 4);
+        material->shininess = materials[i].shininess;
+        model->nummaterials++;
+    }
+    tail = &model->groups;
+    for (i = 0; i < header->numgroups; i++) {
+        group = (GLMgroup*)malloc(sizeof(GLMgroup));
+        group->name = glmCacheString(cache, header->size, groups[i].name);
+        group->numtriangles = groups[i].numtriangles;
+        group->triangles = NULL;
+        if (group->numtriangles) {
+            group->triangles = (GLuint*)glmCacheArray(cache, header->size,
+                groups[i].triangles, group->numtriangles, sizeof(GLuint));
+        }
+        group->material = groups[i].material;
+        group->next = NULL;
+        *tail = group;
+        tail = &group->next;
+        model->numgroups++;
+        if (!group->name || (group->numtriangles && !group->triangles))
+            goto broken;
+    }
+    
+    *scale = header->scale;
+    return model;
+    
+broken:
+    /* leave the mapping to the caller */
+    model->cache = NULL;
+    model->cachesize = 0;
+    model->vertices = model->normals = model->texcoords = model->facetnorms = NULL;
+    model->triangles = NULL;
+    for (i = 0; i < model->nummaterials; i++)
+        model->materials[i].name = NULL;
+    for (group = model->groups; group; group = group->next)
+        group->name = NULL, group->triangles = NULL;
+    glmDelete(model);
+    return NULL;
+}
+
+/* glmWriteCache: write a prepared model into a cache file.  Writes to
+ * a temporary file first, so a model being read never sees a cache
+ * file half written.  Returns GL_FALSE if the file can't be written.
+ *
+ * model    - initialized GLMmodel structure, with facet and vertex normals
+ * name     - name of the cache file
+ * objsize  - length of the model's OBJ file
+ * objsum   - glmChecksum() of the model's OBJ file
+ * angle    - smoothing angle of the vertex normals
+ * scale    - what glmUnitize() returned for the model
+ */
+static GLboolean
+glmWriteCache(GLMmodel* model, char* name, GLuint objsize, GLuint objsum,
+              GLfloat angle, GLfloat scale)
+{
+    GLMcacheheader header;
+    GLMcachematerial* materials;
+    GLMcachegroup* groups;
+    GLMgroup* group;
+    FILE*   file;
+    char*   data;
+    char*   tmpname;
+    GLuint  size, strings, i;
+    GLboolean written;
+    
+    memset(&header, 0, sizeof(header));
+    header.magic = GLM_CACHE_MAGIC;
+    header.version = GLM_CACHE_VERSION;
+    header.headersize = sizeof(GLMcacheheader);
+    header.objsize = objsize;
+    header.objsum = objsum;
+    header.angle = angle;
+    header.scale = scale;
+    header.numvertices   = model->numvertices;
+    header.numnormals    = model->numnormals;
+    header.numtexcoords  = model->numtexcoords;
+    header.numfacetnorms = model->numfacetnorms;
+    header.numtriangles  = model->numtriangles;
+    header.nummaterials  = model->nummaterials;
+    header.numgroups     = model->numgroups;
+    
+    /* lay the arrays out one after the other, 16 byte aligned, with the
+       names at the end */
+#define GLM_CACHE_PLACE(offset, count, itemsize) \
+    (offset) = size; size += ((count) * (itemsize) + 15) & ~15u
+    size = (sizeof(GLMcacheheader) + 15) & ~15u;
+    GLM_CACHE_PLACE(header.vertices, 3 * (model->numvertices + 1), sizeof(GLfloat));
+    GLM_CACHE_PLACE(header.normals, 3 * (model->numnormals + 1), sizeof(GLfloat));
+    if (model->texcoords) {
+        GLM_CACHE_PLACE(header.texcoords, 2 * (model->numtexcoords + 1), sizeof(GLfloat));
+    }
+    GLM_CACHE_PLACE(header.facetnorms, 3 * (model->numfacetnorms + 1), sizeof(GLfloat));
+    GLM_CACHE_PLACE(header.triangles, model->numtriangles, sizeof(GLMtriangle));
+    GLM_CACHE_PLACE(header.materials, model->nummaterials, sizeof(GLMcachematerial));
+    GLM_CACHE_PLACE(header.groups, model->numgroups, sizeof(GLMcachegroup));
+    strings = size;
+    if (model->mtllibname)
+        size += strlen(model->mtllibname) + 1;
+    for (i = 0; i < model->nummaterials; i++)
+        size += strlen(model->materials[i].name) + 1;
+    for (group = model->groups; group; group = group->next)
+        size += strlen(group->name) + 1;
+    size = (size + 15) & ~15u;
+    for (group = model->groups; group; group = group->next)
+        size += (sizeof(GLuint) * group->numtriangles + 15) & ~15u;
+    header.size = size;
+    
+    data = (char*)calloc(size, 1);
+    memcpy(data + header.vertices, model->vertices,
+        sizeof(GLfloat) * 3 * (model->numvertices + 1));
+    memcpy(data + header.normals, model->normals,
+        sizeof(GLfloat) * 3 * (model->numnormals + 1));
+    if (model->texcoords) {
+        memcpy(data + header.texcoords, model->texcoords,
+            sizeof(GLfloat) * 2 * (model->numtexcoords + 1));
+    }
+    memcpy(data + header.facetnorms, model->facetnorms,
+        sizeof(GLfloat) * 3 * (model->numfacetnorms + 1));
+    memcpy(data + header.triangles, model->triangles,
+        sizeof(GLMtriangle) * model->numtriangles);
+    
+    /* names go in first, the group triangle lists after them */
+    size = strings;
+    if (model->mtllibname) {
+        header.mtllibname = size;
+        strcpy(data + size, model->mtllibname);
+        size += strlen(model->mtllibname) + 1;
+    }
+    materials = (GLMcachematerial*)(data + header.materials);
+    for (i = 0; i < model->nummaterials; i++) {
+        materials[i].name = size;
+        strcpy(data + size, model->materials[i].name);
+        size += strlen(model->materials[i].name) + 1;
+        memcpy(materials[i].diffuse, model->materials[i].diffuse, sizeof(GLfloat) * 4);
+        memcpy(materials[i].ambient, model->materials[i].ambient, sizeof(GLfloat) * 4);
+        memcpy(materials[i].specular, model->materials[i].specular, sizeof(GLfloat) * 4);
+        memcpy(materials[i].emmissive, model->materials[i].emmissive, sizeof(GLfloat) * 4);
+        materials[i].shininess = model->materials[i].shininess;
+    }
+    groups = (GLMcachegroup*)(data + header.groups);
+    for (group = model->groups, i = 0; group; group = group->next, i++) {
+        groups[i].name = size;
+        strcpy(data + size, group->name);
+        size += strlen(group->name) + 1;
+    }
+    size = (size + 15) & ~15u;
+    for (group = model->groups, i = 0; group; group = group->next, i++) {
+        groups[i].numtriangles = group->numtriangles;
+        groups[i].material = group->material;
+        groups[i].triangles = size;
+        memcpy(data + size, group->triangles, sizeof(GLuint) * group->numtriangles);
+        size += (sizeof(GLuint) * group->numtriangles + 15) & ~15u;
+    }
+    memcpy(data, &header, sizeof(header));
+#undef GLM_CACHE_PLACE
+    
+    tmpname = (char*)malloc(strlen(name) + 5);
+    sprintf(tmpname, "%s.tmp", name);
+    written = GL_FALSE;
+    file = fopen(tmpname, "wb");
+    if (file) {
+        written = fwrite(data, 1, size, file) == size;
+        written = fclose(file) == 0 && written;
+        if (written)
+            written = rename(tmpname, name) == 0;
+        if (!written)
+            remove(tmpname);
     }
+    free(tmpname);
+    free(data);
     
-    /* rewind to beginning of file and read in the data this pass */
-    rewind(file);
+    return written;
+}
+
+/* glmReadOBJCached: Reads a model like glmReadOBJParallel() and
+ * prepares it like glmUnitize(), glmFacetNormals(),
+ * glmVertexNormals() and glmOptimizeOrder() (without overdraw) do.
+ * The prepared model is kept in a cache file next to the OBJ file
+ * (model.glmc for model.obj), which later reads map into memory
+ * instead, as long as the OBJ file and the angle are the same.  The
+ * arrays of a model read from a cache point into the mapping (writing
+ * to them doesn't change the cache file); glm frees them as usual.
+ * Only changes to the OBJ file itself make a new cache, not changes to
+ * its material library.
+ *
+ * filename - name of the file containing the Wavefront .OBJ format data.
+ * angle    - smoothing angle for glmVertexNormals()
+ * scale    - (return) the scalefactor glmUnitize() used
+ * threads  - most threads to read the OBJ file with
+ */
+GLMmodel*
+glmReadOBJCached(char* filename, GLfloat angle, GLfloat* scale,
+                 GLuint threads)
+{
+    GLMmodel* model;
+    char*   data;
+    char*   cache;
+    char*   name;
+    size_t  size, cachesize;
+    GLuint  objsum;
     
-    glmSecondPass(model, file);
+    /* map the file */
+    data = glmMapFile(filename, &size);
+    if (!data) {
+        fprintf(stderr, "glmReadOBJ() failed: can't open data file \"%s\".\n",
+            filename);
+        exit(1);
+    }
+    objsum = glmChecksum(data, size);
     
-    /* close the file */
-    fclose(file);
+    /* use the cache if it was made from this file */
+    name = glmCacheName(filename);
+    cache = glmMapFile(name, &cachesize);
+    if (cache) {
+        model = glmReadCache(filename, cache, cachesize, size, objsum,
+            angle, scale);
+        if (model) {
+            glmUnmapFile(data, size);
+            free(name);
+            return model;
+        }
+        glmUnmapFile(cache, cachesize);
+    }
+    
+    /* otherwise read and prepare the model, and cache it */
+    model = glmNewModel(filename);
+    glmParse(model, data, size, threads);
+    glmUnmapFile(data, size);
+    *scale = glmUnitize(model);
+    glmFacetNormals(model);
+    glmVertexNormalsParallel(model, angle, threads);
+    glmOptimizeOrder(model, GLM_SMOOTH | GLM_TEXTURE, GL_FALSE);
+    glmWriteCache(model, name, size, objsum, angle, *scale);
+    free(name);
     
     return model;
 }
@@ -1560,6 +3477,7 @@ glmWriteOBJ(GLMmodel* model, char* filename, GLuint mode)
     fclose(file);
 }
 
+#if !defined(GLM_NO_GL)
 /* glmDraw: Renders the model to the current OpenGL context using the
  * mode specified.
  *
@@ -1703,6 +3621,229 @@ glmList(GLMmodel* model, GLuint mode)
     
     return list;
 }
+#endif
+
+/* glmWeldCell: the grid cell of a coordinate, clamped so that
+ * neighbouring coordinates stay in neighbouring cells
+ */
+static GLint
+glmWeldCell(double x, double scale)
+{
+    double cell = floor(x * scale);
+    
+    if (!(cell > -GLM_WELD_CELLS))      /* NaN too */
+        return -GLM_WELD_CELLS;
+    if (cell > GLM_WELD_CELLS)
+        return GLM_WELD_CELLS;
+    return (GLint)cell;
+}
+
+/* glmWeldBucket: the hash bucket of a grid cell */
+static GLuint
+glmWeldBucket(GLint x, GLint y, GLint z, GLuint mask)
+{
+    return ((GLuint)x * 73856093u ^ (GLuint)y * 19349663u ^ (GLuint)z * 83492791u) & mask;
+}
+
+/* glmWeldRange: the cells every vector within epsilon of a vector is
+ * in, lo[] to hi[] inclusive
+ */
+static GLvoid
+glmWeldRange(GLMweld* weld, GLfloat* vector, GLint* lo, GLint* hi)
+{
+    GLuint i;
+    
+    for (i = 0; i < 3; i++) {
+        lo[i] = glmWeldCell(vector[i] - weld->reach, weld->scale);
+        hi[i] = glmWeldCell(vector[i] + weld->reach, weld->scale);
+    }
+}
+
+/* glmWeldWorker: thread entry for a pass of glmWeldVectors() over a
+ * part of the vectors.  Pass 0 finds the bucket of each vector; pass 1
+ * marks the vectors no earlier vector is within epsilon of, giving up
+ * on a vector after GLM_WELD_SCAN earlier vectors.
+ */
+static GLvoid*
+glmWeldWorker(GLvoid* data)
+{
+    GLMweld* weld = (GLMweld*)data;
+    GLfloat* vectors = weld->vectors;
+    GLuint   i, j, k, b, scanned;
+    GLint    lo[3], hi[3], x, y, z;
+    
+    for (i = weld->start; i < weld->end; i++) {
+        if (weld->pass == 0) {
+            weld->buckets[i] = glmWeldBucket(glmWeldCell(vectors[3 * i + 0], weld->scale),
+                                             glmWeldCell(vectors[3 * i + 1], weld->scale),
+                                             glmWeldCell(vectors[3 * i + 2], weld->scale),
+                                             weld->mask);
+            continue;
+        }
+        
+        weld->lonely[i] = GL_TRUE;
+        scanned = 0;
+        glmWeldRange(weld, &vectors[3 * i], lo, hi);
+        for (x = lo[0]; x <= hi[0]; x++) {
+            for (y = lo[1]; y <= hi[1]; y++) {
+                for (z = lo[2]; z <= hi[2]; z++) {
+                    b = glmWeldBucket(x, y, z, weld->mask);
+                    for (k = weld->first[b]; k < weld->first[b + 1]; k++) {
+                        j = weld->sorted[k];
+                        if (j >= i)
+                            break;
+                        if (++scanned > GLM_WELD_SCAN ||
+                            glmEqual(&vectors[3 * i], &vectors[3 * j], weld->epsilon)) {
+                            weld->lonely[i] = GL_FALSE;
+                            goto next;
+                        }
+                    }
+                }
+            }
+        }
+next:
+        ;
+    }
+    return NULL;
+}
+
+/* glmWeldVectors: eliminate (weld) vectors that are within an
+ * epsilon of each other, exactly like glmWeldVectorsLegacy() but
+ * looking only at the vectors in the cells of a hash grid that are
+ * within epsilon of each vector.
+ *
+ * The threads find the cells and check which vectors have no earlier
+ * vector within epsilon; a last pass in order keeps those and looks
+ * up the others among the vectors already kept.  Like the original
+ * loop, that pass also compares each vector with the original vector
+ * whose index is the next free one in the copies.  That is the vector
+ * itself until a vector is welded, so the first vector that can match
+ * anything (the first one, unless it is NaN) is counted as a duplicate
+ * of the next vector kept.
+ *
+ * vectors    - array of GLfloat[3]'s to be welded
+ * numvectors - number of GLfloat[3]'s in vectors
+ * epsilon    - maximum difference between vectors
+ * threads    - most threads to use
+ */
+GLfloat*
+glmWeldVectors(GLfloat* vectors, GLuint* numvectors, GLfloat epsilon, GLuint threads)
+{
+    GLMweld  parts[GLM_MAX_THREADS];
+    GLMweld  weld;
+    GLfloat* copies;
+    GLuint*  head;              /* first copy kept in each bucket */
+    GLuint*  tail;              /* last copy kept in each bucket */
+    GLuint*  next;              /* copy kept after it in its bucket */
+    GLuint   numbuckets, numparts, copied, i, j, k;
+    GLint    lo[3], hi[3], x, y, z;
+    
+    copies = (GLfloat*)malloc(sizeof(GLfloat) * 3 * (*numvectors + 1));
+    memcpy(copies, vectors, (sizeof(GLfloat) * 3 * (*numvectors + 1)));
+    
+    /* nothing is within a zero epsilon, not even a vector of itself */
+    if (!(epsilon > 0)) {
+        for (i = 1; i <= *numvectors; i++)
+            vectors[3 * i + 0] = (GLfloat)i;
+        return copies;
+    }
+    
+    for (numbuckets = 1; numbuckets < 2 * *numvectors; numbuckets *= 2)
+        ;
+    weld.vectors = vectors;
+    weld.epsilon = epsilon;
+    weld.scale   = 1.0 / (GLM_WELD_CELL * (double)epsilon);
+    weld.reach   = 1.001 * epsilon;     /* glmEqual() rounds the difference */
+    if (!(weld.scale > 0))
+        weld.reach = 0.0;               /* an infinite epsilon: one cell */
+    weld.mask    = numbuckets - 1;
+    weld.buckets = (GLuint*)malloc(sizeof(GLuint) * (*numvectors + 1));
+    weld.first   = (GLuint*)calloc(numbuckets + 1, sizeof(GLuint));
+    weld.sorted  = (GLuint*)malloc(sizeof(GLuint) * (*numvectors + 1));
+    weld.lonely  = (GLubyte*)malloc(sizeof(GLubyte) * (*numvectors + 1));
+    head = (GLuint*)calloc(numbuckets, sizeof(GLuint));
+    tail = (GLuint*)calloc(numbuckets, sizeof(GLuint));
+    next = (GLuint*)malloc(sizeof(GLuint) * (*numvectors + 1));
+    
+    numparts = threads;
+    if (numparts > *numvectors / GLM_WELD_PART)
+        numparts = *numvectors / GLM_WELD_PART;
+    if (numparts > GLM_MAX_THREADS)
+        numparts = GLM_MAX_THREADS;
+    if (numparts < 1)
+        numparts = 1;
+    for (i = 0; i < numparts; i++) {
+        parts[i] = weld;
+        parts[i].start = 1 + (GLuint)((double)*numvectors * i / numparts);
+        parts[i].end   = 1 + (GLuint)((double)*numvectors * (i + 1) / numparts);
+        parts[i].pass  = 0;
+    }
+    glmRunThreads(parts, sizeof(GLMweld), numparts, glmWeldWorker);
+    
+    /* sort the vectors by bucket, keeping them in order in each one */
+    for (i = 1; i <= *numvectors; i++)
+        weld.first[weld.buckets[i] + 1]++;
+    for (i = 0; i < numbuckets; i++)
+        weld.first[i + 1] += weld.first[i];
+    memcpy(head, weld.first, sizeof(GLuint) * numbuckets);
+    for (i = 1; i <= *numvectors; i++)
+        weld.sorted[head[weld.buckets[i]]++] = i;
+    memset(head, 0, sizeof(GLuint) * numbuckets);
+    
+    for (i = 0; i < numparts; i++)
+        parts[i].pass = 1;
+    glmRunThreads(parts, sizeof(GLMweld), numparts, glmWeldWorker);
+    
+    copied = 1;
+    for (i = 1; i <= *numvectors; i++) {
+        j = 0;
+        if (copied == i || !weld.lonely[i]) {
+            glmWeldRange(&weld, &vectors[3 * i], lo, hi);
+            for (x = lo[0]; x <= hi[0]; x++) {
+                for (y = lo[1]; y <= hi[1]; y++) {
+                    for (z = lo[2]; z <= hi[2]; z++) {
+                        k = head[glmWeldBucket(x, y, z, weld.mask)];
+                        for (; k && (!j || k < j); k = next[k]) {
+                            if (glmEqual(&vectors[3 * i], &copies[3 * k], epsilon)) {
+                                j = k;
+                                break;
+                            }
+                        }
+                    }
+                }
+            }
+            if (!j && glmEqual(&vectors[3 * i], &copies[3 * copied], epsilon))
+                j = copied;
+        }
+        
+        if (!j) {
+            copies[3 * copied + 0] = vectors[3 * i + 0];
+            copies[3 * copied + 1] = vectors[3 * i + 1];
+            copies[3 * copied + 2] = vectors[3 * i + 2];
+            k = weld.buckets[i];
+            next[copied] = 0;
+            if (tail[k])
+                next[tail[k]] = copied;
+            else
+                head[k] = copied;
+            tail[k] = copied;
+            j = copied;
+            copied++;
+        }
+        vectors[3 * i + 0] = (GLfloat)j;
+    }
+    
+    free(weld.buckets);
+    free(weld.first);
+    free(weld.sorted);
+    free(weld.lonely);
+    free(head);
+    free(tail);
+    free(next);
+    
+    *numvectors = copied - 1;
+    return copies;
+}
 
 /* glmWeld: eliminate (weld) vectors that are within an epsilon of
  * each other.
@@ -1714,16 +3855,31 @@ glmList(GLMmodel* model, GLuint mode)
  */
 GLvoid
 glmWeld(GLMmodel* model, GLfloat epsilon)
+{
+    glmWeldParallel(model, epsilon, 1);
+}
+
+/* glmWeldParallel: eliminate (weld) vectors that are within an
+ * epsilon of each other, like glmWeld(), on several threads.
+ *
+ * model   - initialized GLMmodel structure
+ * epsilon - maximum difference between vertices
+ * threads - most threads to use
+ */
+GLvoid
+glmWeldParallel(GLMmodel* model, GLfloat epsilon, GLuint threads)
 {
     GLfloat* vectors;
     GLfloat* copies;
     GLuint   numvectors;
     GLuint   i;
     
+    glmDropSmoothing(model);
+    
     /* vertices */
     numvectors = model->numvertices;
     vectors  = model->vertices;
-    copies = glmWeldVectors(vectors, &numvectors, epsilon);
+    copies = glmWeldVectors(vectors, &numvectors, epsilon, threads);
     
 #if 1
     printf("glmWeld(): %d redundant vertices.\n", 
@@ -1737,7 +3893,7 @@ glmWeld(GLMmodel* model, GLfloat epsilon)
     }
     
     /* free space for old vertices */
-    free(vectors);
+    glmFree(model, vectors);
     
     /* allocate space for the new vertices */
     model->numvertices = numvectors;
@@ -1754,6 +3910,631 @@ glmWeld(GLMmodel* model, GLfloat epsilon)
     free(copies);
 }
 
+/* glmIndexCorners: number the (vertex, normal, texture coordinate)
+ * triples of the triangle corners of a model in the order its groups
+ * first use them.
+ *
+ * model   - initialized GLMmodel structure
+ * mode    - what tells corners apart besides the vertex, a bitwise OR of
+ *               GLM_FLAT     -  the facet normal of the triangle
+ *               GLM_SMOOTH   -  the vertex normal of the corner
+ *               GLM_TEXTURE  -  the texture coordinate of the corner
+ *           (GLM_SMOOTH wins over GLM_FLAT)
+ * corners - (return) the number of every corner, 3 for each triangle
+ *           of each group, in group order
+ * keys    - (return) the vertex, normal and texture coordinate index
+ *           of every number (0 for what the mode leaves out), or NULL
+ *
+ * Returns how many numbers there are.
+ */
+GLuint
+glmIndexCorners(GLMmodel* model, GLuint mode, GLuint* corners, GLuint* keys)
+{
+    GLMgroup*    group;
+    GLMtriangle* triangle;
+    GLuint* slots;      /* 1 + the number in each hash slot, 0 if empty */
+    GLuint* triples;
+    GLuint  numcorners, size, mask, count, c, i, j, k, r, h, v, n, t;
+    
+    assert(model);
+    
+    numcorners = 0;
+    for (group = model->groups; group; group = group->next)
+        numcorners += 3 * group->numtriangles;
+    for (size = 1; size < 2 * numcorners; size <<= 1)
+        ;
+    mask = size - 1;
+    slots = (GLuint*)calloc(size, sizeof(GLuint));
+    triples = keys ? keys : (GLuint*)malloc(sizeof(GLuint) * 3 * (numcorners + 1));
+    
+    count = 0;
+    c = 0;
+    for (group = model->groups; group; group = group->next) {
+        for (i = 0; i < group->numtriangles; i++) {
+            triangle = &T(group->triangles[i]);
+            for (j = 0; j < 3; j++) {
+                v = triangle->vindices[j];
+                n = 0;
+                if (mode & GLM_SMOOTH) {
+                    n = triangle->nindices[j];
+                    /* glmVertexNormals() only sets the first corner of a
+                       vertex that a degenerate triangle repeats */
+                    for (r = 0; r < j; r++) {
+                        if (triangle->vindices[r] == v)
+                            n = triangle->nindices[r];
+                    }
+                } else if (mode & GLM_FLAT)
+                    n = triangle->findex;
+                t = (mode & GLM_TEXTURE) ? triangle->tindices[j] : 0;
+                
+                h = glmWeldBucket(v, n, t, mask);
+                while (slots[h]) {
+                    k = 3 * (slots[h] - 1);
+                    if (triples[k] == v && triples[k + 1] == n && triples[k + 2] == t)
+                        break;
+                    h = (h + 1) & mask;
+                }
+                if (!slots[h]) {
+                    triples[3 * count + 0] = v;
+                    triples[3 * count + 1] = n;
+                    triples[3 * count + 2] = t;
+                    slots[h] = ++count;
+                }
+                corners[c++] = slots[h] - 1;
+            }
+        }
+    }
+    
+    free(slots);
+    if (!keys)
+        free(triples);
+    return count;
+}
+
+/* glmCacheMiss: whether a FIFO cache of the last GLM_VERTEX_CACHE
+ * vertices missed misses a vertex, adding it if so
+ *
+ * inserted - 1 + the miss each vertex was last added at, 0 for never
+ * vertex   - the vertex drawn
+ * misses   - (in/out) misses so far
+ */
+static GLuint
+glmCacheMiss(GLuint* inserted, GLuint vertex, GLuint* misses)
+{
+    if (inserted[vertex] && inserted[vertex] - 1 + GLM_VERTEX_CACHE >= *misses)
+        return 0;
+    inserted[vertex] = ++*misses;
+    return 1;
+}
+
+/* glmCacheMissRatio: the average cache miss ratio (ACMR) of a model,
+ * how many vertices a post-transform cache of the last
+ * GLM_VERTEX_CACHE vertices (first in, first out, like the hardware
+ * one) transforms for every triangle when its groups are drawn in
+ * order.  3 is the worst, and about 0.5 the best a large mesh can do.
+ *
+ * model - initialized GLMmodel structure
+ * mode  - what tells vertices apart, see glmIndexCorners()
+ */
+GLfloat
+glmCacheMissRatio(GLMmodel* model, GLuint mode)
+{
+    GLMgroup* group;
+    GLuint* corners;
+    GLuint* inserted;
+    GLuint  numcorners, numnumbers, misses, c;
+    
+    assert(model);
+    
+    numcorners = 0;
+    for (group = model->groups; group; group = group->next)
+        numcorners += 3 * group->numtriangles;
+    if (!numcorners)
+        return 0.0;
+    corners = (GLuint*)malloc(sizeof(GLuint) * numcorners);
+    numnumbers = glmIndexCorners(model, mode, corners, NULL);
+    inserted = (GLuint*)calloc(numnumbers, sizeof(GLuint));
+    misses = 0;
+    for (c = 0; c < numcorners; c++)
+        glmCacheMiss(inserted, corners[c], &misses);
+    free(inserted);
+    free(corners);
+    
+    return 3.0 * misses / numcorners;
+}
+
+/* glmOrderMisses: misses of a cache that starts empty drawing the
+ * triangles of a group in an order
+ *
+ * corners      - the corner numbers of the group's triangles
+ * order        - the triangles in drawing order, NULL for as they are
+ * numtriangles - number of triangles in the group
+ * inserted     - cache of glmCacheMiss()
+ * misses       - (in/out) misses of the cache
+ */
+static GLuint
+glmOrderMisses(GLuint* corners, GLuint* order, GLuint numtriangles,
+               GLuint* inserted, GLuint* misses)
+{
+    GLuint first, i, t;
+    
+    *misses += GLM_VERTEX_CACHE;    /* everything in the cache is too old */
+    first = *misses;
+    for (i = 0; i < numtriangles; i++) {
+        t = order ? order[i] : i;
+        glmCacheMiss(inserted, corners[3 * t + 0], misses);
+        glmCacheMiss(inserted, corners[3 * t + 1], misses);
+        glmCacheMiss(inserted, corners[3 * t + 2], misses);
+    }
+    return *misses - first;
+}
+
+/* glmVertexScore: how much drawing a triangle of a vertex is worth,
+ * by Forsyth's "Linear-Speed Vertex Cache Optimisation": more the
+ * more recently the vertex was used and the fewer triangles it has
+ * left, so lone vertices get finished off
+ *
+ * position  - place of the vertex in the cache, -1 if it is not in it
+ * remaining - triangles of the vertex not drawn yet
+ */
+static GLfloat
+glmVertexScore(GLint position, GLuint remaining)
+{
+    GLfloat score = 0.0;
+    
+    if (!remaining)
+        return -1.0;
+    if (position >= 0 && position < 3)
+        score = 0.75;       /* the last triangle's, drawn again or not */
+    else if (position >= 0)
+        score = pow(1.0 - (position - 3) / (double)(GLM_VERTEX_CACHE - 3), 1.5);
+    return score + 2.0 / sqrt((double)remaining);
+}
+
+/* glmOrderGroup: order the triangles of a group for the vertex cache.
+ * Draws the best scoring triangle of the vertices in a simulated least
+ * recently used cache each time, or the first one left if none of them
+ * has triangles left.
+ *
+ * corners     - the corner numbers of the group's triangles
+ * numtriangles - number of triangles in the group
+ * local       - 0 for every corner number, left that way
+ * order       - (return) the group's triangles in drawing order
+ */
+static GLvoid
+glmOrderGroup(GLuint* corners, GLuint numtriangles, GLuint* local, GLuint* order)
+{
+    GLuint*  ids;       /* corner number of each vertex of the group */
+    GLuint*  vertex;    /* vertex of each corner */
+    GLuint*  remaining; /* triangles of each vertex not drawn yet */
+    GLuint*  start;     /* where each vertex's triangles are in adjacent */
+    GLuint*  adjacent;  /* the triangles not drawn yet first */
+    GLint*   position;  /* place of each vertex in the cache, or -1 */
+    GLfloat* vscore;
+    GLfloat* tscore;
+    GLubyte* drawn;
+    GLuint   cache[GLM_VERTEX_CACHE + 3];
+    GLuint   numvertices, numcached, numnew, cursor, i, j, k, v, t, u;
+    GLint    best;
+    GLfloat  score;
+    
+    ids = (GLuint*)malloc(sizeof(GLuint) * 3 * numtriangles);
+    vertex = (GLuint*)malloc(sizeof(GLuint) * 3 * numtriangles);
+    numvertices = 0;
+    for (k = 0; k < 3 * numtriangles; k++) {
+        if (!local[corners[k]]) {
+            ids[numvertices] = corners[k];
+            local[corners[k]] = ++numvertices;
+        }
+        vertex[k] = local[corners[k]] - 1;
+    }
+    
+    remaining = (GLuint*)calloc(numvertices, sizeof(GLuint));
+    start = (GLuint*)malloc(sizeof(GLuint) * (numvertices + 1));
+    adjacent = (GLuint*)malloc(sizeof(GLuint) * 3 * numtriangles);
+    position = (GLint*)malloc(sizeof(GLint) * numvertices);
+    vscore = (GLfloat*)malloc(sizeof(GLfloat) * numvertices);
+    tscore = (GLfloat*)malloc(sizeof(GLfloat) * numtriangles);
+    drawn = (GLubyte*)calloc(numtriangles, sizeof(GLubyte));
+    for (k = 0; k < 3 * numtriangles; k++)
+        remaining[vertex[k]]++;
+    start[0] = 0;
+    for (v = 0; v < numvertices; v++) {
+        start[v + 1] = start[v] + remaining[v];
+        position[v] = 0;
+    }
+    for (k = 0; k < 3 * numtriangles; k++) {
+        v = vertex[k];
+        adjacent[start[v] + position[v]++] = k / 3;
+    }
+    for (v = 0; v < numvertices; v++) {
+        position[v] = -1;
+        vscore[v] = glmVertexScore(-1, remaining[v]);
+    }
+    for (t = 0; t < numtriangles; t++)
+        tscore[t] = vscore[vertex[3 * t]] + vscore[vertex[3 * t + 1]] + vscore[vertex[3 * t + 2]];
+    
+    numcached = 0;
+    cursor = 0;
+    best = -1;
+    for (i = 0; i < numtriangles; i++) {
+        if (best < 0) {
+            while (drawn[cursor])
+                cursor++;
+            best = cursor;
+        }
+        t = best;
+        order[i] = t;
+        drawn[t] = GL_TRUE;
+        
+        /* the triangle's vertices go to the front of the cache, and the
+           triangle out of their lists */
+        numnew = 0;
+        for (j = 0; j < 3; j++) {
+            v = vertex[3 * t + j];
+            for (k = start[v]; adjacent[k] != t; k++)
+                ;
+            adjacent[k] = adjacent[start[v] + remaining[v] - 1];
+            remaining[v]--;
+            for (k = 0; k < numnew && cache[k] != v; k++)
+                ;
+            if (k == numnew)
+                cache[numnew++] = v;
+        }
+        j = numnew;
+        for (k = 0; k < numcached; k++) {
+            v = cache[GLM_VERTEX_CACHE + 3 - numcached + k];
+            if (v != cache[0] && (j < 2 || v != cache[1]) && (j < 3 || v != cache[2]))
+                cache[numnew++] = v;
+        }
+        
+        /* rescore the vertices that moved, the ones pushed out too */
+        for (k = 0; k < numnew; k++) {
+            v = cache[k];
+            position[v] = k < GLM_VERTEX_CACHE ? (GLint)k : -1;
+            vscore[v] = glmVertexScore(position[v], remaining[v]);
+        }
+        best = -1;
+        score = 0.0;
+        for (k = 0; k < numnew; k++) {
+            v = cache[k];
+            for (j = start[v]; j < start[v] + remaining[v]; j++) {
+                u = adjacent[j];
+                tscore[u] = vscore[vertex[3 * u]] + vscore[vertex[3 * u + 1]] + vscore[vertex[3 * u + 2]];
+                if (k < GLM_VERTEX_CACHE && tscore[u] > score) {
+                    score = tscore[u];
+                    best = u;
+                }
+            }
+        }
+        
+        /* keep the cache at the end of the array, so the next triangle's
+           vertices can go in front of it */
+        numcached = numnew < GLM_VERTEX_CACHE ? numnew : GLM_VERTEX_CACHE;
+        memmove(&cache[GLM_VERTEX_CACHE + 3 - numcached], cache, sizeof(GLuint) * numcached);
+    }
+    
+    for (v = 0; v < numvertices; v++)
+        local[ids[v]] = 0;
+    free(ids);
+    free(vertex);
+    free(remaining);
+    free(start);
+    free(adjacent);
+    free(position);
+    free(vscore);
+    free(tscore);
+    free(drawn);
+}
+
+/* glmTriangleNormal: the unnormalized normal of a triangle, whose
+ * length is twice its area, and its center.  Returns the length.
+ *
+ * model    - initialized GLMmodel structure
+ * triangle - triangle of the model
+ * n        - (return) the normal
+ * center   - (return) the center
+ */
+static GLfloat
+glmTriangleNormal(GLMmodel* model, GLMtriangle* triangle, GLfloat* n,
+                  GLfloat* center)
+{
+    GLfloat* v0 = &model->vertices[3 * triangle->vindices[0]];
+    GLfloat* v1 = &model->vertices[3 * triangle->vindices[1]];
+    GLfloat* v2 = &model->vertices[3 * triangle->vindices[2]];
+    GLfloat  u[3], v[3];
+    GLuint   k;
+    
+    for (k = 0; k < 3; k++) {
+        u[k] = v1[k] - v0[k];
+        v[k] = v2[k] - v0[k];
+        center[k] = (v0[k] + v1[k] + v2[k]) / 3.0;
+    }
+    glmCross(u, v, n);
+    return sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+}
+
+/* _GLMcluster: a run of triangles of a group the vertex cache order
+ * draws without starting over */
+typedef struct _GLMcluster {
+    GLfloat facing;         /* how much the run faces away from the center */
+    GLuint  first;          /* first triangle of the run in the order */
+    GLuint  count;
+    GLfloat area;           /* twice the area of the run */
+    GLfloat center[3];      /* area weighted sum of triangle centers */
+    GLfloat normal[3];      /* area weighted sum of triangle normals */
+} GLMcluster;
+
+/* glmClusterCompare: qsort comparator for clusters, most outward
+ * facing first, then in vertex cache order */
+static int
+glmClusterCompare(const void* a, const void* b)
+{
+    const GLMcluster* ca = (const GLMcluster*)a;
+    const GLMcluster* cb = (const GLMcluster*)b;
+    
+    if (ca->facing != cb->facing)
+        return ca->facing > cb->facing ? -1 : 1;
+    return ca->first < cb->first ? -1 : ca->first > cb->first;
+}
+
+/* glmClusterGroup: reorder a group ordered for the vertex cache to cut
+ * overdraw.  Splits the order into runs at every triangle all three of
+ * whose vertices miss the cache and draws the runs that face out from
+ * the center of the model first: from most views they are in front of
+ * the runs facing in, so those fail the depth test instead of being
+ * shaded and then covered.  Costs only the misses where runs meet.
+ *
+ * model    - initialized GLMmodel structure
+ * group    - group the order is of
+ * corners  - the corner numbers of the group's triangles
+ * order    - (in/out) the group's triangles in drawing order
+ * center   - area weighted center of the model
+ * inserted - cache of glmCacheMiss(), empty
+ * misses   - (in/out) misses of the cache
+ */
+static GLvoid
+glmClusterGroup(GLMmodel* model, GLMgroup* group, GLuint* corners,
+                GLuint* order, GLfloat* center, GLuint* inserted,
+                GLuint* misses)
+{
+    GLMcluster* clusters;
+    GLMcluster* cluster = NULL;
+    GLuint* sorted;
+    GLuint  numclusters, missed, i, j, k, t;
+    GLfloat u[3], w[3], n[3], length;
+    
+    clusters = (GLMcluster*)malloc(sizeof(GLMcluster) * group->numtriangles);
+    numclusters = 0;
+    for (i = 0; i < group->numtriangles; i++) {
+        t = order[i];
+        missed  = glmCacheMiss(inserted, corners[3 * t + 0], misses);
+        missed += glmCacheMiss(inserted, corners[3 * t + 1], misses);
+        missed += glmCacheMiss(inserted, corners[3 * t + 2], misses);
+        if (!cluster || missed == 3) {
+            cluster = &clusters[numclusters++];
+            memset(cluster, 0, sizeof(GLMcluster));
+            cluster->first = i;
+        }
+        cluster->count++;
+        
+        length = glmTriangleNormal(model, &T(group->triangles[t]), n, w);
+        cluster->area += length;
+        for (k = 0; k < 3; k++) {
+            cluster->center[k] += length * w[k];
+            cluster->normal[k] += n[k];
+        }
+    }
+    
+    for (i = 0; i < numclusters; i++) {
+        cluster = &clusters[i];
+        cluster->facing = 0.0;
+        length = glmDot(cluster->normal, cluster->normal);
+        if (cluster->area > 0.0 && length > 0.0) {
+            for (k = 0; k < 3; k++)
+                u[k] = cluster->center[k] / cluster->area - center[k];
+            cluster->facing = glmDot(u, cluster->normal) / sqrt(length);
+        }
+        if (cluster->facing != cluster->facing)     /* NaN */
+            cluster->facing = 0.0;
+    }
+    qsort(clusters, numclusters, sizeof(GLMcluster), glmClusterCompare);
+    
+    sorted = (GLuint*)malloc(sizeof(GLuint) * group->numtriangles);
+    k = 0;
+    for (i = 0; i < numclusters; i++) {
+        for (j = 0; j < clusters[i].count; j++)
+            sorted[k++] = order[clusters[i].first + j];
+    }
+    memcpy(order, sorted, sizeof(GLuint) * group->numtriangles);
+    free(sorted);
+    free(clusters);
+}
+
+/* glmCornerIndex: the vertex (0), normal (1) or texture coordinate (2)
+ * indices of a triangle */
+static GLuint*
+glmCornerIndex(GLMtriangle* triangle, GLuint which)
+{
+    if (which == 0)
+        return triangle->vindices;
+    if (which == 1)
+        return triangle->nindices;
+    return triangle->tindices;
+}
+
+/* glmRenumber: renumber the vertices, normals or texture coordinates of
+ * a model in the order its groups first use them, so drawing reads
+ * them front to back.  Unused ones go last, in their old order.
+ *
+ * model      - initialized GLMmodel structure
+ * vectors    - (in/out) the array, 1 based
+ * numvectors - number of vectors in it
+ * size       - floats a vector
+ * which      - 0 for vertices, 1 for normals, 2 for texture coordinates
+ */
+static GLvoid
+glmRenumber(GLMmodel* model, GLfloat** vectors, GLuint numvectors,
+            GLuint size, GLuint which)
+{
+    GLMgroup* group;
+    GLfloat* renumbered;
+    GLuint*  number;    /* new number of each vector, 0 until used */
+    GLuint*  indices;
+    GLuint   count, i, j;
+    
+    number = (GLuint*)calloc(numvectors + 1, sizeof(GLuint));
+    count = 0;
+    for (group = model->groups; group; group = group->next) {
+        for (i = 0; i < group->numtriangles; i++) {
+            indices = glmCornerIndex(&T(group->triangles[i]), which);
+            for (j = 0; j < 3; j++) {
+                if (indices[j] && indices[j] <= numvectors && !number[indices[j]])
+                    number[indices[j]] = ++count;
+            }
+        }
+    }
+    for (i = 1; i <= numvectors; i++) {
+        if (!number[i])
+            number[i] = ++count;
+    }
+    
+    renumbered = (GLfloat*)malloc(sizeof(GLfloat) * size * (numvectors + 1));
+    memcpy(renumbered, *vectors, sizeof(GLfloat) * size);
+    for (i = 1; i <= numvectors; i++)
+        memcpy(&renumbered[size * number[i]], &(*vectors)[size * i], sizeof(GLfloat) * size);
+    for (i = 0; i < model->numtriangles; i++) {
+        indices = glmCornerIndex(&T(i), which);
+        for (j = 0; j < 3; j++) {
+            if (indices[j] && indices[j] <= numvectors)
+                indices[j] = number[indices[j]];
+        }
+    }
+    
+    glmFree(model, *vectors);
+    *vectors = renumbered;
+    free(number);
+}
+
+/* glmOptimizeOrder: reorder the triangles of every group of a model for
+ * the post-transform vertex cache, then its triangles, vertices,
+ * normals and texture coordinates in the order drawing uses them.
+ * See glmCacheMissRatio() for how well the cache does.
+ *
+ * model    - initialized GLMmodel structure
+ * mode     - what tells vertices apart, see glmIndexCorners(); the
+ *            mode the model will be drawn with
+ * overdraw - also draw the outward facing parts of each group first,
+ *            for a few more cache misses (see glmClusterGroup())
+ */
+GLvoid
+glmOptimizeOrder(GLMmodel* model, GLuint mode, GLboolean overdraw)
+{
+    GLMgroup*    group;
+    GLMtriangle* triangles;
+    GLMtriangle* triangle;
+    GLuint*  placed;    /* 1 + the new number of each triangle */
+    GLuint*  corners;
+    GLuint*  local;
+    GLuint*  inserted;
+    GLuint*  order;
+    GLuint*  reordered;
+    GLuint   numcorners, numnumbers, misses = 0, base, count, i, k;
+    GLfloat  center[3], area, w[3], n[3], length;
+    
+    assert(model);
+    
+    glmDropSmoothing(model);
+    
+    numcorners = 0;
+    for (group = model->groups; group; group = group->next)
+        numcorners += 3 * group->numtriangles;
+    if (!numcorners)
+        return;
+    corners = (GLuint*)malloc(sizeof(GLuint) * numcorners);
+    numnumbers = glmIndexCorners(model, mode, corners, NULL);
+    local = (GLuint*)calloc(numnumbers, sizeof(GLuint));
+    inserted = (GLuint*)calloc(numnumbers, sizeof(GLuint));
+    
+    /* the area weighted center the clusters face away from */
+    if (overdraw) {
+        area = 0.0;
+        center[0] = center[1] = center[2] = 0.0;
+        for (i = 0; i < model->numtriangles; i++) {
+            length = glmTriangleNormal(model, &T(i), n, w);
+            area += length;
+            for (k = 0; k < 3; k++)
+                center[k] += length * w[k];
+        }
+        for (k = 0; k < 3; k++)
+            center[k] = area > 0.0 ? center[k] / area : 0.0;
+    }
+    
+    /* order the triangles of each group */
+    base = 0;
+    for (group = model->groups; group; group = group->next) {
+        if (group->numtriangles > 1) {
+            order = (GLuint*)malloc(sizeof(GLuint) * group->numtriangles);
+            glmOrderGroup(&corners[base], group->numtriangles, local, order);
+            
+            /* some groups come already ordered better than this, in strips */
+            if (glmOrderMisses(&corners[base], order, group->numtriangles,
+                    inserted, &misses) >=
+                glmOrderMisses(&corners[base], NULL, group->numtriangles,
+                    inserted, &misses)) {
+                for (i = 0; i < group->numtriangles; i++)
+                    order[i] = i;
+            }
+            if (overdraw) {
+                misses += GLM_VERTEX_CACHE;
+                glmClusterGroup(model, group, &corners[base], order, center,
+                    inserted, &misses);
+            }
+            reordered = (GLuint*)malloc(sizeof(GLuint) * group->numtriangles);
+            for (i = 0; i < group->numtriangles; i++)
+                reordered[i] = group->triangles[order[i]];
+            glmFree(model, group->triangles);
+            group->triangles = reordered;
+            free(order);
+        }
+        base += 3 * group->numtriangles;
+    }
+    free(inserted);
+    free(local);
+    free(corners);
+    
+    /* the triangles in the order the groups draw them, any no group
+       draws last */
+    triangles = (GLMtriangle*)malloc(sizeof(GLMtriangle) * (model->numtriangles + 1));
+    placed = (GLuint*)calloc(model->numtriangles + 1, sizeof(GLuint));
+    count = 0;
+    for (group = model->groups; group; group = group->next) {
+        for (i = 0; i < group->numtriangles; i++) {
+            k = group->triangles[i];
+            if (!placed[k]) {
+                triangles[count] = T(k);
+                placed[k] = ++count;
+            }
+            group->triangles[i] = placed[k] - 1;
+        }
+    }
+    for (i = 0; i < model->numtriangles; i++) {
+        if (!placed[i])
+            triangles[count++] = T(i);
+    }
+    free(placed);
+    triangle = model->triangles;
+    model->triangles = triangles;
+    glmFree(model, triangle);
+    
+    /* the vectors in the order the triangles use them */
+    glmRenumber(model, &model->vertices, model->numvertices, 3, 0);
+    if (model->normals)
+        glmRenumber(model, &model->normals, model->numnormals, 3, 1);
+    if (model->texcoords)
+        glmRenumber(model, &model->texcoords, model->numtexcoords, 2, 2);
+}
+
 /* glmReadPPM: read a PPM raw (type P6) file.  The PPM file has a header
  * that should look something like:
  *
@@ -1811,7 +4592,7 @@ glmReadPPM(char* filename, int* width, int* height)
         if (head[0] == '#')     /* skip comments. */
             continue;
         if (i == 0)
-            i += sscanf(head, "%d %d %d", &h, &w, &d);
+            i += sscanf(head, "%d %d %d", &w, &h, &d);
         else if (i == 1)
             i += sscanf(head, "%d %d", &w, &d);
         else if (i == 2)
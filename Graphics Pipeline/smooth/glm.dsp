@@ -82,6 +82,14 @@ LIB32=link.exe -lib
 # Name "glm - Win32 Debug"
 # Begin Source File
 
+SOURCE=.\framebuffer.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\framebuffer.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\glm.c
 # End Source File
 # Begin Source File
@@ -90,6 +98,38 @@ SOURCE=.\glm.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\lod.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\lod.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\mesh.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\mesh.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\pipeline.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\pipeline.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\texture.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\texture.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\gltb.c
 # End Source File
 # Begin Source File
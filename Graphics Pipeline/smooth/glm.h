@@ -12,7 +12,26 @@
  */
 
 
+#ifndef GLM_H
+#define GLM_H
+
+#if defined(GLM_NO_GL)
+/* built without OpenGL (define GLM_NO_GL), only the GL types glm uses;
+ * glmDraw() and glmList() are left out.
+ */
+typedef float GLfloat;
+typedef int GLint;
+typedef unsigned int GLuint;
+typedef short GLshort;
+typedef unsigned short GLushort;
+typedef unsigned char GLubyte;
+typedef unsigned char GLboolean;
+typedef void GLvoid;
+#define GL_FALSE 0
+#define GL_TRUE 1
+#else
 #include <GLUT/glut.h>
+#endif
 
 
 #ifndef M_PI
@@ -87,6 +106,11 @@ typedef struct _GLMmodel {
 
   GLfloat position[3];          /* position of the model */
 
+  char*    cache;               /* cache file the arrays are mapped from */
+  GLuint   cachesize;           /* length of the cache file */
+
+  struct _GLMsmoothing* smoothing;  /* kept by glmVertexNormalsAngle() */
+
 } GLMmodel;
 
 
@@ -135,7 +159,7 @@ GLvoid
 glmFacetNormals(GLMmodel* model);
 
 /* glmVertexNormals: Generates smooth vertex normals for a model.
- * First builds a list of all the triangles each vertex is in.  Then
+ * First builds a table of all the triangles each vertex is in.  Then
  * loops through each vertex in the the list averaging all the facet
  * normals of the triangles each vertex is in.  Finally, sets the
  * normal index in the triangle for the vertex to the generated smooth
@@ -153,6 +177,40 @@ glmFacetNormals(GLMmodel* model);
 GLvoid
 glmVertexNormals(GLMmodel* model, GLfloat angle);
 
+/* glmVertexNormalsParallel: Generates smooth vertex normals for a
+ * model like glmVertexNormals(), on several threads.
+ *
+ * model   - initialized GLMmodel structure
+ * angle   - maximum angle (in degrees) to smooth across
+ * threads - most threads to use
+ */
+GLvoid
+glmVertexNormalsParallel(GLMmodel* model, GLfloat angle, GLuint threads);
+
+/* glmVertexNormalsAngle: Generates smooth vertex normals for a model
+ * like glmVertexNormals(), redoing only the vertices whose normals
+ * change since the last call, for changing the angle interactively.
+ * The first call does all of them and keeps tables with the model
+ * (until its triangles or facet normals change) to find the vertices
+ * a new angle changes and where their normals go.
+ *
+ * model   - initialized GLMmodel structure
+ * angle   - maximum angle (in degrees) to smooth across
+ * threads - most threads to use the first time
+ *
+ * Returns the number of vertices whose normals were redone.
+ */
+GLuint
+glmVertexNormalsAngle(GLMmodel* model, GLfloat angle, GLuint threads);
+
+/* glmVertexNormalsLegacy: Generates smooth vertex normals like
+ * glmVertexNormals() with the original linked lists of triangles, a
+ * node allocated for every corner.  Kept to check and time
+ * glmVertexNormals() against (see bench.c).
+ */
+GLvoid
+glmVertexNormalsLegacy(GLMmodel* model, GLfloat angle);
+
 /* glmLinearTexture: Generates texture coordinates according to a
  * linear projection of the texture map.  It generates these by
  * linearly mapping the vertices onto a square.
@@ -192,6 +250,41 @@ glmDelete(GLMmodel* model);
 GLMmodel* 
 glmReadOBJ(char* filename);
 
+/* glmReadOBJParallel: Reads a model like glmReadOBJ(), splitting the
+ * file into pieces that are parsed on up to threads threads.  The model
+ * is the same for any number of threads.
+ *
+ * filename - name of the file containing the Wavefront .OBJ format data.  
+ * threads  - most threads to read with
+ */
+GLMmodel* 
+glmReadOBJParallel(char* filename, GLuint threads);
+
+/* glmReadOBJCached: Reads a model like glmReadOBJParallel() and
+ * prepares it like glmUnitize(), glmFacetNormals(),
+ * glmVertexNormals() and glmOptimizeOrder() (without overdraw) do.
+ * The prepared model is kept in a cache file next to the OBJ file
+ * (model.glmc for model.obj), which later reads map into memory
+ * instead, as long as the OBJ file and the angle are the same.
+ *
+ * filename - name of the file containing the Wavefront .OBJ format data.
+ * angle    - smoothing angle for glmVertexNormals()
+ * scale    - (return) the scalefactor glmUnitize() used
+ * threads  - most threads to read the OBJ file with
+ */
+GLMmodel*
+glmReadOBJCached(char* filename, GLfloat angle, GLfloat* scale,
+                 GLuint threads);
+
+/* glmReadOBJLegacy: Reads a model like glmReadOBJ() with the original
+ * reader, which reads the file twice with fscanf().  Kept to check and
+ * time glmReadOBJ() against (see bench.c).
+ *
+ * filename - name of the file containing the Wavefront .OBJ format data.  
+ */
+GLMmodel* 
+glmReadOBJLegacy(char* filename);
+
 /* glmWriteOBJ: Writes a model description in Wavefront .OBJ format to
  * a file.
  *
@@ -207,6 +300,7 @@ glmReadOBJ(char* filename);
 GLvoid
 glmWriteOBJ(GLMmodel* model, char* filename, GLuint mode);
 
+#if !defined(GLM_NO_GL)
 /* glmDraw: Renders the model to the current OpenGL context using the
  * mode specified.
  *
@@ -234,6 +328,7 @@ glmDraw(GLMmodel* model, GLuint mode);
  */
 GLuint
 glmList(GLMmodel* model, GLuint mode);
+#endif
 
 /* glmWeld: eliminate (weld) vectors that are within an epsilon of
  * each other.
@@ -246,6 +341,82 @@ glmList(GLMmodel* model, GLuint mode);
 GLvoid
 glmWeld(GLMmodel* model, GLfloat epsilon);
 
+/* glmWeldParallel: eliminate (weld) vectors that are within an epsilon
+ * of each other like glmWeld(), on several threads.
+ *
+ * model      - initialized GLMmodel structure
+ * epsilon    - maximum difference between vertices
+ * threads    - most threads to use
+ */
+GLvoid
+glmWeldParallel(GLMmodel* model, GLfloat epsilon, GLuint threads);
+
+/* glmWeldVectors: eliminate (weld) vectors that are within an epsilon
+ * of each other.  The first component of each vector is set to the
+ * index of its copy in the returned array, which holds the vectors
+ * kept from index 1 and should be free()'d by the caller.
+ *
+ * vectors    - array of GLfloat[3]'s to be welded, from index 1
+ * numvectors - number of GLfloat[3]'s in vectors, (return) number kept
+ * epsilon    - maximum difference between vectors
+ * threads    - most threads to use
+ */
+GLfloat*
+glmWeldVectors(GLfloat* vectors, GLuint* numvectors, GLfloat epsilon,
+               GLuint threads);
+
+/* glmWeldVectorsLegacy: welds vectors like glmWeldVectors() with the
+ * original loop, which compares every vector with every vector kept
+ * before it.  Kept to check and time glmWeldVectors() against (see
+ * bench.c).
+ */
+GLfloat*
+glmWeldVectorsLegacy(GLfloat* vectors, GLuint* numvectors, GLfloat epsilon);
+
+/* glmIndexCorners: number the (vertex, normal, texture coordinate)
+ * triples of the triangle corners of a model in the order its groups
+ * first use them.  Returns how many numbers there are.
+ *
+ * model   - initialized GLMmodel structure
+ * mode    - what tells corners apart besides the vertex, a bitwise OR of
+ *               GLM_FLAT     -  the facet normal of the triangle
+ *               GLM_SMOOTH   -  the vertex normal of the corner
+ *               GLM_TEXTURE  -  the texture coordinate of the corner
+ *           (GLM_SMOOTH wins over GLM_FLAT)
+ * corners - (return) the number of every corner, 3 for each triangle
+ *           of each group, in group order
+ * keys    - (return) the vertex, normal and texture coordinate index
+ *           of every number (0 for what the mode leaves out), or NULL
+ */
+GLuint
+glmIndexCorners(GLMmodel* model, GLuint mode, GLuint* corners, GLuint* keys);
+
+/* glmCacheMissRatio: the average cache miss ratio (ACMR) of a model,
+ * how many vertices a first in, first out post-transform cache of 32
+ * vertices transforms for every triangle when the groups are drawn in
+ * order.  3 is the worst, and about 0.5 the best a large mesh can do.
+ *
+ * model - initialized GLMmodel structure
+ * mode  - what tells vertices apart, see glmIndexCorners()
+ */
+GLfloat
+glmCacheMissRatio(GLMmodel* model, GLuint mode);
+
+/* glmOptimizeOrder: reorder the triangles of every group of a model for
+ * the post-transform vertex cache (Forsyth's linear-speed vertex cache
+ * optimisation), then number its triangles, vertices, normals and
+ * texture coordinates in the order drawing uses them.  glmWriteOBJ()
+ * and the cache of glmReadOBJCached() keep the order.
+ *
+ * model    - initialized GLMmodel structure
+ * mode     - what tells vertices apart, see glmIndexCorners(); the
+ *            mode the model will be drawn with
+ * overdraw - also draw the outward facing parts of each group first,
+ *            so fewer hidden pixels get shaded, for a few more misses
+ */
+GLvoid
+glmOptimizeOrder(GLMmodel* model, GLuint mode, GLboolean overdraw);
+
 /* glmReadPPM: read a PPM raw (type P6) file.  The PPM file has a header
  * that should look something like:
  *
@@ -276,3 +447,5 @@ glmWeld(GLMmodel* model, GLfloat epsilon);
  */
 GLubyte* 
 glmReadPPM(char* filename, int* width, int* height);
+
+#endif /* GLM_H */
@@ -0,0 +1,935 @@
+/*
+ *  lod.c
+ *
+ *  Levels of detail of glm models.  See lod.h for how the edges to
+ *  collapse are picked.
+ */
+
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lod.h"
+
+
+#define LOD_EDGE_WEIGHT 100.0   /* of the planes that keep an edge */
+#define LOD_FLIP_DOT    0.2     /* least cosine a collapse may turn a
+                                   triangle's normal by */
+
+#define lodMin(a, b) ((a) < (b) ? (a) : (b))
+#define lodMax(a, b) ((a) > (b) ? (a) : (b))
+
+
+/* lodQuadric: a symmetric 4x4 matrix, its upper triangle row by row */
+typedef double lodQuadric[10];
+
+/* lodEdge: an edge to collapse, v[1] into v[0] at target */
+typedef struct _lodEdge {
+    double cost;            /* the error of target against both quadrics,
+                               and vanish */
+    double vanish;          /* weighted lodVanish() when costed */
+    double target[3];
+    GLuint v[2];
+    GLuint stamps[2];       /* the vertices' stamps it was costed with */
+} lodEdge;
+
+/* lodKey: a triangle's edge, to find the triangles that share it */
+typedef struct _lodKey {
+    GLuint lo, hi;          /* vertices, lo < hi */
+    GLuint triangle;
+} lodKey;
+
+/* lodState: a model being simplified */
+typedef struct _lodState {
+    GLMmodel* model;
+    GLuint    numvertices;
+    GLuint    numtriangles;
+    GLuint    live;         /* triangles not collapsed away yet */
+    double    error;        /* largest error of a collapse so far */
+
+    double*     positions;  /* 3 per vertex, 1 based like the model */
+    lodQuadric* quadrics;
+    lodQuadric* planes;     /* the same planes unweighted, to tell the
+                               distance a collapse moves the surface */
+    GLuint*     stamps;     /* change whenever the vertex does */
+    GLuint*     marks;      /* vertices seen, stamped with mark */
+    GLuint      mark;
+
+    GLuint*  corners;       /* 3 vertices per triangle */
+    GLuint*  groups;        /* group number of each triangle */
+    GLubyte* removed;       /* triangle collapsed away */
+
+    GLuint*  first;         /* the triangles of each vertex, in pool */
+    GLuint*  count;
+    GLuint*  pool;
+    GLuint   poolsize, poolcapacity;
+
+    lodEdge* heap;          /* cheapest edge first */
+    GLuint   heapsize, heapcapacity;
+} lodState;
+
+
+/* lodGrow: make room for at least count elements in an array, doubling
+ * its capacity as needed, like glmGrow() */
+static GLvoid*
+lodGrow(GLvoid* array, GLuint* capacity, GLuint count, size_t size)
+{
+    if (count <= *capacity)
+        return array;
+    while (*capacity < count)
+        *capacity = *capacity ? *capacity * 2 : 64;
+    return realloc(array, size * *capacity);
+}
+
+/* lodPlane: adds a plane ax + by + cz + d = 0 to a quadric, weighted */
+static void
+lodPlane(double* q, double a, double b, double c, double d, double weight)
+{
+    q[0] += weight * a * a;
+    q[1] += weight * a * b;
+    q[2] += weight * a * c;
+    q[3] += weight * a * d;
+    q[4] += weight * b * b;
+    q[5] += weight * b * c;
+    q[6] += weight * b * d;
+    q[7] += weight * c * c;
+    q[8] += weight * c * d;
+    q[9] += weight * d * d;
+}
+
+/* lodError: the error of a point against a quadric, the weighted sum of
+ * its squared distances to the quadric's planes */
+static double
+lodError(double* q, double* p)
+{
+    double x = p[0], y = p[1], z = p[2];
+
+    return q[0] * x * x + 2.0 * q[1] * x * y + 2.0 * q[2] * x * z +
+        2.0 * q[3] * x + q[4] * y * y + 2.0 * q[5] * y * z +
+        2.0 * q[6] * y + q[7] * z * z + 2.0 * q[8] * z + q[9];
+}
+
+/* lodOptimal: the point of least error against a quadric, where its
+ * gradient is 0.  Returns 0 if the quadric has no single one (its planes
+ * are all parallel to some line). */
+static GLuint
+lodOptimal(double* q, double* p)
+{
+    double a = q[0], b = q[1], c = q[2], e = q[4], f = q[5], h = q[7];
+    double m00, m01, m02, m11, m12, m22, det, scale;
+
+    /* the adjugate of the symmetric 3x3 part */
+    m00 = e * h - f * f;
+    m01 = c * f - b * h;
+    m02 = b * f - c * e;
+    m11 = a * h - c * c;
+    m12 = b * c - a * f;
+    m22 = a * e - b * b;
+    det = a * m00 + b * m01 + c * m02;
+    scale = a + e + h;
+    if (fabs(det) <= 1e-9 * scale * scale * scale)
+        return 0;
+
+    p[0] = -(m00 * q[3] + m01 * q[6] + m02 * q[8]) / det;
+    p[1] = -(m01 * q[3] + m11 * q[6] + m12 * q[8]) / det;
+    p[2] = -(m02 * q[3] + m12 * q[6] + m22 * q[8]) / det;
+    return 1;
+}
+
+/* lodNormal: the unnormalized normal of a triangle of three points */
+static void
+lodNormal(double* a, double* b, double* c, double* n)
+{
+    double u[3], v[3];
+
+    u[0] = b[0] - a[0];
+    u[1] = b[1] - a[1];
+    u[2] = b[2] - a[2];
+    v[0] = c[0] - a[0];
+    v[1] = c[1] - a[1];
+    v[2] = c[2] - a[2];
+    n[0] = u[1] * v[2] - u[2] * v[1];
+    n[1] = u[2] * v[0] - u[0] * v[2];
+    n[2] = u[0] * v[1] - u[1] * v[0];
+}
+
+/* lodUnit: normalizes a vector, returns its length */
+static double
+lodUnit(double* n)
+{
+    double l = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+    if (l > 0.0) {
+        n[0] /= l;
+        n[1] /= l;
+        n[2] /= l;
+    }
+    return l;
+}
+
+/* lodFacet: the unit normal of a triangle of the state */
+static double
+lodFacet(lodState* s, GLuint t, double* n)
+{
+    GLuint* c = &s->corners[3 * t];
+
+    lodNormal(&s->positions[3 * c[0]], &s->positions[3 * c[1]],
+              &s->positions[3 * c[2]], n);
+    return lodUnit(n);
+}
+
+/* lodKeyCompare: orders edges by their vertices, then triangle */
+static int
+lodKeyCompare(const void* a, const void* b)
+{
+    const lodKey* x = (const lodKey*)a;
+    const lodKey* y = (const lodKey*)b;
+
+    if (x->lo != y->lo)
+        return x->lo < y->lo ? -1 : 1;
+    if (x->hi != y->hi)
+        return x->hi < y->hi ? -1 : 1;
+    if (x->triangle != y->triangle)
+        return x->triangle < y->triangle ? -1 : 1;
+    return 0;
+}
+
+/* lodKeep: adds the plane through an edge of a triangle, at right
+ * angles to the triangle, to the quadrics of the edge's vertices */
+static void
+lodKeep(lodState* s, GLuint a, GLuint b, GLuint t)
+{
+    double  n[3], e[3], m[3], d;
+    double* pa = &s->positions[3 * a];
+    double* pb = &s->positions[3 * b];
+
+    if (lodFacet(s, t, n) == 0.0)
+        return;
+    e[0] = pb[0] - pa[0];
+    e[1] = pb[1] - pa[1];
+    e[2] = pb[2] - pa[2];
+    m[0] = e[1] * n[2] - e[2] * n[1];
+    m[1] = e[2] * n[0] - e[0] * n[2];
+    m[2] = e[0] * n[1] - e[1] * n[0];
+    if (lodUnit(m) == 0.0)
+        return;
+    d = -(m[0] * pa[0] + m[1] * pa[1] + m[2] * pa[2]);
+    lodPlane(s->quadrics[a], m[0], m[1], m[2], d, LOD_EDGE_WEIGHT);
+    lodPlane(s->quadrics[b], m[0], m[1], m[2], d, LOD_EDGE_WEIGHT);
+    lodPlane(s->planes[a], m[0], m[1], m[2], d, 1.0);
+    lodPlane(s->planes[b], m[0], m[1], m[2], d, 1.0);
+}
+
+/* lodPush: adds an edge to the heap */
+static void
+lodPush(lodState* s, lodEdge* edge)
+{
+    GLuint i, parent;
+
+    s->heap = (lodEdge*)lodGrow(s->heap, &s->heapcapacity, s->heapsize + 1,
+                                sizeof(lodEdge));
+    i = s->heapsize++;
+    while (i > 0) {
+        parent = (i - 1) / 2;
+        if (s->heap[parent].cost <= edge->cost)
+            break;
+        s->heap[i] = s->heap[parent];
+        i = parent;
+    }
+    s->heap[i] = *edge;
+}
+
+/* lodPop: takes the cheapest edge off the heap */
+static void
+lodPop(lodState* s, lodEdge* edge)
+{
+    lodEdge last;
+    GLuint  i, child;
+
+    *edge = s->heap[0];
+    last = s->heap[--s->heapsize];
+    i = 0;
+    for (;;) {
+        child = 2 * i + 1;
+        if (child >= s->heapsize)
+            break;
+        if (child + 1 < s->heapsize &&
+            s->heap[child + 1].cost < s->heap[child].cost)
+            child++;
+        if (last.cost <= s->heap[child].cost)
+            break;
+        s->heap[i] = s->heap[child];
+        i = child;
+    }
+    if (s->heapsize)
+        s->heap[i] = last;
+}
+
+/* lodHas: whether a triangle has a vertex */
+static GLuint
+lodHas(lodState* s, GLuint t, GLuint v)
+{
+    GLuint* c = &s->corners[3 * t];
+
+    return c[0] == v || c[1] == v || c[2] == v;
+}
+
+/* lodVanish: the square of how far a collapse moves the surface that
+ * the planes do not see: when the third vertex of a triangle on the
+ * edge has no other triangles, the triangle was a piece of the model on
+ * its own and leaves a hole as large as its corners are far from the
+ * target.  0 otherwise. */
+static double
+lodVanish(lodState* s, GLuint a, GLuint b, double* target)
+{
+    GLuint  i, j, k, t, u, c;
+    double  d, largest = 0.0;
+
+    for (i = 0; i < s->count[a]; i++) {
+        t = s->pool[s->first[a] + i];
+        if (s->removed[t] || !lodHas(s, t, b))
+            continue;
+        c = 0;
+        for (k = 0; k < 3; k++)
+            if (s->corners[3 * t + k] != a && s->corners[3 * t + k] != b)
+                c = s->corners[3 * t + k];
+        for (j = 0; j < s->count[c]; j++) {
+            u = s->pool[s->first[c] + j];
+            if (!s->removed[u] && !(lodHas(s, u, a) && lodHas(s, u, b)))
+                break;
+        }
+        if (j < s->count[c])
+            continue;
+        for (j = 0; j < 3; j++) {
+            c = s->corners[3 * t + j];
+            d = 0.0;
+            for (k = 0; k < 3; k++)
+                d += (s->positions[3 * c + k] - target[k]) *
+                    (s->positions[3 * c + k] - target[k]);
+            largest = lodMax(largest, d);
+        }
+    }
+    return largest;
+}
+
+/* lodCost: costs collapsing an edge and adds it to the heap.  The
+ * target is the point of least error if there is one, or else the
+ * better of the ends and the middle. */
+static void
+lodCost(lodState* s, GLuint a, GLuint b)
+{
+    lodQuadric q;
+    lodEdge    edge;
+    double     p[3], cost;
+    double*    pa = &s->positions[3 * a];
+    double*    pb = &s->positions[3 * b];
+    GLuint     k;
+
+    for (k = 0; k < 10; k++)
+        q[k] = s->quadrics[a][k] + s->quadrics[b][k];
+
+    edge.v[0] = a;
+    edge.v[1] = b;
+    edge.stamps[0] = s->stamps[a];
+    edge.stamps[1] = s->stamps[b];
+    if (lodOptimal(q, edge.target)) {
+        edge.cost = lodError(q, edge.target);
+    } else {
+        for (k = 0; k < 3; k++)
+            edge.target[k] = pa[k];
+        edge.cost = lodError(q, pa);
+        cost = lodError(q, pb);
+        if (cost < edge.cost) {
+            edge.cost = cost;
+            for (k = 0; k < 3; k++)
+                edge.target[k] = pb[k];
+        }
+        for (k = 0; k < 3; k++)
+            p[k] = (pa[k] + pb[k]) / 2.0;
+        cost = lodError(q, p);
+        if (cost < edge.cost) {
+            edge.cost = cost;
+            for (k = 0; k < 3; k++)
+                edge.target[k] = p[k];
+        }
+    }
+    if (edge.cost < 0.0)
+        edge.cost = 0.0;    /* rounding */
+    edge.vanish = LOD_EDGE_WEIGHT * lodVanish(s, a, b, edge.target);
+    edge.cost += edge.vanish;
+    lodPush(s, &edge);
+}
+
+/* lodLink: whether collapsing an edge keeps the surface a surface, that
+ * the vertices next to both ends are just the ones of the triangles on
+ * the edge (the link condition) */
+static GLuint
+lodLink(lodState* s, GLuint a, GLuint b)
+{
+    GLuint i, k, t, v, shared = 0, common = 0;
+
+    s->mark += 2;
+    for (i = 0; i < s->count[a]; i++) {
+        t = s->pool[s->first[a] + i];
+        if (s->removed[t])
+            continue;
+        for (k = 0; k < 3; k++)
+            s->marks[s->corners[3 * t + k]] = s->mark;
+    }
+    for (i = 0; i < s->count[b]; i++) {
+        t = s->pool[s->first[b] + i];
+        if (s->removed[t])
+            continue;
+        if (lodHas(s, t, a))
+            shared++;
+        for (k = 0; k < 3; k++) {
+            v = s->corners[3 * t + k];
+            if (v != a && v != b && s->marks[v] == s->mark) {
+                s->marks[v] = s->mark + 1;
+                common++;
+            }
+        }
+    }
+    return shared > 0 && common == shared;
+}
+
+/* lodFlips: whether moving the triangles of a vertex (but not those on
+ * edge a, b) to a target turns any of them too far, or over */
+static GLuint
+lodFlips(lodState* s, GLuint v, GLuint a, GLuint b, double* target)
+{
+    double  before[3], after[3], lb, la;
+    double* p[3];
+    GLuint  i, k, t, c;
+
+    for (i = 0; i < s->count[v]; i++) {
+        t = s->pool[s->first[v] + i];
+        if (s->removed[t] || (lodHas(s, t, a) && lodHas(s, t, b)))
+            continue;
+        for (k = 0; k < 3; k++) {
+            c = s->corners[3 * t + k];
+            p[k] = c == v ? target : &s->positions[3 * c];
+        }
+        lodNormal(p[0], p[1], p[2], after);
+        lb = lodFacet(s, t, before);
+        la = lodUnit(after);
+        if (lb == 0.0)
+            continue;       /* was degenerate anyway */
+        if (la == 0.0 || before[0] * after[0] + before[1] * after[1] +
+            before[2] * after[2] < LOD_FLIP_DOT)
+            return 1;
+    }
+    return 0;
+}
+
+/* lodCollapse: collapses the cheapest edges until no more than a number
+ * of triangles are left, or no edge can collapse */
+static void
+lodCollapse(lodState* s, GLuint numtriangles)
+{
+    lodEdge edge;
+    double  vanish;
+    GLuint  a, b, i, k, t, v, start;
+
+    while (s->live > numtriangles && s->heapsize) {
+        lodPop(s, &edge);
+        a = edge.v[0];
+        b = edge.v[1];
+        if (edge.stamps[0] != s->stamps[a] || edge.stamps[1] != s->stamps[b])
+            continue;       /* costed before a collapse moved an end */
+        vanish = LOD_EDGE_WEIGHT * lodVanish(s, a, b, edge.target);
+        if (vanish > edge.vanish) {
+            /* a piece became loose since, cost it again */
+            edge.cost += vanish - edge.vanish;
+            edge.vanish = vanish;
+            lodPush(s, &edge);
+            continue;
+        }
+        if (!lodLink(s, a, b) ||
+            lodFlips(s, a, a, b, edge.target) ||
+            lodFlips(s, b, a, b, edge.target))
+            continue;
+
+        for (k = 0; k < 10; k++)
+            s->planes[a][k] += s->planes[b][k];
+        s->error = lodMax(s->error, lodError(s->planes[a], edge.target));
+        s->error = lodMax(s->error, lodVanish(s, a, b, edge.target));
+
+        /* the triangles on the edge go, the others of b move to a */
+        for (i = 0; i < s->count[b]; i++) {
+            t = s->pool[s->first[b] + i];
+            if (s->removed[t])
+                continue;
+            if (lodHas(s, t, a)) {
+                s->removed[t] = 1;
+                s->live--;
+            } else {
+                for (k = 0; k < 3; k++)
+                    if (s->corners[3 * t + k] == b)
+                        s->corners[3 * t + k] = a;
+            }
+        }
+        start = s->poolsize;
+        s->pool = (GLuint*)lodGrow(s->pool, &s->poolcapacity,
+                                   s->poolsize + s->count[a] + s->count[b],
+                                   sizeof(GLuint));
+        for (v = 0; v < 2; v++) {
+            for (i = 0; i < s->count[edge.v[v]]; i++) {
+                t = s->pool[s->first[edge.v[v]] + i];
+                if (!s->removed[t])
+                    s->pool[s->poolsize++] = t;
+            }
+        }
+        s->first[a] = start;
+        s->count[a] = s->poolsize - start;
+        s->count[b] = 0;
+
+        for (k = 0; k < 3; k++)
+            s->positions[3 * a + k] = edge.target[k];
+        for (k = 0; k < 10; k++)
+            s->quadrics[a][k] += s->quadrics[b][k];
+        s->stamps[a]++;
+        s->stamps[b]++;
+
+        /* cost the edges of a again */
+        s->mark += 2;
+        s->marks[a] = s->mark;
+        for (i = 0; i < s->count[a]; i++) {
+            t = s->pool[s->first[a] + i];
+            for (k = 0; k < 3; k++) {
+                v = s->corners[3 * t + k];
+                if (s->marks[v] != s->mark) {
+                    s->marks[v] = s->mark;
+                    lodCost(s, a, v);
+                }
+            }
+        }
+    }
+}
+
+/* lodStart: sets up a model for simplifying, with the quadrics of its
+ * triangles and of the edges to keep, and every edge costed */
+static void
+lodStart(lodState* s, GLMmodel* model, GLfloat angle)
+{
+    GLMgroup* group;
+    lodKey* keys;
+    double  n[3], m[3], d, crease;
+    GLuint  numkeys, g, i, j, k, t, v, a, b;
+    GLuint* c;
+
+    memset(s, 0, sizeof(lodState));
+    s->model = model;
+    s->numvertices = model->numvertices;
+    s->numtriangles = model->numtriangles;
+
+    s->positions = (double*)malloc(sizeof(double) * 3 * (s->numvertices + 1));
+    for (i = 0; i < 3 * (s->numvertices + 1); i++)
+        s->positions[i] = model->vertices[i];
+    s->quadrics = (lodQuadric*)calloc(s->numvertices + 1, sizeof(lodQuadric));
+    s->planes = (lodQuadric*)calloc(s->numvertices + 1, sizeof(lodQuadric));
+    s->stamps = (GLuint*)calloc(s->numvertices + 1, sizeof(GLuint));
+    s->marks = (GLuint*)calloc(s->numvertices + 1, sizeof(GLuint));
+    s->first = (GLuint*)calloc(s->numvertices + 1, sizeof(GLuint));
+    s->count = (GLuint*)calloc(s->numvertices + 1, sizeof(GLuint));
+
+    /* triangles outside every group are not drawn, and those with a
+       vertex twice have no area to keep */
+    s->corners = (GLuint*)malloc(sizeof(GLuint) * 3 * s->numtriangles);
+    s->groups = (GLuint*)malloc(sizeof(GLuint) * s->numtriangles);
+    s->removed = (GLubyte*)malloc(s->numtriangles);
+    memset(s->removed, 1, s->numtriangles);
+    for (t = 0; t < s->numtriangles; t++)
+        for (k = 0; k < 3; k++)
+            s->corners[3 * t + k] = model->triangles[t].vindices[k];
+    for (group = model->groups, g = 0; group; group = group->next, g++) {
+        for (i = 0; i < group->numtriangles; i++) {
+            t = group->triangles[i];
+            c = &s->corners[3 * t];
+            s->groups[t] = g;
+            s->removed[t] = c[0] == c[1] || c[1] == c[2] || c[2] == c[0];
+        }
+    }
+
+    /* the triangles of every vertex */
+    for (t = 0; t < s->numtriangles; t++) {
+        if (s->removed[t])
+            continue;
+        s->live++;
+        for (k = 0; k < 3; k++)
+            s->count[s->corners[3 * t + k]]++;
+    }
+    s->poolcapacity = 2 * 3 * s->live + 64;
+    s->pool = (GLuint*)malloc(sizeof(GLuint) * s->poolcapacity);
+    for (v = 1; v <= s->numvertices; v++) {
+        s->first[v] = s->poolsize;
+        s->poolsize += s->count[v];
+        s->count[v] = 0;
+    }
+    for (t = 0; t < s->numtriangles; t++) {
+        if (s->removed[t])
+            continue;
+        for (k = 0; k < 3; k++) {
+            v = s->corners[3 * t + k];
+            s->pool[s->first[v] + s->count[v]++] = t;
+        }
+    }
+
+    /* the planes of the triangles */
+    for (t = 0; t < s->numtriangles; t++) {
+        if (s->removed[t] || lodFacet(s, t, n) == 0.0)
+            continue;
+        c = &s->corners[3 * t];
+        d = -(n[0] * s->positions[3 * c[0] + 0] +
+              n[1] * s->positions[3 * c[0] + 1] +
+              n[2] * s->positions[3 * c[0] + 2]);
+        for (k = 0; k < 3; k++) {
+            lodPlane(s->quadrics[c[k]], n[0], n[1], n[2], d, 1.0);
+            lodPlane(s->planes[c[k]], n[0], n[1], n[2], d, 1.0);
+        }
+    }
+
+    /* every edge with the triangles on it, to find the ones to keep */
+    keys = (lodKey*)malloc(sizeof(lodKey) * (3 * s->live + 1));
+    numkeys = 0;
+    for (t = 0; t < s->numtriangles; t++) {
+        if (s->removed[t])
+            continue;
+        c = &s->corners[3 * t];
+        for (k = 0; k < 3; k++) {
+            a = c[k];
+            b = c[(k + 1) % 3];
+            keys[numkeys].lo = lodMin(a, b);
+            keys[numkeys].hi = lodMax(a, b);
+            keys[numkeys].triangle = t;
+            numkeys++;
+        }
+    }
+    qsort(keys, numkeys, sizeof(lodKey), lodKeyCompare);
+
+    crease = cos(angle * 3.14159265358979323846 / 180.0);
+    for (i = 0; i < numkeys; i = j) {
+        for (j = i + 1; j < numkeys; j++)
+            if (keys[j].lo != keys[i].lo || keys[j].hi != keys[i].hi)
+                break;
+        if (j - i == 2 &&
+            s->groups[keys[i].triangle] == s->groups[keys[i + 1].triangle]) {
+            lodFacet(s, keys[i].triangle, n);
+            lodFacet(s, keys[i + 1].triangle, m);
+            if (n[0] * m[0] + n[1] * m[1] + n[2] * m[2] >= crease)
+                continue;   /* smooth, within a group */
+        }
+        /* open, non-manifold, group boundary or crease */
+        for (k = i; k < j; k++)
+            lodKeep(s, keys[i].lo, keys[i].hi, keys[k].triangle);
+    }
+
+    /* every edge once, with all planes in */
+    for (i = 0; i < numkeys; i++)
+        if (i == 0 || keys[i].lo != keys[i - 1].lo ||
+            keys[i].hi != keys[i - 1].hi)
+            lodCost(s, keys[i].lo, keys[i].hi);
+    free(keys);
+}
+
+/* lodFinish: frees a state */
+static void
+lodFinish(lodState* s)
+{
+    free(s->positions);
+    free(s->quadrics);
+    free(s->planes);
+    free(s->stamps);
+    free(s->marks);
+    free(s->corners);
+    free(s->groups);
+    free(s->removed);
+    free(s->first);
+    free(s->count);
+    free(s->pool);
+    free(s->heap);
+}
+
+/* lodModel: a model of what is left of the state's model, its vertices
+ * numbered anew, its groups and materials copied, and its normals made
+ * with a smoothing angle */
+static GLMmodel*
+lodModel(lodState* s, GLfloat angle)
+{
+    GLMmodel* source = s->model;
+    GLMmodel* model;
+    GLMgroup* group;
+    GLMgroup* copy;
+    GLMgroup** tail;
+    GLuint* number;
+    GLuint  i, k, t, v, n;
+
+    model = (GLMmodel*)calloc(1, sizeof(GLMmodel));
+    model->pathname = strdup(source->pathname);
+    if (source->mtllibname)
+        model->mtllibname = strdup(source->mtllibname);
+    for (k = 0; k < 3; k++)
+        model->position[k] = source->position[k];
+
+    /* the vertices the live triangles use */
+    number = (GLuint*)calloc(s->numvertices + 1, sizeof(GLuint));
+    model->numvertices = 0;
+    for (t = 0; t < s->numtriangles; t++) {
+        if (s->removed[t])
+            continue;
+        for (k = 0; k < 3; k++) {
+            v = s->corners[3 * t + k];
+            if (!number[v])
+                number[v] = ++model->numvertices;
+        }
+    }
+    model->vertices = (GLfloat*)malloc(sizeof(GLfloat) *
+                                       3 * (model->numvertices + 1));
+    model->vertices[0] = model->vertices[1] = model->vertices[2] = 0.0;
+    for (v = 1; v <= s->numvertices; v++)
+        if (number[v])
+            for (k = 0; k < 3; k++)
+                model->vertices[3 * number[v] + k] =
+                    (GLfloat)s->positions[3 * v + k];
+
+    /* texture coordinates stay as they are, a moved corner keeps its */
+    if (source->numtexcoords) {
+        model->numtexcoords = source->numtexcoords;
+        model->texcoords = (GLfloat*)malloc(sizeof(GLfloat) *
+                                            2 * (model->numtexcoords + 1));
+        memcpy(model->texcoords, source->texcoords,
+               sizeof(GLfloat) * 2 * (model->numtexcoords + 1));
+    }
+
+    model->numtriangles = s->live;
+    model->triangles = (GLMtriangle*)malloc(sizeof(GLMtriangle) *
+                                            (s->live ? s->live : 1));
+    n = 0;
+    tail = &model->groups;
+    for (group = source->groups; group; group = group->next) {
+        copy = (GLMgroup*)malloc(sizeof(GLMgroup));
+        copy->name = strdup(group->name);
+        copy->material = group->material;
+        copy->numtriangles = 0;
+        copy->triangles = (GLuint*)malloc(sizeof(GLuint) *
+            (group->numtriangles ? group->numtriangles : 1));
+        copy->next = NULL;
+        for (i = 0; i < group->numtriangles; i++) {
+            t = group->triangles[i];
+            if (s->removed[t])
+                continue;
+            for (k = 0; k < 3; k++) {
+                model->triangles[n].vindices[k] =
+                    number[s->corners[3 * t + k]];
+                model->triangles[n].nindices[k] = 0;
+                model->triangles[n].tindices[k] =
+                    source->numtexcoords ? source->triangles[t].tindices[k] : 0;
+            }
+            model->triangles[n].findex = 0;
+            copy->triangles[copy->numtriangles++] = n++;
+        }
+        *tail = copy;
+        tail = &copy->next;
+        model->numgroups++;
+    }
+    assert(n == s->live);
+    free(number);
+
+    model->nummaterials = source->nummaterials;
+    if (source->nummaterials) {
+        model->materials = (GLMmaterial*)malloc(sizeof(GLMmaterial) *
+                                                source->nummaterials);
+        memcpy(model->materials, source->materials,
+               sizeof(GLMmaterial) * source->nummaterials);
+        for (i = 0; i < source->nummaterials; i++)
+            model->materials[i].name = strdup(source->materials[i].name);
+    }
+
+    glmFacetNormals(model);
+    glmVertexNormals(model, angle);
+    glmOptimizeOrder(model, GLM_SMOOTH | GLM_TEXTURE, GL_FALSE);
+    return model;
+}
+
+/* lodSimplify: returns a simplified copy of a model.
+ *
+ * model        - initialized GLMmodel structure
+ * numtriangles - most triangles of the copy
+ * angle        - smoothing angle of the model's vertex normals
+ * error        - (return) about how far the copy strays from the model
+ */
+GLMmodel*
+lodSimplify(GLMmodel* model, GLuint numtriangles, GLfloat angle,
+            GLfloat* error)
+{
+    GLMmodel* simple;
+    lodState  s;
+
+    assert(model);
+    assert(model->vertices);
+
+    lodStart(&s, model, angle);
+    lodCollapse(&s, numtriangles);
+    simple = lodModel(&s, angle);
+    if (error)
+        *error = (GLfloat)sqrt(s.error);
+    lodFinish(&s);
+    return simple;
+}
+
+/* lodBuild: simplifies a model into levels of detail.
+ *
+ * model - initialized GLMmodel structure
+ * angle - smoothing angle of the model's vertex normals
+ * mode  - what the meshes carry, see meshCompile()
+ */
+struct lod*
+lodBuild(GLMmodel* model, GLfloat angle, GLuint mode)
+{
+    struct lod* lod;
+    lodState s;
+    GLfloat  lo[3], hi[3], d;
+    GLuint   i, k, target, before;
+
+    assert(model);
+    assert(model->vertices);
+
+    lod = (struct lod*)calloc(1, sizeof(struct lod));
+    lod->numlevels = 1;
+    lod->models[0] = model;
+    lod->meshes[0] = meshCompile(model, mode);
+    lod->errors[0] = 0.0;
+
+    /* the bounding sphere, around the middle of the bounding box */
+    for (k = 0; k < 3; k++)
+        lo[k] = hi[k] = model->numvertices ? model->vertices[3 + k] : 0.0;
+    for (i = 2; i <= model->numvertices; i++) {
+        for (k = 0; k < 3; k++) {
+            lo[k] = lodMin(lo[k], model->vertices[3 * i + k]);
+            hi[k] = lodMax(hi[k], model->vertices[3 * i + k]);
+        }
+    }
+    for (k = 0; k < 3; k++)
+        lod->center[k] = (lo[k] + hi[k]) / 2.0;
+    lod->radius = 0.0;
+    for (i = 1; i <= model->numvertices; i++) {
+        d = 0.0;
+        for (k = 0; k < 3; k++)
+            d += (model->vertices[3 * i + k] - lod->center[k]) *
+                (model->vertices[3 * i + k] - lod->center[k]);
+        lod->radius = lodMax(lod->radius, d);
+    }
+    lod->radius = sqrt(lod->radius);
+
+    /* one run of collapses, a level kept whenever half the triangles of
+       the level before are gone */
+    lodStart(&s, model, angle);
+    while (lod->numlevels < LOD_MAX_LEVELS) {
+        before = s.live;
+        target = before / 2;
+        if (target < LOD_MIN_TRIANGLES)
+            break;
+        lodCollapse(&s, target);
+        if (s.live > before - before / 4)
+            break;          /* stuck, nothing more can collapse */
+        lod->models[lod->numlevels] = lodModel(&s, angle);
+        lod->meshes[lod->numlevels] =
+            meshCompile(lod->models[lod->numlevels], mode);
+        lod->errors[lod->numlevels] = (GLfloat)sqrt(s.error);
+        lod->numlevels++;
+    }
+    lodFinish(&s);
+
+    return lod;
+}
+
+/* lodNormals: redoes the vertex normals of every level for a new
+ * smoothing angle and recompiles the meshes of the levels they changed.
+ *
+ * lod     - levels from lodBuild()
+ * angle   - new smoothing angle
+ * mode    - what the meshes carry, as for lodBuild()
+ * threads - most threads glmVertexNormalsAngle() may use
+ */
+GLuint
+lodNormals(struct lod* lod, GLfloat angle, GLuint mode, GLuint threads)
+{
+    GLuint i, redone, total = 0;
+
+    assert(lod);
+    for (i = 0; i < lod->numlevels; i++) {
+        redone = glmVertexNormalsAngle(lod->models[i], angle, threads);
+        if (!redone)
+            continue;
+        meshDelete(lod->meshes[i]);
+        lod->meshes[i] = meshCompile(lod->models[i], mode);
+        total += redone;
+    }
+    return total;
+}
+
+/* lodDelete: deletes the levels of a model.
+ *
+ * lod - levels from lodBuild()
+ */
+void
+lodDelete(struct lod* lod)
+{
+    GLuint i;
+
+    assert(lod);
+    for (i = 0; i < lod->numlevels; i++) {
+        meshDelete(lod->meshes[i]);
+        if (i > 0)
+            glmDelete(lod->models[i]);
+    }
+    free(lod);
+}
+
+/* lodPick: the coarsest level whose error is at most some pixels on the
+ * screen where the model comes closest to the camera.
+ *
+ * lod        - levels from lodBuild()
+ * modelview  - column major modelview matrix
+ * projection - column major projection matrix
+ * viewport   - x, y, width, height of the viewport in pixels
+ * pixels     - largest error
+ */
+GLuint
+lodPick(struct lod* lod, double* modelview, double* projection,
+        int* viewport, double pixels)
+{
+    double center[3], scale, column, depth, perunit;
+    GLuint i, k, level;
+
+    assert(lod);
+
+    /* the center in eye coordinates, and the most the modelview scales */
+    scale = 0.0;
+    for (k = 0; k < 3; k++) {
+        center[k] = modelview[k] * lod->center[0] +
+            modelview[4 + k] * lod->center[1] +
+            modelview[8 + k] * lod->center[2] + modelview[12 + k];
+        column = modelview[4 * k + 0] * modelview[4 * k + 0] +
+            modelview[4 * k + 1] * modelview[4 * k + 1] +
+            modelview[4 * k + 2] * modelview[4 * k + 2];
+        scale = lodMax(scale, column);
+    }
+    scale = sqrt(scale);
+
+    /* pixels a unit of the model covers at its nearest */
+    perunit = scale * projection[5] * viewport[3] / 2.0;
+    if (projection[11] != 0.0) {
+        depth = -center[2] - lod->radius * scale;
+        if (depth <= 0.0)
+            return 0;       /* the camera is inside the model */
+        perunit /= depth;
+    }
+
+    level = 0;
+    for (i = 1; i < lod->numlevels; i++)
+        if (lod->errors[i] * perunit <= pixels)
+            level = i;
+    return level;
+}
@@ -0,0 +1,120 @@
+/*
+ *  lod.h
+ *
+ *  Levels of detail of glm models, simplified with quadric error
+ *  metrics (Garland and Heckbert, "Surface Simplification Using
+ *  Quadric Error Metrics").
+ *
+ *  Every vertex gets the planes of its triangles as a quadric, which
+ *  sums the squared distances of a point to them, and the edge whose
+ *  collapse into one vertex costs the least against the two quadrics
+ *  collapses next, over and over.  Edges the simplified model has to
+ *  keep get planes of their own, standing on the edge at right angles
+ *  to its triangles, so moving them off the edge costs far more:
+ *
+ *  o  open edges, with only one triangle
+ *  o  edges between two groups, and so between two materials
+ *  o  creases, where the facet normals are further apart than the
+ *     smoothing angle glmVertexNormals() uses
+ *
+ *  Collapses that would flip a triangle over or pinch the surface
+ *  together are skipped.  The levels get their facet and vertex
+ *  normals like the model, with the same smoothing angle.
+ *
+ *  Usage:
+ *
+ *  o  call lodBuild() after the model's facet and vertex normals; it
+ *     keeps a level every time the triangle count halves
+ *  o  for every frame, draw the mesh of the level lodPick() picks
+ *     for the camera
+ *  o  call lodDelete() when done, and lodBuild() again whenever the
+ *     model changes
+ */
+
+
+#ifndef LOD_H
+#define LOD_H
+
+#include "glm.h"
+#include "mesh.h"
+
+
+#define LOD_MAX_LEVELS    8         /* levels, the model's own included */
+#define LOD_MIN_TRIANGLES 256       /* fewest triangles of a level */
+#define LOD_PIXEL_ERROR   1.0       /* error lodPick() allows, in pixels */
+
+
+/* lod: a model and its simplified levels, finest first */
+struct lod
+{
+    GLuint       numlevels;
+    GLMmodel*    models[LOD_MAX_LEVELS];    /* models[0] is the model */
+    struct mesh* meshes[LOD_MAX_LEVELS];    /* each level compiled */
+    GLfloat      errors[LOD_MAX_LEVELS];    /* about how far each level
+                                               strays from the model */
+    GLfloat      center[3];                 /* bounding sphere of the */
+    GLfloat      radius;                    /* model */
+};
+
+
+/* functions */
+
+/* lodSimplify: returns a simplified copy of a model, with no more than
+ * a number of triangles if collapses can get it there.
+ *
+ * model        - initialized GLMmodel structure
+ * numtriangles - most triangles of the copy
+ * angle        - smoothing angle the model's vertex normals were made
+ *                with, creases sharper than it are kept
+ * error        - (return) about how far the copy strays from the model
+ */
+GLMmodel*
+lodSimplify(GLMmodel* model, GLuint numtriangles, GLfloat angle,
+            GLfloat* error);
+
+/* lodBuild: simplifies a model into levels of detail, with half the
+ * triangles of the level before each, down to LOD_MIN_TRIANGLES.
+ *
+ * model - initialized GLMmodel structure, level 0; it is not copied
+ * angle - smoothing angle, see lodSimplify()
+ * mode  - what the meshes carry, see meshCompile()
+ */
+struct lod*
+lodBuild(GLMmodel* model, GLfloat angle, GLuint mode);
+
+/* lodNormals: redoes the vertex normals of every level, the model's
+ * included, for a new smoothing angle with glmVertexNormalsAngle(), and
+ * recompiles the meshes of the levels whose normals changed, instead of
+ * simplifying the model again.  The levels keep the edges lodBuild()
+ * kept as creases; returns the number of vertices whose normals were
+ * redone.
+ *
+ * lod     - levels from lodBuild()
+ * angle   - new smoothing angle
+ * mode    - what the meshes carry, as for lodBuild()
+ * threads - most threads glmVertexNormalsAngle() may use
+ */
+GLuint
+lodNormals(struct lod* lod, GLfloat angle, GLuint mode, GLuint threads);
+
+/* lodDelete: deletes the levels and their meshes, but not the model.
+ *
+ * lod - levels from lodBuild()
+ */
+void
+lodDelete(struct lod* lod);
+
+/* lodPick: returns the coarsest level whose error, where the model
+ * comes closest to the camera, is at most some pixels on the screen.
+ *
+ * lod        - levels from lodBuild()
+ * modelview  - column major modelview matrix
+ * projection - column major projection matrix
+ * viewport   - x, y, width, height of the viewport in pixels
+ * pixels     - largest error, LOD_PIXEL_ERROR for example
+ */
+GLuint
+lodPick(struct lod* lod, double* modelview, double* projection,
+        int* viewport, double pixels);
+
+#endif /* LOD_H */
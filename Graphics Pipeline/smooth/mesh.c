@@ -0,0 +1,447 @@
+/*
+ *  mesh.c
+ *
+ *  Indexed meshes compiled from glm models.  See mesh.h for the
+ *  layout of a mesh.
+ */
+
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mesh.h"
+
+
+/* the serial of the last mesh compiled */
+static GLuint meshSerial = 0;
+
+/* meshSign: 1 for a value >= 0, -1 otherwise */
+static GLfloat
+meshSign(GLfloat x)
+{
+    return x >= 0.0 ? 1.0 : -1.0;
+}
+
+/* meshOctDecode: the unit vector of octahedral coordinates */
+static void
+meshOctDecode(GLshort* q, GLfloat* n)
+{
+    GLfloat u = q[0] / 32767.0f, v = q[1] / 32767.0f, l;
+
+    n[0] = u;
+    n[1] = v;
+    n[2] = 1.0f - fabs(u) - fabs(v);
+    if (n[2] < 0.0f) {
+        /* the folded lower half */
+        n[0] = (1.0f - fabs(v)) * meshSign(u);
+        n[1] = (1.0f - fabs(u)) * meshSign(v);
+    }
+    l = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    n[0] /= l;
+    n[1] /= l;
+    n[2] /= l;
+}
+
+/* meshOctEncode: the octahedral coordinates of a vector, of the four
+ * 16 bit ones around it the one that decodes closest to it */
+static void
+meshOctEncode(GLfloat* n, GLshort* q)
+{
+    GLfloat l1, u, v, t, d[3], dot, best = -2.0;
+    GLint   iu, iv, k;
+    GLshort c[2];
+
+    q[0] = q[1] = 0;
+    l1 = fabs(n[0]) + fabs(n[1]) + fabs(n[2]);
+    if (l1 == 0.0)
+        return;
+    u = n[0] / l1;
+    v = n[1] / l1;
+    if (n[2] < 0.0) {
+        t = u;
+        u = (1.0 - fabs(v)) * meshSign(t);
+        v = (1.0 - fabs(t)) * meshSign(v);
+    }
+    for (k = 0; k < 4; k++) {
+        iu = (GLint)floor(u * 32767.0) + (k & 1);
+        iv = (GLint)floor(v * 32767.0) + (k >> 1);
+        c[0] = (GLshort)(iu > 32767 ? 32767 : iu < -32767 ? -32767 : iu);
+        c[1] = (GLshort)(iv > 32767 ? 32767 : iv < -32767 ? -32767 : iv);
+        meshOctDecode(c, d);
+        dot = d[0] * n[0] + d[1] * n[1] + d[2] * n[2];
+        if (dot > best) {
+            best = dot;
+            q[0] = c[0];
+            q[1] = c[1];
+        }
+    }
+}
+
+/* meshQuantize: the 16 bit steps from origin closest to a value */
+static GLushort
+meshQuantize(GLfloat x, GLfloat origin, GLfloat step)
+{
+    double q;
+
+    if (step <= 0.0)
+        return 0;
+    q = floor((x - origin) / step + 0.5);
+    return (GLushort)(q < 0.0 ? 0.0 : q > 65535.0 ? 65535.0 : q);
+}
+
+/* meshRange: the origin and 16 bit step of the values of one axis of
+ * an array */
+static void
+meshRange(GLfloat* values, GLuint count, GLuint stride, GLfloat* origin,
+          GLfloat* step)
+{
+    GLfloat lo, hi;
+    GLuint  i;
+
+    lo = hi = count ? values[0] : 0.0;
+    for (i = 1; i < count; i++) {
+        if (values[i * stride] < lo)
+            lo = values[i * stride];
+        if (values[i * stride] > hi)
+            hi = values[i * stride];
+    }
+    *origin = lo;
+    *step = (hi - lo) / 65535.0;
+}
+
+/* meshPack: quantizes the interleaved vertices of a mesh into packed
+ * ones, and measures the error */
+static void
+meshPack(struct mesh* mesh)
+{
+    struct meshVertex* vertex;
+    struct meshPacked* packed;
+    GLfloat decoded[3], d[3], error, dot;
+    GLuint  k, a;
+
+    for (a = 0; a < 3; a++)
+        meshRange(&mesh->vertices[0].position[a], mesh->numvertices,
+                  sizeof(struct meshVertex) / sizeof(GLfloat), &mesh->origin[a], &mesh->step[a]);
+    for (a = 0; a < 2; a++)
+        meshRange(&mesh->vertices[0].texcoord[a], mesh->numvertices,
+                  sizeof(struct meshVertex) / sizeof(GLfloat), &mesh->texorigin[a], &mesh->texstep[a]);
+
+    mesh->packed = (struct meshPacked*)calloc(mesh->numvertices + 1, sizeof(struct meshPacked));
+    for (k = 0; k < mesh->numvertices; k++) {
+        vertex = &mesh->vertices[k];
+        packed = &mesh->packed[k];
+        for (a = 0; a < 3; a++)
+            packed->position[a] = meshQuantize(vertex->position[a], mesh->origin[a], mesh->step[a]);
+        for (a = 0; a < 2; a++)
+            packed->texcoord[a] = meshQuantize(vertex->texcoord[a], mesh->texorigin[a], mesh->texstep[a]);
+        meshOctEncode(vertex->normal, packed->normal);
+
+        meshPosition(mesh, k, decoded);
+        for (a = 0; a < 3; a++)
+            d[a] = decoded[a] - vertex->position[a];
+        error = sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+        if (error > mesh->positionerror)
+            mesh->positionerror = error;
+        dot = sqrt(vertex->normal[0] * vertex->normal[0] + vertex->normal[1] * vertex->normal[1] +
+                   vertex->normal[2] * vertex->normal[2]);
+        if (dot > 0.0 && (mesh->mode & (GLM_FLAT | GLM_SMOOTH))) {
+            meshNormal(mesh, k, decoded);
+            dot = (decoded[0] * vertex->normal[0] + decoded[1] * vertex->normal[1] +
+                   decoded[2] * vertex->normal[2]) / dot;
+            error = acos(dot > 1.0 ? 1.0 : dot < -1.0 ? -1.0 : dot) * 180.0 / M_PI;
+            if (error > mesh->normalerror)
+                mesh->normalerror = error;
+        }
+    }
+
+    free(mesh->vertices);
+    mesh->vertices = NULL;
+}
+
+/* meshCompile: compiles a model into an indexed mesh.
+ *
+ * model - initialized GLMmodel structure
+ * mode  - GLM_FLAT, GLM_SMOOTH and GLM_TEXTURE bits, see mesh.h
+ */
+struct mesh*
+meshCompile(GLMmodel* model, GLuint mode)
+{
+    struct mesh* mesh;
+    struct meshGroup* mgroup;
+    struct meshVertex* vertex;
+    GLMgroup* group;
+    GLuint* keys;       /* the triple of each vertex */
+    GLuint* corners;    /* the vertex of every corner, in group order */
+    GLuint  c, g, k, largest, bytes;
+
+    assert(model);
+    assert(model->vertices);
+
+    /* only what the model has, smooth normals over facet normals */
+    mode &= GLM_FLAT | GLM_SMOOTH | GLM_TEXTURE | MESH_PACKED;
+    if (!model->normals)
+        mode &= ~GLM_SMOOTH;
+    if (!model->facetnorms || (mode & GLM_SMOOTH))
+        mode &= ~GLM_FLAT;
+    if (!model->texcoords)
+        mode &= ~GLM_TEXTURE;
+
+    mesh = (struct mesh*)calloc(1, sizeof(struct mesh));
+    mesh->model = model;
+    mesh->mode = mode;
+    mesh->serial = ++meshSerial;
+    for (group = model->groups; group; group = group->next) {
+        mesh->numgroups++;
+        mesh->numcorners += 3 * group->numtriangles;
+    }
+
+    /* give every new triple the next vertex, in group order */
+    keys = (GLuint*)malloc(sizeof(GLuint) * 3 * (mesh->numcorners + 1));
+    corners = (GLuint*)malloc(sizeof(GLuint) * (mesh->numcorners + 1));
+    mesh->numvertices = glmIndexCorners(model, mode, corners, keys);
+
+    /* interleave the attributes of every vertex */
+    mesh->vertices = (struct meshVertex*)calloc(mesh->numvertices + 1, sizeof(struct meshVertex));
+    for (k = 0; k < mesh->numvertices; k++) {
+        vertex = &mesh->vertices[k];
+        memcpy(vertex->position, &model->vertices[3 * keys[3 * k]], sizeof(vertex->position));
+        if (mode & GLM_SMOOTH)
+            memcpy(vertex->normal, &model->normals[3 * keys[3 * k + 1]], sizeof(vertex->normal));
+        else if (mode & GLM_FLAT)
+            memcpy(vertex->normal, &model->facetnorms[3 * keys[3 * k + 1]], sizeof(vertex->normal));
+        if (mode & GLM_TEXTURE)
+            memcpy(vertex->texcoord, &model->texcoords[2 * keys[3 * k + 2]], sizeof(vertex->texcoord));
+    }
+    free(keys);
+    if (mode & MESH_PACKED)
+        meshPack(mesh);
+
+    /* 16 bit indices for every group that can have them, each group's
+       indices starting on a 4 byte boundary */
+    mesh->groups = (struct meshGroup*)malloc(sizeof(struct meshGroup) * (mesh->numgroups + 1));
+    c = 0;
+    for (group = model->groups, g = 0; group; group = group->next, g++) {
+        mgroup = &mesh->groups[g];
+        mgroup->material = group->material;
+        mgroup->numindices = 3 * group->numtriangles;
+        largest = 0;
+        for (k = 0; k < mgroup->numindices; k++) {
+            if (corners[c + k] > largest)
+                largest = corners[c + k];
+        }
+        mgroup->indexsize = largest < 65536 ? 2 : 4;
+        mesh->indexbytes += (mgroup->numindices * mgroup->indexsize + 3) & ~3u;
+        c += mgroup->numindices;
+    }
+    mesh->indices = (GLubyte*)malloc(mesh->indexbytes + 4);
+    c = 0;
+    bytes = 0;
+    for (g = 0; g < mesh->numgroups; g++) {
+        mgroup = &mesh->groups[g];
+        mgroup->indices = mesh->indices + bytes;
+        for (k = 0; k < mgroup->numindices; k++) {
+            if (mgroup->indexsize == 2)
+                ((GLushort*)mgroup->indices)[k] = (GLushort)corners[c + k];
+            else
+                ((GLuint*)mgroup->indices)[k] = corners[c + k];
+        }
+        bytes += (mgroup->numindices * mgroup->indexsize + 3) & ~3u;
+        c += mgroup->numindices;
+    }
+    free(corners);
+
+    return mesh;
+}
+
+/* meshDelete: deletes a mesh.
+ *
+ * mesh - mesh from meshCompile()
+ */
+void
+meshDelete(struct mesh* mesh)
+{
+    if (!mesh)
+        return;
+    free(mesh->vertices);
+    free(mesh->packed);
+    free(mesh->groups);
+    free(mesh->indices);
+    free(mesh);
+}
+
+/* meshModelBytes: bytes of the model's arrays and triangle indices
+ * the mesh stands in for.
+ *
+ * mesh - mesh from meshCompile()
+ */
+long
+meshModelBytes(struct mesh* mesh)
+{
+    GLMmodel* model = mesh->model;
+    long bytes;
+
+    bytes = sizeof(GLfloat) * 3L * (model->numvertices + 1) + sizeof(GLuint) * (long)mesh->numcorners;
+    if (mesh->mode & GLM_SMOOTH)
+        bytes += sizeof(GLfloat) * 3L * (model->numnormals + 1) + sizeof(GLuint) * (long)mesh->numcorners;
+    if (mesh->mode & GLM_FLAT)
+        bytes += sizeof(GLfloat) * 3L * (model->numfacetnorms + 1) + sizeof(GLuint) * (long)mesh->numcorners / 3;
+    if (mesh->mode & GLM_TEXTURE)
+        bytes += sizeof(GLfloat) * 2L * (model->numtexcoords + 1) + sizeof(GLuint) * (long)mesh->numcorners;
+    return bytes;
+}
+
+/* meshBytes: bytes of the mesh's vertices and indices.
+ *
+ * mesh - mesh from meshCompile()
+ */
+long
+meshBytes(struct mesh* mesh)
+{
+    if (mesh->packed)
+        return sizeof(struct meshPacked) * (long)mesh->numvertices + mesh->indexbytes;
+    return sizeof(struct meshVertex) * (long)mesh->numvertices + mesh->indexbytes;
+}
+
+/* meshPosition: the position of a mesh vertex, decoded if the mesh is
+ * packed.
+ *
+ * mesh     - mesh from meshCompile()
+ * i        - vertex
+ * position - room for the decoded position
+ */
+GLfloat*
+meshPosition(struct mesh* mesh, GLuint i, GLfloat* position)
+{
+    GLushort* q;
+
+    if (!mesh->packed)
+        return mesh->vertices[i].position;
+    q = mesh->packed[i].position;
+    position[0] = mesh->origin[0] + mesh->step[0] * q[0];
+    position[1] = mesh->origin[1] + mesh->step[1] * q[1];
+    position[2] = mesh->origin[2] + mesh->step[2] * q[2];
+    return position;
+}
+
+/* meshNormal: the normal of a mesh vertex, like meshPosition().
+ */
+GLfloat*
+meshNormal(struct mesh* mesh, GLuint i, GLfloat* normal)
+{
+    if (!mesh->packed)
+        return mesh->vertices[i].normal;
+    if (!(mesh->mode & (GLM_FLAT | GLM_SMOOTH))) {
+        normal[0] = normal[1] = normal[2] = 0.0;
+        return normal;
+    }
+    meshOctDecode(mesh->packed[i].normal, normal);
+    return normal;
+}
+
+/* meshTexcoord: the texture coordinate of a mesh vertex, like
+ * meshPosition().
+ */
+GLfloat*
+meshTexcoord(struct mesh* mesh, GLuint i, GLfloat* texcoord)
+{
+    GLushort* q;
+
+    if (!mesh->packed)
+        return mesh->vertices[i].texcoord;
+    q = mesh->packed[i].texcoord;
+    texcoord[0] = mesh->texorigin[0] + mesh->texstep[0] * q[0];
+    texcoord[1] = mesh->texorigin[1] + mesh->texstep[1] * q[1];
+    return texcoord;
+}
+
+#if !defined(GLM_NO_GL)
+/* meshDraw: renders a mesh with vertex arrays, a glDrawElements() call
+ * for every group.  A packed mesh is decoded into a float copy first.
+ *
+ * mesh - mesh from meshCompile()
+ * mode - GLM_COLOR or GLM_MATERIAL, see mesh.h
+ */
+void
+meshDraw(struct mesh* mesh, GLuint mode)
+{
+    struct meshGroup* group;
+    struct meshVertex* vertices = mesh->vertices;
+    GLMmaterial* material = NULL;
+    GLuint g, k;
+
+    assert(mesh);
+
+    if (mesh->packed) {
+        vertices = (struct meshVertex*)malloc(sizeof(struct meshVertex) * (mesh->numvertices + 1));
+        for (k = 0; k < mesh->numvertices; k++) {
+            meshPosition(mesh, k, vertices[k].position);
+            meshNormal(mesh, k, vertices[k].normal);
+            meshTexcoord(mesh, k, vertices[k].texcoord);
+        }
+    }
+
+    if (!mesh->model->materials)
+        mode &= ~(GLM_COLOR | GLM_MATERIAL);
+    if (mode & GLM_MATERIAL)
+        mode &= ~GLM_COLOR;
+    if (mode & GLM_COLOR)
+        glEnable(GL_COLOR_MATERIAL);
+    else if (mode & GLM_MATERIAL)
+        glDisable(GL_COLOR_MATERIAL);
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, sizeof(struct meshVertex), vertices[0].position);
+    if (mesh->mode & (GLM_FLAT | GLM_SMOOTH)) {
+        glEnableClientState(GL_NORMAL_ARRAY);
+        glNormalPointer(GL_FLOAT, sizeof(struct meshVertex), vertices[0].normal);
+    }
+    if (mesh->mode & GLM_TEXTURE) {
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        glTexCoordPointer(2, GL_FLOAT, sizeof(struct meshVertex), vertices[0].texcoord);
+    }
+
+    for (g = 0; g < mesh->numgroups; g++) {
+        group = &mesh->groups[g];
+        if (mode & (GLM_COLOR | GLM_MATERIAL))
+            material = &mesh->model->materials[group->material];
+        if (mode & GLM_MATERIAL) {
+            glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, material->ambient);
+            glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, material->diffuse);
+            glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, material->specular);
+            glMaterialf(GL_FRONT_AND_BACK, GL_SHININESS, material->shininess);
+        }
+        if (mode & GLM_COLOR)
+            glColor3fv(material->diffuse);
+        if (group->numindices) {
+            glDrawElements(GL_TRIANGLES, group->numindices,
+                           group->indexsize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT,
+                           group->indices);
+        }
+    }
+
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    if (mesh->packed)
+        free(vertices);
+}
+
+/* meshList: generates and returns a display list of meshDraw().
+ *
+ * mesh - mesh from meshCompile()
+ * mode - GLM_COLOR or GLM_MATERIAL, see meshDraw()
+ */
+GLuint
+meshList(struct mesh* mesh, GLuint mode)
+{
+    GLuint list;
+
+    list = glGenLists(1);
+    glNewList(list, GL_COMPILE);
+    meshDraw(mesh, mode);
+    glEndList();
+
+    return list;
+}
+#endif
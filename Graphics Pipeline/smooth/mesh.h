@@ -0,0 +1,200 @@
+/*
+ *  mesh.h
+ *
+ *  Indexed meshes compiled from glm models.
+ *
+ *  A GLMtriangle keeps separate vertex, normal and texture coordinate
+ *  indices for each corner, so drawing a model gathers every corner
+ *  from three arrays and two corners that are the same point, normal
+ *  and texture coordinate still get transformed and lit twice.
+ *  meshCompile() gives every distinct (vertex, normal, texcoord) triple
+ *  of a model one interleaved vertex and every group of the model an
+ *  index buffer into them, in the group order glmDraw() uses:
+ *
+ *  o  vertices are numbered in the order the groups first use them,
+ *     so the early groups index only low numbered vertices
+ *  o  a group whose vertices all have numbers below 65536 gets 16 bit
+ *     indices, the others 32 bit ones
+ *
+ *  With MESH_PACKED the vertices are quantized to 16 bytes instead of
+ *  32, for large models whose vertex arrays are most of their memory
+ *  and of what a frame reads:
+ *
+ *  o  positions and texture coordinates are 16 bit fixed point steps
+ *     across the bounding box of the mesh's positions and texture
+ *     coordinates (within the [-1, 1] cube of a unitized model, a
+ *     step is about 0.00003)
+ *  o  normals are 32 bit octahedral: the unit vector projected onto
+ *     the octahedron |x| + |y| + |z| = 1, whose lower half is folded
+ *     over the upper one, as two 16 bit coordinates
+ *
+ *  meshPosition(), meshNormal() and meshTexcoord() decode any mesh's
+ *  vertices, and the mesh tells the largest error the packing made.
+ *
+ *  The mesh is a copy; compile it again whenever the model's
+ *  vertices, normals or triangles change.
+ *
+ *  Usage:
+ *
+ *  o  call meshCompile() after the model's facet and vertex normals
+ *  o  hand the mesh to pipelineRender(), or draw it with meshDraw() or
+ *     meshList()
+ *  o  call meshDelete() when done with it
+ */
+
+
+#ifndef MESH_H
+#define MESH_H
+
+#include "glm.h"
+
+
+/* meshVertex: one interleaved vertex, 32 bytes */
+struct meshVertex
+{
+    GLfloat position[3];
+    GLfloat normal[3];      /* zero without GLM_FLAT or GLM_SMOOTH */
+    GLfloat texcoord[2];    /* zero without GLM_TEXTURE */
+};
+
+/* meshPacked: one quantized vertex of a MESH_PACKED mesh, 16 bytes */
+struct meshPacked
+{
+    GLushort position[3];   /* steps from origin, see struct mesh */
+    GLushort unused;
+    GLshort  normal[2];     /* octahedral, -32767 .. 32767 for -1 .. 1 */
+    GLushort texcoord[2];   /* steps from texorigin */
+};
+
+/* meshGroup: the triangles of a group, 3 indices each */
+struct meshGroup
+{
+    GLuint  material;       /* index into the model's materials */
+    GLuint  numindices;
+    GLuint  indexsize;      /* 2 or 4 bytes an index */
+    GLvoid* indices;        /* GLushort or GLuint indices into vertices */
+};
+
+/* mesh: a model compiled into one vertex array and index buffers */
+struct mesh
+{
+    GLMmodel* model;        /* model it was compiled from (materials) */
+    GLuint    mode;         /* GLM_FLAT, GLM_SMOOTH and GLM_TEXTURE bits
+                               it was compiled with */
+
+    GLuint             numvertices;
+    struct meshVertex* vertices;    /* 0 based, unlike the model's;
+                                       NULL if packed */
+    struct meshPacked* packed;      /* 0 based, NULL unless MESH_PACKED */
+
+    /* decoding MESH_PACKED vertices: a position is origin + step * the
+       position's steps on each axis, and the same for texcoords */
+    GLfloat origin[3], step[3];
+    GLfloat texorigin[2], texstep[2];
+    GLfloat positionerror;  /* largest distance of a position from the
+                               model's vertex */
+    GLfloat normalerror;    /* largest angle of a normal from the
+                               model's, in degrees */
+
+    GLuint            numgroups;
+    struct meshGroup* groups;       /* in the model's group order */
+    GLubyte*          indices;      /* every group's indices */
+    GLuint            indexbytes;
+
+    GLuint numcorners;      /* 3 for every triangle of every group */
+    GLuint serial;          /* different for every mesh compiled, so what
+                               is kept of a mesh can tell meshes apart */
+};
+
+
+/* compile mode: quantize the vertices (see above) */
+#define MESH_PACKED (1 << 8)
+
+
+/* meshIndex: index k of a group */
+#define meshIndex(group, k) ((group)->indexsize == 2 ? \
+    (GLuint)((GLushort*)(group)->indices)[k] : ((GLuint*)(group)->indices)[k])
+
+
+/* functions */
+
+/* meshCompile: compiles a model into an indexed mesh.
+ *
+ * model - initialized GLMmodel structure
+ * mode  - what the vertices carry, a bitwise OR of
+ *             GLM_FLAT     -  the facet normal of the triangle
+ *             GLM_SMOOTH   -  the vertex normal of the corner
+ *             GLM_TEXTURE  -  the texture coordinate of the corner
+ *             MESH_PACKED  -  quantized to 16 bytes a vertex
+ *         like in glmDraw(), a mode the model has no data for is
+ *         dropped, and GLM_SMOOTH wins over GLM_FLAT.
+ */
+struct mesh*
+meshCompile(GLMmodel* model, GLuint mode);
+
+/* meshDelete: deletes a mesh.
+ *
+ * mesh - mesh from meshCompile()
+ */
+void
+meshDelete(struct mesh* mesh);
+
+/* meshModelBytes: bytes of the model's arrays and triangle indices
+ * the mesh stands in for, to compare with meshBytes().
+ *
+ * mesh - mesh from meshCompile()
+ */
+long
+meshModelBytes(struct mesh* mesh);
+
+/* meshBytes: bytes of the mesh's vertices and indices.
+ *
+ * mesh - mesh from meshCompile()
+ */
+long
+meshBytes(struct mesh* mesh);
+
+/* meshPosition: the position of a mesh vertex, decoded if the mesh is
+ * packed.  Returns it, or the mesh's own copy of it.
+ *
+ * mesh     - mesh from meshCompile()
+ * i        - vertex
+ * position - room for the decoded position
+ */
+GLfloat*
+meshPosition(struct mesh* mesh, GLuint i, GLfloat* position);
+
+/* meshNormal: the normal of a mesh vertex, like meshPosition().
+ */
+GLfloat*
+meshNormal(struct mesh* mesh, GLuint i, GLfloat* normal);
+
+/* meshTexcoord: the texture coordinate of a mesh vertex, like
+ * meshPosition().
+ */
+GLfloat*
+meshTexcoord(struct mesh* mesh, GLuint i, GLfloat* texcoord);
+
+#if !defined(GLM_NO_GL)
+/* meshDraw: renders a mesh with vertex arrays, a glDrawElements() call
+ * for every group.  A packed mesh is decoded into a float copy first,
+ * fixed function OpenGL has no octahedral normals.
+ *
+ * mesh - mesh from meshCompile()
+ * mode - GLM_COLOR or GLM_MATERIAL to set the color or material of
+ *        every group (normals and texture coordinates are the ones the
+ *        mesh was compiled with)
+ */
+void
+meshDraw(struct mesh* mesh, GLuint mode);
+
+/* meshList: generates and returns a display list of meshDraw().
+ *
+ * mesh - mesh from meshCompile()
+ * mode - GLM_COLOR or GLM_MATERIAL, see meshDraw()
+ */
+GLuint
+meshList(struct mesh* mesh, GLuint mode);
+#endif
+
+#endif /* MESH_H */
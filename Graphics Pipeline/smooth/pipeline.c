@@ -0,0 +1,3184 @@
+/*  
+    pipeline.c
+
+    Software graphics pipeline for glm models: transforms, clips, shades
+    and rasterizes a model into the framebuffer without OpenGL, so it
+    runs in the viewer and in the headless renderer alike.
+*/
+
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+#include "pipeline.h"
+#include "framebuffer.h"
+
+/*=======================================================================
+STRUCTS =================================================================
+=======================================================================*/
+
+//for RGB colors
+struct RGBType
+{
+    float r;
+    float g;
+    float b;
+};
+//the last frame, packed colors from fbResolve
+unsigned int* pixels = NULL;
+
+//the mesh, its model and the shading mode of the frame being rendered
+static struct mesh* mesh;
+static GLMmodel* model;
+static int shadingMode;
+static int texturedFrame;       //this frame maps pipelineTexture
+static int shadowedFrame;       //this frame's tiles resolve through the
+                                //shadow map, see resolveShadows()
+static int ambientFrame;        //its spans keep every pixel's shadowed
+                                //color in shadowAmbient
+
+//points taken from the model, x and y in 28.4 fixed point (see
+//TRIANGLE SETUP)
+struct projectedPoint
+{
+    int x;
+    int y;
+    double z;
+    double q;       //1 / w, for perspective correct colors
+    double u;       //texture coordinates
+    double v;
+    double nx;
+    double ny;
+    double nz;
+    struct RGBType color;
+};
+
+//an attribute as a plane over the screen: its value at the corner of
+//the bounding box plus how much it changes per pixel in x and in y
+struct attribPlane
+{
+    double value;
+    double dx;
+    double dy;
+};
+
+//everything the rasterizer needs about a triangle, computed once
+struct triangleSetup
+{
+    int xmin, xmax, ymin, ymax;  //bounding box clamped to the screen
+    int w[3];                    //edge functions at (xmin, ymin)
+    int wdx[3];                  //edge function steps in x
+    int wdy[3];                  //edge function steps in y
+    struct attribPlane z;
+    struct attribPlane q;        //1 / w
+    struct attribPlane r, g, b;  //color / w
+    struct attribPlane u, v;     //texture coordinates / w, if textured
+    double znear;                //nearest window z of its corners
+    unsigned int alpha;          //top byte of the packed colors it writes
+    struct RGBType ambient;      //what is left of its color in shadow,
+                                 //for spanMapped()
+};
+
+//one row of a triangle handed to a span kernel: edge functions, depth,
+//1 / w, color / w and texture coordinates / w at the first pixel and
+//their steps per pixel in x (and in y, for the texture's derivatives)
+struct spanSetup
+{
+    int w[3];
+    int wdx[3];
+    float z, zdx;
+    float q, qdx, qdy;
+    float r, rdx;
+    float g, gdx;
+    float b, bdx;
+    float u, udx, udy;
+    float v, vdx, vdy;
+    int k0;          //pixels of the row before the span's first one
+    unsigned int alpha;
+    struct RGBType ambient;
+};
+
+/*=======================================================================
+HELPER METHODS ==========================================================
+=======================================================================*/
+
+//finds min between two int values
+static int min(int a, int b)
+{
+    if(a < b)
+        return a;
+    else return b;
+}
+
+//finds max between two int values
+static int max(int a, int b)
+{
+    if(a > b)
+        return a;
+    else return b;
+}
+
+//finds max between two double values
+static double maxd(double a, double b)
+{
+    if(a > b)
+        return a;
+    else return b;
+}
+
+//column major r = a * b, r may be a or b
+void multiplyMatrix(double* r, double* a, double* b)
+{
+    double t[16];
+    int row, col, k;
+    for(col = 0; col < 4; col++)
+    {
+        for(row = 0; row < 4; row++)
+        {
+            t[col * 4 + row] = 0.0;
+            for(k = 0; k < 4; k++)
+                t[col * 4 + row] += a[k * 4 + row] * b[col * 4 + k];
+        }
+    }
+    memcpy(r, t, sizeof(t));
+}
+
+//inverts a matrix by Gauss-Jordan elimination with partial pivoting,
+//returns 0 if it is singular
+int invertMatrix(double* r, double* m)
+{
+    double a[16], pivot, f;
+    int row, col, k, best;
+    memcpy(a, m, sizeof(a));
+    for(k = 0; k < 16; k++)
+        r[k] = k % 5 == 0 ? 1.0 : 0.0;
+    
+    //a[col * 4 + row], rows are eliminated column by column
+    for(col = 0; col < 4; col++)
+    {
+        best = col;
+        for(row = col + 1; row < 4; row++)
+        {
+            if(fabs(a[col * 4 + row]) > fabs(a[col * 4 + best]))
+                best = row;
+        }
+        if(a[col * 4 + best] == 0.0)
+            return 0;
+        for(k = 0; k < 4; k++)
+        {
+            f = a[k * 4 + col]; a[k * 4 + col] = a[k * 4 + best]; a[k * 4 + best] = f;
+            f = r[k * 4 + col]; r[k * 4 + col] = r[k * 4 + best]; r[k * 4 + best] = f;
+        }
+        pivot = a[col * 4 + col];
+        for(k = 0; k < 4; k++)
+        {
+            a[k * 4 + col] /= pivot;
+            r[k * 4 + col] /= pivot;
+        }
+        for(row = 0; row < 4; row++)
+        {
+            f = a[col * 4 + row];
+            if(row == col || f == 0.0)
+                continue;
+            for(k = 0; k < 4; k++)
+            {
+                a[k * 4 + row] -= f * a[k * 4 + col];
+                r[k * 4 + row] -= f * r[k * 4 + col];
+            }
+        }
+    }
+    return 1;
+}
+
+/*=======================================================================
+TRIANGLE SETUP ==========================================================
+=======================================================================*/
+
+//window coordinates are snapped to 1/16 of a pixel, and a pixel is
+//covered when its center is inside the triangle. The edge functions
+//are exact integers at that precision, so two triangles sharing an edge
+//agree on which side of it every pixel center lies, and the top-left
+//rule gives the centers exactly on it to one of them only: a triangle
+//owns its left edges and, of horizontal ones, the top edge as seen on
+//the screen (where window y goes up). No pixel of a closed mesh is
+//drawn twice or left out.
+//
+//In pixel steps an edge function reaches 32 times the square of the
+//frame's width plus both guard bands, and the kernels keep it in an
+//int, so frames up to 4096 pixels across fit (see GUARD_BAND)
+#define SUBPIXEL_BITS 4
+#define SUBPIXEL_ONE (1 << SUBPIXEL_BITS)
+#define SUBPIXEL_HALF (SUBPIXEL_ONE / 2)
+
+//a window coordinate in 28.4 fixed point, rounded to nearest like
+//cvtps2dq does
+int toFixed(float v)
+{
+    return (int)lrintf(v * SUBPIXEL_ONE);
+}
+
+//signed edge function of the line a->b evaluated at (x, y), all in
+//fixed point: positive on one side of the line, negative on the other,
+//0 on it. Exact in a double, the products stay well below 2^53.
+double edgeFunction(struct projectedPoint a, struct projectedPoint b, int x, int y)
+{
+    return (double)(b.x - a.x) * (y - a.y) - (double)(b.y - a.y) * (x - a.x);
+}
+
+//builds the plane of an attribute with values a1, a2, a3 at the three
+//vertices from the barycentric weights of vertices 2 and 3, e2 and e3
+//being their exact edge functions at the center of the corner pixel
+struct attribPlane setupPlane(struct triangleSetup* t, double invArea, double e2, double e3, double a1, double a2, double a3)
+{
+    struct attribPlane plane;
+    double d2 = (a2 - a1) * invArea;
+    double d3 = (a3 - a1) * invArea;
+    
+    plane.value = a1 + e2 * d2 + e3 * d3;
+    plane.dx = (t->wdx[1] * d2 + t->wdx[2] * d3) * SUBPIXEL_ONE;
+    plane.dy = (t->wdy[1] * d2 + t->wdy[2] * d3) * SUBPIXEL_ONE;
+    return plane;
+}
+
+//sets up the edge opposite a vertex, from a to b: its steps per pixel
+//and, at the corner pixel, its value in pixel steps with the fill rule
+//folded in, so that a pixel is inside exactly when w >= 0.
+//Returns the exact edge function at the corner pixel's center.
+double setupEdge(struct triangleSetup* t, int i, struct projectedPoint a, struct projectedPoint b, int sign)
+{
+    int cx = t->xmin * SUBPIXEL_ONE + SUBPIXEL_HALF;
+    int cy = t->ymin * SUBPIXEL_ONE + SUBPIXEL_HALF;
+    double e = sign * edgeFunction(a, b, cx, cy);
+    
+    t->wdx[i] = sign * (a.y - b.y);
+    t->wdy[i] = sign * (b.x - a.x);
+    
+    //centers on an edge the triangle doesn't own are outside, and going
+    //a pixel changes the edge function by a multiple of SUBPIXEL_ONE,
+    //so e + bias >= 0 exactly when floor((e + bias) / SUBPIXEL_ONE) is
+    int owned = t->wdx[i] > 0 || (t->wdx[i] == 0 && t->wdy[i] < 0);
+    t->w[i] = (int)floor((e - (owned ? 0 : 1)) / SUBPIXEL_ONE);
+    return e;
+}
+
+//computes the bounding box, edge functions and depth plane of a
+//triangle on a width x height target, returns 0 if nothing of it lands
+//there. e gets the exact edge functions at the corner pixel and invArea
+//what turns them into barycentric weights, for the other planes.
+int setupCoverage(struct projectedPoint p1, struct projectedPoint p2, struct projectedPoint p3, int width, int height,
+                  struct triangleSetup* t, double* e, double* invArea)
+{
+    //the pixels whose centers are inside the corners' bounding box, the
+    //shifts floor negative coordinates too
+    t->xmin = max((min(p1.x, min(p2.x, p3.x)) + SUBPIXEL_HALF - 1) >> SUBPIXEL_BITS, 0);
+    t->xmax = min((max(p1.x, max(p2.x, p3.x)) - SUBPIXEL_HALF) >> SUBPIXEL_BITS, width - 1);
+    t->ymin = max((min(p1.y, min(p2.y, p3.y)) + SUBPIXEL_HALF - 1) >> SUBPIXEL_BITS, 0);
+    t->ymax = min((max(p1.y, max(p2.y, p3.y)) - SUBPIXEL_HALF) >> SUBPIXEL_BITS, height - 1);
+    
+    //twice the signed area, zero for degenerate triangles
+    //rejected triangles keep an empty box so they land in no tile
+    double triArea = edgeFunction(p1, p2, p3.x, p3.y);
+    if(triArea == 0 || t->xmin > t->xmax || t->ymin > t->ymax)
+    {
+        t->xmin = 1;
+        t->xmax = 0;
+        return 0;
+    }
+    
+    //flip the edges of clockwise triangles so inside is always >= 0
+    int sign = (triArea > 0) ? 1 : -1;
+    *invArea = sign / triArea;
+    
+    //w[i] is the edge opposite vertex i, e[i] * invArea its barycentric weight
+    e[0] = setupEdge(t, 0, p2, p3, sign);
+    e[1] = setupEdge(t, 1, p3, p1, sign);
+    e[2] = setupEdge(t, 2, p1, p2, sign);
+    
+    //window z is linear on the screen
+    t->z = setupPlane(t, *invArea, e[1], e[2], p1.z, p2.z, p3.z);
+    t->znear = p1.z < p2.z ? p1.z : p2.z;
+    if(p3.z < t->znear)
+        t->znear = p3.z;
+    return 1;
+}
+
+//computes the bounding box, edge functions and attribute planes of a
+//triangle, returns 0 if nothing of it lands on the screen
+int setupTriangle(struct projectedPoint p1, struct projectedPoint p2, struct projectedPoint p3, struct triangleSetup* t)
+{
+    double e[3], invArea;
+    
+    if(!setupCoverage(p1, p2, p3, fbWidth, fbHeight, t, e, &invArea))
+        return 0;
+    
+    //the colors are linear in the model, not on the screen, so they are
+    //interpolated as color / w and 1 / w, which are linear on the
+    //screen, and divided at every pixel
+    t->q = setupPlane(t, invArea, e[1], e[2], p1.q, p2.q, p3.q);
+    t->r = setupPlane(t, invArea, e[1], e[2], p1.color.r * p1.q, p2.color.r * p2.q, p3.color.r * p3.q);
+    t->g = setupPlane(t, invArea, e[1], e[2], p1.color.g * p1.q, p2.color.g * p2.q, p3.color.g * p3.q);
+    t->b = setupPlane(t, invArea, e[1], e[2], p1.color.b * p1.q, p2.color.b * p2.q, p3.color.b * p3.q);
+    if(texturedFrame)
+    {
+        t->u = setupPlane(t, invArea, e[1], e[2], p1.u * p1.q, p2.u * p2.q, p3.u * p3.q);
+        t->v = setupPlane(t, invArea, e[1], e[2], p1.v * p1.q, p2.v * p2.q, p3.v * p3.q);
+    }
+    return 1;
+}
+
+/*=======================================================================
+SHADOW MAP ==============================================================
+=======================================================================*/
+
+//the model seen from the light of computeShade(), which shines along
+//(0, 0, 1) in model space like the normals it is given, so the light
+//turns with the model and so do its shadows. An orthographic view down
+//the model's z axis over its bounding box is rendered into a map of
+//the nearest window z first (see SHADOW PASS), then every pixel left
+//visible in the frame looks up where it lands in the map, and where
+//something nearer the light covers it only the ambient part of its
+//color is left.
+#define SHADOW_SIZE 512
+
+//percentage closer filtering: the fraction of a 3x3 texel kernel
+//around the pixel that lights it, each tap comparing bilinearly
+#define SHADOW_TAPS 3
+
+//how much farther from the light the map is drawn than the model, like
+//glPolygonOffset(): a few times the depth slope of a triangle across a
+//texel, since the kernel reaches 2 texels off the pixel, plus a bit
+//for the rounding of the window z of the shadow map and the frame
+#define SHADOW_SLOPE_BIAS 2.5
+#define SHADOW_BIAS (1.0 / 4096.0)
+
+int shadowsEnabled = 0;
+int keepShadowMap = 1;
+float* shadowDepth = NULL;      //window z from the light, SHADOW_SIZE
+                                //rows from the bottom
+unsigned int* shadowAmbient = NULL; //packed shadowed colors of the
+                                //pixels of ambientFrame frames
+int shadowAmbientCapacity = 0;
+
+/*=======================================================================
+SPAN KERNELS ============================================================
+=======================================================================*/
+
+//a span kernel covers, depth tests and writes count pixels of one row
+//starting at frame index "index". Pixel i of the span gets
+//    k = (float)(s->k0 + i)
+//    z = s->z + s->zdx * k
+//    r = (s->r + s->rdx * k) * (1.0f / (s->q + s->qdx * k))    (same for g and b)
+//in every kernel, clamped and scaled to the framebuffer formats the
+//same way too, so the SIMD kernels match the scalar one bit for bit and
+//a span k0 pixels into a row matches the whole row.
+char* kernelNames[] = { "scalar", "SSE2", "AVX2" };
+int rasterKernel = KERNEL_SCALAR;  //kernel used by fillTriangle
+int bestKernel = KERNEL_SCALAR;    //fastest kernel this processor runs
+
+//clamps to [0, 1] the way maxps then minps do
+float clampUnit(float v)
+{
+    v = v > 0.0f ? v : 0.0f;
+    return v < 1.0f ? v : 1.0f;
+}
+
+//a color channel as a byte, rounded to nearest
+unsigned int colorByte(float c)
+{
+    return (unsigned int)(int)(clampUnit(c) * 255.0f + 0.5f);
+}
+
+//covers, tests and writes pixels first .. count - 1 of a span one at a time
+void spanPixels(struct spanSetup* s, int index, int first, int count)
+{
+    int i;
+    int w1 = s->w[0] + s->wdx[0] * first;
+    int w2 = s->w[1] + s->wdx[1] * first;
+    int w3 = s->w[2] + s->wdx[2] * first;
+    for(i = first; i < count; i++)
+    {
+        if((w1 | w2 | w3) >= 0)
+        {
+            float k = (float)(s->k0 + i);
+            unsigned int key = fbFrame | FB_DEPTH(clampUnit(s->z + s->zdx * k));
+            if(fbDepth[index + i] >= key)
+            {
+                float w = 1.0f / (s->q + s->qdx * k);
+                fbDepth[index + i] = key;
+                fbColor[index + i] = s->alpha | FB_RGB(colorByte((s->r + s->rdx * k) * w),
+                                                       colorByte((s->g + s->gdx * k) * w),
+                                                       colorByte((s->b + s->bdx * k) * w));
+            }
+        }
+        w1 += s->wdx[0];
+        w2 += s->wdx[1];
+        w3 += s->wdx[2];
+    }
+}
+
+//reference kernel, one pixel at a time
+void spanScalar(struct spanSetup* s, int index, int count)
+{
+    spanPixels(s, index, 0, count);
+}
+
+//texture coordinates at a pixel k pixels into the span's row and dy
+//rows above it
+void spanTexcoord(struct spanSetup* s, float k, float dy, float* uv)
+{
+    float w = 1.0f / (s->q + s->qdx * k + s->qdy * dy);
+    uv[0] = (s->u + s->udx * k + s->udy * dy) * w;
+    uv[1] = (s->v + s->vdx * k + s->vdy * dy) * w;
+}
+
+//textured triangles, and those of shadowed frames whose materials
+//don't fit a byte, one pixel at a time whichever kernel is selected.
+//Every pixel that passes the depth test is modulated by the texture,
+//filtered at the level of detail of its 2x2 quad of pixels: like a GPU,
+//the derivatives are the differences across the quad's bottom left
+//pixel and its neighbours to the right and above. Shadowed frames also
+//keep the triangle's ambient color, as textured, for resolveShadows().
+void spanMapped(struct spanSetup* s, int index, int count)
+{
+    int i;
+    int w1 = s->w[0], w2 = s->w[1], w3 = s->w[2];
+    int x = index % fbWidth, odd = (index / fbWidth) & 1, quad = -1;
+    float lod = 0.0f, corner[2], right[2], above[2], uv[2], texel[3] = { 1.0f, 1.0f, 1.0f };
+    float r, g, b;
+    for(i = 0; i < count; i++)
+    {
+        if((w1 | w2 | w3) >= 0)
+        {
+            float k = (float)(s->k0 + i);
+            unsigned int key = fbFrame | FB_DEPTH(clampUnit(s->z + s->zdx * k));
+            if(fbDepth[index + i] >= key)
+            {
+                float w = 1.0f / (s->q + s->qdx * k);
+                r = (s->r + s->rdx * k) * w;
+                g = (s->g + s->gdx * k) * w;
+                b = (s->b + s->bdx * k) * w;
+                if(texturedFrame)
+                {
+                    if((x + i) >> 1 != quad)
+                    {
+                        float kc = k - ((x + i) & 1);
+                        quad = (x + i) >> 1;
+                        spanTexcoord(s, kc, (float)-odd, corner);
+                        spanTexcoord(s, kc + 1.0f, (float)-odd, right);
+                        spanTexcoord(s, kc, (float)(1 - odd), above);
+                        lod = textureLod(pipelineTexture, right[0] - corner[0], right[1] - corner[1],
+                                         above[0] - corner[0], above[1] - corner[1]);
+                    }
+                    uv[0] = (s->u + s->udx * k) * w;
+                    uv[1] = (s->v + s->vdx * k) * w;
+                    textureSample(pipelineTexture, uv[0], uv[1], lod, textureFilter, texel);
+                }
+                fbDepth[index + i] = key;
+                fbColor[index + i] = s->alpha | FB_RGB(colorByte(r * texel[0]), colorByte(g * texel[1]),
+                                                       colorByte(b * texel[2]));
+                if(ambientFrame)
+                    shadowAmbient[index + i] = FB_RGB(colorByte(s->ambient.r * texel[0]),
+                                                      colorByte(s->ambient.g * texel[1]),
+                                                      colorByte(s->ambient.b * texel[2]));
+            }
+        }
+        w1 += s->wdx[0];
+        w2 += s->wdx[1];
+        w3 += s->wdx[2];
+    }
+}
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define HAVE_SIMD_KERNELS
+#include <immintrin.h>
+
+//colorByte of 4 channels
+__attribute__((target("sse2")))
+__m128i colorSSE2(__m128 c)
+{
+    c = _mm_min_ps(_mm_max_ps(c, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+    return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(c, _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f)));
+}
+
+//4 pixels at a time, blends into the planes with full stores and leaves
+//the last count % 4 pixels to the scalar kernel so it never writes
+//outside the span (the pixels past it may belong to another tile)
+__attribute__((target("sse2")))
+void spanSSE2(struct spanSetup* s, int index, int count)
+{
+    int i;
+    __m128i minusOne = _mm_set1_epi32(-1);
+    __m128i w1 = _mm_setr_epi32(s->w[0], s->w[0] + s->wdx[0], s->w[0] + 2 * s->wdx[0], s->w[0] + 3 * s->wdx[0]);
+    __m128i w2 = _mm_setr_epi32(s->w[1], s->w[1] + s->wdx[1], s->w[1] + 2 * s->wdx[1], s->w[1] + 3 * s->wdx[1]);
+    __m128i w3 = _mm_setr_epi32(s->w[2], s->w[2] + s->wdx[2], s->w[2] + 2 * s->wdx[2], s->w[2] + 3 * s->wdx[2]);
+    __m128i w1step = _mm_set1_epi32(4 * s->wdx[0]);
+    __m128i w2step = _mm_set1_epi32(4 * s->wdx[1]);
+    __m128i w3step = _mm_set1_epi32(4 * s->wdx[2]);
+    __m128i frame = _mm_set1_epi32((int)fbFrame);
+    __m128i alpha = _mm_set1_epi32((int)s->alpha);
+    __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+    __m128 depthScale = _mm_set1_ps(FB_DEPTH_SCALE);
+    __m128 k = _mm_add_ps(_mm_set1_ps((float)s->k0), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+    __m128 kstep = _mm_set1_ps(4.0f);
+    
+    for(i = 0; i + 4 <= count; i += 4)
+    {
+        __m128i inside = _mm_cmpgt_epi32(_mm_or_si128(w1, _mm_or_si128(w2, w3)), minusOne);
+        if(_mm_movemask_ps(_mm_castsi128_ps(inside)))
+        {
+            __m128i* depth = (__m128i*)&fbDepth[index + i];
+            __m128i* color = (__m128i*)&fbColor[index + i];
+            __m128i old = _mm_loadu_si128(depth);
+            __m128 z = _mm_add_ps(_mm_set1_ps(s->z), _mm_mul_ps(_mm_set1_ps(s->zdx), k));
+            __m128i key = _mm_or_si128(frame, _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(z, zero), one), depthScale)));
+            __m128i mask = _mm_andnot_si128(_mm_cmpgt_epi32(key, old), inside);
+            if(_mm_movemask_ps(_mm_castsi128_ps(mask)))
+            {
+                __m128 w = _mm_div_ps(one, _mm_add_ps(_mm_set1_ps(s->q), _mm_mul_ps(_mm_set1_ps(s->qdx), k)));
+                __m128i r = colorSSE2(_mm_mul_ps(_mm_add_ps(_mm_set1_ps(s->r), _mm_mul_ps(_mm_set1_ps(s->rdx), k)), w));
+                __m128i g = colorSSE2(_mm_mul_ps(_mm_add_ps(_mm_set1_ps(s->g), _mm_mul_ps(_mm_set1_ps(s->gdx), k)), w));
+                __m128i b = colorSSE2(_mm_mul_ps(_mm_add_ps(_mm_set1_ps(s->b), _mm_mul_ps(_mm_set1_ps(s->bdx), k)), w));
+                __m128i c = _mm_or_si128(_mm_or_si128(alpha, r), _mm_or_si128(_mm_slli_epi32(g, 8), _mm_slli_epi32(b, 16)));
+                _mm_storeu_si128(depth, _mm_or_si128(_mm_and_si128(mask, key), _mm_andnot_si128(mask, old)));
+                _mm_storeu_si128(color, _mm_or_si128(_mm_and_si128(mask, c), _mm_andnot_si128(mask, _mm_loadu_si128(color))));
+            }
+        }
+        w1 = _mm_add_epi32(w1, w1step);
+        w2 = _mm_add_epi32(w2, w2step);
+        w3 = _mm_add_epi32(w3, w3step);
+        k = _mm_add_ps(k, kstep);
+    }
+    
+    spanPixels(s, index, i, count);
+}
+
+//colorByte of 8 channels
+__attribute__((target("avx2")))
+__m256i colorAVX2(__m256 c)
+{
+    c = _mm256_min_ps(_mm256_max_ps(c, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+    return _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(c, _mm256_set1_ps(255.0f)), _mm256_set1_ps(0.5f)));
+}
+
+//8 pixels at a time, the last partial group is masked off so the
+//masked loads and stores never touch pixels outside the span
+__attribute__((target("avx2")))
+void spanAVX2(struct spanSetup* s, int index, int count)
+{
+    int i;
+    __m256i minusOne = _mm256_set1_epi32(-1);
+    __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i w1 = _mm256_add_epi32(_mm256_set1_epi32(s->w[0]), _mm256_mullo_epi32(lane, _mm256_set1_epi32(s->wdx[0])));
+    __m256i w2 = _mm256_add_epi32(_mm256_set1_epi32(s->w[1]), _mm256_mullo_epi32(lane, _mm256_set1_epi32(s->wdx[1])));
+    __m256i w3 = _mm256_add_epi32(_mm256_set1_epi32(s->w[2]), _mm256_mullo_epi32(lane, _mm256_set1_epi32(s->wdx[2])));
+    __m256i w1step = _mm256_set1_epi32(8 * s->wdx[0]);
+    __m256i w2step = _mm256_set1_epi32(8 * s->wdx[1]);
+    __m256i w3step = _mm256_set1_epi32(8 * s->wdx[2]);
+    __m256i frame = _mm256_set1_epi32((int)fbFrame);
+    __m256i alpha = _mm256_set1_epi32((int)s->alpha);
+    __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+    __m256 depthScale = _mm256_set1_ps(FB_DEPTH_SCALE);
+    __m256 k = _mm256_cvtepi32_ps(_mm256_add_epi32(lane, _mm256_set1_epi32(s->k0)));
+    __m256 kstep = _mm256_set1_ps(8.0f);
+    __m256 z0 = _mm256_set1_ps(s->z), zdx = _mm256_set1_ps(s->zdx);
+    __m256 q0 = _mm256_set1_ps(s->q), qdx = _mm256_set1_ps(s->qdx);
+    __m256 r0 = _mm256_set1_ps(s->r), rdx = _mm256_set1_ps(s->rdx);
+    __m256 g0 = _mm256_set1_ps(s->g), gdx = _mm256_set1_ps(s->gdx);
+    __m256 b0 = _mm256_set1_ps(s->b), bdx = _mm256_set1_ps(s->bdx);
+    
+    for(i = 0; i < count; i += 8)
+    {
+        __m256i valid = _mm256_cmpgt_epi32(_mm256_set1_epi32(count - i), lane);
+        __m256i inside = _mm256_cmpgt_epi32(_mm256_or_si256(w1, _mm256_or_si256(w2, w3)), minusOne);
+        __m256i mask = _mm256_and_si256(valid, inside);
+        if(_mm256_movemask_ps(_mm256_castsi256_ps(mask)))
+        {
+            int* depth = (int*)&fbDepth[index + i];
+            int* color = (int*)&fbColor[index + i];
+            __m256i old = _mm256_maskload_epi32(depth, mask);
+            __m256 z = _mm256_add_ps(z0, _mm256_mul_ps(zdx, k));
+            __m256i key = _mm256_or_si256(frame, _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(z, zero), one), depthScale)));
+            mask = _mm256_andnot_si256(_mm256_cmpgt_epi32(key, old), mask);
+            if(_mm256_movemask_ps(_mm256_castsi256_ps(mask)))
+            {
+                __m256 w = _mm256_div_ps(one, _mm256_add_ps(q0, _mm256_mul_ps(qdx, k)));
+                __m256i r = colorAVX2(_mm256_mul_ps(_mm256_add_ps(r0, _mm256_mul_ps(rdx, k)), w));
+                __m256i g = colorAVX2(_mm256_mul_ps(_mm256_add_ps(g0, _mm256_mul_ps(gdx, k)), w));
+                __m256i b = colorAVX2(_mm256_mul_ps(_mm256_add_ps(b0, _mm256_mul_ps(bdx, k)), w));
+                __m256i c = _mm256_or_si256(_mm256_or_si256(alpha, r), _mm256_or_si256(_mm256_slli_epi32(g, 8), _mm256_slli_epi32(b, 16)));
+                _mm256_maskstore_epi32(depth, mask, key);
+                _mm256_maskstore_epi32(color, mask, c);
+            }
+        }
+        w1 = _mm256_add_epi32(w1, w1step);
+        w2 = _mm256_add_epi32(w2, w2step);
+        w3 = _mm256_add_epi32(w3, w3step);
+        k = _mm256_add_ps(k, kstep);
+    }
+}
+#endif
+
+void (*spanKernels[])(struct spanSetup*, int, int) = {
+    spanScalar,
+#if defined(HAVE_SIMD_KERNELS)
+    spanSSE2,
+    spanAVX2,
+#endif
+};
+
+//picks the widest kernel the processor supports
+int detectKernel(void)
+{
+#if defined(HAVE_SIMD_KERNELS)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return KERNEL_AVX2;
+    if(__builtin_cpu_supports("sse2"))
+        return KERNEL_SSE2;
+#endif
+    return KERNEL_SCALAR;
+}
+
+/*=======================================================================
+TRIANGLE FILL ===========================================================
+=======================================================================*/
+
+//8x8 blocks of a tile fillTriangle() can leave out, see HIERARCHICAL Z
+#define HIZ_BLOCK 8
+
+//fills the part of a triangle inside the rectangle (x0, y0)-(x1, y1),
+//handing every row of its bounding box to the selected span kernel.
+//With blocks, a byte for each HIZ_BLOCK square of the rectangle row by
+//row, only the runs of nonzero blocks of a row are handed over, with
+//the values the whole row would give them.
+void fillTriangle(struct triangleSetup* t, int x0, int y0, int x1, int y1, unsigned char* blocks)
+{
+    int y, a, b;
+    int across = (x1 - x0) / HIZ_BLOCK + 1;
+    unsigned char* row;
+    int xs = max(t->xmin, x0), xe = min(t->xmax, x1);
+    int ys = max(t->ymin, y0), ye = min(t->ymax, y1);
+    void (*kernel)(struct spanSetup*, int, int) = texturedFrame || ambientFrame ? spanMapped : spanKernels[rasterKernel];
+    struct spanSetup span;
+    
+    if(xs > xe)
+        return;
+    
+    //move the plane values from the bounding box corner to (xs, ys)
+    int ox = xs - t->xmin, oy = ys - t->ymin;
+    int w1Row = t->w[0] + t->wdx[0] * ox + t->wdy[0] * oy;
+    int w2Row = t->w[1] + t->wdx[1] * ox + t->wdy[1] * oy;
+    int w3Row = t->w[2] + t->wdx[2] * ox + t->wdy[2] * oy;
+    double zRow = t->z.value + t->z.dx * ox + t->z.dy * oy;
+    double qRow = t->q.value + t->q.dx * ox + t->q.dy * oy;
+    double uRow = 0.0, vRow = 0.0;
+    double rRow = t->r.value + t->r.dx * ox + t->r.dy * oy;
+    double gRow = t->g.value + t->g.dx * ox + t->g.dy * oy;
+    double bRow = t->b.value + t->b.dx * ox + t->b.dy * oy;
+    
+    span.wdx[0] = t->wdx[0];
+    span.wdx[1] = t->wdx[1];
+    span.wdx[2] = t->wdx[2];
+    span.zdx = t->z.dx;
+    span.qdx = t->q.dx;
+    span.qdy = t->q.dy;
+    if(texturedFrame)
+    {
+        uRow = t->u.value + t->u.dx * ox + t->u.dy * oy;
+        vRow = t->v.value + t->v.dx * ox + t->v.dy * oy;
+        span.udx = t->u.dx;
+        span.udy = t->u.dy;
+        span.vdx = t->v.dx;
+        span.vdy = t->v.dy;
+    }
+    span.ambient = t->ambient;
+    span.rdx = t->r.dx;
+    span.gdx = t->g.dx;
+    span.bdx = t->b.dx;
+    span.alpha = t->alpha;
+    
+    for(y = ys; y <= ye; y++)
+    {
+        span.z = zRow;
+        span.q = qRow;
+        span.u = uRow;
+        span.v = vRow;
+        span.r = rRow;
+        span.g = gRow;
+        span.b = bRow;
+        row = blocks ? &blocks[(y - y0) / HIZ_BLOCK * across] : NULL;
+        for(a = xs; a <= xe; a = b + 1)
+        {
+            //from a to the end of the run of blocks it starts
+            b = xe;
+            if(row)
+            {
+                b = min(x0 + ((a - x0) / HIZ_BLOCK + 1) * HIZ_BLOCK - 1, xe);
+                if(!row[(a - x0) / HIZ_BLOCK])
+                    continue;
+                while(b < xe && row[(b + 1 - x0) / HIZ_BLOCK])
+                    b = min(b + HIZ_BLOCK, xe);
+            }
+            span.w[0] = w1Row + t->wdx[0] * (a - xs);
+            span.w[1] = w2Row + t->wdx[1] * (a - xs);
+            span.w[2] = w3Row + t->wdx[2] * (a - xs);
+            span.k0 = a - xs;
+            kernel(&span, y * fbWidth + a, b - a + 1);
+        }
+        
+        w1Row += t->wdy[0];
+        w2Row += t->wdy[1];
+        w3Row += t->wdy[2];
+        zRow += t->z.dy;
+        qRow += t->q.dy;
+        if(texturedFrame)
+        {
+            uRow += t->u.dy;
+            vRow += t->v.dy;
+        }
+        rRow += t->r.dy;
+        gRow += t->g.dy;
+        bRow += t->b.dy;
+    }
+}
+
+/*=======================================================================
+SHADING =================================================================
+=======================================================================*/
+
+//the ambient part of computeShade(), all that is left in shadow
+struct RGBType ambientShade(GLMmaterial mat)
+{
+    struct RGBType color;
+    color.r = mat.ambient[0] * 0.5;
+    color.g = mat.ambient[1] * 0.5;
+    color.b = mat.ambient[2] * 0.5;
+    return color;
+}
+
+//the light and the look at vector are the same for every vertex and
+//pixel, so their half vector is worked out once a frame, not per call
+float lightDirection[3] = { 0, 0, 1 };
+float eyeDirection[3] = { 0, 0, 1 };
+float halfVector[3];
+
+void setupHalfVector(void)
+{
+    float tempx = lightDirection[0] + eyeDirection[0];
+    float tempy = lightDirection[1] + eyeDirection[1];
+    float tempz = lightDirection[2] + eyeDirection[2];
+    float mag = sqrt((tempx * tempx) + (tempy * tempy) + (tempz * tempz));
+    halfVector[0] = tempx/mag;
+    halfVector[1] = tempy/mag;
+    halfVector[2] = tempz/mag;
+}
+
+struct RGBType computeShade(double nx, double ny, double nz, GLMmaterial mat, double* modelview)
+{
+    //ambient shading
+    struct RGBType ambient = ambientShade(mat);
+    float la_r = ambient.r;
+    float la_g = ambient.g;
+    float la_b = ambient.b;
+    
+    //light dir
+    float lx = lightDirection[0];
+    float ly = lightDirection[1];
+    float lz = lightDirection[2];
+
+    float mag;
+    
+    if(shadingMode == PIPELINE_FLAT)
+    {
+        mag = sqrt((nx * nx) + (ny * ny) + (nz * nz));
+        nx /= mag;
+        ny /= mag;
+        nz /= mag;
+    }
+    
+    //diffuse shading
+    float dp = (nx * lx) + (ny * ly) + (nz * lz);
+    float ld_r = mat.diffuse[0] * 1.0 * maxd(0.0, dp);
+    float ld_g = mat.diffuse[1] * 1.0 * maxd(0.0, dp);
+    float ld_b = mat.diffuse[2] * 1.0 * maxd(0.0, dp);
+    
+    //specular shading
+    dp = (nx * halfVector[0]) + (ny * halfVector[1]) + (nz * halfVector[2]);
+    double highlight = pow(maxd(0.0, dp), mat.shininess);
+    float ls_r = mat.specular[0] * 0.3 * highlight;
+    float ls_g = mat.specular[1] * 0.3 * highlight;
+    float ls_b = mat.specular[2] * 0.3 * highlight;
+    
+    struct RGBType color;
+    color.r = la_r + ld_r + ls_r;
+    color.g = la_g + ld_g + ls_g;
+    color.b = la_b + ld_b + ls_b;
+
+    return color;
+}
+
+/*=======================================================================
+RASTERIZE ===============================================================
+=======================================================================*/
+
+//shades the corners of a triangle with one color in flat mode, Gouraud
+//mode gathers the colors of its corners from the light cache instead
+void shadeTriangle(struct projectedPoint* p, GLMmaterial mat, double* modelview)
+{
+    //find triangle normal
+    struct RGBType color;
+    float nx = (p[0].nx + p[1].nx + p[2].nx)/3;
+    float ny = (p[0].ny + p[1].ny + p[2].ny)/3;
+    float nz = (p[0].nz + p[1].nz + p[2].nz)/3;
+    color = computeShade(nx, ny, nz, mat, modelview);
+    p[0].color = p[1].color = p[2].color = color;
+}
+
+/*=======================================================================
+THREADS =================================================================
+=======================================================================*/
+
+//a small pool of worker threads that split the jobs of parallelFor()
+//between themselves and the calling thread
+int numThreads = 1;
+
+#if !defined(_WIN32)
+#include <pthread.h>
+
+pthread_t       workers[MAX_THREADS];
+int             numWorkers = 0;
+pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t  poolWake = PTHREAD_COND_INITIALIZER;
+pthread_cond_t  poolDone = PTHREAD_COND_INITIALIZER;
+void          (*poolJob)(int);
+int             poolJobCount = 0;
+int             poolNext = 0;
+int             poolFinished = 0;
+int             poolGeneration = 0;
+
+//runs jobs until there are none left, called with poolLock held
+void runJobs(void)
+{
+    while(poolNext < poolJobCount)
+    {
+        int job = poolNext++;
+        pthread_mutex_unlock(&poolLock);
+        poolJob(job);
+        pthread_mutex_lock(&poolLock);
+        poolFinished++;
+    }
+    if(poolFinished == poolJobCount)
+        pthread_cond_signal(&poolDone);
+}
+
+void* workerMain(void* arg)
+{
+    int index = (int)(long)arg;
+    int generation = 0;
+    
+    pthread_mutex_lock(&poolLock);
+    for(;;)
+    {
+        while(generation == poolGeneration)
+            pthread_cond_wait(&poolWake, &poolLock);
+        generation = poolGeneration;
+        
+        //workers beyond the current thread count sit this one out
+        if(index < numThreads - 1)
+            runJobs();
+    }
+    return NULL;
+}
+#endif
+
+//calls job(0) .. job(count - 1), spread over numThreads threads
+void parallelFor(void (*job)(int), int count)
+{
+    int i;
+    
+#if !defined(_WIN32)
+    if(numThreads > 1 && count > 1)
+    {
+        pthread_mutex_lock(&poolLock);
+        while(numWorkers < numThreads - 1)
+        {
+            pthread_create(&workers[numWorkers], NULL, workerMain, (void*)(long)numWorkers);
+            numWorkers++;
+        }
+        poolJob = job;
+        poolJobCount = count;
+        poolNext = 0;
+        poolFinished = 0;
+        poolGeneration++;
+        pthread_cond_broadcast(&poolWake);
+        
+        runJobs();
+        while(poolFinished < poolJobCount)
+            pthread_cond_wait(&poolDone, &poolLock);
+        pthread_mutex_unlock(&poolLock);
+        return;
+    }
+#endif
+    for(i = 0; i < count; i++)
+        job(i);
+}
+
+//number of processors, used as the default thread count
+int processorCount(void)
+{
+#if defined(_SC_NPROCESSORS_ONLN)
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if(n > 0)
+        return min((int)n, MAX_THREADS);
+#endif
+    return 1;
+}
+
+/*=======================================================================
+TILES ===================================================================
+=======================================================================*/
+
+//the screen is split into tiles that are rasterized independently,
+//every tile owns its part of the frame planes so no locking is needed
+#define TILE_SIZE 64
+int tilesAcross = 0, tilesDown = 0, numTiles = 0;
+
+//triangles overlapping a tile, in submission order
+struct tileBin
+{
+    int count;
+    int capacity;
+    struct triangleSetup** triangles;
+};
+struct tileBin* bins = NULL;
+int binCapacity = 0;
+
+//adds a triangle to the bins of the tiles it overlaps, across tiles a row
+void binTriangle(struct tileBin* tileBins, int across, struct triangleSetup* t)
+{
+    int tx, ty;
+    if(t->xmin > t->xmax || t->ymin > t->ymax)
+        return;
+    for(ty = t->ymin / TILE_SIZE; ty <= t->ymax / TILE_SIZE; ty++)
+    {
+        for(tx = t->xmin / TILE_SIZE; tx <= t->xmax / TILE_SIZE; tx++)
+        {
+            struct tileBin* bin = &tileBins[ty * across + tx];
+            if(bin->count == bin->capacity)
+            {
+                bin->capacity = max(64, bin->capacity * 2);
+                bin->triangles = (struct triangleSetup**)realloc(bin->triangles, sizeof(struct triangleSetup*) * bin->capacity);
+            }
+            bin->triangles[bin->count++] = t;
+        }
+    }
+}
+
+/*=======================================================================
+HIERARCHICAL Z ==========================================================
+=======================================================================*/
+
+//the farthest depth key of every 8x8 block of the frame and of every
+//tile, so whole triangles, and then blocks of them, that lie behind
+//everything drawn there so far never reach a span kernel. The kernels
+//only ever lower depths, so a farthest key taken before some of them
+//ran is still at least the real one and only rejects less:
+//
+//  o  a triangle covering all of a block lowers its key to the
+//     farthest depth of the triangle there
+//  o  a triangle covering part of it leaves the key as it is, and the
+//     key is read back from the depth plane when a test needs it
+//  o  a tile's key is the farthest of its blocks' keys
+//
+//The span kernels depth test 4 or 8 pixels at once before they shade
+//any, so the tests only pay where many layers overlap; hizEnabled is
+//off by default.
+#define HIZ_EMPTY 0xffffffffu   //nothing drawn in the block this frame
+
+//partial draws before a block's key is read back again while some of
+//its pixels were not drawn on this frame, the read can't hide anything
+//until they are
+#define HIZ_OPEN_DRAWS 4
+
+//how far a triangle's pixels may land from its depth plane, the span
+//kernels interpolate z in floats
+#define HIZ_SLACK (1.0 / 65536.0)
+
+int hizEnabled = 0;
+int hizAcross = 0, hizDown = 0;
+unsigned int* hizFar = NULL;     //farthest key of every block
+unsigned char* hizDraws = NULL;  //partial draws since its key was read
+unsigned char* hizOpen = NULL;   //some pixel was not drawn when it was
+unsigned int* tileFar = NULL;    //farthest key of every tile
+
+//what the tests of one tile rejected this frame
+struct hizCounts
+{
+    int tested, culled;           //triangles
+    int blocks, blocksCulled;     //8x8 blocks of them
+};
+struct hizCounts* tileHiz = NULL;
+
+//depth key no larger than that of any pixel at or behind window z
+unsigned int hizNearKey(double z)
+{
+    return fbFrame | FB_DEPTH(clampUnit(z - HIZ_SLACK));
+}
+
+//depth key no smaller than that of any pixel at or in front of window z
+unsigned int hizFarKey(double z)
+{
+    return fbFrame | FB_DEPTH(clampUnit(z + HIZ_SLACK));
+}
+
+//the farthest key of the blocks of the tile (x0, y0)-(x1, y1)
+unsigned int hizTileFar(int x0, int y0, int x1, int y1)
+{
+    int bx, by;
+    unsigned int far = 0;
+    for(by = y0 / HIZ_BLOCK; by <= y1 / HIZ_BLOCK; by++)
+    {
+        for(bx = x0 / HIZ_BLOCK; bx <= x1 / HIZ_BLOCK; bx++)
+        {
+            if(hizFar[by * hizAcross + bx] > far)
+                far = hizFar[by * hizAcross + bx];
+        }
+    }
+    return far;
+}
+
+//lowers the key of a block of a tile, and the tile's if no other block
+//shares the old key
+void hizLower(int tile, int x0, int y0, int x1, int y1, int block, unsigned int far)
+{
+    int bx, by;
+    unsigned int old = hizFar[block];
+    if(far >= old)
+        return;
+    hizFar[block] = far;
+    if(old != tileFar[tile])
+        return;
+    for(by = y0 / HIZ_BLOCK; by <= y1 / HIZ_BLOCK; by++)
+    {
+        for(bx = x0 / HIZ_BLOCK; bx <= x1 / HIZ_BLOCK; bx++)
+        {
+            if(hizFar[by * hizAcross + bx] == old)
+                return;
+        }
+    }
+    tileFar[tile] = hizTileFar(x0, y0, x1, y1);
+}
+
+#if defined(HAVE_SIMD_KERNELS)
+//the farthest key of a whole block inside the frame, 8 pixels a row
+__attribute__((target("avx2")))
+unsigned int hizReadAVX2(unsigned int* depth)
+{
+    int y;
+    __m256i far = _mm256_loadu_si256((__m256i*)depth);
+    __m128i half;
+    for(y = 1; y < HIZ_BLOCK; y++)
+        far = _mm256_max_epu32(far, _mm256_loadu_si256((__m256i*)&depth[y * fbWidth]));
+    half = _mm_max_epu32(_mm256_castsi256_si128(far), _mm256_extracti128_si256(far, 1));
+    half = _mm_max_epu32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+    half = _mm_max_epu32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+    return (unsigned int)_mm_cvtsi128_si32(half);
+}
+#endif
+
+//reads the farthest key of a block back from the depth plane
+unsigned int hizRead(int block)
+{
+    int x, y;
+    int x0 = (block % hizAcross) * HIZ_BLOCK, x1 = min(x0 + HIZ_BLOCK, fbWidth);
+    int y0 = (block / hizAcross) * HIZ_BLOCK, y1 = min(y0 + HIZ_BLOCK, fbHeight);
+    unsigned int far = 0;
+    
+    hizDraws[block] = 0;
+#if defined(HAVE_SIMD_KERNELS)
+    if(rasterKernel == KERNEL_AVX2 && x1 - x0 == HIZ_BLOCK && y1 - y0 == HIZ_BLOCK)
+    {
+        far = hizReadAVX2(&fbDepth[y0 * fbWidth + x0]);
+        hizOpen[block] = (far & FB_TAG_MASK) != fbFrame;
+        return far;
+    }
+#endif
+    for(y = y0; y < y1; y++)
+    {
+        for(x = x0; x < x1; x++)
+        {
+            if(fbDepth[y * fbWidth + x] > far)
+                far = fbDepth[y * fbWidth + x];
+        }
+    }
+    hizOpen[block] = (far & FB_TAG_MASK) != fbFrame;
+    return far;
+}
+
+//whether everything in a block of a tile is nearer than a key, reading
+//the block's key back first if it was drawn on enough to maybe pass
+int hizHidden(int tile, int x0, int y0, int x1, int y1, int block, unsigned int near)
+{
+    if(near <= hizFar[block] && hizDraws[block] >= (hizOpen[block] ? HIZ_OPEN_DRAWS : 1))
+        hizLower(tile, x0, y0, x1, y1, block, hizRead(block));
+    return near > hizFar[block];
+}
+
+//starts a tile's frame with nothing drawn in it
+void hizClearTile(int tile, int x0, int y0, int x1, int y1)
+{
+    int bx, by;
+    for(by = y0 / HIZ_BLOCK; by <= y1 / HIZ_BLOCK; by++)
+    {
+        for(bx = x0 / HIZ_BLOCK; bx <= x1 / HIZ_BLOCK; bx++)
+        {
+            hizFar[by * hizAcross + bx] = HIZ_EMPTY;
+            hizDraws[by * hizAcross + bx] = 0;
+            hizOpen[by * hizAcross + bx] = 1;
+        }
+    }
+    tileFar[tile] = HIZ_EMPTY;
+    memset(&tileHiz[tile], 0, sizeof(struct hizCounts));
+}
+
+//fills the part of a triangle inside the tile (x0, y0)-(x1, y1) like
+//fillTriangle(), unless the tile's key hides all of it, leaving out the
+//8x8 blocks its edges miss or their keys hide
+void hizFillTriangle(struct triangleSetup* t, int tile, int x0, int y0, int x1, int y1)
+{
+    struct hizCounts* counts = &tileHiz[tile];
+    unsigned char blocks[(TILE_SIZE / HIZ_BLOCK) * (TILE_SIZE / HIZ_BLOCK)];
+    int across = (x1 - x0) / HIZ_BLOCK + 1;
+    int xs = max(t->xmin, x0), xe = min(t->xmax, x1);
+    int ys = max(t->ymin, y0), ye = min(t->ymax, y1);
+    int i, bx, by, bx0, bx1, by0, by1, block, inside, covered;
+    int wRow[3], w[3], wFar[3], wNear[3];
+    int drawn = 0, hidden = 0;
+    double zRow, z, zNear, zFar;
+    unsigned int near = hizNearKey(t->znear);
+    
+    if(xs > xe || ys > ye)
+        return;
+    counts->tested++;
+    if(near > tileFar[tile])
+    {
+        counts->culled++;
+        return;
+    }
+    
+    bx0 = (xs - x0) / HIZ_BLOCK;
+    bx1 = (xe - x0) / HIZ_BLOCK;
+    by0 = (ys - y0) / HIZ_BLOCK;
+    by1 = (ye - y0) / HIZ_BLOCK;
+    
+    //most triangles are small enough to lie in one block, which they
+    //can't cover all of
+    if(bx0 == bx1 && by0 == by1)
+    {
+        block = (y0 / HIZ_BLOCK + by0) * hizAcross + x0 / HIZ_BLOCK + bx0;
+        counts->blocks++;
+        if(hizHidden(tile, x0, y0, x1, y1, block, near))
+        {
+            counts->blocksCulled++;
+            counts->culled++;
+            return;
+        }
+        if(hizDraws[block] < 255)
+            hizDraws[block]++;
+        fillTriangle(t, x0, y0, x1, y1, NULL);
+        return;
+    }
+    
+    //edge functions and depth at the first block's corner, and how far
+    //they go up and down across a block from there
+    for(i = 0; i < 3; i++)
+    {
+        wRow[i] = t->w[i] + t->wdx[i] * (x0 + bx0 * HIZ_BLOCK - t->xmin) + t->wdy[i] * (y0 + by0 * HIZ_BLOCK - t->ymin);
+        wFar[i] = max(t->wdx[i], 0) * (HIZ_BLOCK - 1) + max(t->wdy[i], 0) * (HIZ_BLOCK - 1);
+        wNear[i] = min(t->wdx[i], 0) * (HIZ_BLOCK - 1) + min(t->wdy[i], 0) * (HIZ_BLOCK - 1);
+    }
+    zRow = t->z.value + t->z.dx * (x0 + bx0 * HIZ_BLOCK - t->xmin) + t->z.dy * (y0 + by0 * HIZ_BLOCK - t->ymin);
+    zNear = (t->z.dx < 0 ? t->z.dx : 0.0) * (HIZ_BLOCK - 1) + (t->z.dy < 0 ? t->z.dy : 0.0) * (HIZ_BLOCK - 1);
+    zFar = (t->z.dx > 0 ? t->z.dx : 0.0) * (HIZ_BLOCK - 1) + (t->z.dy > 0 ? t->z.dy : 0.0) * (HIZ_BLOCK - 1);
+    
+    for(by = by0; by <= by1; by++)
+    {
+        w[0] = wRow[0];
+        w[1] = wRow[1];
+        w[2] = wRow[2];
+        z = zRow;
+        for(bx = bx0; bx <= bx1; bx++)
+        {
+            //the edge functions are largest and smallest at corners of
+            //the block, it is outside the triangle if one is negative at
+            //all four and inside if none is at any
+            inside = w[0] + wFar[0] >= 0 && w[1] + wFar[1] >= 0 && w[2] + wFar[2] >= 0;
+            covered = w[0] + wNear[0] >= 0 && w[1] + wNear[1] >= 0 && w[2] + wNear[2] >= 0;
+            block = (y0 / HIZ_BLOCK + by) * hizAcross + x0 / HIZ_BLOCK + bx;
+            blocks[by * across + bx] = 0;
+            if(inside)
+            {
+                //and so is the depth plane nearest and farthest
+                counts->blocks++;
+                if(hizHidden(tile, x0, y0, x1, y1, block, hizNearKey(maxd(z + zNear, t->znear))))
+                {
+                    counts->blocksCulled++;
+                    hidden = 1;
+                }
+                else
+                {
+                    blocks[by * across + bx] = 1;
+                    drawn = 1;
+                    if(covered)
+                        hizLower(tile, x0, y0, x1, y1, block, hizFarKey(z + zFar));
+                    else if(hizDraws[block] < 255)
+                        hizDraws[block]++;
+                }
+            }
+            w[0] += t->wdx[0] * HIZ_BLOCK;
+            w[1] += t->wdx[1] * HIZ_BLOCK;
+            w[2] += t->wdx[2] * HIZ_BLOCK;
+            z += t->z.dx * HIZ_BLOCK;
+        }
+        wRow[0] += t->wdy[0] * HIZ_BLOCK;
+        wRow[1] += t->wdy[1] * HIZ_BLOCK;
+        wRow[2] += t->wdy[2] * HIZ_BLOCK;
+        zRow += t->z.dy * HIZ_BLOCK;
+    }
+    
+    //the span kernels skip the blocks outside it as fast
+    if(!drawn)
+        counts->culled++;
+    else
+        fillTriangle(t, x0, y0, x1, y1, hidden ? blocks : NULL);
+}
+
+/*=======================================================================
+VERTEX PROCESSING =======================================================
+=======================================================================*/
+
+#define VERTEX_BLOCK 4096
+
+//camera of the current frame
+int viewport[4];
+double modelview[16];
+double projection[16];
+
+//a camera as the transform kernels see it: projection * modelview
+//followed by the viewport transform, as floats so the batch kernels can
+//use them directly, and the clip space and window coordinates of every
+//mesh vertex it projects
+struct vertexTransform
+{
+    float mvp[16];
+    float scale[3], offset[3];
+    float *clipX, *clipY, *clipZ, *clipW;
+    int *screenX, *screenY;     //28.4 fixed point
+    float *screenZ;
+    float *screenQ;             //1 / w
+    int capacity;
+};
+
+//the frame's camera, and the light's for the shadow map, which keeps
+//vertices of its own so drawing the map leaves the frame's alone
+struct vertexTransform frameView, lightView;
+
+//the clip planes each vertex of the frame is outside of
+unsigned char* outcodes = NULL;
+int vertexCapacity = 0;
+
+//normals of a packed mesh, decoded once a frame with the transform
+float* decodedNormals = NULL;
+
+//normal of a mesh vertex
+float* vertexNormal(int i)
+{
+    return mesh->packed ? &decodedNormals[3 * i] : mesh->vertices[i].normal;
+}
+
+//projects vertices first .. last - 1 one at a time
+void transformScalar(struct vertexTransform* view, int first, int last)
+{
+    int i;
+    float* v;
+    float decoded[3], m[16], scale[3], offset[3];
+    memcpy(m, view->mvp, sizeof(m));
+    memcpy(scale, view->scale, sizeof(scale));
+    memcpy(offset, view->offset, sizeof(offset));
+    for(i = first; i < last; i++)
+    {
+        v = meshPosition(mesh, i, decoded);
+        float x = m[0] * v[0] + m[4] * v[1] + m[8] * v[2] + m[12];
+        float y = m[1] * v[0] + m[5] * v[1] + m[9] * v[2] + m[13];
+        float z = m[2] * v[0] + m[6] * v[1] + m[10] * v[2] + m[14];
+        float w = m[3] * v[0] + m[7] * v[1] + m[11] * v[2] + m[15];
+        view->clipX[i] = x;
+        view->clipY[i] = y;
+        view->clipZ[i] = z;
+        view->clipW[i] = w;
+        view->screenX[i] = toFixed(x / w * scale[0] + offset[0]);
+        view->screenY[i] = toFixed(y / w * scale[1] + offset[1]);
+        view->screenZ[i] = z / w * scale[2] + offset[2];
+        view->screenQ[i] = 1.0f / w;
+    }
+}
+
+#if defined(HAVE_SIMD_KERNELS)
+//projects vertices 4 at a time with the same operations as the scalar
+//version, so both give identical window coordinates
+__attribute__((target("sse2")))
+void transformSSE2(struct vertexTransform* view, int first, int last)
+{
+    int i, c;
+    __m128 m[16], scale[3], offset[3];
+    __m128 one = _mm_set1_ps(1.0f), subpixel = _mm_set1_ps(SUBPIXEL_ONE);
+    for(c = 0; c < 16; c++)
+        m[c] = _mm_set1_ps(view->mvp[c]);
+    for(c = 0; c < 3; c++)
+    {
+        scale[c] = _mm_set1_ps(view->scale[c]);
+        offset[c] = _mm_set1_ps(view->offset[c]);
+    }
+    
+    for(i = first; i + 4 <= last; i += 4)
+    {
+        float decoded[4][3];
+        float* v0 = meshPosition(mesh, i, decoded[0]);
+        float* v1 = meshPosition(mesh, i + 1, decoded[1]);
+        float* v2 = meshPosition(mesh, i + 2, decoded[2]);
+        float* v3 = meshPosition(mesh, i + 3, decoded[3]);
+        __m128 vx = _mm_setr_ps(v0[0], v1[0], v2[0], v3[0]);
+        __m128 vy = _mm_setr_ps(v0[1], v1[1], v2[1], v3[1]);
+        __m128 vz = _mm_setr_ps(v0[2], v1[2], v2[2], v3[2]);
+        __m128 x = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0], vx), _mm_mul_ps(m[4], vy)), _mm_mul_ps(m[8], vz)), m[12]);
+        __m128 y = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[1], vx), _mm_mul_ps(m[5], vy)), _mm_mul_ps(m[9], vz)), m[13]);
+        __m128 z = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[2], vx), _mm_mul_ps(m[6], vy)), _mm_mul_ps(m[10], vz)), m[14]);
+        __m128 w = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[3], vx), _mm_mul_ps(m[7], vy)), _mm_mul_ps(m[11], vz)), m[15]);
+        _mm_storeu_ps(&view->clipX[i], x);
+        _mm_storeu_ps(&view->clipY[i], y);
+        _mm_storeu_ps(&view->clipZ[i], z);
+        _mm_storeu_ps(&view->clipW[i], w);
+        x = _mm_add_ps(_mm_mul_ps(_mm_div_ps(x, w), scale[0]), offset[0]);
+        y = _mm_add_ps(_mm_mul_ps(_mm_div_ps(y, w), scale[1]), offset[1]);
+        _mm_storeu_si128((__m128i*)&view->screenX[i], _mm_cvtps_epi32(_mm_mul_ps(x, subpixel)));
+        _mm_storeu_si128((__m128i*)&view->screenY[i], _mm_cvtps_epi32(_mm_mul_ps(y, subpixel)));
+        _mm_storeu_ps(&view->screenZ[i], _mm_add_ps(_mm_mul_ps(_mm_div_ps(z, w), scale[2]), offset[2]));
+        _mm_storeu_ps(&view->screenQ[i], _mm_div_ps(one, w));
+    }
+    transformScalar(view, i, last);
+}
+#endif
+
+/*=======================================================================
+CLIPPING ================================================================
+=======================================================================*/
+
+//how far past the screen (in pixels) a triangle may reach before
+//it is clipped, keeps window coordinates and edge functions well inside
+//int range while letting most triangles that cross the border skip clipping
+#define GUARD_BAND 2048
+
+//clip planes as (a, b, c, d): a vertex is inside if ax + by + cz + dw >= 0
+//the view frustum planes only reject triangles, the near plane and the
+//guard-band planes are the ones triangles actually get clipped against
+#define PLANE_LEFT 0
+#define PLANE_RIGHT 1
+#define PLANE_BOTTOM 2
+#define PLANE_TOP 3
+#define PLANE_NEAR 4
+#define PLANE_FAR 5
+#define PLANE_GUARD_LEFT 6
+#define PLANE_GUARD_RIGHT 7
+#define PLANE_GUARD_BOTTOM 8
+#define PLANE_GUARD_TOP 9
+#define NUM_PLANES 10
+#define FRUSTUM_PLANES 0x3f
+#define CLIPPING_PLANES 0x3d0
+
+float clipPlanes[NUM_PLANES][4] = {
+    {  1,  0,  0, 1 },  //left
+    { -1,  0,  0, 1 },  //right
+    {  0,  1,  0, 1 },  //bottom
+    {  0, -1,  0, 1 },  //top
+    {  0,  0,  1, 1 },  //near
+    {  0,  0, -1, 1 },  //far
+};
+
+//a vertex in clip space carrying its shaded color, texture and shadow
+//map coordinates
+struct clipVertex
+{
+    float x, y, z, w;
+    struct RGBType color;
+    float u, v;
+};
+
+//the guard band in normalized device coordinates depends on the viewport
+void setupClipPlanes(void)
+{
+    float left = (-GUARD_BAND - frameView.offset[0]) / frameView.scale[0];
+    float right = (fbWidth - 1 + GUARD_BAND - frameView.offset[0]) / frameView.scale[0];
+    float bottom = (-GUARD_BAND - frameView.offset[1]) / frameView.scale[1];
+    float top = (fbHeight - 1 + GUARD_BAND - frameView.offset[1]) / frameView.scale[1];
+    float planes[4][4] = {
+        {  1,  0, 0, -left },
+        { -1,  0, 0, right },
+        {  0,  1, 0, -bottom },
+        {  0, -1, 0, top },
+    };
+    memcpy(clipPlanes[PLANE_GUARD_LEFT], planes, sizeof(planes));
+}
+
+float planeDistance(float* plane, float x, float y, float z, float w)
+{
+    return plane[0] * x + plane[1] * y + plane[2] * z + plane[3] * w;
+}
+
+//sets bit i of a vertex's outcode when it is outside clip plane i
+void computeOutcodes(int first, int last)
+{
+    int i, p;
+    for(i = first; i < last; i++)
+    {
+        int code = 0;
+        for(p = 0; p < NUM_PLANES; p++)
+        {
+            if(planeDistance(clipPlanes[p], frameView.clipX[i], frameView.clipY[i], frameView.clipZ[i], frameView.clipW[i]) < 0)
+                code |= 1 << p;
+        }
+        outcodes[i] = code;
+    }
+}
+
+//clips a convex polygon against one plane (Sutherland-Hodgman), returns
+//the number of vertices written to out (at most n + 1)
+int clipPolygon(struct clipVertex* in, int n, float* plane, struct clipVertex* out)
+{
+    int i, count = 0;
+    for(i = 0; i < n; i++)
+    {
+        struct clipVertex* a = &in[i];
+        struct clipVertex* b = &in[(i + 1) % n];
+        float da = planeDistance(plane, a->x, a->y, a->z, a->w);
+        float db = planeDistance(plane, b->x, b->y, b->z, b->w);
+        if(da >= 0)
+            out[count++] = *a;
+        if((da >= 0) != (db >= 0))
+        {
+            float t = da / (da - db);
+            struct clipVertex* c = &out[count++];
+            c->x = a->x + (b->x - a->x) * t;
+            c->y = a->y + (b->y - a->y) * t;
+            c->z = a->z + (b->z - a->z) * t;
+            c->w = a->w + (b->w - a->w) * t;
+            c->color.r = a->color.r + (b->color.r - a->color.r) * t;
+            c->color.g = a->color.g + (b->color.g - a->color.g) * t;
+            c->color.b = a->color.b + (b->color.b - a->color.b) * t;
+            c->u = a->u + (b->u - a->u) * t;
+            c->v = a->v + (b->v - a->v) * t;
+        }
+    }
+    return count;
+}
+
+//clips a triangle against the planes in the mask, returns the number of
+//vertices of the resulting convex polygon (0 if nothing is left)
+int clipTriangle(struct clipVertex* polygon, int mask)
+{
+    struct clipVertex scratch[3 + NUM_PLANES];
+    int p, n = 3;
+    for(p = 0; p < NUM_PLANES && n > 0; p++)
+    {
+        if(mask & (1 << p))
+        {
+            n = clipPolygon(polygon, n, clipPlanes[p], scratch);
+            memcpy(polygon, scratch, sizeof(struct clipVertex) * n);
+        }
+    }
+    return n;
+}
+
+/*=======================================================================
+PIPELINE ================================================================
+=======================================================================*/
+
+//projects one block of vertices, with SSE2 whenever a SIMD span kernel
+//is selected so the 'v' check covers the transform as well, and decodes
+//their normals if the mesh is packed
+void vertexJob(int block)
+{
+    int first = block * VERTEX_BLOCK;
+    int last = min(first + VERTEX_BLOCK, mesh->numvertices);
+#if defined(HAVE_SIMD_KERNELS)
+    if(rasterKernel != KERNEL_SCALAR)
+        transformSSE2(&frameView, first, last);
+    else
+#endif
+    transformScalar(&frameView, first, last);
+    computeOutcodes(first, last);
+    if(mesh->packed)
+    {
+        for(int i = first; i < last; i++)
+            meshNormal(mesh, i, &decodedNormals[3 * i]);
+    }
+}
+
+//makes a transform's vertex arrays as large as the mesh's vertex array
+void reserveTransform(struct vertexTransform* view)
+{
+    if(view->capacity < (int)mesh->numvertices + 1)
+    {
+        view->capacity = mesh->numvertices + 1;
+        view->screenX = (int*)realloc(view->screenX, sizeof(int) * view->capacity);
+        view->screenY = (int*)realloc(view->screenY, sizeof(int) * view->capacity);
+        view->screenZ = (float*)realloc(view->screenZ, sizeof(float) * view->capacity);
+        view->screenQ = (float*)realloc(view->screenQ, sizeof(float) * view->capacity);
+        view->clipX = (float*)realloc(view->clipX, sizeof(float) * view->capacity);
+        view->clipY = (float*)realloc(view->clipY, sizeof(float) * view->capacity);
+        view->clipZ = (float*)realloc(view->clipZ, sizeof(float) * view->capacity);
+        view->clipW = (float*)realloc(view->clipW, sizeof(float) * view->capacity);
+    }
+}
+
+//makes the frame's per vertex arrays as large as the mesh's vertex array
+void reserveVertices(void)
+{
+    reserveTransform(&frameView);
+    if(vertexCapacity < (int)mesh->numvertices + 1)
+    {
+        vertexCapacity = mesh->numvertices + 1;
+        outcodes = (unsigned char*)realloc(outcodes, vertexCapacity);
+        decodedNormals = (float*)realloc(decodedNormals, sizeof(float) * 3 * vertexCapacity);
+    }
+}
+
+//projects every mesh vertex once with the camera of the frame, so the
+//transform costs scale with the vertex count rather than the corner count
+void transformVertices(void)
+{
+    double m[16];
+    int c;
+    
+    //column major, mvp = projection * modelview
+    multiplyMatrix(m, projection, modelview);
+    for(c = 0; c < 16; c++)
+        frameView.mvp[c] = m[c];
+    frameView.scale[0] = viewport[2] / 2.0;
+    frameView.scale[1] = viewport[3] / 2.0;
+    frameView.scale[2] = 0.5;
+    frameView.offset[0] = viewport[0] + viewport[2] / 2.0;
+    frameView.offset[1] = viewport[1] + viewport[3] / 2.0;
+    frameView.offset[2] = 0.5;
+    
+    reserveVertices();
+    setupClipPlanes();
+    
+    parallelFor(vertexJob, (mesh->numvertices + VERTEX_BLOCK - 1) / VERTEX_BLOCK);
+}
+
+//model space to the frame's window coordinates and back, for what
+//deferred shading needs to know of a pixel's place in the model
+double modelToWindow[16];
+double windowToModel[16];
+
+void setupWindowMatrices(void)
+{
+    double window[16];
+    
+    memset(window, 0, sizeof(window));
+    window[0] = frameView.scale[0];
+    window[5] = frameView.scale[1];
+    window[10] = frameView.scale[2];
+    window[12] = frameView.offset[0];
+    window[13] = frameView.offset[1];
+    window[14] = frameView.offset[2];
+    window[15] = 1.0;
+    multiplyMatrix(modelToWindow, projection, modelview);
+    multiplyMatrix(modelToWindow, window, modelToWindow);
+    if(!invertMatrix(windowToModel, modelToWindow))
+        memset(windowToModel, 0, sizeof(windowToModel));
+}
+
+#define GEOMETRY_BLOCK 1024
+
+struct pipelineStats frameStats;
+
+//triangles set up by one geometry block, in submission order
+struct geometryBlock
+{
+    int count;
+    int capacity;
+    struct triangleSetup* setups;
+    struct pipelineStats stats;
+};
+
+//the next setup at the end of a block's list, growing it if needed;
+//it is on the list once the caller counts it
+struct triangleSetup* nextSetup(struct geometryBlock* block)
+{
+    if(block->count == block->capacity)
+    {
+        block->capacity = max(64, block->capacity * 2);
+        block->setups = (struct triangleSetup*)realloc(block->setups, sizeof(struct triangleSetup) * block->capacity);
+    }
+    return &block->setups[block->count];
+}
+
+//the group of a draw triangle, the last of count groups starting at or
+//before it
+int findGroup(int* first, int count, int triangle)
+{
+    int lo = 0, hi = count - 1, mid;
+    while(lo < hi)
+    {
+        mid = (lo + hi + 1) / 2;
+        if(first[mid] <= triangle)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+//per frame state shared with the jobs
+struct geometryBlock* blocks = NULL;
+int numBlocks = 0, blockCapacity = 0;
+int* groupFirst = NULL;         //first draw triangle of every mesh group
+int* drawGroups = NULL;         //mesh groups in the order they are drawn
+float* groupNear = NULL;        //nearest window z of every mesh group
+int numDraw = 0, groupCapacity = 0;
+int sortGroups = 0;             //draw the groups nearest first
+struct texture* pipelineTexture = NULL;
+int textureFilter = TEXTURE_TRILINEAR;
+int cullBackFaces = 0;          //mirrors GL_CULL_FACE
+int deferredFrame = 0;          //this frame fills the G-buffer
+
+//models without a material library still get the default material
+GLMmaterial defaultMaterial = { NULL, { 0.8, 0.8, 0.8, 1.0 }, { 0.2, 0.2, 0.2, 1.0 }, { 0.0, 0.0, 0.0, 1.0 }, { 0.0, 0.0, 0.0, 1.0 }, 65.0 };
+
+//the G-buffer has a byte for the material index of a pixel
+#define GBUFFER_MATERIALS 256
+
+//computeShade calls of each tile's deferred shading
+int* tileShaded = NULL;
+
+//material of a draw triangle
+GLMmaterial drawMaterial(int index)
+{
+    return model->materials ? model->materials[index] : defaultMaterial;
+}
+
+/*=======================================================================
+LIGHT CACHE =============================================================
+=======================================================================*/
+
+#define LIGHT_BLOCK 4096
+
+//Gouraud colors of the mesh vertices, lit once per frame for the
+//material of the first triangle that uses them, so a vertex shared by
+//several triangles is not lit again at every corner
+int* vertexMaterial = NULL;      //-1 if no triangle uses the vertex
+struct RGBType* lightCache = NULL;
+int lightCapacity = 0;
+int numLit = 0;                  //vertices lit this frame
+
+//lights one block of vertices
+void lightJob(int block)
+{
+    int i;
+    int first = block * LIGHT_BLOCK;
+    int last = min(first + LIGHT_BLOCK, mesh->numvertices);
+    float* n;
+    for(i = first; i < last; i++)
+    {
+        if(vertexMaterial[i] < 0)
+            continue;
+        n = vertexNormal(i);
+        lightCache[i] = computeShade(n[0], n[1], n[2], drawMaterial(vertexMaterial[i]), modelview);
+    }
+}
+
+//clears the cache and makes it as large as the mesh's vertex array
+void resetLightCache(void)
+{
+    int i;
+    if(lightCapacity < (int)mesh->numvertices)
+    {
+        lightCapacity = mesh->numvertices;
+        vertexMaterial = (int*)realloc(vertexMaterial, sizeof(int) * lightCapacity);
+        lightCache = (struct RGBType*)realloc(lightCache, sizeof(struct RGBType) * lightCapacity);
+    }
+    for(i = 0; i < (int)mesh->numvertices; i++)
+        vertexMaterial[i] = -1;
+    numLit = 0;
+}
+
+//claims a vertex for a material, the first material drawn with it wins
+void useVertex(int i, int material)
+{
+    if(vertexMaterial[i] < 0)
+    {
+        vertexMaterial[i] = material;
+        numLit++;
+    }
+}
+
+//Gouraud color of a triangle corner, from the cache unless its vertex
+//was claimed by another material
+struct RGBType cachedShade(int i, int material, struct pipelineStats* stats)
+{
+    float* n;
+    if(vertexMaterial[i] == material)
+        return lightCache[i];
+    stats->shaded++;
+    n = vertexNormal(i);
+    return computeShade(n[0], n[1], n[2], drawMaterial(material), modelview);
+}
+
+/*=======================================================================
+SHADOW PASS =============================================================
+=======================================================================*/
+
+//the shadow map is rendered like a frame with less to do: the same
+//transforms project the vertices, and the same setup, bins and tile
+//jobs rasterize the triangles, but into window z only, and the nearest
+//z wins whatever order they come in. When the frame culls back faces,
+//so does the light: a surface turned from it is in shadow anyway, and
+//in a closed model the surface facing the light is always the nearest.
+#define SHADOW_TILES (SHADOW_SIZE / TILE_SIZE)
+
+double lightWindow[16];         //model space to shadow map window
+double frameToLight[16];        //frame window to shadow map window
+struct tileBin shadowBins[SHADOW_TILES * SHADOW_TILES];
+struct geometryBlock* shadowBlocks = NULL;
+int numShadowBlocks = 0, shadowBlockCapacity = 0;
+int* shadowFirst = NULL;        //first triangle of every mesh group
+int numShadowDraw = 0, shadowGroupCapacity = 0;
+
+//what the shadow map in shadowDepth was drawn for
+unsigned int shadowSerial = 0;  //the mesh's serial, 0 for none
+int shadowCulled, shadowKernel;
+int shadowMapDrawn = 0;         //by the last frame
+
+//projects one block of vertices from the light like vertexJob()
+void shadowVertexJob(int block)
+{
+    int first = block * VERTEX_BLOCK;
+    int last = min(first + VERTEX_BLOCK, mesh->numvertices);
+#if defined(HAVE_SIMD_KERNELS)
+    if(rasterKernel != KERNEL_SCALAR)
+        transformSSE2(&lightView, first, last);
+    else
+#endif
+    transformScalar(&lightView, first, last);
+}
+
+//sets up one block of the mesh's triangles in the shadow map, pushed
+//away from the light by their bias, unless they are culled
+void shadowGeometryJob(int index)
+{
+    int i, j, k, g;
+    int first = index * GEOMETRY_BLOCK;
+    int last = min(first + GEOMETRY_BLOCK, numShadowDraw);
+    struct geometryBlock* block = &shadowBlocks[index];
+    struct meshGroup* group;
+    struct projectedPoint pts[3];
+    struct triangleSetup* t;
+    double e[3], invArea;
+    
+    block->count = 0;
+    g = findGroup(shadowFirst, mesh->numgroups, first);
+    for(i = first; i < last; i++)
+    {
+        while(i >= shadowFirst[g + 1])
+            g++;
+        group = &mesh->groups[g];
+        k = 3 * (i - shadowFirst[g]);
+        for(j = 0; j < 3; j++)
+        {
+            int v = meshIndex(group, k + j);
+            pts[j].x = lightView.screenX[v];
+            pts[j].y = lightView.screenY[v];
+            pts[j].z = lightView.screenZ[v];
+        }
+        if(cullBackFaces && edgeFunction(pts[0], pts[1], pts[2].x, pts[2].y) < 0)
+            continue;
+        t = nextSetup(block);
+        if(setupCoverage(pts[0], pts[1], pts[2], SHADOW_SIZE, SHADOW_SIZE, t, e, &invArea))
+        {
+            t->z.value += SHADOW_SLOPE_BIAS * maxd(fabs(t->z.dx), fabs(t->z.dy)) + SHADOW_BIAS;
+            block->count++;
+        }
+    }
+}
+
+//shadow map rows: count texels from depth on, with the edge functions
+//w and window z at the first and their steps per texel. Texel k gets
+//z + zdx * k in every kernel, so they all draw the same map.
+void shadowRowScalar(float* depth, int count, int* w, int* wdx, float z, float zdx)
+{
+    int k;
+    int w1 = w[0], w2 = w[1], w3 = w[2];
+    for(k = 0; k < count; k++)
+    {
+        float zk = z + zdx * (float)k;
+        if((w1 | w2 | w3) >= 0 && zk < depth[k])
+            depth[k] = zk;
+        w1 += wdx[0];
+        w2 += wdx[1];
+        w3 += wdx[2];
+    }
+}
+
+#if defined(HAVE_SIMD_KERNELS)
+//4 texels at a time, count is a multiple of 4
+__attribute__((target("sse2")))
+void shadowRowSSE2(float* depth, int count, int* w, int* wdx, float z, float zdx)
+{
+    int k;
+    __m128i minusOne = _mm_set1_epi32(-1);
+    __m128i w1 = _mm_setr_epi32(w[0], w[0] + wdx[0], w[0] + 2 * wdx[0], w[0] + 3 * wdx[0]);
+    __m128i w2 = _mm_setr_epi32(w[1], w[1] + wdx[1], w[1] + 2 * wdx[1], w[1] + 3 * wdx[1]);
+    __m128i w3 = _mm_setr_epi32(w[2], w[2] + wdx[2], w[2] + 2 * wdx[2], w[2] + 3 * wdx[2]);
+    __m128i w1step = _mm_set1_epi32(4 * wdx[0]);
+    __m128i w2step = _mm_set1_epi32(4 * wdx[1]);
+    __m128i w3step = _mm_set1_epi32(4 * wdx[2]);
+    __m128 kf = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f), kstep = _mm_set1_ps(4.0f);
+    __m128 z0 = _mm_set1_ps(z), dz = _mm_set1_ps(zdx);
+    for(k = 0; k < count; k += 4)
+    {
+        __m128 inside = _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_or_si128(w1, _mm_or_si128(w2, w3)), minusOne));
+        __m128 old = _mm_loadu_ps(&depth[k]);
+        __m128 zk = _mm_add_ps(z0, _mm_mul_ps(dz, kf));
+        __m128 nearer = _mm_and_ps(inside, _mm_cmplt_ps(zk, old));
+        _mm_storeu_ps(&depth[k], _mm_or_ps(_mm_and_ps(nearer, zk), _mm_andnot_ps(nearer, old)));
+        w1 = _mm_add_epi32(w1, w1step);
+        w2 = _mm_add_epi32(w2, w2step);
+        w3 = _mm_add_epi32(w3, w3step);
+        kf = _mm_add_ps(kf, kstep);
+    }
+}
+
+//8 texels at a time, count is a multiple of 8
+__attribute__((target("avx2")))
+void shadowRowAVX2(float* depth, int count, int* w, int* wdx, float z, float zdx)
+{
+    int k;
+    __m256i minusOne = _mm256_set1_epi32(-1);
+    __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i w1 = _mm256_add_epi32(_mm256_set1_epi32(w[0]), _mm256_mullo_epi32(lane, _mm256_set1_epi32(wdx[0])));
+    __m256i w2 = _mm256_add_epi32(_mm256_set1_epi32(w[1]), _mm256_mullo_epi32(lane, _mm256_set1_epi32(wdx[1])));
+    __m256i w3 = _mm256_add_epi32(_mm256_set1_epi32(w[2]), _mm256_mullo_epi32(lane, _mm256_set1_epi32(wdx[2])));
+    __m256i w1step = _mm256_set1_epi32(8 * wdx[0]);
+    __m256i w2step = _mm256_set1_epi32(8 * wdx[1]);
+    __m256i w3step = _mm256_set1_epi32(8 * wdx[2]);
+    __m256 kf = _mm256_cvtepi32_ps(lane), kstep = _mm256_set1_ps(8.0f);
+    __m256 z0 = _mm256_set1_ps(z), dz = _mm256_set1_ps(zdx);
+    for(k = 0; k < count; k += 8)
+    {
+        __m256 inside = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_or_si256(w1, _mm256_or_si256(w2, w3)), minusOne));
+        __m256 old = _mm256_loadu_ps(&depth[k]);
+        __m256 zk = _mm256_add_ps(z0, _mm256_mul_ps(dz, kf));
+        __m256 nearer = _mm256_and_ps(inside, _mm256_cmp_ps(zk, old, _CMP_LT_OQ));
+        _mm256_storeu_ps(&depth[k], _mm256_blendv_ps(old, zk, nearer));
+        w1 = _mm256_add_epi32(w1, w1step);
+        w2 = _mm256_add_epi32(w2, w2step);
+        w3 = _mm256_add_epi32(w3, w3step);
+        kf = _mm256_add_ps(kf, kstep);
+    }
+}
+#endif
+
+void (*shadowRows[])(float*, int, int*, int*, float, float) = {
+    shadowRowScalar,
+#if defined(HAVE_SIMD_KERNELS)
+    shadowRowSSE2,
+    shadowRowAVX2,
+#endif
+};
+
+//the part of the 4x4 texels from depth on, SHADOW_SIZE apart, that
+//lights a pixel at window z from the light, each weighed by how much of
+//the 3x3 bilinear taps around it cover it: 1 - fx, 1, 1, fx across and
+//1 - fy, 1, 1, fy up. Each column sums its rows in order and the
+//columns are added in pairs, the order SSE2 adds its lanes in, so both
+//kernels give the same visibility bit for bit.
+float shadowTapsScalar(float* depth, float fx, float fy, float z)
+{
+    int i, j;
+    float wx[SHADOW_TAPS + 1] = { 1.0f - fx, 1.0f, 1.0f, fx };
+    float wy[SHADOW_TAPS + 1] = { 1.0f - fy, 1.0f, 1.0f, fy };
+    float acc[SHADOW_TAPS + 1] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    for(j = 0; j <= SHADOW_TAPS; j++, depth += SHADOW_SIZE)
+    {
+        for(i = 0; i <= SHADOW_TAPS; i++)
+            acc[i] += wy[j] * (z <= depth[i] ? wx[i] : 0.0f);
+    }
+    return ((acc[0] + acc[2]) + (acc[1] + acc[3])) * (1.0f / (SHADOW_TAPS * SHADOW_TAPS));
+}
+
+#if defined(HAVE_SIMD_KERNELS)
+//the column sums of shadowTapsScalar() in 4 lanes, a row of 4 texels
+//at a time
+__attribute__((target("sse2")))
+__m128 shadowColumnsSSE2(float* depth, float fx, float fy, float z)
+{
+    __m128 wx = _mm_setr_ps(1.0f - fx, 1.0f, 1.0f, fx), z0 = _mm_set1_ps(z);
+    __m128 acc = _mm_mul_ps(_mm_set1_ps(1.0f - fy), _mm_and_ps(_mm_cmple_ps(z0, _mm_loadu_ps(depth)), wx));
+    acc = _mm_add_ps(acc, _mm_and_ps(_mm_cmple_ps(z0, _mm_loadu_ps(depth + SHADOW_SIZE)), wx));
+    acc = _mm_add_ps(acc, _mm_and_ps(_mm_cmple_ps(z0, _mm_loadu_ps(depth + 2 * SHADOW_SIZE)), wx));
+    return _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(fy), _mm_and_ps(_mm_cmple_ps(z0, _mm_loadu_ps(depth + 3 * SHADOW_SIZE)), wx)));
+}
+
+__attribute__((target("sse2")))
+float shadowTapsSSE2(float* depth, float fx, float fy, float z)
+{
+    __m128 acc = shadowColumnsSSE2(depth, fx, fy, z);
+    acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+    return _mm_cvtss_f32(_mm_mul_ss(acc, _mm_set_ss(1.0f / (SHADOW_TAPS * SHADOW_TAPS))));
+}
+#endif
+
+//the part of a pixel at shadow map point (x, y) and window z from the
+//light that is lit, by percentage closer filtering over the texels
+//around it; outside the map is lit. Kernels that lie wholly inside the
+//map go to the taps of the selected kernel.
+float shadowVisibility(float x, float y, float z)
+{
+    int i, j, tx, ty, sx, sy;
+    float fx, fy, wx[SHADOW_TAPS + 1], wy[SHADOW_TAPS + 1];
+    float acc[SHADOW_TAPS + 1] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    float* depth;
+    
+    x -= 0.5f;
+    y -= 0.5f;
+    tx = (int)floorf(x);
+    ty = (int)floorf(y);
+    fx = x - tx;
+    fy = y - ty;
+    tx -= SHADOW_TAPS / 2;
+    ty -= SHADOW_TAPS / 2;
+    if(tx >= 0 && ty >= 0 && tx + SHADOW_TAPS < SHADOW_SIZE && ty + SHADOW_TAPS < SHADOW_SIZE)
+    {
+        depth = &shadowDepth[ty * SHADOW_SIZE + tx];
+#if defined(HAVE_SIMD_KERNELS)
+        if(rasterKernel != KERNEL_SCALAR)
+            return shadowTapsSSE2(depth, fx, fy, z);
+#endif
+        return shadowTapsScalar(depth, fx, fy, z);
+    }
+    
+    for(i = 0; i <= SHADOW_TAPS; i++)
+        wx[i] = wy[i] = 1.0f;
+    wx[0] = 1.0f - fx;
+    wx[SHADOW_TAPS] = fx;
+    wy[0] = 1.0f - fy;
+    wy[SHADOW_TAPS] = fy;
+    for(j = 0; j <= SHADOW_TAPS; j++)
+    {
+        sy = ty + j;
+        depth = sy >= 0 && sy < SHADOW_SIZE ? &shadowDepth[sy * SHADOW_SIZE] : NULL;
+        for(i = 0; i <= SHADOW_TAPS; i++)
+        {
+            sx = tx + i;
+            acc[i] += wy[j] * (!depth || sx < 0 || sx >= SHADOW_SIZE || z <= depth[sx] ? wx[i] : 0.0f);
+        }
+    }
+    return ((acc[0] + acc[2]) + (acc[1] + acc[3])) * (1.0f / (SHADOW_TAPS * SHADOW_TAPS));
+}
+
+//shadowVisibility() of the frame pixel (x, y) with depth key "key",
+//taken into the shadow map through frameToLight
+float pixelVisibility(int x, int y, unsigned int key)
+{
+    double* m = frameToLight;
+    double z = (key & ~FB_TAG_MASK) / FB_DEPTH_SCALE;
+    double sw = m[3] * (x + 0.5) + m[7] * (y + 0.5) + m[11] * z + m[15];
+    if(sw == 0.0)
+        return 1.0f;
+    sw = 1.0 / sw;
+    return shadowVisibility((m[0] * (x + 0.5) + m[4] * (y + 0.5) + m[8] * z + m[12]) * sw,
+                            (m[1] * (x + 0.5) + m[5] * (y + 0.5) + m[9] * z + m[13]) * sw,
+                            (m[2] * (x + 0.5) + m[6] * (y + 0.5) + m[10] * z + m[14]) * sw);
+}
+
+//the pixelVisibility() of count pixels of frame row y from x on, whose
+//depth keys start at keys, into visible. Pixels not drawn this frame
+//may get any visibility.
+void visibilityRowScalar(float* visible, unsigned int* keys, int x, int y, int count)
+{
+    int i;
+    for(i = 0; i < count; i++)
+        visible[i] = (keys[i] & FB_TAG_MASK) == fbFrame ? pixelVisibility(x + i, y, keys[i]) : 1.0f;
+}
+
+#if defined(HAVE_SIMD_KERNELS)
+//projects and places 4 pixels at a time with the same operations as
+//pixelVisibility() and shadowVisibility(), then reads their taps and
+//adds up their columns together; any 4 with a pixel near the map's
+//edges or on the light's horizon go one by one
+__attribute__((target("sse2")))
+void visibilityRowSSE2(float* visible, unsigned int* keys, int x, int y, int count)
+{
+    int i, k;
+    double* m = frameToLight;
+    int tx[4], ty[4];
+    float fx[4], fy[4], fz[4];
+    __m128d c[16], half = _mm_set1_pd(0.5);
+    __m128d wy = _mm_set1_pd(y + 0.5);
+    __m128i depthMask = _mm_set1_epi32(~FB_TAG_MASK), tag = _mm_set1_epi32(fbFrame);
+    __m128i lowest = _mm_set1_epi32(SHADOW_TAPS / 2), highest = _mm_set1_epi32(SHADOW_SIZE - 1 - SHADOW_TAPS);
+    for(k = 0; k < 16; k++)
+        c[k] = _mm_set1_pd(m[k]);
+    
+    for(i = 0; i + 4 <= count; i += 4)
+    {
+        __m128i key = _mm_loadu_si128((__m128i*)&keys[i]), t[2];
+        __m128 p[3], f[2], depth, columns[4];
+        __m128d flat = _mm_setzero_pd();
+        int h, j;
+        if(!_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_andnot_si128(depthMask, key), tag))))
+        {
+            _mm_storeu_ps(&visible[i], _mm_set1_ps(1.0f));
+            continue;
+        }
+        depth = _mm_div_ps(_mm_cvtepi32_ps(_mm_and_si128(key, depthMask)), _mm_set1_ps(FB_DEPTH_SCALE));
+        for(h = 0; h < 2; h++)
+        {
+            __m128d wx = _mm_add_pd(_mm_cvtepi32_pd(_mm_setr_epi32(x + i + 2 * h, x + i + 2 * h + 1, 0, 0)), half);
+            __m128d z = _mm_cvtps_pd(h ? _mm_movehl_ps(depth, depth) : depth);
+            __m128d sw = _mm_add_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(c[3], wx), _mm_mul_pd(c[7], wy)), _mm_mul_pd(c[11], z)), c[15]);
+            flat = _mm_or_pd(flat, _mm_cmpeq_pd(sw, _mm_setzero_pd()));
+            sw = _mm_div_pd(_mm_set1_pd(1.0), sw);
+            for(j = 0; j < 3; j++)
+            {
+                __m128 v = _mm_cvtpd_ps(_mm_mul_pd(_mm_add_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(c[j], wx), _mm_mul_pd(c[4 + j], wy)),
+                                                                         _mm_mul_pd(c[8 + j], z)), c[12 + j]), sw));
+                p[j] = h ? _mm_movelh_ps(p[j], v) : v;
+            }
+        }
+        for(j = 0; j < 2; j++)
+        {
+            //floorf(): truncate, then step down where that went up
+            __m128 v = _mm_sub_ps(p[j], _mm_set1_ps(0.5f));
+            __m128i n = _mm_cvttps_epi32(v);
+            n = _mm_add_epi32(n, _mm_castps_si128(_mm_cmplt_ps(v, _mm_cvtepi32_ps(n))));
+            f[j] = _mm_sub_ps(v, _mm_cvtepi32_ps(n));
+            t[j] = _mm_sub_epi32(n, lowest);
+        }
+        if(_mm_movemask_pd(flat) ||
+           _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_cmplt_epi32(t[0], _mm_setzero_si128()), _mm_cmpgt_epi32(t[0], highest)),
+                                          _mm_or_si128(_mm_cmplt_epi32(t[1], _mm_setzero_si128()), _mm_cmpgt_epi32(t[1], highest)))))
+        {
+            visibilityRowScalar(&visible[i], &keys[i], x + i, y, 4);
+            continue;
+        }
+        _mm_storeu_si128((__m128i*)tx, t[0]);
+        _mm_storeu_si128((__m128i*)ty, t[1]);
+        _mm_storeu_ps(fx, f[0]);
+        _mm_storeu_ps(fy, f[1]);
+        _mm_storeu_ps(fz, p[2]);
+        for(k = 0; k < 4; k++)
+            columns[k] = shadowColumnsSSE2(&shadowDepth[ty[k] * SHADOW_SIZE + tx[k]], fx[k], fy[k], fz[k]);
+        _MM_TRANSPOSE4_PS(columns[0], columns[1], columns[2], columns[3]);
+        _mm_storeu_ps(&visible[i], _mm_mul_ps(_mm_add_ps(_mm_add_ps(columns[0], columns[2]), _mm_add_ps(columns[1], columns[3])),
+                                              _mm_set1_ps(1.0f / (SHADOW_TAPS * SHADOW_TAPS))));
+    }
+    visibilityRowScalar(&visible[i], &keys[i], x + i, y, count - i);
+}
+#endif
+
+//the AVX2 kernel looks up its shadows with the SSE2 row: placing a
+//pixel in the map is bound by its double divide, which a 256 bit
+//register does no faster per lane, and an AVX2 row ran slower than
+//this one. visibilityNames tells which row each kernel runs.
+void (*visibilityRows[])(float*, unsigned int*, int, int, int) = {
+    visibilityRowScalar,
+#if defined(HAVE_SIMD_KERNELS)
+    visibilityRowSSE2,
+    visibilityRowSSE2,
+#endif
+};
+char* visibilityNames[] = { "scalar", "SSE2", "SSE2" };
+
+//keeps the nearest window z of the part of a triangle inside the tile
+//(x0, y0)-(x1, y1) of the shadow map, a row at a time with the shadow
+//row kernel of the selected span kernel. The rows run from and to
+//multiples of 8 texels, which the tile's edges are too: the texels
+//they add are outside the bounding box and so outside the triangle.
+void shadowFillTriangle(struct triangleSetup* t, int x0, int y0, int x1, int y1)
+{
+    int y, i, w[3];
+    int xs = max(t->xmin, x0) & ~7, xe = min(t->xmax, x1) | 7;
+    int ys = max(t->ymin, y0), ye = min(t->ymax, y1);
+    void (*row)(float*, int, int*, int*, float, float) = shadowRows[rasterKernel];
+    
+    if(xs > xe || ys > ye)
+        return;
+    int ox = xs - t->xmin, oy = ys - t->ymin;
+    for(i = 0; i < 3; i++)
+        w[i] = t->w[i] + t->wdx[i] * ox + t->wdy[i] * oy;
+    double zRow = t->z.value + t->z.dx * ox + t->z.dy * oy;
+    
+    for(y = ys; y <= ye; y++)
+    {
+        row(&shadowDepth[y * SHADOW_SIZE + xs], xe - xs + 1, w, t->wdx, zRow, t->z.dx);
+        for(i = 0; i < 3; i++)
+            w[i] += t->wdy[i];
+        zRow += t->z.dy;
+    }
+}
+
+//clears one tile of the shadow map and rasterizes its bin
+void shadowTileJob(int tile)
+{
+    int i, y;
+    int x0 = (tile % SHADOW_TILES) * TILE_SIZE;
+    int y0 = (tile / SHADOW_TILES) * TILE_SIZE;
+    struct tileBin* bin = &shadowBins[tile];
+    
+    for(y = y0; y < y0 + TILE_SIZE; y++)
+    {
+        for(i = 0; i < TILE_SIZE; i++)
+            shadowDepth[y * SHADOW_SIZE + x0 + i] = 1.0f;
+    }
+    for(i = 0; i < bin->count; i++)
+        shadowFillTriangle(bin->triangles[i], x0, y0, x0 + TILE_SIZE - 1, y0 + TILE_SIZE - 1);
+}
+
+//renders the shadow map of the mesh, from an orthographic camera
+//looking down its z axis whose view fits its bounding box. It projects
+//with lightView, so the frame's camera and vertices are left as they are.
+//The light is fixed to the model, so with keepShadowMap the map of the
+//last frame does as long as it was drawn for the same mesh, the same
+//faces culled and the same kernel.
+void renderShadowMap(void)
+{
+    int c, g, i, j;
+    float lo[3], hi[3], decoded[3], *v;
+    double clip[16], window[16], half, depth;
+    
+    shadowMapDrawn = !keepShadowMap || mesh->serial != shadowSerial ||
+                     cullBackFaces != shadowCulled || rasterKernel != shadowKernel;
+    if(!shadowMapDrawn)
+        return;
+    shadowSerial = mesh->serial;
+    shadowCulled = cullBackFaces;
+    shadowKernel = rasterKernel;
+    lo[0] = lo[1] = lo[2] = 1e30f;
+    hi[0] = hi[1] = hi[2] = -1e30f;
+    for(i = 0; i < (int)mesh->numvertices; i++)
+    {
+        v = meshPosition(mesh, i, decoded);
+        for(c = 0; c < 3; c++)
+        {
+            if(v[c] < lo[c])
+                lo[c] = v[c];
+            if(v[c] > hi[c])
+                hi[c] = v[c];
+        }
+    }
+    
+    //square texels, x and y to -1 .. 1 and the top of the model to
+    //window z 0, its bottom to 1
+    half = maxd(maxd(hi[0] - lo[0], hi[1] - lo[1]) / 2.0, 1e-6);
+    depth = maxd((hi[2] - lo[2]) / 2.0, 1e-6);
+    memset(clip, 0, sizeof(clip));
+    clip[0] = 1.0 / half;
+    clip[5] = 1.0 / half;
+    clip[10] = -1.0 / depth;
+    clip[12] = -(lo[0] + hi[0]) / 2.0 / half;
+    clip[13] = -(lo[1] + hi[1]) / 2.0 / half;
+    clip[14] = (lo[2] + hi[2]) / 2.0 / depth;
+    clip[15] = 1.0;
+    memset(window, 0, sizeof(window));
+    window[0] = window[5] = window[12] = window[13] = SHADOW_SIZE / 2.0;
+    window[10] = window[14] = 0.5;
+    window[15] = 1.0;
+    multiplyMatrix(lightWindow, window, clip);
+    
+    for(c = 0; c < 16; c++)
+        lightView.mvp[c] = clip[c];
+    for(c = 0; c < 3; c++)
+    {
+        lightView.scale[c] = window[c * 5];
+        lightView.offset[c] = window[12 + c];
+    }
+    reserveTransform(&lightView);
+    parallelFor(shadowVertexJob, (mesh->numvertices + VERTEX_BLOCK - 1) / VERTEX_BLOCK);
+    
+    //every triangle in the mesh's own order
+    if(shadowGroupCapacity < (int)mesh->numgroups + 1)
+    {
+        shadowGroupCapacity = mesh->numgroups + 1;
+        shadowFirst = (int*)realloc(shadowFirst, sizeof(int) * shadowGroupCapacity);
+    }
+    numShadowDraw = 0;
+    for(g = 0; g < (int)mesh->numgroups; g++)
+    {
+        shadowFirst[g] = numShadowDraw;
+        numShadowDraw += mesh->groups[g].numindices / 3;
+    }
+    shadowFirst[mesh->numgroups] = numShadowDraw;
+    numShadowBlocks = (numShadowDraw + GEOMETRY_BLOCK - 1) / GEOMETRY_BLOCK;
+    if(shadowBlockCapacity < numShadowBlocks)
+    {
+        shadowBlocks = (struct geometryBlock*)realloc(shadowBlocks, sizeof(struct geometryBlock) * numShadowBlocks);
+        memset(&shadowBlocks[shadowBlockCapacity], 0, sizeof(struct geometryBlock) * (numShadowBlocks - shadowBlockCapacity));
+        shadowBlockCapacity = numShadowBlocks;
+    }
+    parallelFor(shadowGeometryJob, numShadowBlocks);
+    
+    for(i = 0; i < SHADOW_TILES * SHADOW_TILES; i++)
+        shadowBins[i].count = 0;
+    for(i = 0; i < numShadowBlocks; i++)
+    {
+        for(j = 0; j < shadowBlocks[i].count; j++)
+            binTriangle(shadowBins, SHADOW_TILES, &shadowBlocks[i].setups[j]);
+    }
+    if(!shadowDepth)
+        shadowDepth = (float*)malloc(sizeof(float) * SHADOW_SIZE * SHADOW_SIZE);
+    parallelFor(shadowTileJob, SHADOW_TILES * SHADOW_TILES);
+}
+
+//sets up frameToLight, which takes the frame's window coordinates back
+//to model space through the camera and on into the shadow map's, for
+//deferred shading and resolveShadows()
+void setupFrameToLight(void)
+{
+    multiplyMatrix(frameToLight, lightWindow, windowToModel);
+}
+
+/*=======================================================================
+TILED LIGHTING ==========================================================
+=======================================================================*/
+
+//the point lights of deferred frames are culled twice, so a pixel only
+//loops over the few that reach it however many the frame has:
+//
+//  o  every light is binned like a triangle into the tiles its screen
+//     rectangle overlaps, the projected corners of the cube around it
+//  o  once a tile is drawn, every LIGHT_TILE square of it keeps in a
+//     list of its own the lights whose sphere reaches the part of the
+//     view its pixels were drawn in. The square's depths are split in
+//     two halves halfway between the nearest and the farthest, and each
+//     half spans only from its own nearest to its farthest pixel, so at
+//     a silhouette the lights in the gap between the model and what is
+//     behind it are left out as well.
+//
+//Lights are lit per pixel by shadeGBuffer(), so they need deferred
+//shading; Gouraud frames only have the light along z.
+struct pipelineLight* pipelineLights = NULL;
+int numLights = 0;
+
+//a light as the pixels read it
+struct frameLight
+{
+    float x, y, z;
+    float radius;
+    float radius2;               //radius squared
+    float r, g, b;
+    int xmin, ymin, xmax, ymax;  //the pixels its screen rectangle covers
+};
+
+//lights overlapping a tile, and the list of the LIGHT_TILE square of
+//it being shaded
+struct lightBin
+{
+    int count;
+    int capacity;
+    int* lights;
+    int* list;
+    int tiles;                   //squares with pixels lit this frame
+    int listed;                  //lights in their lists, summed
+    int pixels;                  //pixels lit in those squares
+    int reached;                 //lights reaching those pixels, summed
+};
+
+struct frameLight* frameLights = NULL;  //the lights reaching the view
+int numFrameLights = 0, frameLightCapacity = 0;
+struct lightBin* lightBins = NULL;
+double eyePosition[3];           //the camera in model space
+
+//places lights at random in [-1, 1] on every axis, from a xorshift
+//generator of their own so rand() is left alone
+void scatterLights(struct pipelineLight* lights, int count, float radius, unsigned int seed)
+{
+    int i, k;
+    unsigned int x = seed ? seed : 1;
+    float random[6];
+    
+    for(i = 0; i < count; i++)
+    {
+        for(k = 0; k < 6; k++)
+        {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            random[k] = (x >> 8) / 16777216.0f;
+        }
+        lights[i].position[0] = random[0] * 2.0f - 1.0f;
+        lights[i].position[1] = random[1] * 2.0f - 1.0f;
+        lights[i].position[2] = random[2] * 2.0f - 1.0f;
+        lights[i].color[0] = 0.25f + random[3] * 0.75f;
+        lights[i].color[1] = 0.25f + random[4] * 0.75f;
+        lights[i].color[2] = 0.25f + random[5] * 0.75f;
+        lights[i].radius = radius;
+    }
+}
+
+//the lights' spheres, count * 4/3 pi r^3, add up to LIGHTS_REACHING
+//times the 2x2x2 cube they are scattered in
+float reachingRadius(int count)
+{
+    return (float)pow(3.0 * LIGHTS_REACHING * 8.0 / (4.0 * M_PI * max(count, 1)), 1.0 / 3.0);
+}
+
+//adds a light to the bins of the tiles it overlaps
+void binLight(int light, int xmin, int ymin, int xmax, int ymax)
+{
+    int tx, ty;
+    for(ty = ymin / TILE_SIZE; ty <= ymax / TILE_SIZE; ty++)
+    {
+        for(tx = xmin / TILE_SIZE; tx <= xmax / TILE_SIZE; tx++)
+        {
+            struct lightBin* bin = &lightBins[ty * tilesAcross + tx];
+            if(bin->count == bin->capacity)
+            {
+                bin->capacity = max(64, bin->capacity * 2);
+                bin->lights = (int*)realloc(bin->lights, sizeof(int) * bin->capacity);
+                bin->list = (int*)realloc(bin->list, sizeof(int) * bin->capacity);
+            }
+            bin->lights[bin->count++] = light;
+        }
+    }
+}
+
+//keeps the lights whose cube reaches the view and bins them. A cube
+//reaching behind the camera could cover any part of the screen.
+void binLights(void)
+{
+    int i, c, xmin, ymin, xmax, ymax;
+    double p[3], h[4], wx, wy, wz, minx, miny, minz, maxx, maxy, maxz, eye[16];
+    double* m = modelToWindow;
+    struct pipelineLight* light;
+    struct frameLight* f;
+    
+    if(invertMatrix(eye, modelview))
+    {
+        eyePosition[0] = eye[12];
+        eyePosition[1] = eye[13];
+        eyePosition[2] = eye[14];
+    }
+    if(frameLightCapacity < numLights)
+    {
+        frameLightCapacity = numLights;
+        frameLights = (struct frameLight*)realloc(frameLights, sizeof(struct frameLight) * frameLightCapacity);
+    }
+    
+    for(i = 0; pipelineLights && i < numLights; i++)
+    {
+        light = &pipelineLights[i];
+        if(!(light->radius > 0.0f))
+            continue;
+        minx = miny = minz = 1e30;
+        maxx = maxy = maxz = -1e30;
+        for(c = 0; c < 8; c++)
+        {
+            p[0] = light->position[0] + (c & 1 ? light->radius : -light->radius);
+            p[1] = light->position[1] + (c & 2 ? light->radius : -light->radius);
+            p[2] = light->position[2] + (c & 4 ? light->radius : -light->radius);
+            h[0] = m[0] * p[0] + m[4] * p[1] + m[8] * p[2] + m[12];
+            h[1] = m[1] * p[0] + m[5] * p[1] + m[9] * p[2] + m[13];
+            h[2] = m[2] * p[0] + m[6] * p[1] + m[10] * p[2] + m[14];
+            h[3] = m[3] * p[0] + m[7] * p[1] + m[11] * p[2] + m[15];
+            if(h[3] <= 0.0)
+                break;
+            wx = h[0] / h[3];
+            wy = h[1] / h[3];
+            wz = h[2] / h[3];
+            minx = wx < minx ? wx : minx;
+            miny = wy < miny ? wy : miny;
+            minz = wz < minz ? wz : minz;
+            maxx = wx > maxx ? wx : maxx;
+            maxy = wy > maxy ? wy : maxy;
+            maxz = wz > maxz ? wz : maxz;
+        }
+        if(c < 8)
+        {
+            minx = miny = minz = 0.0;
+            maxx = fbWidth;
+            maxy = fbHeight;
+            maxz = 1.0;
+        }
+        if(maxx < 0.0 || maxy < 0.0 || minx >= fbWidth || miny >= fbHeight || maxz < 0.0 || minz > 1.0)
+            continue;
+        xmin = minx < 0.0 ? 0 : (int)minx;
+        ymin = miny < 0.0 ? 0 : (int)miny;
+        xmax = maxx >= fbWidth ? fbWidth - 1 : (int)maxx;
+        ymax = maxy >= fbHeight ? fbHeight - 1 : (int)maxy;
+        
+        f = &frameLights[numFrameLights];
+        f->x = light->position[0];
+        f->y = light->position[1];
+        f->z = light->position[2];
+        f->radius = light->radius;
+        f->radius2 = light->radius * light->radius;
+        f->r = light->color[0];
+        f->g = light->color[1];
+        f->b = light->color[2];
+        f->xmin = xmin;
+        f->ymin = ymin;
+        f->xmax = xmax;
+        f->ymax = ymax;
+        binLight(numFrameLights++, xmin, ymin, xmax, ymax);
+    }
+}
+
+//the box in model space around the part of the view that the window
+//rectangle (x0, y0)-(x1, y1) sees from window z zmin to zmax: the
+//lowest corner in box[0 .. 2] and the highest in box[3 .. 5]
+void viewBox(double* box, int x0, int y0, int x1, int y1, double zmin, double zmax)
+{
+    double wx, wy, wz, w, v, *p = windowToModel;
+    int c, k;
+    
+    for(k = 0; k < 3; k++)
+    {
+        box[k] = 1e30;
+        box[3 + k] = -1e30;
+    }
+    for(c = 0; c < 8; c++)
+    {
+        wx = c & 1 ? x1 + 1 : x0;
+        wy = c & 2 ? y1 + 1 : y0;
+        wz = c & 4 ? zmax : zmin;
+        w = p[3] * wx + p[7] * wy + p[11] * wz + p[15];
+        for(k = 0; k < 3 && w != 0.0; k++)
+        {
+            v = (p[k] * wx + p[4 + k] * wy + p[8 + k] * wz + p[12 + k]) / w;
+            box[k] = v < box[k] ? v : box[k];
+            box[3 + k] = v > box[3 + k] ? v : box[3 + k];
+        }
+    }
+}
+
+//whether a light's sphere reaches a box of viewBox()
+int lightReachesBox(struct frameLight* light, double* box)
+{
+    double d, d2 = 0.0, center[3];
+    int k;
+    
+    center[0] = light->x;
+    center[1] = light->y;
+    center[2] = light->z;
+    for(k = 0; k < 3; k++)
+    {
+        d = center[k] < box[k] ? box[k] - center[k] : center[k] > box[3 + k] ? center[k] - box[3 + k] : 0.0;
+        d2 += d * d;
+    }
+    return d2 <= light->radius2;
+}
+
+//lists in bin->list the lights of a tile whose sphere reaches the
+//pixels of (x0, y0)-(x1, y1) drawn at window z z[0] .. z[1] or z[2] ..
+//z[3]. A light has to overlap the square on the screen, be inside the
+//four planes of its sides, and reach one of the two depth ranges: be
+//inside its two planes and reach the box around it, which leaves out
+//the spheres near a corner of the range that the planes keep. Returns
+//the length of the list.
+int cullLights(struct lightBin* bin, int x0, int y0, int x1, int y1, double* z)
+{
+    double planes[8][4], bounds[8], scale[8], boxes[2][6], mag, *m = modelToWindow;
+    int i, k, n, r, count = 0;
+    struct frameLight* light;
+    
+    //a window coordinate above or below a bound is a row of
+    //modelToWindow against its last row; the last two planes bound the
+    //second depth range
+    bounds[0] = x0;
+    bounds[1] = x1 + 1;
+    bounds[2] = y0;
+    bounds[3] = y1 + 1;
+    for(i = 0; i < 4; i++)
+        bounds[4 + i] = z[i];
+    for(i = 0; i < 8; i++)
+    {
+        scale[i] = i & 1 ? -1.0 : 1.0;
+        for(k = 0; k < 4; k++)
+            planes[i][k] = scale[i] * (m[k * 4 + min(i / 2, 2)] - bounds[i] * m[k * 4 + 3]);
+        mag = sqrt(planes[i][0] * planes[i][0] + planes[i][1] * planes[i][1] + planes[i][2] * planes[i][2]);
+        for(k = 0; k < 4 && mag > 0.0; k++)
+            planes[i][k] /= mag;
+    }
+    for(r = 0; r < 2; r++)
+        viewBox(boxes[r], x0, y0, x1, y1, z[2 * r], z[2 * r + 1]);
+    
+    for(n = 0; n < bin->count; n++)
+    {
+        light = &frameLights[bin->lights[n]];
+        if(light->xmax < x0 || light->xmin > x1 || light->ymax < y0 || light->ymin > y1)
+            continue;
+        for(i = 0; i < 4; i++)
+        {
+            if(planes[i][0] * light->x + planes[i][1] * light->y + planes[i][2] * light->z + planes[i][3] < -light->radius)
+                break;
+        }
+        if(i < 4)
+            continue;
+        for(r = 0; r < 2; r++)
+        {
+            for(i = 4 + 2 * r; i < 6 + 2 * r; i++)
+            {
+                if(planes[i][0] * light->x + planes[i][1] * light->y + planes[i][2] * light->z + planes[i][3] < -light->radius)
+                    break;
+            }
+            if(i == 6 + 2 * r && lightReachesBox(light, boxes[r]))
+                break;
+        }
+        if(r < 2)
+            bin->list[count++] = bin->lights[n];
+    }
+    return count;
+}
+
+//the point lights of a list added to the color of a pixel at (px, py,
+//pz) in model space with unit normal (nx, ny, nz): Blinn-Phong like
+//computeShade(), but towards the light and the camera from the pixel,
+//fading with (1 - (d / radius)^2)^2 so a light ends where its sphere
+//does. Returns the lights whose sphere holds the pixel.
+int addPointLights(struct RGBType* color, GLMmaterial* mat, int* list, int count,
+                    float px, float py, float pz, float nx, float ny, float nz)
+{
+    int n;
+    int specular = mat->specular[0] > 0.0f || mat->specular[1] > 0.0f || mat->specular[2] > 0.0f;
+    float vx, vy, vz, lx, ly, lz, hx, hy, hz, mag, d2, d, dp, fade, highlight;
+    float dr = 0.0f, dg = 0.0f, db = 0.0f, sr = 0.0f, sg = 0.0f, sb = 0.0f;
+    int reached = 0;
+    struct frameLight* light;
+    
+    //towards the camera
+    vx = eyePosition[0] - px;
+    vy = eyePosition[1] - py;
+    vz = eyePosition[2] - pz;
+    mag = sqrtf(vx * vx + vy * vy + vz * vz);
+    if(mag > 0.0f)
+    {
+        vx /= mag;
+        vy /= mag;
+        vz /= mag;
+    }
+    
+    for(n = 0; n < count; n++)
+    {
+        light = &frameLights[list[n]];
+        lx = light->x - px;
+        ly = light->y - py;
+        lz = light->z - pz;
+        d2 = lx * lx + ly * ly + lz * lz;
+        if(d2 >= light->radius2)
+            continue;
+        reached++;
+        dp = nx * lx + ny * ly + nz * lz;
+        if(dp <= 0.0f)
+            continue;
+        d = sqrtf(d2);
+        lx /= d;
+        ly /= d;
+        lz /= d;
+        fade = 1.0f - d2 / light->radius2;
+        fade *= fade;
+        
+        //diffuse shading
+        dp *= fade / d;
+        dr += light->r * dp;
+        dg += light->g * dp;
+        db += light->b * dp;
+        
+        //specular shading
+        if(!specular)
+            continue;
+        hx = lx + vx;
+        hy = ly + vy;
+        hz = lz + vz;
+        mag = sqrtf(hx * hx + hy * hy + hz * hz);
+        dp = nx * hx + ny * hy + nz * hz;
+        if(dp <= 0.0f)
+            continue;
+        highlight = powf(dp / mag, mat->shininess) * fade;
+        sr += light->r * highlight;
+        sg += light->g * highlight;
+        sb += light->b * highlight;
+    }
+    color->r += mat->diffuse[0] * dr + mat->specular[0] * 0.3f * sr;
+    color->g += mat->diffuse[1] * dg + mat->specular[1] * 0.3f * sg;
+    color->b += mat->diffuse[2] * db + mat->specular[2] * 0.3f * sb;
+    return reached;
+}
+
+/*=======================================================================
+PIPELINE STAGES =========================================================
+=======================================================================*/
+
+//sets up a triangle at the end of a block's list, unless it is culled
+void emitTriangle(struct geometryBlock* block, struct projectedPoint* p, unsigned int alpha, struct RGBType ambient)
+{
+    struct triangleSetup* t;
+    if(cullBackFaces && edgeFunction(p[0], p[1], p[2].x, p[2].y) < 0)
+    {
+        block->stats.backfaceCulled++;
+        return;
+    }
+    t = nextSetup(block);
+    if(setupTriangle(p[0], p[1], p[2], t))
+    {
+        t->alpha = alpha;
+        t->ambient = ambient;
+        block->count++;
+        block->stats.rasterized++;
+    }
+}
+
+//window coordinates of a clipped vertex, same formula as transformScalar()
+struct projectedPoint projectClipVertex(struct clipVertex* c)
+{
+    struct projectedPoint p;
+    p.x = toFixed(c->x / c->w * frameView.scale[0] + frameView.offset[0]);
+    p.y = toFixed(c->y / c->w * frameView.scale[1] + frameView.offset[1]);
+    p.z = c->z / c->w * frameView.scale[2] + frameView.offset[2];
+    p.q = 1.0 / c->w;
+    p.u = c->u;
+    p.v = c->v;
+    p.color = c->color;
+    return p;
+}
+
+//culls, shades and sets up one block of triangles. Triangles inside the
+//guard band use the projected vertices directly, the rest are clipped in
+//clip space and split into a fan.
+void geometryJob(int index)
+{
+    int i, j, k, n, v[3], codes, material;
+    unsigned int alpha;
+    int first = index * GEOMETRY_BLOCK;
+    int last = min(first + GEOMETRY_BLOCK, numDraw);
+    struct geometryBlock* block = &blocks[index];
+    struct meshGroup* group;
+    struct projectedPoint pts[3];
+    struct clipVertex polygon[3 + NUM_PLANES];
+    float* normal;
+    float texcoord[2], *uv;
+    struct RGBType ambient = { 0.0f, 0.0f, 0.0f };
+    
+    block->count = 0;
+    memset(&block->stats, 0, sizeof(block->stats));
+    
+    int g = findGroup(groupFirst, mesh->numgroups, first);
+    for(i = first; i < last; i++)
+    {
+        while(i >= groupFirst[g + 1])
+            g++;
+        group = &mesh->groups[drawGroups[g]];
+        material = group->material;
+        k = 3 * (i - groupFirst[g]);
+        v[0] = meshIndex(group, k);
+        v[1] = meshIndex(group, k + 1);
+        v[2] = meshIndex(group, k + 2);
+        block->stats.triangles++;
+        
+        //all three corners outside the same frustum plane
+        if(outcodes[v[0]] & outcodes[v[1]] & outcodes[v[2]] & FRUSTUM_PLANES)
+        {
+            block->stats.frustumCulled++;
+            continue;
+        }
+        codes = (outcodes[v[0]] | outcodes[v[1]] | outcodes[v[2]]) & CLIPPING_PLANES;
+        
+        for(j = 0; j < 3; j++)
+        {
+            pts[j].x = frameView.screenX[v[j]];
+            pts[j].y = frameView.screenY[v[j]];
+            pts[j].z = frameView.screenZ[v[j]];
+            pts[j].q = frameView.screenQ[v[j]];
+            normal = vertexNormal(v[j]);
+            pts[j].nx = normal[0];
+            pts[j].ny = normal[1];
+            pts[j].nz = normal[2];
+            pts[j].u = pts[j].v = 0.0;
+            if(texturedFrame)
+            {
+                uv = meshTexcoord(mesh, v[j], texcoord);
+                pts[j].u = uv[0];
+                pts[j].v = uv[1];
+            }
+        }
+        
+        //back faces are culled before they are shaded
+        if(!codes && cullBackFaces && edgeFunction(pts[0], pts[1], pts[2].x, pts[2].y) < 0)
+        {
+            block->stats.backfaceCulled++;
+            continue;
+        }
+        
+        if(deferredFrame)
+        {
+            //the G-buffer stores the normal as a color and the material
+            //in the alpha byte, shadeGBuffer() lights it per pixel
+            for(j = 0; j < 3; j++)
+            {
+                pts[j].color.r = pts[j].nx * 0.5 + 0.5;
+                pts[j].color.g = pts[j].ny * 0.5 + 0.5;
+                pts[j].color.b = pts[j].nz * 0.5 + 0.5;
+            }
+            alpha = material << 24;
+        }
+        else if(shadingMode == PIPELINE_FLAT)
+        {
+            shadeTriangle(pts, drawMaterial(material), modelview);
+            block->stats.shaded++;
+            alpha = FB_ALPHA;
+        }
+        else
+        {
+            for(j = 0; j < 3; j++)
+                pts[j].color = cachedShade(v[j], material, &block->stats);
+            alpha = FB_ALPHA;
+        }
+        //resolveShadows() finds the ambient color of a pixel from the
+        //material in its alpha byte, or from shadowAmbient
+        if(shadowedFrame && !ambientFrame)
+            alpha = material << 24;
+        if(ambientFrame)
+            ambient = ambientShade(drawMaterial(material));
+        if(!codes)
+        {
+            emitTriangle(block, pts, alpha, ambient);
+            continue;
+        }
+        
+        block->stats.clipped++;
+        for(j = 0; j < 3; j++)
+        {
+            polygon[j].x = frameView.clipX[v[j]];
+            polygon[j].y = frameView.clipY[v[j]];
+            polygon[j].z = frameView.clipZ[v[j]];
+            polygon[j].w = frameView.clipW[v[j]];
+            polygon[j].color = pts[j].color;
+            polygon[j].u = pts[j].u;
+            polygon[j].v = pts[j].v;
+        }
+        n = clipTriangle(polygon, codes);
+        for(j = 1; j + 1 < n; j++)
+        {
+            pts[0] = projectClipVertex(&polygon[0]);
+            pts[1] = projectClipVertex(&polygon[j]);
+            pts[2] = projectClipVertex(&polygon[j + 1]);
+            emitTriangle(block, pts, alpha, ambient);
+        }
+    }
+}
+
+//lights the pixels drawn this frame inside (x0, y0)-(x1, y1) from the
+//G-buffer into pixels, so computeShade runs once per visible pixel
+//however many triangles were drawn over it. With shadows, the rows'
+//places in the shadow map come from their window coordinates and depth
+//through frameToLight, and with point lights a pixel's place in the model
+//through windowToModel, adding up the lights that reach them in the
+//square's bin. Returns the pixels lit.
+int shadeGBuffer(int x0, int y0, int x1, int y1, struct lightBin* bin, int numListed)
+{
+    int x, y, i, lit = 0;
+    unsigned int g;
+    double nx, ny, nz, mag, z, sw, *p = windowToModel;
+    float visible[TILE_SIZE];
+    GLMmaterial mat;
+    struct RGBType color, ambient;
+    
+    for(y = y0; y <= y1; y++)
+    {
+        if(shadowsEnabled)
+            visibilityRows[rasterKernel](visible, &fbDepth[y * fbWidth + x0], x0, y, x1 - x0 + 1);
+        for(x = x0; x <= x1; x++)
+        {
+            i = y * fbWidth + x;
+            if((fbDepth[i] & FB_TAG_MASK) != fbFrame)
+            {
+                pixels[i] = FB_COLOR(0, 0, 0);
+                continue;
+            }
+            g = fbColor[i];
+            nx = (g & 255) * (2.0 / 255.0) - 1.0;
+            ny = ((g >> 8) & 255) * (2.0 / 255.0) - 1.0;
+            nz = ((g >> 16) & 255) * (2.0 / 255.0) - 1.0;
+            mag = sqrt(nx * nx + ny * ny + nz * nz);
+            if(mag > 0.0)
+            {
+                nx /= mag;
+                ny /= mag;
+                nz /= mag;
+            }
+            mat = drawMaterial(g >> 24);
+            color = computeShade(nx, ny, nz, mat, modelview);
+            z = (fbDepth[i] & ~FB_TAG_MASK) / FB_DEPTH_SCALE;
+            if(shadowsEnabled)
+            {
+                ambient = ambientShade(mat);
+                color.r = ambient.r + (color.r - ambient.r) * visible[x - x0];
+                color.g = ambient.g + (color.g - ambient.g) * visible[x - x0];
+                color.b = ambient.b + (color.b - ambient.b) * visible[x - x0];
+            }
+            if(numListed)
+            {
+                sw = p[3] * (x + 0.5) + p[7] * (y + 0.5) + p[11] * z + p[15];
+                if(sw != 0.0)
+                    bin->reached += addPointLights(&color, &mat, bin->list, numListed,
+                                   (p[0] * (x + 0.5) + p[4] * (y + 0.5) + p[8] * z + p[12]) / sw,
+                                   (p[1] * (x + 0.5) + p[5] * (y + 0.5) + p[9] * z + p[13]) / sw,
+                                   (p[2] * (x + 0.5) + p[6] * (y + 0.5) + p[10] * z + p[14]) / sw,
+                                   nx, ny, nz);
+            }
+            pixels[i] = FB_COLOR(colorByte(color.r), colorByte(color.g), colorByte(color.b));
+            lit++;
+        }
+    }
+    return lit;
+}
+
+//the ambient color of every material of a shadowed frame, by the
+//material index its pixels keep in the alpha byte
+struct RGBType materialAmbient[GBUFFER_MATERIALS];
+
+//copies the pixels drawn this frame inside (x0, y0)-(x1, y1) to pixels
+//like fbResolve(), fading those the shadow map hides to their ambient
+//color. Only the pixels left visible read the map, a row at a time
+//through the visibility row of the selected kernel like shadeGBuffer(),
+//so neither overdraw nor the span kernels pay for the filter.
+void resolveShadows(int x0, int y0, int x1, int y1)
+{
+    int x, y, i;
+    unsigned int c, a;
+    float visible[TILE_SIZE];
+    struct RGBType ambient;
+    
+    for(y = y0; y <= y1; y++)
+    {
+        visibilityRows[rasterKernel](visible, &fbDepth[y * fbWidth + x0], x0, y, x1 - x0 + 1);
+        for(x = x0; x <= x1; x++)
+        {
+            i = y * fbWidth + x;
+            if((fbDepth[i] & FB_TAG_MASK) != fbFrame)
+            {
+                pixels[i] = FB_COLOR(0, 0, 0);
+                continue;
+            }
+            c = fbColor[i];
+            if(visible[x - x0] == 1.0f)
+            {
+                pixels[i] = FB_ALPHA | (c & ~FB_ALPHA);
+                continue;
+            }
+            if(ambientFrame)
+            {
+                a = shadowAmbient[i];
+                ambient.r = (a & 255) * (1.0f / 255.0f);
+                ambient.g = ((a >> 8) & 255) * (1.0f / 255.0f);
+                ambient.b = ((a >> 16) & 255) * (1.0f / 255.0f);
+            }
+            else
+                ambient = materialAmbient[c >> 24];
+            pixels[i] = FB_COLOR(colorByte(ambient.r + ((c & 255) * (1.0f / 255.0f) - ambient.r) * visible[x - x0]),
+                                 colorByte(ambient.g + (((c >> 8) & 255) * (1.0f / 255.0f) - ambient.g) * visible[x - x0]),
+                                 colorByte(ambient.b + (((c >> 16) & 255) * (1.0f / 255.0f) - ambient.b) * visible[x - x0]));
+        }
+    }
+}
+
+//deferred shading of a tile, a LIGHT_TILE square at a time with the
+//lights its depth bounds leave when the frame has any. Returns the
+//pixels lit.
+int shadeTile(int tile, int x0, int y0, int x1, int y1)
+{
+    int x, y, sx, sy, sx1, sy1, i, drawn, shaded, lit = 0, numListed;
+    unsigned int key, nearest, farthest, half, nearFar, farNear;
+    double z[4];
+    struct lightBin* bin = &lightBins[tile];
+    
+    if(!bin->count)
+        return shadeGBuffer(x0, y0, x1, y1, NULL, 0);
+    for(sy = y0; sy <= y1; sy += LIGHT_TILE)
+    {
+        for(sx = x0; sx <= x1; sx += LIGHT_TILE)
+        {
+            sx1 = min(sx + LIGHT_TILE - 1, x1);
+            sy1 = min(sy + LIGHT_TILE - 1, y1);
+            nearest = ~FB_TAG_MASK;
+            farthest = 0;
+            drawn = 0;
+            for(y = sy; y <= sy1; y++)
+            {
+                for(x = sx; x <= sx1; x++)
+                {
+                    i = y * fbWidth + x;
+                    if((fbDepth[i] & FB_TAG_MASK) != fbFrame)
+                        continue;
+                    key = fbDepth[i] & ~FB_TAG_MASK;
+                    nearest = key < nearest ? key : nearest;
+                    farthest = key > farthest ? key : farthest;
+                    drawn = 1;
+                }
+            }
+            numListed = 0;
+            if(drawn)
+            {
+                //the farthest key of the near half and the nearest of
+                //the far one
+                half = nearest + (farthest - nearest) / 2;
+                nearFar = nearest;
+                farNear = farthest;
+                for(y = sy; y <= sy1; y++)
+                {
+                    for(x = sx; x <= sx1; x++)
+                    {
+                        i = y * fbWidth + x;
+                        if((fbDepth[i] & FB_TAG_MASK) != fbFrame)
+                            continue;
+                        key = fbDepth[i] & ~FB_TAG_MASK;
+                        if(key <= half)
+                            nearFar = key > nearFar ? key : nearFar;
+                        else
+                            farNear = key < farNear ? key : farNear;
+                    }
+                }
+                //a key stands for the depths up to the next one
+                z[0] = nearest / FB_DEPTH_SCALE;
+                z[1] = (nearFar + 1) / FB_DEPTH_SCALE;
+                z[2] = farNear / FB_DEPTH_SCALE;
+                z[3] = (farthest + 1) / FB_DEPTH_SCALE;
+                numListed = cullLights(bin, sx, sy, sx1, sy1, z);
+                bin->tiles++;
+                bin->listed += numListed;
+            }
+            shaded = shadeGBuffer(sx, sy, sx1, sy1, bin, numListed);
+            if(drawn)
+                bin->pixels += shaded;
+            lit += shaded;
+        }
+    }
+    return lit;
+}
+
+//rasterizes one tile's bin and copies the tile to pixels, on a black
+//background (fbClear already cleared the frame)
+void tileJob(int tile)
+{
+    int i;
+    int x0 = (tile % tilesAcross) * TILE_SIZE, x1 = min(x0 + TILE_SIZE, fbWidth) - 1;
+    int y0 = (tile / tilesAcross) * TILE_SIZE, y1 = min(y0 + TILE_SIZE, fbHeight) - 1;
+    struct tileBin* bin = &bins[tile];
+    
+    hizClearTile(tile, x0, y0, x1, y1);
+    for(i = 0; i < bin->count; i++)
+    {
+        if(hizEnabled)
+            hizFillTriangle(bin->triangles[i], tile, x0, y0, x1, y1);
+        else
+            fillTriangle(bin->triangles[i], x0, y0, x1, y1, NULL);
+    }
+    
+    tileShaded[tile] = 0;
+    if(deferredFrame)
+        tileShaded[tile] = shadeTile(tile, x0, y0, x1, y1);
+    else if(shadowedFrame)
+        resolveShadows(x0, y0, x1, y1);
+    else
+        fbResolve(pixels, x0, y0, x1, y1, FB_COLOR(0, 0, 0));
+}
+
+//sets the size of the frame, the tiles and the image
+void pipelineResize(int width, int height)
+{
+    fbResize(width, height);
+    pixels = (unsigned int*)realloc(pixels, sizeof(unsigned int) * width * height);
+    
+    tilesAcross = (width + TILE_SIZE - 1) / TILE_SIZE;
+    tilesDown = (height + TILE_SIZE - 1) / TILE_SIZE;
+    numTiles = tilesAcross * tilesDown;
+    if(binCapacity < numTiles)
+    {
+        bins = (struct tileBin*)realloc(bins, sizeof(struct tileBin) * numTiles);
+        memset(&bins[binCapacity], 0, sizeof(struct tileBin) * (numTiles - binCapacity));
+        tileShaded = (int*)realloc(tileShaded, sizeof(int) * numTiles);
+        tileFar = (unsigned int*)realloc(tileFar, sizeof(unsigned int) * numTiles);
+        tileHiz = (struct hizCounts*)realloc(tileHiz, sizeof(struct hizCounts) * numTiles);
+        lightBins = (struct lightBin*)realloc(lightBins, sizeof(struct lightBin) * numTiles);
+        memset(&lightBins[binCapacity], 0, sizeof(struct lightBin) * (numTiles - binCapacity));
+        binCapacity = numTiles;
+    }
+    hizAcross = (width + HIZ_BLOCK - 1) / HIZ_BLOCK;
+    hizDown = (height + HIZ_BLOCK - 1) / HIZ_BLOCK;
+    hizFar = (unsigned int*)realloc(hizFar, sizeof(unsigned int) * hizAcross * hizDown);
+    hizDraws = (unsigned char*)realloc(hizDraws, hizAcross * hizDown);
+    hizOpen = (unsigned char*)realloc(hizOpen, hizAcross * hizDown);
+}
+
+//orders groups by their nearest window z, then by their index
+int compareGroups(const void* a, const void* b)
+{
+    int ga = *(const int*)a, gb = *(const int*)b;
+    if(groupNear[ga] != groupNear[gb])
+        return groupNear[ga] < groupNear[gb] ? -1 : 1;
+    return ga - gb;
+}
+
+//puts the groups whose vertices come nearest first, so what they hide
+//is rejected by the hierarchical z instead of drawn over. Vertices
+//outside the view count as far as the far plane.
+void sortDrawGroups(void)
+{
+    int g, i, v;
+    struct meshGroup* group;
+    float zNear;
+    
+    for(g = 0; g < (int)mesh->numgroups; g++)
+    {
+        group = &mesh->groups[g];
+        zNear = 1.0f;
+        for(i = 0; i < (int)group->numindices; i++)
+        {
+            v = meshIndex(group, i);
+            if(!(outcodes[v] & FRUSTUM_PLANES) && frameView.screenZ[v] < zNear)
+                zNear = frameView.screenZ[v];
+        }
+        groupNear[g] = zNear;
+    }
+    qsort(drawGroups, mesh->numgroups, sizeof(int), compareGroups);
+}
+
+//sort-middle pipeline: vertices are transformed and triangles culled,
+//clipped and set up in parallel, binned into screen tiles in submission
+//order, then the tiles are
+//rasterized in parallel. Every pixel sees its triangles in the same order
+//whatever the thread count, so the image is identical for any numThreads.
+void pipelineRender(struct mesh* m, int mode, int cull, double* mv, double* proj, int* vp)
+{
+    struct meshGroup* group;
+    int g, i, j;
+    
+    mesh = m;
+    model = m->model;
+    shadingMode = mode;
+    memcpy(modelview, mv, sizeof(modelview));
+    memcpy(projection, proj, sizeof(projection));
+    memcpy(viewport, vp, sizeof(viewport));
+    cullBackFaces = cull;
+    deferredFrame = mode == PIPELINE_DEFERRED && model->nummaterials <= GBUFFER_MATERIALS;
+    texturedFrame = pipelineTexture && (mesh->mode & GLM_TEXTURE) && !deferredFrame;
+    shadowedFrame = shadowsEnabled && !deferredFrame;
+    ambientFrame = shadowedFrame && (texturedFrame || model->nummaterials > GBUFFER_MATERIALS);
+    //Gouraud shading, and deferred shading that fell back to it
+    int gouraud = mode != PIPELINE_FLAT && !deferredFrame;
+    setupHalfVector();
+    if(shadowsEnabled)
+        renderShadowMap();
+    transformVertices();
+    if(deferredFrame || shadowsEnabled)
+        setupWindowMatrices();
+    if(shadowsEnabled)
+        setupFrameToLight();
+    if(ambientFrame && shadowAmbientCapacity < fbWidth * fbHeight)
+    {
+        shadowAmbientCapacity = fbWidth * fbHeight;
+        shadowAmbient = (unsigned int*)realloc(shadowAmbient, sizeof(unsigned int) * shadowAmbientCapacity);
+    }
+    for(i = 0; shadowedFrame && !ambientFrame && i < max(1, model->nummaterials); i++)
+        materialAmbient[i] = ambientShade(drawMaterial(i));
+    for(i = 0; i < numTiles; i++)
+    {
+        lightBins[i].count = lightBins[i].tiles = lightBins[i].listed = 0;
+        lightBins[i].pixels = lightBins[i].reached = 0;
+    }
+    numFrameLights = 0;
+    if(deferredFrame && numLights)
+        binLights();
+    if(gouraud)
+        resetLightCache();
+    
+    //the triangles are drawn in group order, straight from the index
+    //buffers; a geometry block finds its group through groupFirst
+    if(groupCapacity < (int)mesh->numgroups + 1)
+    {
+        groupCapacity = mesh->numgroups + 1;
+        groupFirst = (int*)realloc(groupFirst, sizeof(int) * groupCapacity);
+        drawGroups = (int*)realloc(drawGroups, sizeof(int) * groupCapacity);
+        groupNear = (float*)realloc(groupNear, sizeof(float) * groupCapacity);
+    }
+    for(g = 0; g < (int)mesh->numgroups; g++)
+        drawGroups[g] = g;
+    if(sortGroups)
+        sortDrawGroups();
+    numDraw = 0;
+    for(g = 0; g < (int)mesh->numgroups; g++)
+    {
+        group = &mesh->groups[drawGroups[g]];
+        groupFirst[g] = numDraw;
+        numDraw += group->numindices / 3;
+        if(gouraud)
+        {
+            for(i = 0; i < (int)group->numindices; i++)
+                useVertex(meshIndex(group, i), group->material);
+        }
+    }
+    groupFirst[mesh->numgroups] = numDraw;
+    if(gouraud)
+        parallelFor(lightJob, (mesh->numvertices + LIGHT_BLOCK - 1) / LIGHT_BLOCK);
+    
+    numBlocks = (numDraw + GEOMETRY_BLOCK - 1) / GEOMETRY_BLOCK;
+    if(blockCapacity < numBlocks)
+    {
+        blocks = (struct geometryBlock*)realloc(blocks, sizeof(struct geometryBlock) * numBlocks);
+        memset(&blocks[blockCapacity], 0, sizeof(struct geometryBlock) * (numBlocks - blockCapacity));
+        blockCapacity = numBlocks;
+    }
+    parallelFor(geometryJob, numBlocks);
+    
+    memset(&frameStats, 0, sizeof(frameStats));
+    for(i = 0; i < numTiles; i++)
+        bins[i].count = 0;
+    for(i = 0; i < numBlocks; i++)
+    {
+        for(j = 0; j < blocks[i].count; j++)
+            binTriangle(bins, tilesAcross, &blocks[i].setups[j]);
+        frameStats.triangles += blocks[i].stats.triangles;
+        frameStats.frustumCulled += blocks[i].stats.frustumCulled;
+        frameStats.backfaceCulled += blocks[i].stats.backfaceCulled;
+        frameStats.clipped += blocks[i].stats.clipped;
+        frameStats.rasterized += blocks[i].stats.rasterized;
+        frameStats.shaded += blocks[i].stats.shaded;
+    }
+    for(i = 0; shadowsEnabled && i < numShadowBlocks; i++)
+        frameStats.shadowTriangles += shadowBlocks[i].count;
+    frameStats.shadowMapDrawn = shadowsEnabled && shadowMapDrawn;
+    if(gouraud)
+        frameStats.shaded += numLit;
+    
+    fbClear();
+    parallelFor(tileJob, numTiles);
+    for(i = 0; i < numTiles; i++)
+    {
+        frameStats.shaded += tileShaded[i];
+        frameStats.hizTested += tileHiz[i].tested;
+        frameStats.hizCulled += tileHiz[i].culled;
+        frameStats.hizBlocks += tileHiz[i].blocks;
+        frameStats.hizBlocksCulled += tileHiz[i].blocksCulled;
+        frameStats.lightTiles += lightBins[i].tiles;
+        frameStats.tileLights += lightBins[i].listed;
+        frameStats.lightPixels += lightBins[i].pixels;
+        frameStats.pixelLights += lightBins[i].reached;
+    }
+    frameStats.lights = numFrameLights;
+}
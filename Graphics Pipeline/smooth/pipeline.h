@@ -0,0 +1,178 @@
+/*
+ *  pipeline.h
+ *
+ *  Software graphics pipeline for glm models.  Renders a model compiled
+ *  into a mesh (see mesh.h) with the camera given as OpenGL style
+ *  matrices into an image of packed RGBA colors (see framebuffer.h),
+ *  without OpenGL.
+ *
+ *  Usage:
+ *
+ *  o  call pipelineResize() to set the size of the image
+ *  o  compile the model with meshCompile(model, GLM_SMOOTH), with
+ *     GLM_TEXTURE as well to map pipelineTexture onto it
+ *  o  set shadowsEnabled for shadows of the model on itself
+ *  o  point pipelineLights at numLights point lights, which deferred
+ *     frames add to the light along z
+ *  o  call pipelineRender() to draw a frame into pixels[]
+ *  o  frameStats tells what happened to the triangles of that frame
+ */
+
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "glm.h"
+#include "mesh.h"
+#include "texture.h"
+
+
+/* shading modes */
+#define PIPELINE_FLAT      0        /* one color per triangle */
+#define PIPELINE_SMOOTH    1        /* Gouraud, one color per vertex */
+#define PIPELINE_DEFERRED  2        /* per pixel, from a G-buffer */
+
+/* span kernels */
+#define KERNEL_SCALAR 0
+#define KERNEL_SSE2 1
+#define KERNEL_AVX2 2
+
+#define MAX_THREADS 64
+
+#define LIGHT_TILE 16               /* pixels a side of the screen tiles
+                                       that cull point lights */
+#define LIGHTS_REACHING 4           /* point lights reaching a point of
+                                       the model, see reachingRadius() */
+
+
+/* pipelineLight: a point light, in the model's coordinates like the
+ * light along z, that fades out smoothly to nothing at its radius
+ */
+struct pipelineLight
+{
+    float position[3];
+    float color[3];      /* diffuse and specular intensity */
+    float radius;
+};
+
+
+/* pipelineStats: what happened to the triangles of the last frame
+ */
+struct pipelineStats
+{
+    int triangles;       /* triangles submitted */
+    int frustumCulled;   /* entirely outside the view frustum */
+    int backfaceCulled;  /* facing away from the camera */
+    int clipped;         /* crossed the near plane or the guard band */
+    int rasterized;      /* triangles handed to the tiles (after clipping) */
+    int shaded;          /* computeShade calls */
+    int hizTested;       /* triangles tested against a tile's depth, once
+                            for every tile they overlap */
+    int hizCulled;       /* of those, behind everything drawn there */
+    int hizBlocks;       /* 8x8 blocks of them tested the same way */
+    int hizBlocksCulled; /* of those, behind everything drawn there */
+    int shadowTriangles; /* triangles drawn into the shadow map */
+    int shadowMapDrawn;  /* 1 if the frame drew the shadow map, 0 if it
+                            kept the one before */
+    int lights;          /* point lights reaching into the view */
+    int lightTiles;      /* LIGHT_TILE square tiles with pixels lit by
+                            them */
+    int tileLights;      /* lights in those tiles' lists, summed */
+    int lightPixels;     /* pixels lit in those tiles */
+    int pixelLights;     /* lights reaching those pixels, summed */
+};
+
+
+extern struct pipelineStats frameStats;
+extern unsigned int* pixels;        /* the last frame, rows from the bottom */
+
+extern char* kernelNames[];
+extern char* visibilityNames[];     /* the shadow lookup row each span
+                                       kernel runs */
+extern int rasterKernel;            /* span kernel used by the rasterizer */
+extern int bestKernel;              /* fastest kernel this processor runs */
+extern int numThreads;              /* threads a frame is split between */
+extern int hizEnabled;              /* skip triangles and 8x8 blocks of
+                                       them hidden by what a tile already
+                                       holds (hierarchical z), off by
+                                       default */
+extern int sortGroups;              /* draw the groups nearest first */
+extern struct texture* pipelineTexture; /* modulates the colors of meshes
+                                       compiled with GLM_TEXTURE, unless
+                                       deferred; NULL for none */
+extern int textureFilter;           /* TEXTURE_BILINEAR or
+                                       TEXTURE_TRILINEAR */
+extern int shadowsEnabled;          /* render the model from the light
+                                       into a shadow map first and leave
+                                       what it hides in ambient light
+                                       only, off by default */
+extern int keepShadowMap;           /* draw the shadow map again only when
+                                       the mesh, the faces culled or the
+                                       kernel change, since the light
+                                       turns with the model; on by
+                                       default */
+extern struct pipelineLight* pipelineLights; /* point lights of deferred
+                                       frames, NULL for none */
+extern int numLights;               /* lights in pipelineLights */
+
+
+/* functions */
+
+/* detectKernel: returns the widest span kernel the processor supports.
+ */
+int
+detectKernel(void);
+
+/* processorCount: returns the number of processors (at most
+ * MAX_THREADS), the default for numThreads.
+ */
+int
+processorCount(void);
+
+/* scatterLights: places point lights at random in the cube glmUnitize()
+ * leaves a model in, with random colors, for tests and benchmarks.
+ *
+ * lights - (return) count lights
+ * count  - number of lights
+ * radius - radius of every light
+ * seed   - the same seed places the same lights
+ */
+void
+scatterLights(struct pipelineLight* lights, int count, float radius,
+              unsigned int seed);
+
+/* reachingRadius: returns the radius at which count lights scattered by
+ * scatterLights() fill its cube LIGHTS_REACHING times over, so about
+ * that many of them reach any point of the model whatever their count.
+ *
+ * count - number of lights
+ */
+float
+reachingRadius(int count);
+
+/* pipelineResize: sets the size of the image pixels[] holds.
+ *
+ * width  - pixels per row
+ * height - rows
+ */
+void
+pipelineResize(int width, int height);
+
+/* pipelineRender: renders a mesh into pixels[].  Every mesh vertex
+ * is transformed and lit once per frame.
+ *
+ * mesh       - mesh compiled with vertex normals (GLM_SMOOTH), packed
+ *              (MESH_PACKED) or not
+ * mode       - shading, one of PIPELINE_FLAT, PIPELINE_SMOOTH or
+ *              PIPELINE_DEFERRED
+ * cull       - nonzero to cull back faces (counter-clockwise in
+ *              window coordinates is front, like GL_CCW)
+ * modelview  - column major modelview matrix
+ * projection - column major projection matrix
+ * viewport   - x, y, width, height of the viewport in pixels
+ */
+void
+pipelineRender(struct mesh* mesh, int mode, int cull,
+               double* modelview, double* projection, int* viewport);
+
+#endif /* PIPELINE_H */
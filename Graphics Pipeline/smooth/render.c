@@ -0,0 +1,431 @@
+/*
+    render.c
+
+    Headless renderer: draws OBJ models with the software pipeline and
+    writes them out as PPM images, with no window, GLUT or OpenGL.
+
+        render [options] model.obj [model.obj ...]
+
+    -o path      output image, or output directory for several models
+                 (default: <model>.ppm in the current directory)
+    -s WxH       image size in pixels (default 512x512)
+    -m mode      flat, smooth or deferred shading (default smooth)
+    -a degrees   turn the model around the vertical axis
+    -e degrees   tilt the model towards the camera
+    -d distance  camera distance from the model's center (default 3)
+    -f degrees   vertical field of view (default 60)
+    -n frames    render every model this many times, for timing
+    -t threads   threads to load and render with (default: all processors)
+    -k kernel    span kernel: scalar, sse2 or avx2 (default: the widest
+                 the processor runs; "bench kernels" checks they match)
+    -p           quantize the vertices to 16 bytes (see mesh.h)
+    -l           simplify each model into levels of detail and draw the one
+                 its size on the screen needs (see lod.h)
+    -r order     reorder the triangles of each model at load: "cache" for
+                 the vertex cache, "overdraw" for the vertex cache and
+                 outward facing parts first (see glmOptimizeOrder)
+    -z           skip what a tile already hides with hierarchical z
+    -g           draw the groups of each model nearest first
+    -x image     map an SGI or PPM image onto the models (see texture.h),
+                 with their own texture coordinates or sphere mapped
+                 ones, filtered trilinearly
+    -bilinear    filter the image bilinearly in the nearest mipmap instead
+    -shadows     shadow the models on themselves from the light, through a
+                 shadow map filtered with PCF
+    -lights N    light the models with N point lights as well, scattered
+                 around them and culled per 16x16 tile, just large enough
+                 that about 4 of them reach any point; needs -m deferred
+    -radius r    give the point lights radius r instead
+    -nocull      draw back faces too
+*/
+
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "glm.h"
+#include "lod.h"
+#include "pipeline.h"
+
+#define MAX_SIZE 8192
+
+//camera and image settings from the command line
+int width = 512, height = 512;
+int mode = PIPELINE_SMOOTH;
+double azimuth = 0.0, elevation = 0.0, distance = 3.0, fov = 60.0;
+int frames = 1;
+int cull = 1;
+int order = -1;     //-1, or whether glmOptimizeOrder() cuts overdraw
+int packed = 0;     //MESH_PACKED to quantize the vertices
+int levels = 0;     //draw levels of detail
+char* output = NULL;
+char* image = NULL; //texture image
+int lights = 0;     //point lights
+double radius = 0.0;
+
+//milliseconds on a monotonic clock
+double now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000.0 + t.tv_nsec / 1000000.0;
+}
+
+//part of a count as a percentage, 0 of nothing
+double percent(int part, int count)
+{
+    return count ? 100.0 * part / count : 0.0;
+}
+
+/*=======================================================================
+CAMERA ==================================================================
+=======================================================================*/
+
+//column major r = a * b
+void multiply(double* r, double* a, double* b)
+{
+    double t[16];
+    int row, col, k;
+    for(col = 0; col < 4; col++)
+    {
+        for(row = 0; row < 4; row++)
+        {
+            t[col * 4 + row] = 0.0;
+            for(k = 0; k < 4; k++)
+                t[col * 4 + row] += a[k * 4 + row] * b[col * 4 + k];
+        }
+    }
+    memcpy(r, t, sizeof(t));
+}
+
+//the matrices the viewer would set up with gluPerspective, glTranslate
+//and glRotate for the camera on the command line
+void setupCamera(double* modelview, double* projection, int* viewport)
+{
+    double f = 1.0 / tan(fov * M_PI / 360.0);
+    double near = 1.0, far = 128.0;
+    double a = azimuth * M_PI / 180.0, e = elevation * M_PI / 180.0;
+    double turn[16] = {
+        cos(a), 0, -sin(a), 0,
+        0, 1, 0, 0,
+        sin(a), 0, cos(a), 0,
+        0, 0, 0, 1,
+    };
+    double tilt[16] = {
+        1, 0, 0, 0,
+        0, cos(e), sin(e), 0,
+        0, -sin(e), cos(e), 0,
+        0, 0, 0, 1,
+    };
+    double translate[16] = {
+        1, 0, 0, 0,
+        0, 1, 0, 0,
+        0, 0, 1, 0,
+        0, 0, -distance, 1,
+    };
+    double perspective[16] = {
+        f * height / width, 0, 0, 0,
+        0, f, 0, 0,
+        0, 0, (far + near) / (near - far), -1,
+        0, 0, 2 * far * near / (near - far), 0,
+    };
+
+    multiply(modelview, tilt, turn);
+    multiply(modelview, translate, modelview);
+    memcpy(projection, perspective, sizeof(perspective));
+    viewport[0] = 0;
+    viewport[1] = 0;
+    viewport[2] = width;
+    viewport[3] = height;
+}
+
+/*=======================================================================
+OUTPUT ==================================================================
+=======================================================================*/
+
+//writes pixels as a binary PPM, top row first
+int writePPM(char* filename)
+{
+    int x, y;
+    unsigned int c;
+    FILE* file = fopen(filename, "wb");
+    if(!file)
+    {
+        fprintf(stderr, "render: can't open \"%s\" for writing.\n", filename);
+        return 0;
+    }
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    for(y = height - 1; y >= 0; y--)
+    {
+        for(x = 0; x < width; x++)
+        {
+            c = pixels[y * width + x];
+            fputc(c & 255, file);
+            fputc((c >> 8) & 255, file);
+            fputc((c >> 16) & 255, file);
+        }
+    }
+    fclose(file);
+    return 1;
+}
+
+//image name of a model: the output path itself for a single model,
+//otherwise <output or .>/<model name>.ppm
+char* imageName(char* modelName, int numModels)
+{
+    char* base = strrchr(modelName, '/');
+    char* dir = output ? output : ".";
+    char* name;
+    char* dot;
+
+    if(output && numModels == 1)
+        return strdup(output);
+    base = base ? base + 1 : modelName;
+    name = (char*)malloc(strlen(dir) + strlen(base) + 6);
+    sprintf(name, "%s/%s", dir, base);
+    dot = strrchr(name, '.');
+    if(dot && dot > name + strlen(dir))
+        *dot = '\0';
+    strcat(name, ".ppm");
+    return name;
+}
+
+/*=======================================================================
+MAIN ====================================================================
+=======================================================================*/
+
+void usage(void)
+{
+    fprintf(stderr, "usage: render [-o path] [-s WxH] [-m flat|smooth|deferred] [-a degrees]\n"
+                    "              [-e degrees] [-d distance] [-f degrees] [-n frames]\n"
+                    "              [-t threads] [-k scalar|sse2|avx2] [-r cache|overdraw]\n"
+                    "              [-p] [-l] [-z] [-g] [-x image] [-bilinear] [-shadows]\n"
+                    "              [-lights N] [-radius r] [-nocull]\n"
+                    "              model.obj [model.obj ...]\n");
+    exit(1);
+}
+
+int main(int argc, char** argv)
+{
+    GLMmodel* model;
+    struct mesh* mesh;
+    struct lod* lod = NULL;
+    GLuint level = 0;
+    double modelview[16], projection[16];
+    int viewport[4];
+    double start, loadTime, renderTime, totalTime = 0.0;
+    double before, after;
+    long totalTriangles = 0;
+    int i, f, first, numModels;
+    int texWidth, texHeight;
+    GLuint texture = 0;   //GLM_TEXTURE to compile the texture coordinates
+    char* name;
+
+    numThreads = processorCount();
+    rasterKernel = bestKernel = detectKernel();
+    for(i = 1; i < argc && argv[i][0] == '-'; i++)
+    {
+        if(strcmp(argv[i], "-nocull") == 0)
+            cull = 0;
+        else if(strcmp(argv[i], "-p") == 0)
+            packed = MESH_PACKED;
+        else if(strcmp(argv[i], "-l") == 0)
+            levels = 1;
+        else if(strcmp(argv[i], "-g") == 0)
+            sortGroups = 1;
+        else if(strcmp(argv[i], "-z") == 0)
+            hizEnabled = 1;
+        else if(strcmp(argv[i], "-bilinear") == 0)
+            textureFilter = TEXTURE_BILINEAR;
+        else if(strcmp(argv[i], "-shadows") == 0)
+            shadowsEnabled = 1;
+        else if(i + 1 >= argc)
+            usage();
+        else if(strcmp(argv[i], "-o") == 0)
+            output = argv[++i];
+        else if(strcmp(argv[i], "-x") == 0)
+            image = argv[++i];
+        else if(strcmp(argv[i], "-s") == 0)
+        {
+            if(sscanf(argv[++i], "%dx%d", &width, &height) != 2)
+                usage();
+        }
+        else if(strcmp(argv[i], "-m") == 0)
+        {
+            i++;
+            if(strcmp(argv[i], "flat") == 0)
+                mode = PIPELINE_FLAT;
+            else if(strcmp(argv[i], "smooth") == 0)
+                mode = PIPELINE_SMOOTH;
+            else if(strcmp(argv[i], "deferred") == 0)
+                mode = PIPELINE_DEFERRED;
+            else
+                usage();
+        }
+        else if(strcmp(argv[i], "-a") == 0)
+            azimuth = atof(argv[++i]);
+        else if(strcmp(argv[i], "-e") == 0)
+            elevation = atof(argv[++i]);
+        else if(strcmp(argv[i], "-d") == 0)
+            distance = atof(argv[++i]);
+        else if(strcmp(argv[i], "-f") == 0)
+            fov = atof(argv[++i]);
+        else if(strcmp(argv[i], "-lights") == 0)
+            lights = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-radius") == 0)
+            radius = atof(argv[++i]);
+        else if(strcmp(argv[i], "-n") == 0)
+            frames = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-t") == 0)
+            numThreads = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-k") == 0)
+        {
+            i++;
+            if(strcmp(argv[i], "scalar") == 0)
+                rasterKernel = KERNEL_SCALAR;
+            else if(strcmp(argv[i], "sse2") == 0)
+                rasterKernel = KERNEL_SSE2;
+            else if(strcmp(argv[i], "avx2") == 0)
+                rasterKernel = KERNEL_AVX2;
+            else
+                usage();
+            if(rasterKernel > bestKernel)
+            {
+                fprintf(stderr, "render: this processor has no %s kernel.\n", kernelNames[rasterKernel]);
+                return 1;
+            }
+        }
+        else if(strcmp(argv[i], "-r") == 0)
+        {
+            i++;
+            if(strcmp(argv[i], "cache") == 0)
+                order = GL_FALSE;
+            else if(strcmp(argv[i], "overdraw") == 0)
+                order = GL_TRUE;
+            else
+                usage();
+        }
+        else
+            usage();
+    }
+    first = i;
+    numModels = argc - first;
+    if(numModels < 1 || width < 1 || height < 1 || width > MAX_SIZE || height > MAX_SIZE || frames < 1 ||
+       lights < 0 || radius < 0.0)
+        usage();
+    //point lights are only lit per pixel, in deferred frames
+    if((lights || radius > 0.0) && mode != PIPELINE_DEFERRED)
+    {
+        fprintf(stderr, "render: -lights and -radius need -m deferred.\n");
+        return 1;
+    }
+    if(radius > 0.0 && !lights)
+    {
+        fprintf(stderr, "render: -radius needs -lights.\n");
+        return 1;
+    }
+    if(numThreads < 1)
+        numThreads = 1;
+    if(numThreads > MAX_THREADS)
+        numThreads = MAX_THREADS;
+
+    pipelineResize(width, height);
+    setupCamera(modelview, projection, viewport);
+    if(image)
+    {
+        GLubyte* texels = textureReadImage(image, &texWidth, &texHeight);
+        if(!texels)
+            return 1;
+        pipelineTexture = textureCreate(texels, texWidth, texHeight);
+        free(texels);
+        texture = GLM_TEXTURE;
+    }
+    if(lights)
+    {
+        if(radius == 0.0)
+            radius = reachingRadius(lights);
+        pipelineLights = (struct pipelineLight*)malloc(sizeof(struct pipelineLight) * lights);
+        scatterLights(pipelineLights, lights, radius, 1);
+        numLights = lights;
+    }
+
+    for(i = first; i < argc; i++)
+    {
+        //prepared the way the viewer prepares its models
+        start = now();
+        model = glmReadOBJParallel(argv[i], numThreads);
+        glmUnitize(model);
+        glmFacetNormals(model);
+        glmVertexNormalsParallel(model, 90.0, numThreads);
+        if(texture && !model->numtexcoords)
+            glmSpheremapTexture(model);
+        loadTime = now() - start;
+        before = glmCacheMissRatio(model, GLM_SMOOTH);
+        start = now();
+        if(order >= 0)
+            glmOptimizeOrder(model, GLM_SMOOTH, (GLboolean)order);
+        if(levels)
+        {
+            lod = lodBuild(model, 90.0, GLM_SMOOTH | texture | packed);
+            level = lodPick(lod, modelview, projection, viewport, LOD_PIXEL_ERROR);
+            mesh = lod->meshes[level];
+        }
+        else
+            mesh = meshCompile(model, GLM_SMOOTH | texture | packed);
+        loadTime += now() - start;
+        after = glmCacheMissRatio(model, GLM_SMOOTH);
+
+        start = now();
+        for(f = 0; f < frames; f++)
+            pipelineRender(mesh, mode, cull, modelview, projection, viewport);
+        renderTime = (now() - start) / frames;
+        totalTime += renderTime;
+        totalTriangles += mesh->numcorners / 3;
+
+        name = imageName(argv[i], numModels);
+        printf("%-32s %8d triangles  load %9.3f ms  render %8.3f ms  %s\n",
+               argv[i], mesh->numcorners / 3, loadTime, renderTime, name);
+        printf("%-32s %8d vertices   %5.2f corners each  %7ld KB -> %7ld KB\n",
+               "", mesh->numvertices, (double)mesh->numcorners / mesh->numvertices,
+               meshModelBytes(mesh) / 1024, meshBytes(mesh) / 1024);
+        if(order >= 0)
+            printf("%-32s %8.3f ACMR before   %5.3f after\n", "", before, after);
+        if(packed)
+            printf("%-32s %8.6f largest position error   %5.3f degrees normal error\n",
+                   "", mesh->positionerror, mesh->normalerror);
+        if(levels)
+            printf("%-32s %8u level of %u    %8.5f error   %d triangles at level 0\n",
+                   "", level, lod->numlevels, lod->errors[level], model->numtriangles);
+        if(hizEnabled)
+            printf("%-32s %7.1f%% of triangles in a tile hidden   %5.1f%% of their blocks\n",
+                   "", percent(frameStats.hizCulled, frameStats.hizTested),
+                   percent(frameStats.hizBlocksCulled, frameStats.hizBlocks));
+        if(shadowsEnabled)
+            printf("%-32s %8d triangles in the shadow map%s\n", "", frameStats.shadowTriangles,
+                   frameStats.shadowMapDrawn ? "" : ", kept from the frame before");
+        if(lights)
+            printf("%-32s %8d point lights in view   %5.2f a %dx%d tile   %5.2f a pixel\n", "",
+                   frameStats.lights,
+                   frameStats.lightTiles ? (double)frameStats.tileLights / frameStats.lightTiles : 0.0,
+                   LIGHT_TILE, LIGHT_TILE,
+                   frameStats.lightPixels ? (double)frameStats.pixelLights / frameStats.lightPixels : 0.0);
+        f = writePPM(name);
+        free(name);
+        if(!f)
+            return 1;
+        if(levels)
+            lodDelete(lod);
+        else
+            meshDelete(mesh);
+        glmDelete(model);
+    }
+
+    printf("%d models, %d x %d, %d threads, %s kernel: %.3f ms per frame, %.0f triangles/s\n",
+           numModels, width, height, numThreads, kernelNames[rasterKernel],
+           totalTime / numModels, totalTriangles / (totalTime / 1000.0));
+    if(shadowsEnabled)
+        printf("shadows looked up with the %s row\n", visibilityNames[rasterKernel]);
+    return 0;
+}
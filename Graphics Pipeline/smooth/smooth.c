@@ -11,9 +11,13 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <stdarg.h>
+#include <string.h>
 #include <GLUT/glut.h>
 #include "gltb.h"
 #include "glm.h"
+#include "mesh.h"
+#include "lod.h"
+#include "pipeline.h"
 #include "dirent32.h"
 
 #pragma comment( linker, "/entry:\"mainCRTStartup\"" )  // set the entry point to be main()
@@ -22,10 +26,22 @@
 int usingPipeline = 0;
 int flatShading = 0;
 int smoothShading = 0;
+int deferredShading = 0;
 
 char*      model_file = NULL;		/* name of the obect file */
 GLuint     model_list = 0;		    /* display list for object */
+GLboolean  list_stale = GL_FALSE;	/* display list behind the model? */
 GLMmodel*  model;			        /* glm model data structure */
+struct mesh* mesh = NULL;		    /* model compiled for the pipeline */
+GLboolean  mesh_stale = GL_FALSE;	/* mesh behind the model? */
+GLuint     mesh_packed = 0;		    /* MESH_PACKED for quantized vertices */
+GLuint     mesh_texture = 0;		/* GLM_TEXTURE when texturing */
+GLuint     texture_name = 0;		/* OpenGL's copy of the texture */
+struct pipelineLight point_lights[4096];	/* point lights of the pipeline */
+struct lod* lod = NULL;			    /* levels of detail of the model */
+GLboolean  lod_on = GL_FALSE;		/* draw the level the model's size needs? */
+GLuint     lod_lists[LOD_MAX_LEVELS];	/* display lists of the coarser levels */
+GLuint     lod_level = 0;		    /* level drawn last */
 GLfloat    scale;			        /* original scale factor */
 GLfloat    smoothing_angle = 90.0;	/* smoothing angle */
 GLfloat    weld_distance = 0.00001;	/* epsilon for welding vertices */
@@ -50,625 +66,119 @@ GLdouble   pan_z = 0.0;
 #endif
 
 /*=======================================================================
-STRUCTS =================================================================
-=======================================================================*/
-
-//for RGB colors
-struct RGBType
-{
-    float r;
-    float g;
-    float b;
-};
-struct RGBType pixels[512 * 512];
-
-//points taken from the model
-struct projectedPoint
-{
-    int x;
-    int y;
-    double z;
-    double nx;
-    double ny;
-    double nz;
-    struct RGBType color;
-};
-
-//points on the frame
-struct framePoint
-{
-    int populated;
-    double z;
-    struct RGBType color;
-};
-//for entire frame
-struct framePoint frameBuffer[512 * 512];
-//for individual triangles
-struct framePoint triangle[512 * 512];
-
-/*=======================================================================
-HELPER METHODS ==========================================================
+PIPELINE ================================================================
 =======================================================================*/
 
-//distance between two points
-double distance(struct projectedPoint p1, struct projectedPoint p2)
-{
-    return sqrt(pow(p2.x - p1.x, 2) + pow(p2.y - p1.y, 2));
-}
-
-//finds area of a triangle
-double area(struct projectedPoint p1, struct projectedPoint p2, struct projectedPoint p3)
-{
-    double a = distance(p1, p2);
-    double b = distance(p2, p3);
-    double c = distance (p3, p1);
-    
-    double s = (a + b + c)/2.0;
-    
-    return sqrt(s * (s - a) * (s - b) * (s - c));
-}
+//size of the window and of the pipeline's image
+#define IMAGE_SIZE 512
 
-//finds min between two int values
-int min(int a, int b)
+//compiles the model again for the pipeline, with the vertex normals
+//it shades with whatever the display list uses, and simplifies it into
+//levels of detail when they are on (mesh is then level 0's)
+void compileMesh(void)
 {
-    if(a < b)
-        return a;
-    else return b;
-}
-
-//finds max between two int values
-int max(int a, int b)
-{
-    if(a > b)
-        return a;
-    else return b;
-}
-
-//finds max between two double values
-double maxd(double a, double b)
-{
-    if(a > b)
-        return a;
-    else return b;
-}
-
-//swaps two int values
-void swap(int *a, int *b)
-{
-    int temp = *a;
-    *a = *b;
-    *b = temp;
-}
-
-//swaps two colors
-void swapColor(struct RGBType* a, struct RGBType* b)
-{
-    struct RGBType temp = *a;
-    *a = *b;
-    *b = temp;
-}
-
-double implicitLine(double x0, double y0, double x1, double y1, double x, double y)
-{
-    return (y0 - y1) * x + (x1 - x0) * y + (x0 * y1) - (x1 * y0);
-}
-
-void clearTriangleBuffer(void)
-{
-    int i, j;
-    for(i = 0; i < 512; i++)
-    {
-        for(j = 0; j < 512; j++)
-        {
-            triangle[(i * 512) + j].populated = 0;
-        }
-    }
-}
-
-void clearFrameBuffer(void)
-{
-    int i, j;
-    for(i = 0; i < 512; i++)
-    {
-        for(j = 0; j < 512; j++)
-        {
-            frameBuffer[(i * 512) + j].populated = 0;
-        }
-    }
-}
-
-void clearPixels(void)
-{
-    int i, j;
-    for(i = 0; i < 512; i++)
+    if(lod)
     {
-        for(j = 0; j < 512; j++)
-        {
-            pixels[(i * 512) + j].r = 0.0;
-            pixels[(i * 512) + j].g = 0.0;
-            pixels[(i * 512) + j].b = 0.0;
-        }
-    }
-}
-
-/*=======================================================================
-INTERPOLATION ===========================================================
-=======================================================================*/
-
-double interpolate1D(struct projectedPoint p1, struct projectedPoint p2, int x, int y)
-{
-    //intermediate point
-    struct projectedPoint p3;
-    p3.x = x; p3.y = y;
-    
-    //distance between endpoints
-    double dep = distance(p1, p2);
-    
-    //distance from p1
-    double dp1 = distance(p1, p3);
-    
-    dp1 /= dep;
-
-    return (1 - dp1) * p1.z + dp1 * p2.z;
-}
-
-struct RGBType interpolate1Dcolor(struct projectedPoint p1, struct projectedPoint p2, int x, int y)
-{
-    //intermediate point
-    struct projectedPoint p3;
-    p3.x = x; p3.y = y;
-    
-    //distance between endpoints
-    double dep = distance(p1, p2);
-    
-    //distance from p1
-    double dp1 = distance(p1, p3);
-    
-    dp1 /= dep;
-    
-    struct RGBType color;
-    color.r = (1 - dp1) * p1.color.r + dp1 * p2.color.r;
-    color.g = (1 - dp1) * p1.color.g + dp1 * p2.color.g;
-    color.b = (1 - dp1) * p1.color.b + dp1 * p2.color.b;
-    return color;
-}
-
-double interpolate2D(struct projectedPoint p1, struct projectedPoint p2, struct projectedPoint p3, int x, int y)
-{
-    struct projectedPoint p4;
-    p4.x = x; p4.y = y;
-    
-    double triArea = area(p1, p2, p3);
-
-    double alpha1 = area(p1, p2, p4)/triArea;
-    double alpha2 = area(p1, p3, p4)/triArea;
-    double alpha3 = area(p2, p3, p4)/triArea;
-    
-    return (alpha1 * p3.z) + (alpha2 * p2.z) + (alpha3 * p1.z);
-}
-
-struct RGBType interpolate2Dcolor(struct projectedPoint p1, struct projectedPoint p2, struct projectedPoint p3, int x, int y)
-{
-    struct projectedPoint p4;
-    p4.x = x; p4.y = y;
-    
-    double triArea = area(p1, p2, p3);
-    
-    double alpha1 = area(p1, p2, p4)/triArea;
-    double alpha2 = area(p1, p3, p4)/triArea;
-    double alpha3 = area(p2, p3, p4)/triArea;
-    
-    struct RGBType color;
-    color.r = (alpha1 * p3.color.r) + (alpha2 * p2.color.r) + (alpha3 * p1.color.r);
-    color.g = (alpha1 * p3.color.g) + (alpha2 * p2.color.g) + (alpha3 * p1.color.g);
-    color.b = (alpha1 * p3.color.b) + (alpha2 * p2.color.b) + (alpha3 * p1.color.b);
-    return color;
-}
-
-/*=======================================================================
-BRASENHAM ===============================================================
-=======================================================================*/
-void plotPoint(struct projectedPoint p1, struct projectedPoint p2, int x, int y, struct RGBType color)
-{
-    double z;
-    int pointIndex = (y) * 512 + x;
-    if(frameBuffer[pointIndex].populated == 0)
-    {
-        frameBuffer[pointIndex].populated = 1;
-        frameBuffer[pointIndex].z = interpolate1D(p1, p2, x, y);
-        if(flatShading == 1)
-        {
-            frameBuffer[pointIndex].color = color;
-        }
-        if(smoothShading == 1)
-        {
-            frameBuffer[pointIndex].color = interpolate1Dcolor(p1, p2, x, y);
-        }
+        lodDelete(lod);
+        lod = NULL;
     }
     else
+        meshDelete(mesh);
+    if(lod_on)
     {
-        z = interpolate1D(p1, p2, x, y);
-        if(frameBuffer[pointIndex].z > z)
-        {
-            frameBuffer[pointIndex].z = z;
-            if(flatShading == 1)
-            {
-                frameBuffer[pointIndex].color = color;
-            }
-            if(smoothShading == 1)
-            {
-                frameBuffer[pointIndex].color = interpolate1Dcolor(p1, p2, x, y);
-            }
-        }
-    }
-    triangle[pointIndex].populated = 1;
-}
-
-void brasenham(struct projectedPoint p1, struct projectedPoint p2, struct RGBType color)
-{
-    int pointIndex = 0;
-    double z;
-    if(p1.y == p2.y) //horizontal line
-    {
-        int x = min(p1.x, p2.x);
-        int y = p1.y;
-        while(x <= max(p1.x, p2.x))
-        {
-            plotPoint(p1, p2, x, y, color);
-            x += 1;
-        }
-    }
-    else if(p1.x == p2.x) //vertical line
-    {
-        int x = p1.x;
-        int y = min(p1.y, p2.y);
-        while(y <= max(p1.y, p2.y))
-        {
-            plotPoint(p1, p2, x, y, color);
-            y += 1;
-        }
-    }
-    else{
-        double slope = (double)(p2.y - p1.y)/(double)(p2.x - p1.x);
-        if(slope >= 0 && slope <= 1)
-        {
-            if(p1.x > p2.x)
-            {
-                swap(&p1.x, &p2.x);
-                swap(&p1.y, &p2.y);
-                swapColor(&p1.color, &p2.color);
-            }
-            double d = implicitLine(p1.x, p1.y, p2.x, p2.y, p1.x + 1, p1.y + 0.5);
-            int x = min(p1.x, p2.x);
-            int y = min(p1.y, p2.y);
-            while(x <= max(p1.x, p2.x))
-            {
-                plotPoint(p1, p2, x, y, color);
-                if(d < 0)
-                {
-                    y++;
-                    d += (p2.x - p1.x) + (p1.y - p2.y);
-                }
-                else d += p1.y - p2.y;
-                x++;
-            }
-        }
-        else if(slope >= -1 && slope <= 0)
-        {
-            if(p1.x < p2.x)
-            {
-                swap(&p1.x, &p2.x);
-                swap(&p1.y, &p2.y);
-                swapColor(&p1.color, &p2.color);
-            }
-            double d = implicitLine(p1.x, p1.y, p2.x, p2.y, p1.x + 1, p1.y - 0.5);
-            int x = min(p1.x, p2.x);
-            int y = max(p1.y, p2.y);
-            while(x <= max(p1.x, p2.x))
-            {
-                plotPoint(p1, p2, x, y, color);
-                if(d < 0)
-                {
-                    y--;
-                    d += (p1.y - p2.y) - (p2.x - p1.x);
-                }
-                else d += p1.y - p2.y;
-                x++;
-            }
-        }
-        else if(slope > 1)
-        {
-            if(p1.x < p2.x)
-            {
-                swap(&p1.x, &p2.x);
-                swap(&p1.y, &p2.y);
-                swapColor(&p1.color, &p2.color);
-            }
-            double d = implicitLine(p1.x, p1.y, p2.x, p2.y, p1.x + 0.5, p1.y + 1);
-            int x = min(p1.x, p2.x);
-            int y = min(p1.y, p2.y);
-            while(y <= max(p1.y, p2.y))
-            {
-                plotPoint(p1, p2, x, y, color);
-                if(d < 0)
-                {
-                    x++;
-                    d += (p2.x - p1.x) + (p1.y - p2.y);
-                }
-                else d += p2.x - p1.x;
-                y++;
-            }
-        }
-        else
-        {
-            if(p1.x > p2.x)
-            {
-                swap(&p1.x, &p2.x);
-                swap(&p1.y, &p2.y);
-                swapColor(&p1.color, &p2.color);
-            }
-            double d = implicitLine(p1.x, p1.y, p2.x, p2.y, p1.x + 0.5, p1.y - 1);
-            int x = min(p1.x, p2.x);
-            int y = max(p1.y, p2.y);
-            while(y >= min(p1.y, p2.y))
-            {
-                plotPoint(p1, p2, x, y, color);
-                if(d < 0)
-                {
-                    x++;
-                    d += (p1.y - p2.y) - (p2.x - p1.x);
-                }
-                else d += p1.x - p2.x;
-                y--;
-            }
-        }
+        lod = lodBuild(model, smoothing_angle, GLM_SMOOTH | mesh_texture | mesh_packed);
+        mesh = lod->meshes[0];
     }
+    else
+        mesh = meshCompile(model, GLM_SMOOTH | mesh_texture | mesh_packed);
+    mesh_stale = GL_FALSE;
 }
 
-/*=======================================================================
-SCAN LINE ===============================================================
-=======================================================================*/
-
-void scanLine(struct projectedPoint p1, struct projectedPoint p2, struct projectedPoint p3, struct RGBType color)
+//redoes the vertex normals that smoothing_angle changes; the levels of
+//detail get theirs redone and only their meshes recompiled, the mesh
+//alone is recompiled when the pipeline next needs it
+void smoothingAngle(void)
 {
-    int pointIndex = 0;
-    double z;
-    int xmin = min(p1.x, min(p2.x, p3.x)), xmax = max(p1.x, max(p2.x, p3.x));
-    int ymin = min(p1.y, min(p2.y, p3.y)), ymax = max(p1.y, max(p2.y, p3.y));
-    
-    int x = xmin, y = ymin, sx = 0, ex = 0, vertexIntersectCount = 0;
-    
-    for(y = ymin + 1; y <= ymax - 1; y++)
+    if(lod)
     {
-        for(x = xmin; x <= xmax; x++)
+        if(lodNormals(lod, smoothing_angle, GLM_SMOOTH | mesh_texture | mesh_packed, numThreads))
         {
-            pointIndex = y * 512 + x;
-            if(triangle[pointIndex].populated == 1)
-            {
-                sx = x + 1;
-                break;
-            }
-        }
-        for(x = xmax; x >= xmin; x--)
-        {
-            pointIndex = y * 512 + x;
-            if(triangle[pointIndex].populated == 1)
-            {
-                ex = x - 1;
-                break;
-            }
-        }
-        for(x = sx; x <= ex; x++)
-        {
-            pointIndex = y * 512 + x;
-            if(frameBuffer[pointIndex].populated == 0)
-            {
-                frameBuffer[pointIndex].populated = 1;
-                frameBuffer[pointIndex].z = interpolate2D(p1, p2, p3, x, y);
-                if(flatShading == 1)
-                {
-                    frameBuffer[pointIndex].color = color;
-                }
-                if(smoothShading == 1)
-                {
-                    frameBuffer[pointIndex].color = interpolate2Dcolor(p1, p2, p3, x, y);
-                }
-            }
-            else
-            {
-                z = interpolate2D(p1, p2, p3, x, y);
-                if(frameBuffer[pointIndex].z >= z)
-                {
-                    frameBuffer[pointIndex].z = z;
-                    if(flatShading == 1)
-                    {
-                        frameBuffer[pointIndex].color = color;
-                    }
-                    if(smoothShading == 1)
-                    {
-                        frameBuffer[pointIndex].color = interpolate2Dcolor(p1, p2, p3, x, y);
-                    }
-                }
-            }
-            triangle[pointIndex].populated = 1;
+            mesh = lod->meshes[0];
+            list_stale = GL_TRUE;
         }
     }
+    else if(glmVertexNormalsAngle(model, smoothing_angle, numThreads))
+        list_stale = mesh_stale = GL_TRUE;
 }
 
-/*=======================================================================
-SHADING =================================================================
-=======================================================================*/
-
-struct RGBType computeShade(double nx, double ny, double nz, GLMmaterial mat, GLdouble* modelview)
+//loads the texture for both renderers the first time it is turned on:
+//mipmaps for OpenGL and a Morton ordered copy for the pipeline
+int loadTexture(void)
 {
-    //ambient shading
-    float la_r = mat.ambient[0] * 0.5;
-    float la_g = mat.ambient[1] * 0.5;
-    float la_b = mat.ambient[2] * 0.5;
-    
-    //light dir
-    float lx = 0;
-    float ly = 0;
-    float lz = 1;
-
-    float mag;
+    GLubyte* image;
+    int width, height;
     
-    if(flatShading == 1)
+    if(pipelineTexture)
+        return 1;
+    image = textureReadImage(DATA_DIR "paisley.rgb", &width, &height);
+    if(!image)
     {
-        mag = sqrt((nx * nx) + (ny * ny) + (nz * nz));
-        nx /= mag;
-        ny /= mag;
-        nz /= mag;
+        fprintf(stderr, "loadTexture(): can't read %s.\n", DATA_DIR "paisley.rgb");
+        return 0;
     }
-    
-    //diffuse shading
-    float dp = (nx * lx) + (ny * ly) + (nz * lz);
-    float ld_r = mat.diffuse[0] * 1.0 * maxd(0.0, dp);
-    float ld_g = mat.diffuse[1] * 1.0 * maxd(0.0, dp);
-    float ld_b = mat.diffuse[2] * 1.0 * maxd(0.0, dp);
-    
-    //look at vector
-    float ex = 0;
-    float ey = 0;
-    float ez = 1;
-    
-    //calculating h vector
-    float tempx = lx + ex;
-    float tempy = ly + ey;
-    float tempz = lz + ez;
-    
-    mag = sqrt((tempx * tempx) + (tempy * tempy) + (tempz * tempz));
-    float hx = tempx/mag;
-    float hy = tempy/mag;
-    float hz = tempz/mag;
-    
-    //specular shading
-    dp = (nx * hx) + (ny * hy) + (nz * hz);
-    float ls_r = mat.specular[0] * 0.3 * pow(maxd(0.0, dp), mat.shininess);
-    float ls_g = mat.specular[1] * 0.3 * pow(maxd(0.0, dp), mat.shininess);
-    float ls_b = mat.specular[2] * 0.3 * pow(maxd(0.0, dp), mat.shininess);
-    
-    struct RGBType color;
-    color.r = la_r + ld_r + ls_r;
-    color.g = la_g + ld_g + ls_g;
-    color.b = la_b + ld_b + ls_b;
-
-    return color;
+    glGenTextures(1, &texture_name);
+    glBindTexture(GL_TEXTURE_2D, texture_name);
+    gluBuild2DMipmaps(GL_TEXTURE_2D, GL_RGBA, width, height, GL_RGBA, GL_UNSIGNED_BYTE, image);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+    pipelineTexture = textureCreate(image, width, height);
+    free(image);
+    return 1;
 }
 
-void shade()
+//the texture filter OpenGL uses, the same as the pipeline's
+void textureFilterGL(void)
 {
-    int y, x, pi;
-    for(y = 0; y < 512; y++)
-    {
-        for(x = 0; x < 512; x++)
-        {
-            pi = y * 512 + x;
-            if(frameBuffer[pi].populated == 1)
-            {
-                pixels[pi].r = frameBuffer[pi].color.r;
-                pixels[pi].g = frameBuffer[pi].color.g;
-                pixels[pi].b = frameBuffer[pi].color.b;
-            }
-        }
-    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+        textureFilter == TEXTURE_TRILINEAR ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR_MIPMAP_NEAREST);
 }
 
-/*=======================================================================
-RASTERIZE ===============================================================
-=======================================================================*/
-
-void rasterize(struct projectedPoint p1, struct projectedPoint p2, struct projectedPoint p3, GLMmaterial mat, GLdouble* modelview)
+//the level of detail the model's size on the screen needs with the
+//current matrices, 0 when levels are off
+GLuint pickLevel(void)
 {
-    int i;
-    
-    //find triangle normal
-    struct RGBType color;
-    if(flatShading == 1)
-    {
-        float nx = (p1.nx + p2.nx + p3.nx)/3;
-        float ny = (p1.ny + p2.ny + p3.ny)/3;
-        float nz = (p1.nz + p2.nz + p3.nz)/3;
-        color = computeShade(nx, ny, nz, mat, modelview);
-    }
-    if(smoothShading == 1)
-    {
-        p1.color = computeShade(p1.nx, p1.ny, p1.nz, mat, modelview);
-        p2.color = computeShade(p2.nx, p2.ny, p2.nz, mat, modelview);
-        p3.color = computeShade(p3.nx, p3.ny, p3.nz, mat, modelview);
-    }
+    GLdouble modelview[16], projection[16];
+    GLint viewport[4];
     
-    //draw line from p1 to p2
-    brasenham(p1, p2, color);
-        
-    //draw line from p2 to p3
-    brasenham(p2, p3, color);
-        
-    //draw line from p3 to p1
-    brasenham(p3, p1, color);
-        
-    scanLine(p1, p2, p3, color);
-    clearTriangleBuffer();
+    if(!lod)
+        return 0;
+    glGetDoublev( GL_MODELVIEW_MATRIX, modelview );
+    glGetDoublev( GL_PROJECTION_MATRIX, projection );
+    glGetIntegerv( GL_VIEWPORT, viewport );
+    return lodPick(lod, modelview, projection, viewport, LOD_PIXEL_ERROR);
 }
 
-/*=======================================================================
-PIPELINE ================================================================
-=======================================================================*/
-
-void pipeline()
+//renders the model with the software pipeline from OpenGL's camera,
+//in the shading mode picked with the keyboard
+void pipeline(void)
 {
-    clearFrameBuffer();
-    clearPixels();
-    
-    //groups and triangle variables
-    GLMgroup *currentGroup = model->groups;
-    GLMtriangle tri;
-    int triIndex, pointIndex;
+    GLdouble modelview[16], projection[16];
+    GLint viewport[4];
+    int mode = PIPELINE_SMOOTH;
     
-    //for vertices
-    double a, b, c, na, nb, nc;
-    int k = 0;
-    struct projectedPoint pts[3];
+    if(flatShading)
+        mode = PIPELINE_FLAT;
+    else if(deferredShading)
+        mode = PIPELINE_DEFERRED;
     
-    //for glProject
-    GLint viewport[4];
-    GLdouble modelview[16];
-    GLdouble projection[16];
     glGetDoublev( GL_MODELVIEW_MATRIX, modelview );
     glGetDoublev( GL_PROJECTION_MATRIX, projection );
     glGetIntegerv( GL_VIEWPORT, viewport );
-    GLdouble winX, winY, winZ;
-    
-    GLMmaterial mat;
-    
-    //entire pipeline process
-    while(currentGroup != NULL)
-    {
-        int i, j;
-        mat = model->materials[currentGroup->material];
-        for(i = 0; i < currentGroup->numtriangles; i++)
-        {
-            triIndex = currentGroup->triangles[i];
-            tri = model->triangles[triIndex];
-            for(j = 0; j < 3; j++)
-            {
-                a = model->vertices[3*tri.vindices[j]];
-                b = model->vertices[3*tri.vindices[j] + 1];
-                c = model->vertices[3*tri.vindices[j] + 2];
-                
-                pts[j].nx = model->normals[3*tri.nindices[j]];
-                pts[j].ny = model->normals[3*tri.nindices[j] + 1];
-                pts[j].nz = model->normals[3*tri.nindices[j] + 2];
-
-                gluProject(a, b, c, modelview, projection, viewport, &winX, &winY, &winZ);
-                pts[j].x = winX; pts[j].y = winY; pts[j].z = winZ;
-                //k++;
-            }
-            rasterize(pts[0], pts[1], pts[2], mat, modelview);
-        }
-        currentGroup = currentGroup->next;
-    }
-    shade();
+    if(mesh_stale)
+        compileMesh();
+    lod_level = pickLevel();
+    pipelineRender(lod ? lod->meshes[lod_level] : mesh, mode, glIsEnabled(GL_CULL_FACE),
+                   modelview, projection, viewport);
 }
 
 /*=======================================================================
@@ -736,6 +246,47 @@ shadowtext(int x, int y, char* s)
     glEnable(GL_DEPTH_TEST);
 }
 
+/* display lists of the mesh and of the coarser levels, from the meshes
+   as they are */
+void
+meshLists(void)
+{
+    GLuint mode = GLM_NONE;
+    GLuint i;
+    struct mesh* flat;
+    
+    if (model_list)
+        glDeleteLists(model_list, 1);
+    for (i = 1; i < LOD_MAX_LEVELS; i++) {
+        if (lod_lists[i])
+            glDeleteLists(lod_lists[i], 1);
+        lod_lists[i] = 0;
+    }
+    
+    /* generate a list */
+    if (material_mode == 1)
+        mode = GLM_COLOR;
+    else if (material_mode == 2)
+        mode = GLM_MATERIAL;
+    if (facet_normal) {
+        flat = meshCompile(model, GLM_FLAT | mesh_texture | mesh_packed);
+        model_list = meshList(flat, mode);
+        meshDelete(flat);
+    } else {
+        model_list = meshList(mesh, mode);
+    }
+    for (i = 1; lod && i < lod->numlevels; i++) {
+        if (facet_normal) {
+            flat = meshCompile(lod->models[i], GLM_FLAT | mesh_texture | mesh_packed);
+            lod_lists[i] = meshList(flat, mode);
+            meshDelete(flat);
+        } else {
+            lod_lists[i] = meshList(lod->meshes[i], mode);
+        }
+    }
+    list_stale = GL_FALSE;
+}
+
 void
 lists(void)
 {
@@ -749,26 +300,14 @@ lists(void)
     glMaterialfv(GL_FRONT, GL_SPECULAR, specular);
     glMaterialf(GL_FRONT, GL_SHININESS, shininess);
     
-    if (model_list)
-        glDeleteLists(model_list, 1);
+    /* models without texture coordinates get them sphere mapped */
+    if (mesh_texture && !model->numtexcoords)
+        glmSpheremapTexture(model);
     
-    /* generate a list */
-    if (material_mode == 0) { 
-        if (facet_normal)
-            model_list = glmList(model, GLM_FLAT);
-        else
-            model_list = glmList(model, GLM_SMOOTH);
-    } else if (material_mode == 1) {
-        if (facet_normal)
-            model_list = glmList(model, GLM_FLAT | GLM_COLOR);
-        else
-            model_list = glmList(model, GLM_SMOOTH | GLM_COLOR);
-    } else if (material_mode == 2) {
-        if (facet_normal)
-            model_list = glmList(model, GLM_FLAT | GLM_MATERIAL);
-        else
-            model_list = glmList(model, GLM_SMOOTH | GLM_MATERIAL);
-    }
+    /* the smooth list draws the pipeline's mesh, facet normals need
+       a mesh of their own */
+    compileMesh();
+    meshLists();
 }
 
 void
@@ -777,10 +316,7 @@ init(void)
     gltbInit(GLUT_LEFT_BUTTON);
     
     /* read in the model */
-    model = glmReadOBJ(model_file);
-    scale = glmUnitize(model);
-    glmFacetNormals(model);
-    glmVertexNormals(model, smoothing_angle);
+    model = glmReadOBJCached(model_file, smoothing_angle, &scale, numThreads);
     
     if (model->nummaterials > 0)
         material_mode = 2;
@@ -831,6 +367,13 @@ display(void)
 
         if(usingPipeline == 0)
         {
+            //the pipeline only recompiles its mesh, so normals changed
+            //while it was on only rebuild the list once it is needed
+            if (list_stale) {
+                if (mesh_stale)
+                    compileMesh();
+                meshLists();
+            }
 #if 0   /* glmDraw() performance test */
             if (material_mode == 0) {
                 if (facet_normal)
@@ -849,7 +392,8 @@ display(void)
                     glmDraw(model, GLM_SMOOTH | GLM_MATERIAL);
             }
 #else
-            glCallList(model_list);
+            lod_level = pickLevel();
+            glCallList(lod_level ? lod_lists[lod_level] : model_list);
 #endif
             
             glDisable(GL_LIGHTING);
@@ -864,11 +408,41 @@ display(void)
         }
         else{
             pipeline();
-            glDrawPixels(512,512,GL_RGB,GL_FLOAT,pixels);
+            glDrawPixels(IMAGE_SIZE,IMAGE_SIZE,GL_RGBA,GL_UNSIGNED_BYTE,pixels);
         }
     
         glPopMatrix();
         
+        if (stats && usingPipeline) {
+            int height = glutGet(GLUT_WINDOW_HEIGHT);
+            sprintf(s, "%d triangles\n%d outside frustum\n%d back faces\n"
+                    "%d clipped\n%d rasterized\n%d computeShade calls\n"
+                    "%d vertices, %.2f corners each",
+                    frameStats.triangles, frameStats.frustumCulled,
+                    frameStats.backfaceCulled, frameStats.clipped,
+                    frameStats.rasterized, frameStats.shaded,
+                    mesh->numvertices, (double)mesh->numcorners / mesh->numvertices);
+            if (lod) {
+                sprintf(s + strlen(s), "\nlevel %u of %u, %u triangles",
+                        lod_level, lod->numlevels, lod->models[lod_level]->numtriangles);
+            }
+            if (hizEnabled) {
+                sprintf(s + strlen(s), "\n%d of %d triangles hidden, %d of %d blocks",
+                        frameStats.hizCulled, frameStats.hizTested,
+                        frameStats.hizBlocksCulled, frameStats.hizBlocks);
+            }
+            if (shadowsEnabled)
+                sprintf(s + strlen(s), "\n%d triangles in the shadow map%s",
+                        frameStats.shadowTriangles, frameStats.shadowMapDrawn ? "" : " (kept)");
+            if (numLights && deferredShading)
+                sprintf(s + strlen(s), "\n%d point lights in view, %.2f a %dx%d tile, %.2f a pixel",
+                        frameStats.lights, frameStats.lightTiles ?
+                        (double)frameStats.tileLights / frameStats.lightTiles : 0.0,
+                        LIGHT_TILE, LIGHT_TILE, frameStats.lightPixels ?
+                        (double)frameStats.pixelLights / frameStats.lightPixels : 0.0);
+            shadowtext(5, height-(5+18*1), s);
+        }
+        
         /*if (stats) {
             // XXX - this could be done a _whole lot_ faster... 
             int height = glutGet(GLUT_WINDOW_HEIGHT);
@@ -905,6 +479,8 @@ keyboard(unsigned char key, int x, int y)
         printf("help\n\n");
         printf("y         -  Toggle graphics pipeline/flat shading");
         printf("u         -  Toggle graphics pipeline/smooth shading");
+        printf("i         -  Toggle graphics pipeline/per-pixel (deferred) shading\n");
+        printf("k         -  Cycle pipeline span kernel (scalar/SSE2/AVX2)\n");
         printf("w         -  Toggle wireframe/filled\n");
         printf("c         -  Toggle culling\n");
         printf("n         -  Toggle facet/smooth normal\n");
@@ -916,6 +492,14 @@ keyboard(unsigned char key, int x, int y)
         printf("t         -  Show model stats\n");
         printf("o         -  Weld vertices in model\n");
         printf("+/-       -  Increase/decrease smoothing angle\n");
+        printf("Q         -  Toggle packed (quantized) vertices\n");
+        printf("l         -  Toggle levels of detail\n");
+        printf("z         -  Toggle hierarchical z in the pipeline\n");
+        printf("Z         -  Toggle drawing the nearest groups first\n");
+        printf("j         -  Toggle shadows in the pipeline\n");
+        printf("L         -  Cycle 0/1/256/4096 point lights (deferred shading)\n");
+        printf("x         -  Toggle texture (data/paisley.rgb)\n");
+        printf("X         -  Toggle bilinear/trilinear texture filter\n");
         printf("W         -  Write model to file (out.obj)\n");
         printf("q/escape  -  Quit\n\n");
         break;
@@ -928,9 +512,10 @@ keyboard(unsigned char key, int x, int y)
             smoothShading = 0;
             pipeline();
         }
-        else if(usingPipeline == 1 && smoothShading == 1)
+        else if(usingPipeline == 1 && (smoothShading == 1 || deferredShading == 1))
         {
             smoothShading = 0;
+            deferredShading = 0;
             flatShading = 1;
             pipeline();
         }
@@ -948,10 +533,11 @@ keyboard(unsigned char key, int x, int y)
             flatShading = 0;
             pipeline();
         }
-        else if(usingPipeline == 1 && flatShading == 1)
+        else if(usingPipeline == 1 && (flatShading == 1 || deferredShading == 1))
         {
             smoothShading = 1;
             flatShading = 0;
+            deferredShading = 0;
             pipeline();
         }
         else
@@ -960,6 +546,29 @@ keyboard(unsigned char key, int x, int y)
             usingPipeline = 0;
         }
         break;
+    case 'i':
+        if(usingPipeline == 1 && deferredShading == 1)
+        {
+            deferredShading = 0;
+            usingPipeline = 0;
+        }
+        else
+        {
+            usingPipeline = 1;
+            deferredShading = 1;
+            flatShading = 0;
+            smoothShading = 0;
+            pipeline();
+        }
+        break;
+    case 'k':
+        rasterKernel++;
+        if (rasterKernel > bestKernel)
+            rasterKernel = KERNEL_SCALAR;
+        printf("Span kernel: %s, shadow lookups %s\n", kernelNames[rasterKernel],
+               visibilityNames[rasterKernel]);
+        break;
+        
     case 't':
         stats = !stats;
         break;
@@ -1023,33 +632,101 @@ keyboard(unsigned char key, int x, int y)
         
     case 'o':
         //printf("Welded %d\n", glmWeld(model, weld_distance));
-        glmVertexNormals(model, smoothing_angle);
+        glmVertexNormalsParallel(model, smoothing_angle, numThreads);
         lists();
         break;
         
     case 'O':
         weld_distance += 0.01;
         printf("Weld distance: %.2f\n", weld_distance);
-        glmWeld(model, weld_distance);
+        glmWeldParallel(model, weld_distance, numThreads);
         glmFacetNormals(model);
-        glmVertexNormals(model, smoothing_angle);
+        glmVertexNormalsParallel(model, smoothing_angle, numThreads);
         lists();
         break;
         
     case '-':
         smoothing_angle -= 1.0;
         printf("Smoothing angle: %.1f\n", smoothing_angle);
-        glmVertexNormals(model, smoothing_angle);
-        lists();
+        smoothingAngle();
         break;
         
     case '+':
         smoothing_angle += 1.0;
         printf("Smoothing angle: %.1f\n", smoothing_angle);
-        glmVertexNormals(model, smoothing_angle);
+        smoothingAngle();
+        break;
+        
+    case 'Q':
+        mesh_packed ^= MESH_PACKED;
+        compileMesh();
+        if (mesh_packed)
+            printf("Packed vertices: %ld KB, largest error %g (position), %.3f degrees (normal)\n",
+                meshBytes(mesh) / 1024, mesh->positionerror, mesh->normalerror);
+        else
+            printf("Float vertices: %ld KB\n", meshBytes(mesh) / 1024);
+        lists();
+        break;
+        
+    case 'l':
+        lod_on = !lod_on;
+        lists();
+        if (lod) {
+            GLuint i;
+            for (i = 0; i < lod->numlevels; i++)
+                printf("Level %u: %u triangles, error %g\n", i,
+                    lod->models[i]->numtriangles, lod->errors[i]);
+        } else
+            printf("Levels of detail off\n");
+        break;
+        
+    case 'z':
+        hizEnabled = !hizEnabled;
+        printf("Hierarchical z %s\n", hizEnabled ? "on" : "off");
+        break;
+        
+    case 'j':
+        shadowsEnabled = !shadowsEnabled;
+        printf("Shadows in the pipeline %s\n", shadowsEnabled ? "on" : "off");
+        break;
+        
+    case 'L':
+        //point lights are only lit per pixel, in deferred frames
+        if (!(usingPipeline == 1 && deferredShading == 1)) {
+            printf("Point lights need deferred shading, press 'i' first\n");
+            break;
+        }
+        numLights = numLights == 0 ? 1 : numLights == 1 ? 256 : numLights == 256 ? 4096 : 0;
+        scatterLights(point_lights, numLights, reachingRadius(numLights), 1);
+        pipelineLights = point_lights;
+        printf("%d point lights in the pipeline (deferred shading)\n", numLights);
+        break;
+        
+    case 'Z':
+        sortGroups = !sortGroups;
+        printf("Nearest groups first %s\n", sortGroups ? "on" : "off");
+        break;
+        
+    case 'x':
+        if (!mesh_texture && !loadTexture())
+            break;
+        mesh_texture ^= GLM_TEXTURE;
+        if (mesh_texture)
+            glEnable(GL_TEXTURE_2D);
+        else
+            glDisable(GL_TEXTURE_2D);
+        textureFilterGL();
+        printf("Texture %s\n", mesh_texture ? "on" : "off");
         lists();
         break;
         
+    case 'X':
+        textureFilter = textureFilter == TEXTURE_TRILINEAR ? TEXTURE_BILINEAR : TEXTURE_TRILINEAR;
+        if (mesh_texture)
+            textureFilterGL();
+        printf("Texture filter: %s\n", textureFilter == TEXTURE_TRILINEAR ? "trilinear" : "bilinear");
+        break;
+        
     case 'W':
         glmScale(model, 1.0/scale);
         glmWriteOBJ(model, "out.obj", GLM_SMOOTH | GLM_MATERIAL);
@@ -1101,10 +778,7 @@ menu(int item)
         name = (char*)malloc(strlen(direntp->d_name) + strlen(DATA_DIR) + 1);
         strcpy(name, DATA_DIR);
         strcat(name, direntp->d_name);
-        model = glmReadOBJ(name);
-        scale = glmUnitize(model);
-        glmFacetNormals(model);
-        glmVertexNormals(model, smoothing_angle);
+        model = glmReadOBJCached(name, smoothing_angle, &scale, numThreads);
         
         if (model->nummaterials > 0)
             material_mode = 2;
@@ -1183,28 +857,29 @@ main(int argc, char** argv)
     struct dirent* direntp;
     DIR* dirp;
     int models;
+    int i;
     
-    glutInitWindowSize(512, 512);
+    glutInitWindowSize(IMAGE_SIZE, IMAGE_SIZE);
     glutInit(&argc, argv);
     
-    while (--argc) {
-        if (strcmp(argv[argc], "-sb") == 0)
+    numThreads = processorCount();
+    rasterKernel = bestKernel = detectKernel();
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-sb") == 0)
             buffering = GLUT_SINGLE;
-        else
-            model_file = argv[argc];
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            numThreads = atoi(argv[++i]);
+            if (numThreads < 1)
+                numThreads = 1;
+            if (numThreads > MAX_THREADS)
+                numThreads = MAX_THREADS;
+        } else
+            model_file = argv[i];
     }
+    pipelineResize(IMAGE_SIZE, IMAGE_SIZE);
     
     if (!model_file) {
-        model_file = "/data/dolphins.obj";
-    }
-    
-    //pixels
-    int p;
-    for(p = 0; p < 512 * 512; p++)
-    {
-        pixels[p].r = 0.0;
-        pixels[p].g = 0.0;
-        pixels[p].b = 0.0;
+        model_file = DATA_DIR "dolphins.obj";
     }
     
     glutInitDisplayMode(GLUT_RGB | GLUT_DEPTH | buffering);
@@ -1248,6 +923,13 @@ main(int argc, char** argv)
     glutAddMenuEntry("[o]   Weld redundant vertices", 'o');
     glutAddMenuEntry("[+]   Increase smoothing angle", '+');
     glutAddMenuEntry("[-]   Decrease smoothing angle", '-');
+    glutAddMenuEntry("[l]   Toggle levels of detail", 'l');
+    glutAddMenuEntry("[z]   Toggle hierarchical z", 'z');
+    glutAddMenuEntry("[Z]   Toggle nearest groups first", 'Z');
+    glutAddMenuEntry("[j]   Toggle pipeline shadows", 'j');
+    glutAddMenuEntry("[L]   Cycle point lights (deferred)", 'L');
+    glutAddMenuEntry("[x]   Toggle texture", 'x');
+    glutAddMenuEntry("[X]   Toggle bilinear/trilinear filter", 'X');
     glutAddMenuEntry("[W]   Write model to file (out.obj)", 'W');
     glutAddMenuEntry("", 0);
     glutAddMenuEntry("[Esc] Quit", 27);
@@ -0,0 +1,443 @@
+/*
+ *  texture.c
+ *
+ *  Mipmapped textures for the software pipeline.  See texture.h for
+ *  the layout of the texels.
+ */
+
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "texture.h"
+
+
+/* textureSpread: the low 16 bits of a value spread out to the even
+ * bits, the x half of a Morton index */
+static GLuint
+textureSpread(GLuint v)
+{
+    v &= 0xffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+/* textureAxis: the part of a texel's index one coordinate gives,
+ * spread over the even bits of the square the smaller side makes and
+ * whole squares above it, shifted up by one bit for y */
+static GLuint
+textureAxis(struct textureLevel* level, GLuint c, GLuint y)
+{
+    GLuint square = (1 << level->shift) - 1;
+
+    return (textureSpread(c & square) << y) | ((c >> level->shift) << (2 * level->shift));
+}
+
+/* textureIndex: index of a texel in its level's texels.
+ *
+ * level - level of a texture
+ * x, y  - texel, 0 .. width - 1 and 0 .. height - 1
+ */
+GLuint
+textureIndex(struct textureLevel* level, GLuint x, GLuint y)
+{
+    return textureAxis(level, x, 0) | textureAxis(level, y, 1);
+}
+
+/* textureNearestPower: the power of two nearest to a size */
+static GLuint
+textureNearestPower(GLuint n)
+{
+    GLuint p = 1;
+
+    while (p * 2 <= n)
+        p *= 2;
+    if (n - p > 2 * p - n)
+        p *= 2;
+    return p;
+}
+
+/* textureScale: scales RGBA bytes to another size, bilinearly between
+ * the pixel centers */
+static GLubyte*
+textureScale(GLubyte* image, int width, int height, int w, int h)
+{
+    GLubyte* scaled = (GLubyte*)malloc(4 * w * h);
+    GLfloat  fx, fy, ax, ay;
+    int      x, y, x0, y0, x1, y1, c;
+
+    for (y = 0; y < h; y++) {
+        fy = (y + 0.5f) * height / h - 0.5f;
+        fy = fy < 0.0f ? 0.0f : fy;
+        y0 = (int)fy;
+        y1 = y0 + 1 < height ? y0 + 1 : y0;
+        ay = fy - y0;
+        for (x = 0; x < w; x++) {
+            fx = (x + 0.5f) * width / w - 0.5f;
+            fx = fx < 0.0f ? 0.0f : fx;
+            x0 = (int)fx;
+            x1 = x0 + 1 < width ? x0 + 1 : x0;
+            ax = fx - x0;
+            for (c = 0; c < 4; c++) {
+                GLfloat a = image[4 * (y0 * width + x0) + c] * (1.0f - ax) +
+                            image[4 * (y0 * width + x1) + c] * ax;
+                GLfloat b = image[4 * (y1 * width + x0) + c] * (1.0f - ax) +
+                            image[4 * (y1 * width + x1) + c] * ax;
+                scaled[4 * (y * w + x) + c] = (GLubyte)(a + (b - a) * ay + 0.5f);
+            }
+        }
+    }
+    return scaled;
+}
+
+/* textureCreate: builds a texture and its mipmaps from an image.
+ *
+ * image  - RGBA bytes, 4 a pixel, the first row at texture v = 0
+ * width  - pixels across
+ * height - pixels down
+ */
+struct texture*
+textureCreate(GLubyte* image, int width, int height)
+{
+    struct texture*      texture;
+    struct textureLevel* level;
+    struct textureLevel* above;
+    GLubyte* scaled = image;
+    GLuint   w, h, l, x, y, c, sx, sy, sum, total = 0;
+    GLuint   t[4];
+
+    w = textureNearestPower(width);
+    h = textureNearestPower(height);
+    if (w > 1u << (TEXTURE_MAX_LEVELS - 1))
+        w = 1u << (TEXTURE_MAX_LEVELS - 1);
+    if (h > 1u << (TEXTURE_MAX_LEVELS - 1))
+        h = 1u << (TEXTURE_MAX_LEVELS - 1);
+    if (w != (GLuint)width || h != (GLuint)height)
+        scaled = textureScale(image, width, height, w, h);
+
+    texture = (struct texture*)malloc(sizeof(struct texture));
+    texture->numlevels = 0;
+    for (;;) {
+        level = &texture->levels[texture->numlevels++];
+        level->width = w;
+        level->height = h;
+        for (level->shift = 0; (2u << level->shift) <= (w < h ? w : h); level->shift++)
+            ;
+        total += w * h;
+        if (w == 1 && h == 1)
+            break;
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+    }
+    texture->texels = (GLuint*)malloc(sizeof(GLuint) * total);
+    total = 0;
+    for (l = 0; l < texture->numlevels; l++) {
+        texture->levels[l].texels = texture->texels + total;
+        total += texture->levels[l].width * texture->levels[l].height;
+    }
+
+    /* the largest level straight from the image */
+    level = &texture->levels[0];
+    for (y = 0; y < level->height; y++) {
+        for (x = 0; x < level->width; x++) {
+            GLubyte* p = &scaled[4 * (y * level->width + x)];
+            level->texels[textureIndex(level, x, y)] =
+                p[0] | (p[1] << 8) | (p[2] << 16) | ((GLuint)p[3] << 24);
+        }
+    }
+    if (scaled != image)
+        free(scaled);
+
+    /* and every other one averaging the one above it */
+    for (l = 1; l < texture->numlevels; l++) {
+        level = &texture->levels[l];
+        above = &texture->levels[l - 1];
+        sx = above->width > 1 ? 1 : 0;
+        sy = above->height > 1 ? 1 : 0;
+        for (y = 0; y < level->height; y++) {
+            for (x = 0; x < level->width; x++) {
+                t[0] = above->texels[textureIndex(above, 2 * x, 2 * y)];
+                t[1] = above->texels[textureIndex(above, 2 * x + sx, 2 * y)];
+                t[2] = above->texels[textureIndex(above, 2 * x, 2 * y + sy)];
+                t[3] = above->texels[textureIndex(above, 2 * x + sx, 2 * y + sy)];
+                level->texels[textureIndex(level, x, y)] = 0;
+                for (c = 0; c < 32; c += 8) {
+                    sum = ((t[0] >> c) & 255) + ((t[1] >> c) & 255) +
+                          ((t[2] >> c) & 255) + ((t[3] >> c) & 255);
+                    level->texels[textureIndex(level, x, y)] |= ((sum + 2) / 4) << c;
+                }
+            }
+        }
+    }
+    return texture;
+}
+
+/* textureDelete: deletes a texture.
+ *
+ * texture - texture from textureCreate()
+ */
+void
+textureDelete(struct texture* texture)
+{
+    if (!texture)
+        return;
+    free(texture->texels);
+    free(texture);
+}
+
+/* textureLod: level of detail a pixel needs, log2 of how many texels
+ * of the largest level one pixel spans (0 or less magnifies it).
+ *
+ * texture    - texture from textureCreate()
+ * dudx, dvdx - change of the texture coordinates from one pixel to
+ *              the next across
+ * dudy, dvdy - and from one row to the next
+ */
+GLfloat
+textureLod(struct texture* texture, GLfloat dudx, GLfloat dvdx,
+           GLfloat dudy, GLfloat dvdy)
+{
+    GLfloat w = texture->levels[0].width, h = texture->levels[0].height;
+    GLfloat x = dudx * dudx * w * w + dvdx * dvdx * h * h;
+    GLfloat y = dudy * dudy * w * w + dvdy * dvdy * h * h;
+
+    /* log2 of the longer of the two steps, in texels */
+    return 0.5f * log2f(x > y ? x : y);
+}
+
+/* textureBilinear: filters 4 texels of a level, adds them to rgb
+ * weighted by weight */
+static void
+textureBilinear(struct textureLevel* level, GLfloat u, GLfloat v,
+                GLfloat weight, GLfloat* rgb)
+{
+    GLfloat fx = u * level->width - 0.5f, fy = v * level->height - 0.5f;
+    GLfloat ax, ay, w00, w10, w01, w11;
+    GLuint  t00, t10, t01, t11, ix[2], iy[2];
+    int     x = (int)fx, y = (int)fy, c;
+
+    /* floor, and repeat */
+    if (fx < x)
+        x--;
+    if (fy < y)
+        y--;
+    ax = fx - x;
+    ay = fy - y;
+    ix[0] = textureAxis(level, x & (level->width - 1), 0);
+    ix[1] = textureAxis(level, (x + 1) & (level->width - 1), 0);
+    iy[0] = textureAxis(level, y & (level->height - 1), 1);
+    iy[1] = textureAxis(level, (y + 1) & (level->height - 1), 1);
+    t00 = level->texels[ix[0] | iy[0]];
+    t10 = level->texels[ix[1] | iy[0]];
+    t01 = level->texels[ix[0] | iy[1]];
+    t11 = level->texels[ix[1] | iy[1]];
+
+    weight *= 1.0f / 255.0f;
+    w00 = (1.0f - ax) * (1.0f - ay) * weight;
+    w10 = ax * (1.0f - ay) * weight;
+    w01 = (1.0f - ax) * ay * weight;
+    w11 = ax * ay * weight;
+    for (c = 0; c < 3; c++) {
+        rgb[c] += ((t00 >> (8 * c)) & 255) * w00 + ((t10 >> (8 * c)) & 255) * w10 +
+                  ((t01 >> (8 * c)) & 255) * w01 + ((t11 >> (8 * c)) & 255) * w11;
+    }
+}
+
+/* textureSample: filters a texture at some texture coordinates.
+ *
+ * texture - texture from textureCreate()
+ * u, v    - texture coordinates, repeating outside [0, 1)
+ * lod     - level of detail from textureLod()
+ * filter  - TEXTURE_BILINEAR or TEXTURE_TRILINEAR
+ * rgb     - (return) red, green and blue in [0, 1]
+ */
+void
+textureSample(struct texture* texture, GLfloat u, GLfloat v, GLfloat lod,
+              int filter, GLfloat* rgb)
+{
+    GLuint  last = texture->numlevels - 1, l;
+    GLfloat f;
+
+    rgb[0] = rgb[1] = rgb[2] = 0.0f;
+    if (!(lod > 0.0f)) {
+        /* magnified, or no derivatives at all */
+        textureBilinear(&texture->levels[0], u, v, 1.0f, rgb);
+    } else if (lod >= last) {
+        textureBilinear(&texture->levels[last], u, v, 1.0f, rgb);
+    } else if (filter == TEXTURE_TRILINEAR) {
+        l = (GLuint)lod;
+        f = lod - l;
+        textureBilinear(&texture->levels[l], u, v, 1.0f - f, rgb);
+        if (f > 0.0f)
+            textureBilinear(&texture->levels[l + 1], u, v, f, rgb);
+    } else {
+        textureBilinear(&texture->levels[(GLuint)(lod + 0.5f)], u, v, 1.0f, rgb);
+    }
+}
+
+/* textureReadBytes: big endian value of some bytes */
+static GLuint
+textureReadBytes(GLubyte* p, int n)
+{
+    GLuint v = 0;
+
+    while (n--)
+        v = (v << 8) | *p++;
+    return v;
+}
+
+/* textureReadSGI: reads an SGI image file, see textureReadImage() */
+static GLubyte*
+textureReadSGI(FILE* file, char* filename, int* width, int* height)
+{
+    GLubyte  header[512];
+    GLubyte* image = NULL;
+    GLubyte* data = NULL;
+    GLubyte* row = NULL;
+    GLubyte  c;
+    long     size;
+    GLuint   storage, bpc, xsize, ysize, zsize, x, y, z, n, offset, end;
+    GLuint   channel;
+
+    if (fread(header, 1, 512, file) != 512 || textureReadBytes(header, 2) != 474) {
+        fprintf(stderr, "textureReadImage(): %s is not an SGI image.\n", filename);
+        return NULL;
+    }
+    storage = header[2];
+    bpc = header[3];
+    xsize = textureReadBytes(header + 6, 2);
+    ysize = textureReadBytes(header + 8, 2);
+    zsize = textureReadBytes(header + 10, 2);
+    if (textureReadBytes(header + 4, 2) < 3)
+        zsize = 1;
+    if (bpc != 1 || zsize < 1 || zsize > 4 || !xsize || !ysize) {
+        fprintf(stderr, "textureReadImage(): %s is an SGI image of a kind "
+                "it can't read.\n", filename);
+        return NULL;
+    }
+
+    /* the rest of the file, the tables and the channels */
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    data = (GLubyte*)malloc(size);
+    end = (GLuint)size;
+    fseek(file, 0, SEEK_SET);
+    if (fread(data, 1, size, file) != (size_t)size)
+        goto bad;
+
+    image = (GLubyte*)malloc(4 * xsize * ysize);
+    row = (GLubyte*)malloc(xsize);
+    for (z = 0; z < zsize; z++) {
+        /* gray and alpha images keep alpha second */
+        channel = zsize == 2 && z == 1 ? 3 : z;
+        for (y = 0; y < ysize; y++) {
+            if (storage == 0) {
+                offset = 512 + (z * ysize + y) * xsize;
+                if (offset + xsize > end)
+                    goto bad;
+                memcpy(row, data + offset, xsize);
+            } else {
+                /* runs: a count with the top bit set copies that many
+                   bytes, without it repeats the next byte */
+                n = z * ysize + y;
+                if (512 + 4 * (zsize * ysize + n) + 4 > end)
+                    goto bad;
+                offset = textureReadBytes(data + 512 + 4 * n, 4);
+                x = 0;
+                while (offset < end) {
+                    c = data[offset++];
+                    n = c & 0x7f;
+                    if (!n)
+                        break;
+                    if (x + n > xsize || offset + (c & 0x80 ? n : 1) > end)
+                        goto bad;
+                    if (c & 0x80) {
+                        memcpy(row + x, data + offset, n);
+                        offset += n;
+                    } else {
+                        memset(row + x, data[offset++], n);
+                    }
+                    x += n;
+                }
+            }
+            for (x = 0; x < xsize; x++)
+                image[4 * (y * xsize + x) + channel] = row[x];
+        }
+    }
+
+    /* gray into green and blue, and opaque without alpha */
+    for (x = 0; x < xsize * ysize; x++) {
+        if (zsize < 3)
+            image[4 * x + 1] = image[4 * x + 2] = image[4 * x];
+        if (zsize != 2 && zsize != 4)
+            image[4 * x + 3] = 255;
+    }
+    free(row);
+    free(data);
+    *width = xsize;
+    *height = ysize;
+    return image;
+
+bad:
+    fprintf(stderr, "textureReadImage(): %s is cut short.\n", filename);
+    free(row);
+    free(image);
+    free(data);
+    return NULL;
+}
+
+/* textureReadImage: reads an SGI image (.rgb, .rgba, .bw, plain or run
+ * length encoded) or a raw PPM file (with glmReadPPM()) into RGBA
+ * bytes, 4 a pixel, the bottom row first as glTexImage2D() takes them.
+ * Returns NULL if it can't.
+ *
+ * filename - name of the file
+ * width    - (return) pixels across
+ * height   - (return) pixels down
+ */
+GLubyte*
+textureReadImage(char* filename, int* width, int* height)
+{
+    FILE*    file;
+    GLubyte* rgb;
+    GLubyte* image;
+    GLubyte  magic[2];
+    int      i, y, w, h;
+
+    file = fopen(filename, "rb");
+    if (!file) {
+        perror(filename);
+        return NULL;
+    }
+    if (fread(magic, 1, 2, file) != 2) {
+        fclose(file);
+        return NULL;
+    }
+    if (magic[0] != 'P') {
+        rewind(file);
+        image = textureReadSGI(file, filename, width, height);
+        fclose(file);
+        return image;
+    }
+    fclose(file);
+
+    /* PPM files start at the top row */
+    rgb = glmReadPPM(filename, &w, &h);
+    if (!rgb)
+        return NULL;
+    image = (GLubyte*)malloc(4 * w * h);
+    for (y = 0; y < h; y++) {
+        for (i = 0; i < w; i++) {
+            memcpy(&image[4 * ((h - 1 - y) * w + i)], &rgb[3 * (y * w + i)], 3);
+            image[4 * ((h - 1 - y) * w + i) + 3] = 255;
+        }
+    }
+    free(rgb);
+    *width = w;
+    *height = h;
+    return image;
+}
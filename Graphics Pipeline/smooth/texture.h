@@ -0,0 +1,126 @@
+/*
+ *  texture.h
+ *
+ *  Mipmapped textures for the software pipeline.
+ *
+ *  The texels of every level are kept in Morton (Z curve) order: the
+ *  bits of a texel's x and y are interleaved into its index, so every
+ *  aligned 2x2, 4x4 or 8x8 square of texels is contiguous and a 4x4
+ *  square of packed texels is one 64 byte cache line.  A step in v is
+ *  then as close as a step in u, and the four texels a bilinear filter
+ *  reads, and the ones the next pixel reads, mostly share a line
+ *  whichever way a triangle crosses the texture; in rows, every step in
+ *  v would be a whole row of texels away.
+ *
+ *  Like gluBuild2DMipmaps(), the image is scaled to the nearest power
+ *  of two on each side, and every level halves the one before,
+ *  averaging 2x2 texels, down to 1x1.  Texture coordinates repeat like
+ *  GL_REPEAT, and texel (0, 0) is the first of the image.
+ *
+ *  Usage:
+ *
+ *  o  read an image with textureReadImage(), or get RGBA bytes from
+ *     elsewhere, and build the levels with textureCreate()
+ *  o  for every pixel, find the level of detail with textureLod() from
+ *     how fast the texture coordinates change across the screen, and
+ *     filter the texture there with textureSample()
+ *  o  call textureDelete() when done
+ */
+
+
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include "glm.h"
+
+
+#define TEXTURE_MAX_LEVELS 16       /* up to 32768 texels a side */
+
+/* filters */
+#define TEXTURE_BILINEAR  0         /* in the nearest level, like
+                                       GL_LINEAR_MIPMAP_NEAREST */
+#define TEXTURE_TRILINEAR 1         /* between the two nearest levels,
+                                       like GL_LINEAR_MIPMAP_LINEAR */
+
+
+/* textureLevel: one level of a texture */
+struct textureLevel
+{
+    GLuint  width, height;          /* powers of two */
+    GLuint  shift;                  /* log2 of the smaller of them */
+    GLuint* texels;                 /* packed RGBA, R in the low byte,
+                                       in Morton order */
+};
+
+/* texture: a texture and its mipmaps, largest first */
+struct texture
+{
+    GLuint              numlevels;
+    struct textureLevel levels[TEXTURE_MAX_LEVELS];
+    GLuint*             texels;     /* every level's texels */
+};
+
+
+/* functions */
+
+/* textureReadImage: reads an SGI image (.rgb, .rgba, .bw, plain or run
+ * length encoded) or a raw PPM file (with glmReadPPM()) into RGBA
+ * bytes, 4 a pixel, the bottom row first as glTexImage2D() takes them.
+ * Returns NULL if it can't.
+ *
+ * filename - name of the file
+ * width    - (return) pixels across
+ * height   - (return) pixels down
+ */
+GLubyte*
+textureReadImage(char* filename, int* width, int* height);
+
+/* textureCreate: builds a texture and its mipmaps from an image.
+ *
+ * image  - RGBA bytes, 4 a pixel, the first row at texture v = 0
+ * width  - pixels across
+ * height - pixels down
+ */
+struct texture*
+textureCreate(GLubyte* image, int width, int height);
+
+/* textureDelete: deletes a texture.
+ *
+ * texture - texture from textureCreate()
+ */
+void
+textureDelete(struct texture* texture);
+
+/* textureIndex: index of a texel in its level's texels.
+ *
+ * level - level of a texture
+ * x, y  - texel, 0 .. width - 1 and 0 .. height - 1
+ */
+GLuint
+textureIndex(struct textureLevel* level, GLuint x, GLuint y);
+
+/* textureLod: level of detail a pixel needs, log2 of how many texels
+ * of the largest level one pixel spans (0 or less magnifies it).
+ *
+ * texture    - texture from textureCreate()
+ * dudx, dvdx - change of the texture coordinates from one pixel to
+ *              the next across
+ * dudy, dvdy - and from one row to the next
+ */
+GLfloat
+textureLod(struct texture* texture, GLfloat dudx, GLfloat dvdx,
+           GLfloat dudy, GLfloat dvdy);
+
+/* textureSample: filters a texture at some texture coordinates.
+ *
+ * texture - texture from textureCreate()
+ * u, v    - texture coordinates, repeating outside [0, 1)
+ * lod     - level of detail from textureLod()
+ * filter  - TEXTURE_BILINEAR or TEXTURE_TRILINEAR
+ * rgb     - (return) red, green and blue in [0, 1]
+ */
+void
+textureSample(struct texture* texture, GLfloat u, GLfloat v, GLfloat lod,
+              int filter, GLfloat* rgb);
+
+#endif /* TEXTURE_H */